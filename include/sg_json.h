@@ -73,6 +73,12 @@ typedef struct sgj_state_t {
                                  * element contains a line of plain text. The
                                  * array's JSON name is 'plain_text_output' */
     sgj_opaque_p userp;         /* for temporary usage */
+    sgj_opaque_p streamp;       /* streamed output state, see
+                                 * sgj_stream_start() */
+    sgj_opaque_p arenap;        /* bump allocator holding the in-core JSON
+                                 * tree, released by sgj_finish() */
+    bool heap_in_arena;         /* heap values attached to the arena tree,
+                                 * so sgj_finish() must walk it */
 } sgj_state;
 
 /* This function tries to convert the in_name C string to the "snake_case"
@@ -185,6 +191,18 @@ sgj_opaque_p sgj_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop,
 sgj_opaque_p sgj_snake_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop,
                                         const char * conv2sname);
 
+/* Similar to sgj_named_subarray_r() but if streamed output has been
+ * enabled by sgj_stream_start() then this array becomes the streamed array.
+ * When an element is added to the streamed array, the elements before it
+ * are written out and freed. So the in-core tree stays small no matter how
+ * many elements are added. Once the first element has been written, the
+ * objects and arrays that come before this array in the tree (i.e. those
+ * added to the tree earlier) must not be changed. Only one array is
+ * streamed at a time; a later call to this function moves streaming to
+ * the new array. */
+sgj_opaque_p sgj_named_subarray_stream_r(sgj_state * jsp, sgj_opaque_p jop,
+                                         const char * sn_name);
+
 /* If either jsp or value is NULL or jsp->pr_as_json is false then nothing
  * happens and NULL is returned. The insertion point is at jop but if it is
  * NULL jsp->basep is used. If 'sn_name' is non-NULL a new named JSON object
@@ -225,6 +243,12 @@ sgj_opaque_p sgj_js_nv_i(sgj_state * jsp, sgj_opaque_p jop,
 sgj_opaque_p sgj_js_nv_b(sgj_state * jsp, sgj_opaque_p jop,
                          const char * sn_name, bool value);
 
+/* Similar to sgj_js_nv_i() but the value is a JSON number formed from the
+ * double 'value'. It is output with 6 significant digits (i.e. printf's
+ * "%g") so is suited to rates and ratios, not to large counts or times. */
+sgj_opaque_p sgj_js_nv_d(sgj_state * jsp, sgj_opaque_p jop,
+                         const char * sn_name, double value);
+
 /* If jsp is NULL, jsp->pr_as_json is false or ua_jop is NULL nothing then
  * happens and NULL is returned. 'jop' is the insertion point but if it is
  * NULL jsp->basep is used instead. If 'sn_name' is non-NULL a new named JSON
@@ -357,24 +381,45 @@ void sgj_haj_vb(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 void sgj_hr_str_out(sgj_state * jsp, const char * sp, int slen);
 
 /* Nothing in the in-core JSON tree is actually printed to 'fp' (typically
- * stdout) until this call is made. If jsp is NULL, jsp->pr_as_json is false
+ * stdout) until this call is made, unless streamed output has been enabled
+ * (see sgj_stream_start() below). If jsp is NULL, jsp->pr_as_json is false
  * or jsp->basep is NULL then this function does nothing. If jsp->exit_status
  * is true then a new JSON object named "exit_status" and the 'exit_status'
  * value rendered as a JSON integer is appended to jsp->basep. The in-core
- * JSON tree with jsp->basep as its root is streamed to 'fp'. */
+ * JSON tree with jsp->basep as its root is streamed to 'fp'. If streamed
+ * output has started then only the part of the tree not yet written is
+ * output, to the stream given to sgj_stream_start(). */
 void sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
                       const char * estr, FILE * fp);
 
+/* Enables streamed output of the in-core JSON tree to 'fp' which should be
+ * the same stream later given to sgj_js2file_estr(). Should be called after
+ * sgj_start_r(). Nothing is written until an element is added to an array
+ * made by sgj_named_subarray_stream_r(); from then on the part of the tree
+ * that precedes that array is written out as it is completed and
+ * sgj_js2file_estr() writes the remainder. The output is the same as without
+ * streaming. Returns false, and streaming stays disabled, if jsp is NULL,
+ * jsp->pr_as_json is false or jsp->pr_out_hr is true (since the
+ * 'plain_text_output' array, near the start of the tree, is added to until
+ * the end). */
+bool sgj_stream_start(sgj_state * jsp, FILE * fp);
+
 /* This function is only needed if the pointer returned from either
  * sgj_new_unattached_object_r() or sgj_new_unattached_array_r() has not
  * been attached into the in-core JSON tree whose root is jsp->basep . */
 void sgj_free_unattached(sgj_opaque_p jop);
 
 /* If jsp is NULL or jsp->basep is NULL then this function does nothing.
- * This function does bottom up, heap freeing of all the in-core JSON
- * objects and arrays attached to the root JSON object assumed to be
- * found at jsp->basep . After this call jsp->basep, jsp->out_hrp and
- * jsp->userp will all be set to NULL.  */
+ * This function frees all the in-core JSON objects and arrays attached
+ * to the root JSON object assumed to be found at jsp->basep . Those
+ * allocated from the arena created by sgj_start_r() are released in one
+ * shot. The tree is only walked (to free heap values) when there is no
+ * arena or heap values were attached to it; for example those made after
+ * streaming started or an object from sgj_js_nv_o() that was made without
+ * an arena. After this call jsp->basep, jsp->out_hrp and jsp->userp will
+ * all be set to NULL. If streamed output has started but
+ * sgj_js2file_estr() has not been called, the remainder of the tree is
+ * written out first so the output is well formed. */
 void sgj_finish(sgj_state * jsp);
 
 /* Forms a string of the JSON command line options help and assumes,
@@ -284,6 +284,72 @@ bool sg_get_sense_filemark_eom_ili(const uint8_t * sensep, int sb_len,
 bool sg_get_sense_progress_fld(const uint8_t * sensep, int sb_len,
                                int * progress_outp);
 
+#define SG_SENSE_MAX_DESCS 16   /* descriptor offsets held in sg_sense_fields */
+
+/* All the fields that the sg_get_sense_*() functions above yield, found in
+ * one pass over a sense buffer by sg_get_sense_fields(). The '_present'
+ * flags (and info_valid, sks_valid and progress_present) match the return
+ * values of the corresponding sg_get_sense_*() function. Fields not present
+ * are zero. For descriptor format, desc_off[] holds the offset in the sense
+ * buffer of each of the first num_descs descriptors. */
+struct sg_sense_fields {
+    uint8_t response_code;  /* 0x70 to 0x73, 0 when not decodable */
+    uint8_t sense_key;
+    uint8_t asc;
+    uint8_t ascq;
+    bool descriptor_fmt;    /* response code 0x72 or 0x73 */
+    bool deferred;          /* response code 0x71 or 0x73 */
+    bool sdat_ovfl;         /* descriptor format only */
+    bool info_valid;        /* as sg_get_sense_info_fld() */
+    bool cmd_spec_present;  /* as sg_get_sense_cmd_spec_fld() */
+    bool fm_eom_ili_present;    /* as sg_get_sense_filemark_eom_ili() */
+    bool filemark;
+    bool eom;
+    bool ili;
+    bool sks_valid;         /* SKSV bit set in fixed format or in a sense
+                             * key specific descriptor */
+    bool progress_present;  /* as sg_get_sense_progress_fld() */
+    uint8_t num_descs;      /* number of valid desc_off[] entries */
+    uint8_t sks[3];         /* sense key specific bytes (SKSV bit first) */
+    uint16_t progress;
+    uint16_t desc_off[SG_SENSE_MAX_DESCS];
+    uint64_t info;
+    uint64_t cmd_spec;
+};
+
+/* Decodes the sense buffer at 'sbp' of length 'sb_len' into 'sfp' walking
+ * any descriptors once. The bounds checks are the same as those of the
+ * sg_get_sense_*() functions so short fixed format buffers (e.g. 7 to 11
+ * bytes) and truncated descriptors give the same fields. Bytes at or beyond
+ * 'sb_len', which some of those functions read, are not read but are taken
+ * to be zero. Returns true if the response code is one of 0x70 to 0x73,
+ * else returns false with 'sfp' zeroed. */
+bool sg_get_sense_fields(const uint8_t * sbp, int sb_len,
+                         struct sg_sense_fields * sfp);
+
+/* Calls sg_get_sense_fields() on each of the 'num' sense buffers whose
+ * addresses are in sbp_arr[] and lengths are in sb_len_arr[], placing the
+ * results in sf_arr[]. A NULL entry in sbp_arr[] yields a zeroed element.
+ * Returns the number of sense buffers that were decoded. */
+int sg_get_sense_fields_arr(const uint8_t * const * sbp_arr,
+                            const int * sb_len_arr, int num,
+                            struct sg_sense_fields * sf_arr);
+
+#define SG_ATA_RETURN_DESC_LEN 14
+
+/* Places the ATA registers returned by a SAT layer for an ATA PASS-THROUGH
+ * command in 'ardp' laid out as an ATA Status Return sense descriptor
+ * (type 0x9) of SG_ATA_RETURN_DESC_LEN bytes. With descriptor format sense
+ * that descriptor is copied. With fixed format sense (response code 0x70
+ * or 0x71, SAT-2 and later) the ERROR, STATUS, DEVICE, COUNT (7:0) and
+ * LBA (23:0) fields are taken from bytes 3 to 6 and 9 to 11; the other
+ * fields are zero. The caller should check that the additional sense code
+ * is ATA PASS THROUGH INFORMATION AVAILABLE (or the command failed) first.
+ * Returns true if the registers were found, else returns false with
+ * 'ardp' zeroed. */
+bool sg_get_sense_ata_return_desc(const uint8_t * sbp, int sb_len,
+                                  uint8_t * ardp);
+
 /* Closely related to sg_print_sense(). Puts decoded sense data in 'buff'.
  * Usually multiline with multiple '\n' including one trailing. If
  * 'raw_sinfo' set appends sense buffer in hex. 'leadin' is string prepended
@@ -0,0 +1,103 @@
+#ifndef SG_MONITOR_H
+#define SG_MONITOR_H
+
+/*
+ * Copyright (c) 2023 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Monitor for long running operations such as FORMAT UNIT, FORMAT MEDIUM,
+ * SANITIZE and a foreground SEND DIAGNOSTIC self-test. Once such a command
+ * has been started with its IMMED bit set, the device reports progress in
+ * the sense data returned by TEST UNIT READY or REQUEST SENSE. The monitor
+ * polls any number of devices from the caller's thread. Each device has its
+ * own poll interval which adapts to the rate at which its progress
+ * indication changes: it backs off while the operation is slow and polls
+ * more often as completion nears. From that rate an estimated time to
+ * completion is derived. The caller is told about each state change via a
+ * callback and optionally each event is added to a JSON array.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sg_json.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Poll types, TEST UNIT READY switches to REQUEST SENSE if the device
+ * becomes not ready without a progress indication. */
+#define SG_MON_POLL_TUR 0
+#define SG_MON_POLL_RS 1        /* SSC and SBC-4 prefer REQUEST SENSE */
+
+/* Event types passed to the sg_mon_event_f callback */
+#define SG_MON_EV_START 0       /* first poll of device */
+#define SG_MON_EV_PROGRESS 1    /* progress indication changed */
+#define SG_MON_EV_DONE 2        /* no progress indication, so finished */
+#define SG_MON_EV_ERROR 3       /* poll failed or operation failed */
+#define SG_MON_EV_TIMEOUT 4     /* overall timeout reached before done */
+
+struct sg_mon_event {
+    int type;           /* one of SG_MON_EV_* */
+    int idx;            /* as returned by sg_mon_add() */
+    int progress;       /* -1 if not available, else 0 to 65535 */
+    int res;            /* 0 or SG_LIB_CAT_* (or other SG_LIB_*) value */
+    int num_polls;
+    uint32_t elapsed_ms;        /* since sg_mon_add() */
+    uint32_t eta_ms;    /* estimated time to completion, 0 if unknown */
+    uint32_t next_poll_ms;      /* current poll interval */
+    const char * dev_name;
+    const char * op_name;       /* e.g. "Format unit" */
+};
+
+/* Called from sg_mon_run() for each event. 'ctxp' is the pointer given to
+ * sg_mon_run(). */
+typedef void (*sg_mon_event_f)(void * ctxp, const struct sg_mon_event * evp);
+
+struct sg_monitor;      /* opaque */
+
+/* Creates a monitor. Poll intervals are kept between 'min_ms' and 'max_ms'
+ * milliseconds; if either is zero or less then 1000 and 60000 are used.
+ * If jsp is non-NULL and JSON output is active then each event is added
+ * to a JSON array named "monitor_event_list" (created under jop or the
+ * JSON root if jop is NULL). That array is streamed (see
+ * sgj_named_subarray_stream_r()) if the caller has called
+ * sgj_stream_start(). Returns NULL if out of memory. */
+struct sg_monitor * sg_mon_create(int min_ms, int max_ms, sgj_state * jsp,
+                                  sgj_opaque_p jop, int verbose);
+
+/* Adds a device, open on 'sg_fd', to be monitored. 'dev_name' and
+ * 'op_name' are only used in events and are not copied. 'poll_type' is
+ * SG_MON_POLL_TUR or SG_MON_POLL_RS; 'desc' asks for descriptor format
+ * sense data when REQUEST SENSE is used. The first poll is 'first_ms'
+ * milliseconds after this call (if zero or less the monitor's minimum
+ * interval is used). Returns an index (0 or more) on success else -1. */
+int sg_mon_add(struct sg_monitor * mp, int sg_fd, const char * dev_name,
+               const char * op_name, int poll_type, bool desc, int first_ms);
+
+/* Polls each added device until all have finished (or failed) or until
+ * 'timeout_secs' seconds have elapsed (no limit if zero or less). May be
+ * called again after further sg_mon_add() calls. Returns 0 if all devices
+ * finished without error, else the result of the first device (in order
+ * added) that failed or timed out. */
+int sg_mon_run(struct sg_monitor * mp, int timeout_secs,
+               sg_mon_event_f event_fn, void * ctxp);
+
+/* Writes a one line description of the event to 'b' (up to blen bytes,
+ * including trailing null). Returns 'b'. */
+char * sg_mon_event_str(const struct sg_mon_event * evp, int blen, char * b);
+
+void sg_mon_destroy(struct sg_monitor * mp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_MONITOR_H */
@@ -126,6 +126,7 @@ struct sg_pt_linux_scsi {
     bool nvme_stat_dnr; /* Do No Retry, part of completion status field */
     bool nvme_stat_more; /* More, part of completion status field */
     bool mdxfer_out;    /* direction of metadata xfer, true->data-out */
+    bool nvme_no_uring; /* device refused NVMe commands via io_uring */
     int dev_fd;                 /* -1 if not given (yet) */
     int in_err;
     int os_err;
@@ -144,6 +145,7 @@ struct sg_pt_linux_scsi {
     void * mdxferp;
     uint8_t * nvme_id_ctlp;     /* cached response to controller IDENTIFY */
     uint8_t * free_nvme_id_ctlp;
+    void * nvme_uringp;         /* io_uring for NVMe commands, if in use */
     uint8_t tmf_request[4];
 };
 
@@ -192,6 +194,10 @@ void sg_find_bsg_nvme_char_major(int verbose);
 int sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb);
 int sg_linux_get_sg_version(const struct sg_pt_base * vp);
 
+/* Returns the io_uring (if any) used for NVMe commands by ptp to a pool
+ * for reuse by other pt objects. Called when ptp is destroyed. */
+void sg_nvme_uring_release(struct sg_pt_linux_scsi * ptp);
+
 /* This trims given NVMe block device name in Linux (e.g. /dev/nvme0n1p5)
  * to the name of its associated char device (e.g. /dev/nvme0). If this
  * occurs true is returned and the char device name is placed in 'b' (as
@@ -0,0 +1,74 @@
+#ifndef SG_VPD_CACHE_H
+#define SG_VPD_CACHE_H
+
+/*
+ * Copyright (c) 2023 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Opt-in cache of standard INQUIRY and selected VPD page responses. It is
+ * active when the SG3_UTILS_VPD_CACHE environment variable is set; its
+ * value is the cache directory (if empty or "1" then /run/sg3_utils/vpd is
+ * used). Entries are keyed by the device's logical unit identity (in Linux
+ * the 'wwid' sysfs attribute of the device) so they survive device node
+ * renaming and are never served for a different logical unit. An entry
+ * expires after SG3_UTILS_VPD_CACHE_TTL seconds (default: 600, 0 for no
+ * expiry). All entries for a device are removed when it reports a unit
+ * attention of "INQUIRY DATA HAS CHANGED" or "MICROCODE HAS BEEN CHANGED".
+ *
+ * The INQUIRY helpers in sg_cmds_basic.c consult this cache so utilities
+ * need no changes. If the device identity can't be found (e.g. not Linux)
+ * the cache is bypassed.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_VPD_CACHE_DEF_DIR "/run/sg3_utils/vpd"
+#define SG_VPD_CACHE_DEF_TTL 600        /* seconds */
+
+/* Returns true if the SG3_UTILS_VPD_CACHE environment variable is set */
+bool sg_vpd_cache_active(void);
+
+/* Returns true if the response of INQUIRY with 'evpd' and 'pg' is one that
+ * is cached: the standard INQUIRY response and the Supported VPD pages,
+ * Unit serial number, Device identification, Extended INQUIRY data, Block
+ * limits and Block device characteristics VPD pages. */
+bool sg_vpd_cache_pg_cacheable(bool evpd, int pg);
+
+/* Looks up the INQUIRY response for the device open on 'sg_fd'. On a hit
+ * up to 'mx_resp_len' bytes are copied to 'resp', the residual count is
+ * written to *residp (if non-NULL) and 0 is returned. Returns -1 on a miss
+ * (including when the cache is not active). */
+int sg_vpd_cache_get(int sg_fd, bool evpd, int pg, uint8_t * resp,
+                     int mx_resp_len, int * residp, int verbose);
+
+/* Stores 'len' bytes of the INQUIRY response in 'resp' for the device open
+ * on 'sg_fd'. Does nothing if the cache is not active, the page is not
+ * cacheable, the device identity can't be found, the response is shorter
+ * than the length it declares, or a longer response is already cached. */
+void sg_vpd_cache_put(int sg_fd, bool evpd, int pg, const uint8_t * resp,
+                      int len, int verbose);
+
+/* Removes all cache entries of the device open on 'sg_fd' */
+void sg_vpd_cache_invalidate(int sg_fd, int verbose);
+
+/* Returns true if the sense data indicates cached INQUIRY data of the
+ * device is no longer valid (i.e. a unit attention with an additional
+ * sense code of 0x3f and qualifier of 0x1 or 0x3). */
+bool sg_vpd_cache_sense_invalidates(const uint8_t * sbp, int sb_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_VPD_CACHE_H */
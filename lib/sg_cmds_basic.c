@@ -35,6 +35,7 @@
 #include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_vpd_cache.h"
 
 /* Needs to be after config.h */
 #ifdef SG_LIB_LINUX
@@ -42,7 +43,7 @@
 #endif
 
 
-static const char * const version_str = "2.02 20230311";
+static const char * const version_str = "2.03 20231027";
 
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
@@ -323,6 +324,8 @@ sg_cmds_process_resp(struct sg_pt_base * ptvp, const char * leadin,
         }
         return -1;
     case SCSI_PT_RESULT_SENSE:
+        if (sg_vpd_cache_active() && sg_vpd_cache_sense_invalidates(sbp, slen))
+            sg_vpd_cache_invalidate(get_pt_file_handle(ptvp), verbose);
         return sg_cmds_process_helper(leadin, req_din_x, act_din_x,
                                       req_dout_x, act_dout_x, sbp, slen,
                                       noisy, verbose, o_sense_cat);
@@ -388,7 +391,9 @@ sg_ll_inquiry_com(struct sg_pt_base * ptvp, int sg_fd, bool cmddt, bool evpd,
     bool ptvp_given = false;
     bool local_sense = true;
     bool local_cdb = true;
+    bool use_cache = false;
     int res, ret, sense_cat, resid;
+    int fd = -1;
     uint8_t inq_cdb[INQUIRY_CMDLEN] = {INQUIRY_CMD, 0, 0, 0, 0, 0};
     uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
     uint8_t * up;
@@ -403,6 +408,15 @@ sg_ll_inquiry_com(struct sg_pt_base * ptvp, int sg_fd, bool cmddt, bool evpd,
     if (evpd)
         inq_cdb[1] |= 0x1;
     inq_cdb[2] = (uint8_t)pg_op;
+    /* opt-in response cache; not when caller supplied their own cdb */
+    if ((! cmddt) && sg_vpd_cache_active() &&
+        ((NULL == ptvp) || (NULL == get_scsi_pt_cdb_buf(ptvp)))) {
+        fd = ptvp ? get_pt_file_handle(ptvp) : sg_fd;
+        if (0 == sg_vpd_cache_get(fd, evpd, pg_op, (uint8_t *)resp,
+                                  mx_resp_len, residp, verbose))
+            return 0;
+        use_cache = true;
+    }
     /* 16 bit allocation length (was 8, increased in spc3r09, 200209) */
     sg_put_unaligned_be16((uint16_t)mx_resp_len, inq_cdb + 3);
     if (verbose) {
@@ -478,6 +492,9 @@ sg_ll_inquiry_com(struct sg_pt_base * ptvp, int sg_fd, bool cmddt, bool evpd,
         /* zero unfilled section of response buffer, based on resid */
         memset((uint8_t *)resp + (mx_resp_len - resid), 0, resid);
     }
+    if (use_cache && (0 == ret))
+        sg_vpd_cache_put(fd, evpd, pg_op, (const uint8_t *)resp,
+                         mx_resp_len - ((resid > 0) ? resid : 0), verbose);
 fini:
     if (ptvp_given) {
         if (local_sense)    /* stop caller trying to access local sense */
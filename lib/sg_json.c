@@ -42,6 +42,26 @@ static const json_serialize_opts def_out_settings = {
     4                                   /* indent size */
 };
 
+/* Streamed output state. lvl[] holds the objects and arrays on the path
+ * from jsp->basep to the one currently being written: for each, its
+ * opening bracket and its entries before 'next' have been written. */
+#define SGJ_STREAM_MAX_DEPTH 32
+
+struct sgj_stream_lvl_t {
+    json_value * jvp;
+    unsigned int next;          /* index of next entry to write */
+    bool any;                   /* true once an entry has been written */
+};
+
+struct sgj_stream_t {
+    FILE * fp;
+    json_value * sap;           /* streamed array, NULL if none */
+    bool done;                  /* closing brackets written */
+    int depth;                  /* number of valid elements in lvl[] */
+    json_serialize_opts out_settings;
+    struct sgj_stream_lvl_t lvl[SGJ_STREAM_MAX_DEPTH];
+};
+
 static int sgj_name_to_snake(const char * in, char * out, int maxlen_out);
 
 
@@ -232,6 +252,9 @@ sgj_init_state(sgj_state * jsp, const char * j_optarg)
     jsp->basep = NULL;
     jsp->out_hrp = NULL;
     jsp->userp = NULL;
+    jsp->streamp = NULL;
+    jsp->arenap = NULL;
+    jsp->heap_in_arena = false;
 
     cp = getenv(sgj_opts_ev);
     if (cp) {
@@ -244,6 +267,16 @@ sgj_init_state(sgj_state * jsp, const char * j_optarg)
     return j_optarg ? sgj_parse_opts(jsp, j_optarg) : true;
 }
 
+/* Arena that new JSON values are allocated from, NULL for the heap. Once
+ * streamed output has started values are released as they are written so
+ * they come from the heap. */
+static json_arena *
+sgj_arena(const sgj_state * jsp)
+{
+    return (jsp && (NULL == jsp->streamp)) ? (json_arena *)jsp->arenap :
+                                             NULL;
+}
+
 sgj_opaque_p
 sgj_start_r(const char * util_name, const char * ver_str, int argc,
             char *argv[], sgj_state * jsp)
@@ -256,39 +289,44 @@ sgj_start_r(const char * util_name, const char * ver_str, int argc,
 
     if (NULL == jsp)
         return NULL;
-    jvp = json_object_new(0);
+    if (NULL == jsp->arenap)
+        jsp->arenap = json_arena_new(0);   /* if NULL, use the heap */
+    jvp = json_object_new_a(sgj_arena(jsp), 0);
     if (NULL == jvp)
         return NULL;
 
     jsp->basep = jvp;
     if (jsp->pr_leadin) {
-        jap = json_array_new(0);
+        jap = json_array_new_a(sgj_arena(jsp), 0);
         if  (NULL == jap) {
             json_builder_free((json_value *)jvp);
             return NULL;
         }
         /* assume rest of json_*_new() calls succeed */
-        json_array_push((json_value *)jap, json_integer_new(1));
-        json_array_push((json_value *)jap, json_integer_new(0));
+        json_array_push((json_value *)jap,
+                        json_integer_new_a(sgj_arena(jsp), 1));
+        json_array_push((json_value *)jap,
+                        json_integer_new_a(sgj_arena(jsp), 0));
         json_object_push((json_value *)jvp, "json_format_version",
                          (json_value *)jap);
         if (util_name) {
-            jap = json_array_new(0);
+            jap = json_array_new_a(sgj_arena(jsp), 0);
             if (argv) {
                 for (k = 0; k < argc; ++k)
                     json_array_push((json_value *)jap,
-                                    json_string_new(argv[k]));
+                                    json_string_new_a(sgj_arena(jsp),
+                                                      argv[k]));
             }
             jv2p = json_object_push((json_value *)jvp, "utility_invoked",
-                                    json_object_new(0));
+                                    json_object_new_a(sgj_arena(jsp), 0));
             json_object_push((json_value *)jv2p, "name",
-                             json_string_new(util_name));
+                             json_string_new_a(sgj_arena(jsp), util_name));
             if (ver_str)
                 json_object_push((json_value *)jv2p, "version_date",
-                                 json_string_new(ver_str));
+                                 json_string_new_a(sgj_arena(jsp), ver_str));
             else
                 json_object_push((json_value *)jv2p, "version_date",
-                                 json_string_new("0.0"));
+                                 json_string_new_a(sgj_arena(jsp), "0.0"));
             json_object_push((json_value *)jv2p, "argv", jap);
         }
         if (jsp->verbose) {
@@ -296,22 +334,23 @@ sgj_start_r(const char * util_name, const char * ver_str, int argc,
             char b[32];
 
             json_object_push((json_value *)jv2p, "environment_variable_name",
-                             json_string_new(sgj_opts_ev));
+                             json_string_new_a(sgj_arena(jsp), sgj_opts_ev));
             json_object_push((json_value *)jv2p, "environment_variable_value",
-                             json_string_new(cp ? cp : "no available"));
+                             json_string_new_a(sgj_arena(jsp),
+                                               cp ? cp : "no available"));
             sg_json_settings(jsp, b, sizeof(b));
             json_object_push((json_value *)jv2p, "json_options",
-                             json_string_new(b));
+                             json_string_new_a(sgj_arena(jsp), b));
         }
     } else {
         if (jsp->pr_out_hr && util_name)
             jv2p = json_object_push((json_value *)jvp, "utility_invoked",
-                                    json_object_new(0));
+                                    json_object_new_a(sgj_arena(jsp), 0));
     }
     if (jsp->pr_out_hr && jv2p) {
         jsp->out_hrp = json_object_push((json_value *)jv2p,
                                          "plain_text_output",
-                                        json_array_new(0));
+                                        json_array_new_a(sgj_arena(jsp), 0));
         if (jsp->pr_leadin && (jsp->verbose > 3)) {
             char * bp = (char *)calloc(4096, 1);
 
@@ -325,6 +364,285 @@ sgj_start_r(const char * util_name, const char * ver_str, int argc,
     return jvp;
 }
 
+static void
+sgj_get_out_settings(const sgj_state * jsp, json_serialize_opts * osp)
+{
+    memcpy(osp, &def_out_settings, sizeof(*osp));
+    if (jsp->pr_indent_size != def_out_settings.indent_size)
+        osp->indent_size = jsp->pr_indent_size;
+    if (! jsp->pr_pretty)
+        osp->mode = jsp->pr_packed ? json_serialize_mode_packed :
+                                     json_serialize_mode_single_line;
+}
+
+static unsigned int
+sgjs_num_entries(const json_value * cp)
+{
+    return (json_object == cp->type) ? cp->u.object.length :
+                                       cp->u.array.length;
+}
+
+static json_value *
+sgjs_entry(const json_value * cp, unsigned int idx)
+{
+    return (json_object == cp->type) ? cp->u.object.values[idx].value :
+                                       cp->u.array.values[idx];
+}
+
+static void
+sgjs_newline(struct sgj_stream_t * ssp, int depth)
+{
+    int k, n;
+
+    if (json_serialize_mode_multiline != ssp->out_settings.mode)
+        return;
+    fputc('\n', ssp->fp);
+    n = depth * ssp->out_settings.indent_size;
+    for (k = 0; k < n; ++k)
+        fputc(' ', ssp->fp);
+}
+
+/* Writes the complete JSON value at jvp which is at nesting level 'depth'.
+ * The serializer knows nothing of 'depth' so line breaks it outputs are
+ * indented here. Returns false if a heap allocation fails. */
+static bool
+sgjs_value_out(struct sgj_stream_t * ssp, json_value * jvp, int depth)
+{
+    size_t len;
+    char * b;
+    char * cp;
+    char * np;
+    json_value * parentp = jvp->parent;
+
+    jvp->parent = NULL;     /* else serializer continues with the parent */
+    len = json_measure_ex(jvp, ssp->out_settings);
+    b = (char *)malloc(len);
+    if (b)
+        json_serialize_ex(b, jvp, ssp->out_settings);
+    jvp->parent = parentp;
+    if (NULL == b)
+        return false;
+    for (cp = b; (np = strchr(cp, '\n')); cp = np + 1) {
+        fwrite(cp, 1, np - cp, ssp->fp);
+        sgjs_newline(ssp, depth);
+    }
+    fputs(cp, ssp->fp);
+    free(b);
+    return true;
+}
+
+/* Writes what comes before entry 'idx' of level k: a comma (unless it is
+ * the first), a line break and, if level k is an object, the name. */
+static bool
+sgjs_entry_lead(struct sgj_stream_t * ssp, int k, unsigned int idx)
+{
+    int mode = ssp->out_settings.mode;
+    struct sgj_stream_lvl_t * lp = ssp->lvl + k;
+
+    if (lp->any)
+        fputs((json_serialize_mode_single_line == mode) ? ", " : ",",
+              ssp->fp);
+    lp->any = true;
+    sgjs_newline(ssp, k + 1);
+    if (json_object == lp->jvp->type) {
+        bool ok;
+        const json_object_entry * ep = lp->jvp->u.object.values + idx;
+        json_value * nvp = json_string_new_length(ep->name_length, ep->name);
+
+        if (NULL == nvp)
+            return false;
+        ok = sgjs_value_out(ssp, nvp, k + 1);
+        json_builder_free(nvp);
+        fputs((json_serialize_mode_packed == mode) ? ":" : ": ", ssp->fp);
+        return ok;
+    }
+    return true;
+}
+
+static void
+sgjs_open(struct sgj_stream_t * ssp, json_value * jvp)
+{
+    struct sgj_stream_lvl_t * lp = ssp->lvl + ssp->depth++;
+
+    fputc((json_object == jvp->type) ? '{' : '[', ssp->fp);
+    if (json_serialize_mode_single_line == ssp->out_settings.mode)
+        fputc(' ', ssp->fp);
+    lp->jvp = jvp;
+    lp->next = 0;
+    lp->any = false;
+}
+
+/* Writes out entries of the innermost level until 'keep' remain. Written
+ * elements of the streamed array are removed from it and freed. */
+static bool
+sgjs_drain(struct sgj_stream_t * ssp, unsigned int keep)
+{
+    int k = ssp->depth - 1;
+    struct sgj_stream_lvl_t * lp = ssp->lvl + k;
+    json_value * cp = lp->jvp;
+    json_value * jvp;
+
+    while (lp->next + keep < sgjs_num_entries(cp)) {
+        jvp = sgjs_entry(cp, lp->next);
+        if (! (sgjs_entry_lead(ssp, k, lp->next) &&
+               sgjs_value_out(ssp, jvp, k + 1)))
+            return false;
+        if (cp == ssp->sap) {
+            --cp->u.array.length;
+            memmove(cp->u.array.values, cp->u.array.values + 1,
+                    cp->u.array.length * sizeof(json_value *));
+            json_builder_free(jvp);
+        } else
+            ++lp->next;
+    }
+    return true;
+}
+
+static bool
+sgjs_close(struct sgj_stream_t * ssp)
+{
+    const json_value * cp = ssp->lvl[ssp->depth - 1].jvp;
+
+    if (! sgjs_drain(ssp, 0))
+        return false;
+    --ssp->depth;
+    sgjs_newline(ssp, ssp->depth);
+    if (json_serialize_mode_single_line == ssp->out_settings.mode)
+        fputc(' ', ssp->fp);
+    fputc((json_object == cp->type) ? '}' : ']', ssp->fp);
+    return true;
+}
+
+/* Makes tp the innermost open level, first writing out everything that
+ * precedes it in the tree. Returns false if that is not possible (e.g.
+ * part of the path to tp has already been written and closed). */
+static bool
+sgjs_seek(sgj_state * jsp, struct sgj_stream_t * ssp, json_value * tp)
+{
+    int k, n;
+    unsigned int idx, num;
+    struct sgj_stream_lvl_t * lp;
+    json_value * jvp;
+    json_value * chain[SGJ_STREAM_MAX_DEPTH];
+
+    for (n = 0, jvp = tp; jvp && (n < SGJ_STREAM_MAX_DEPTH);
+         jvp = jvp->parent)
+        chain[n++] = jvp;       /* chain[0] is tp, chain[n - 1] is root */
+    if (jvp || (chain[n - 1] != (json_value *)jsp->basep))
+        return false;
+    for (k = 0; (k < ssp->depth) && (k < n); ++k) {
+        if (ssp->lvl[k].jvp != chain[n - 1 - k])
+            break;
+    }
+    while (ssp->depth > k) {
+        if (! sgjs_close(ssp))
+            return false;
+    }
+    if (0 == ssp->depth) {
+        if (ssp->done)
+            return false;
+        sgjs_open(ssp, chain[n - 1]);
+        k = 1;
+    }
+    for ( ; k < n; ++k) {
+        lp = ssp->lvl + k - 1;
+        jvp = chain[n - 1 - k];
+        num = sgjs_num_entries(lp->jvp);
+        for (idx = lp->next; idx < num; ++idx) {
+            if (sgjs_entry(lp->jvp, idx) == jvp)
+                break;
+        }
+        if (idx >= num)
+            return false;
+        for ( ; lp->next < idx; ++lp->next) {
+            if (! (sgjs_entry_lead(ssp, k - 1, lp->next) &&
+                   sgjs_value_out(ssp, sgjs_entry(lp->jvp, lp->next), k)))
+                return false;
+        }
+        if (! sgjs_entry_lead(ssp, k - 1, idx))
+            return false;
+        lp->next = idx + 1;
+        sgjs_open(ssp, jvp);
+    }
+    return true;
+}
+
+/* Called after an element is pushed onto array jap. If it is the streamed
+ * array then all but its last element are written out. */
+static void
+sgj_stream_chk(sgj_state * jsp, json_value * jap)
+{
+    struct sgj_stream_t * ssp = (struct sgj_stream_t *)jsp->streamp;
+    const json_value * jvp;
+
+    if ((NULL == ssp) || (jap != ssp->sap) || (jap->u.array.length < 2))
+        return;
+    for (jvp = jap; jvp->parent; jvp = jvp->parent)
+        ;
+    if (jvp != (json_value *)jsp->basep)
+        return;         /* not yet attached to the tree, try later */
+    if (! (sgjs_seek(jsp, ssp, jap) && sgjs_drain(ssp, 1))) {
+        pr2ws("%s: unable to stream JSON output\n", __func__);
+        ssp->sap = NULL;
+    }
+}
+
+static void
+sgjs_finish(struct sgj_stream_t * ssp)
+{
+    while (ssp->depth > 0) {
+        if (! sgjs_close(ssp)) {
+            pr2ws("%s: unable to stream JSON output\n", __func__);
+            break;
+        }
+    }
+    fputc('\n', ssp->fp);
+    ssp->done = true;
+}
+
+bool
+sgj_stream_start(sgj_state * jsp, FILE * fp)
+{
+    struct sgj_stream_t * ssp;
+
+    if ((NULL == jsp) || (! jsp->pr_as_json) || (NULL == jsp->basep) ||
+        jsp->pr_out_hr || (NULL == fp))
+        return false;
+    if (jsp->streamp)
+        return true;
+    ssp = (struct sgj_stream_t *)calloc(1, sizeof(*ssp));
+    if (NULL == ssp)
+        return false;
+    ssp->fp = fp;
+    sgj_get_out_settings(jsp, &ssp->out_settings);
+    jsp->streamp = ssp;
+    if (jsp->arenap)    /* from now on values come from the heap */
+        jsp->heap_in_arena = true;
+    return true;
+}
+
+/* Notes when heap value jvp is about to be attached to the arena tree */
+static void
+sgj_chk_heap(sgj_state * jsp, const json_value * jvp)
+{
+    if (jsp->arenap && jvp && (NULL == json_value_arena(jvp)))
+        jsp->heap_in_arena = true;
+}
+
+/* Pushes jvp onto the array jap, then checks if it is the streamed array */
+static json_value *
+sgj_arr_push(sgj_state * jsp, json_value * jap, json_value * jvp)
+{
+    json_value * resp;
+
+    sgj_chk_heap(jsp, jvp);
+    resp = json_array_push(jap, jvp);
+
+    if (resp && jsp->streamp)
+        sgj_stream_chk(jsp, jap);
+    return resp;
+}
+
 void
 sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
                  const char * estr, FILE * fp)
@@ -333,6 +651,7 @@ sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
     const char * ccp;
     char * b;
     json_value * jvp = (json_value *)(jop ? jop : jsp->basep);
+    struct sgj_stream_t * ssp = (struct sgj_stream_t *)jsp->streamp;
     json_serialize_opts out_settings;
 
     if (NULL == jvp) {
@@ -353,12 +672,13 @@ sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
         }
         sgj_js_nv_istr(jsp, jop, "exit_status", exit_status, NULL, ccp);
     }
-    memcpy(&out_settings, &def_out_settings, sizeof(out_settings));
-    if (jsp->pr_indent_size != def_out_settings.indent_size)
-        out_settings.indent_size = jsp->pr_indent_size;
-    if (! jsp->pr_pretty)
-        out_settings.mode = jsp->pr_packed ? json_serialize_mode_packed :
-                                json_serialize_mode_single_line;
+    if (ssp && (NULL == jop) && (ssp->depth > 0)) {
+        /* streamed output has started, write what remains */
+        if (! ssp->done)
+            sgjs_finish(ssp);
+        return;
+    }
+    sgj_get_out_settings(jsp, &out_settings);
 
     len = json_measure_ex(jvp, out_settings);
     if (len < 1)
@@ -381,12 +701,31 @@ sgj_js2file_estr(sgj_state * jsp, sgj_opaque_p jop, int exit_status,
 void
 sgj_finish(sgj_state * jsp)
 {
+    /* when everything came from the arena, no need to walk the tree */
+    bool walk = jsp && ((NULL == jsp->arenap) || jsp->heap_in_arena);
+
+    if (jsp && jsp->streamp) {
+        struct sgj_stream_t * ssp = (struct sgj_stream_t *)jsp->streamp;
+
+        if ((ssp->depth > 0) && (! ssp->done))
+            sgjs_finish(ssp);
+        free(ssp);
+        jsp->streamp = NULL;
+    }
     if (jsp && jsp->basep) {
-        json_builder_free((json_value *)jsp->basep);
+        /* only frees heap values, the arena goes below */
+        if (walk)
+            json_builder_free((json_value *)jsp->basep);
         jsp->basep = NULL;
         jsp->out_hrp = NULL;
         jsp->userp = NULL;
     }
+    if (jsp && jsp->arenap) {
+        json_arena_free((json_arena *)jsp->arenap);
+        jsp->arenap = NULL;
+    }
+    if (jsp)
+        jsp->heap_in_arena = false;
 }
 
 void
@@ -453,7 +792,7 @@ sgj_pr_hr(sgj_state * jsp, const char * fmt, ...)
             }
         }
         json_array_push((json_value *)jsp->out_hrp,
-                        json_string_new(step ? b + 1 : b));
+                        json_string_new_a(sgj_arena(jsp), step ? b + 1 : b));
         va_end(args);
     } else {    /* do nothing, just consume arguments */
         va_start(args, fmt);
@@ -469,7 +808,8 @@ sgj_named_subobject_r(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name)
 
     if (jsp && jsp->pr_as_json && sn_name)
         resp = json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                 sn_name, json_object_new(0));
+                                 sn_name,
+                                 json_object_new_a(sgj_arena(jsp), 0));
     return resp;
 }
 
@@ -484,7 +824,8 @@ sgj_snake_named_subobject_r(sgj_state * jsp, sgj_opaque_p jop,
 
         if (nlen > 0)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sname, json_object_new(0));
+                                    sname,
+                                    json_object_new_a(sgj_arena(jsp), 0));
     }
     return NULL;
 }
@@ -497,7 +838,18 @@ sgj_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name)
 
     if (jsp && jsp->pr_as_json && sn_name)
         resp = json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                sn_name, json_array_new(0));
+                                sn_name, json_array_new_a(sgj_arena(jsp), 0));
+    return resp;
+}
+
+sgj_opaque_p
+sgj_named_subarray_stream_r(sgj_state * jsp, sgj_opaque_p jop,
+                            const char * sn_name)
+{
+    sgj_opaque_p resp = sgj_named_subarray_r(jsp, jop, sn_name);
+
+    if (resp && jsp->streamp)
+        ((struct sgj_stream_t *)jsp->streamp)->sap = (json_value *)resp;
     return resp;
 }
 
@@ -512,7 +864,8 @@ sgj_snake_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop,
 
         if (nlen > 0)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sname, json_array_new(0));
+                                    sname,
+                                    json_array_new_a(sgj_arena(jsp), 0));
     }
     return NULL;
 }
@@ -521,21 +874,24 @@ sgj_snake_named_subarray_r(sgj_state * jsp, sgj_opaque_p jop,
 sgj_opaque_p
 sgj_new_unattached_object_r(sgj_state * jsp)
 {
-    return (jsp && jsp->pr_as_json) ? json_object_new(0) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+           json_object_new_a(sgj_arena(jsp), 0) : NULL;
 }
 
 /* Newly created array is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_array_r(sgj_state * jsp)
 {
-    return (jsp && jsp->pr_as_json) ? json_array_new(0) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+           json_array_new_a(sgj_arena(jsp), 0) : NULL;
 }
 
 /* Newly created string is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_string_r(sgj_state * jsp, const char * value)
 {
-    return (jsp && jsp->pr_as_json) ? json_string_new(value) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+           json_string_new_a(sgj_arena(jsp), value) : NULL;
 }
 
 /* Newly created string with length object is un-attached to jsp->basep
@@ -543,29 +899,31 @@ sgj_new_unattached_string_r(sgj_state * jsp, const char * value)
 sgj_opaque_p
 sgj_new_unattached_str_len_r(sgj_state * jsp, const char * value, int vlen)
 {
-    return (jsp && jsp->pr_as_json) ? json_string_new_length(vlen, value) :
-                                      NULL;
+    return (jsp && jsp->pr_as_json) ?
+           json_string_new_length_a(sgj_arena(jsp), vlen, value) : NULL;
 }
 
 /* Newly created integer object is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_integer_r(sgj_state * jsp, uint64_t value)
 {
-    return (jsp && jsp->pr_as_json) ? json_integer_new(value) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+           json_integer_new_a(sgj_arena(jsp), value) : NULL;
 }
 
 /* Newly created boolean object is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_bool_r(sgj_state * jsp, bool value)
 {
-    return (jsp && jsp->pr_as_json) ? json_boolean_new(value) : NULL;
+    return (jsp && jsp->pr_as_json) ?
+           json_boolean_new_a(sgj_arena(jsp), value) : NULL;
 }
 
 /* Newly created null object is un-attached to jsp->basep tree */
 sgj_opaque_p
 sgj_new_unattached_null_r(sgj_state * jsp)
 {
-    return (jsp && jsp->pr_as_json) ? json_null_new() : NULL;
+    return (jsp && jsp->pr_as_json) ? json_null_new_a(sgj_arena(jsp)) : NULL;
 }
 
 sgj_opaque_p
@@ -575,10 +933,11 @@ sgj_js_nv_s(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
     if (jsp && jsp->pr_as_json && value) {
         if (sn_name)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sn_name, json_string_new(value));
+                                    sn_name,
+                                    json_string_new_a(sgj_arena(jsp), value));
         else
-            return json_array_push((json_value *)(jop ? jop : jsp->basep),
-                                   json_string_new(value));
+            return sgj_arr_push(jsp, (json_value *)(jop ? jop : jsp->basep),
+                                json_string_new_a(sgj_arena(jsp), value));
     } else
         return NULL;
 }
@@ -596,10 +955,13 @@ sgj_js_nv_s_len(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
         }
         if (sn_name)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sn_name, json_string_new_length(k, value));
+                                    sn_name,
+                                    json_string_new_length_a(sgj_arena(jsp),
+                                                             k, value));
         else
-            return json_array_push((json_value *)(jop ? jop : jsp->basep),
-                                   json_string_new_length(k, value));
+            return sgj_arr_push(jsp, (json_value *)(jop ? jop : jsp->basep),
+                                json_string_new_length_a(sgj_arena(jsp), k,
+                                                         value));
     } else
         return NULL;
 }
@@ -651,10 +1013,11 @@ sgj_js_nv_i(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
     if (jsp && jsp->pr_as_json) {
         if (sn_name)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sn_name, json_integer_new(value));
+                                    sn_name,
+                                    json_integer_new_a(sgj_arena(jsp), value));
         else
-            return json_array_push((json_value *)(jop ? jop : jsp->basep),
-                                   json_integer_new(value));
+            return sgj_arr_push(jsp, (json_value *)(jop ? jop : jsp->basep),
+                                json_integer_new_a(sgj_arena(jsp), value));
     }
     else
         return NULL;
@@ -667,10 +1030,27 @@ sgj_js_nv_b(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
     if (jsp && jsp->pr_as_json) {
         if (sn_name)
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
-                                    sn_name, json_boolean_new(value));
+                                    sn_name,
+                                    json_boolean_new_a(sgj_arena(jsp), value));
+        else
+            return sgj_arr_push(jsp, (json_value *)(jop ? jop : jsp->basep),
+                                json_boolean_new_a(sgj_arena(jsp), value));
+    } else
+        return NULL;
+}
+
+sgj_opaque_p
+sgj_js_nv_d(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
+            double value)
+{
+    if (jsp && jsp->pr_as_json) {
+        if (sn_name)
+            return json_object_push((json_value *)(jop ? jop : jsp->basep),
+                                    sn_name,
+                                    json_double_new_a(sgj_arena(jsp), value));
         else
-            return json_array_push((json_value *)(jop ? jop : jsp->basep),
-                                   json_boolean_new(value));
+            return sgj_arr_push(jsp, (json_value *)(jop ? jop : jsp->basep),
+                                json_double_new_a(sgj_arena(jsp), value));
     } else
         return NULL;
 }
@@ -681,12 +1061,14 @@ sgj_js_nv_o(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
             sgj_opaque_p ua_jop)
 {
     if (jsp && jsp->pr_as_json && ua_jop) {
-        if (sn_name)
+        if (sn_name) {
+            sgj_chk_heap(jsp, (const json_value *)ua_jop);
             return json_object_push((json_value *)(jop ? jop : jsp->basep),
                                     sn_name, (json_value *)ua_jop);
+        }
         else
-            return json_array_push((json_value *)(jop ? jop : jsp->basep),
-                                   (json_value *)ua_jop);
+            return sgj_arr_push(jsp, (json_value *)(jop ? jop : jsp->basep),
+                                (json_value *)ua_jop);
     } else
         return NULL;
 }
@@ -798,8 +1180,8 @@ sgj_js_nv_s_nex(sgj_state * jsp, sgj_opaque_p jop, const char * sn_name,
     as_nex = jsp->pr_name_ex && nex_s;
     if ((NULL == val_s) && (! as_nex))
         /* corner case: assume jop is an array */
-        json_array_push((json_value *)(jop ? jop : jsp->basep),
-                         json_string_new(sn_name));
+        sgj_arr_push(jsp, (json_value *)(jop ? jop : jsp->basep),
+                     json_string_new_a(sgj_arena(jsp), sn_name));
     else if (NULL == val_s)
         sgj_js_nv_s(jsp, jop, sn_name, nex_s);
     else if (! as_nex)
@@ -1150,14 +1532,15 @@ sgj_haj_xx(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
         if (NULL == jop) {
             if (as_json && jsp->pr_out_hr) {
                 eaten = true;
+                sgj_chk_heap(jsp, jvp);
                 json_array_push((json_value *)jsp->out_hrp,
-                                jvp ? jvp : json_null_new());
+                                jvp ? jvp : json_null_new_a(sgj_arena(jsp)));
             }
         } else {        /* assume jop points to named array */
             if (as_json) {
                 eaten = true;
-                json_array_push((json_value *)jop,
-                                jvp ? jvp : json_null_new());
+                sgj_arr_push(jsp, (json_value *)jop,
+                             jvp ? jvp : json_null_new_a(sgj_arena(jsp)));
             }
         }
         goto fini;
@@ -1206,8 +1589,9 @@ sgj_haj_xx(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
             }
             if (! done) {
                 eaten = true;
+                sgj_chk_heap(jsp, jvp);
                 json_object_push((json_value *)jop, jname,
-                                 jvp ? jvp : json_null_new());
+                                 jvp ? jvp : json_null_new_a(sgj_arena(jsp)));
             }
         }
     }
@@ -1215,7 +1599,8 @@ sgj_haj_xx(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
         sgj_haj_helper(b + n, blen - n, aname, sep, true, jvp, 0, hex_haj);
 
     if (as_json && jsp->pr_out_hr)
-        json_array_push((json_value *)jsp->out_hrp, json_string_new(b));
+        json_array_push((json_value *)jsp->out_hrp,
+                        json_string_new_a(sgj_arena(jsp), b));
     if (! as_json)
         printf("%s\n", b);
 fini:
@@ -1230,7 +1615,7 @@ sgj_haj_vs(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
     json_value * jvp;
 
     /* make json_value even if jsp->pr_as_json is false */
-    jvp = value ? json_string_new(value) : NULL;
+    jvp = value ? json_string_new_a(sgj_arena(jsp), value) : NULL;
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, false, NULL, NULL);
 }
 
@@ -1241,7 +1626,7 @@ sgj_haj_vi(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_integer_new(value);
+    jvp = json_integer_new_a(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, hex_haj, NULL, NULL);
 }
 
@@ -1252,7 +1637,7 @@ sgj_haj_vistr(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_integer_new(value);
+    jvp = json_integer_new_a(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, hex_haj, val_s,
                  NULL);
 }
@@ -1264,7 +1649,7 @@ sgj_haj_vi_nex(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_integer_new(value);
+    jvp = json_integer_new_a(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, hex_haj, NULL, nex_s);
 }
 
@@ -1276,7 +1661,7 @@ sgj_haj_vistr_nex(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_integer_new(value);
+    jvp = json_integer_new_a(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, hex_haj, val_s,
                nex_s);
 }
@@ -1287,7 +1672,7 @@ sgj_haj_vb(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
 {
     json_value * jvp;
 
-    jvp = json_boolean_new(value);
+    jvp = json_boolean_new_a(sgj_arena(jsp), value);
     sgj_haj_xx(jsp, jop, leadin_sp, aname, sep, jvp, false, NULL, NULL);
 }
 
@@ -1312,7 +1697,8 @@ sgj_haj_subo_r(sgj_state * jsp, sgj_opaque_p jop, int leadin_sp,
                        hex_haj);
 
     if (as_json && jsp->pr_out_hr)
-        json_array_push((json_value *)jsp->out_hrp, json_string_new(b));
+        json_array_push((json_value *)jsp->out_hrp,
+                        json_string_new_a(sgj_arena(jsp), b));
     if (! as_json)
         printf("%s\n", b);
 
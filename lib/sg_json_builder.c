@@ -60,11 +60,160 @@ typedef struct json_builder_value
    size_t additional_length_allocated;
    size_t length_iterated;
 
+   json_arena * arena;  /* NULL when allocated from the heap */
+
 } json_builder_value;
 
 /* Use this to silence clang --analyze warning about 'unix.MallocSizeof' */
 static const int jbv_sz = sizeof (json_builder_value);
 
+/* An arena is a list of chunks, allocations are carved from the front
+ * chunk. Nothing is freed until the whole arena is. */
+#define JSON_ARENA_DEF_CHUNK (32 * 1024)
+#define JSON_ARENA_ALIGN (2 * sizeof (void *))
+
+typedef struct json_arena_chunk
+{
+   struct json_arena_chunk * next;
+   size_t size;
+   size_t used;
+
+} json_arena_chunk;
+
+struct json_arena
+{
+   json_arena_chunk * head;
+   size_t chunk_size;
+};
+
+#define JSON_ARENA_HDR_SZ ((sizeof (json_arena_chunk) + JSON_ARENA_ALIGN - 1) \
+                           & ~(JSON_ARENA_ALIGN - 1))
+
+json_arena * json_arena_new (size_t chunk_size)
+{
+   json_arena * arena = (json_arena *) calloc (1, sizeof (json_arena));
+
+   if (!arena)
+      return NULL;
+
+   arena->chunk_size = chunk_size ? chunk_size : JSON_ARENA_DEF_CHUNK;
+
+   return arena;
+}
+
+void json_arena_free (json_arena * arena)
+{
+   json_arena_chunk * chunk;
+
+   if (!arena)
+      return;
+
+   while ((chunk = arena->head))
+   {
+      arena->head = chunk->next;
+      free (chunk);
+   }
+
+   free (arena);
+}
+
+static void * json_arena_alloc (json_arena * arena, size_t size, int zero)
+{
+   json_arena_chunk * chunk = arena->head;
+   char * p;
+
+   size = (size + JSON_ARENA_ALIGN - 1) & ~(JSON_ARENA_ALIGN - 1);
+
+   if (!chunk || (chunk->used + size > chunk->size))
+   {
+      /* large requests get their own chunk, placed behind the front one
+       * so what remains of that can still be used */
+      int own = (size > arena->chunk_size / 4);
+      size_t csize = own ? size : arena->chunk_size;
+
+      if (! (chunk = (json_arena_chunk *) malloc (JSON_ARENA_HDR_SZ + csize)))
+         return NULL;
+
+      chunk->size = csize;
+      chunk->used = 0;
+
+      if (own && arena->head)
+      {
+         chunk->next = arena->head->next;
+         arena->head->next = chunk;
+      }
+      else
+      {
+         chunk->next = arena->head;
+         arena->head = chunk;
+      }
+   }
+
+   p = (char *) chunk + JSON_ARENA_HDR_SZ + chunk->used;
+   chunk->used += size;
+
+   if (zero)
+      memset (p, 0, size);
+
+   return p;
+}
+
+/* Returns an element array with room for 'length + extra' elements of
+ * 'elem_sz' bytes, the first 'length' copied from 'values'. Heap values
+ * are realloc()-ed. Arena values can't give back the old array so they
+ * grow geometrically with the spare count put in additional_length_allocated
+ */
+static void * values_grow (json_value * value, void * values, size_t length,
+                           size_t extra, size_t elem_sz)
+{
+   json_builder_value * bvalue = (json_builder_value *) value;
+   void * values_new;
+   size_t n;
+
+   if (!bvalue->arena)
+      return realloc (values, elem_sz * (length + extra));
+
+   n = length + extra;
+
+   if (n < 2 * length)
+      n = 2 * length;
+
+   if (n < 4)
+      n = 4;
+
+   if (! (values_new = json_arena_alloc (bvalue->arena, elem_sz * n, 0)))
+      return NULL;
+
+   if (length)
+      memcpy (values_new, values, elem_sz * length);
+
+   bvalue->additional_length_allocated = n - length - extra;
+
+   return values_new;
+}
+
+json_arena * json_value_arena (const json_value * value)
+{
+   return value ? ((const json_builder_value *) value)->arena : NULL;
+}
+
+static json_value * value_new (json_arena * arena, json_type type)
+{
+   json_value * value = (json_value *) (arena ?
+                           json_arena_alloc (arena, jbv_sz, 1) :
+                           calloc (1, jbv_sz));
+
+   if (!value)
+      return NULL;
+
+   ((json_builder_value *) value)->is_builder_value = 1;
+   ((json_builder_value *) value)->arena = arena;
+
+   value->type = type;
+
+   return value;
+}
+
 
 static int builderize (json_value * value)
 {
@@ -136,18 +285,25 @@ static int get_serialize_flags (json_serialize_opts opts)
 }
 
 json_value * json_array_new (size_t length)
+{
+   return json_array_new_a (NULL, length);
+}
+
+json_value * json_array_new_a (json_arena * arena, size_t length)
 {
     /* 'value' will be pointer to an instance of the base class json_value */
-    json_value * value = (json_value *) calloc (1, jbv_sz);
+    json_value * value = value_new (arena, json_array);
 
     if (!value)
        return NULL;
 
-    ((json_builder_value *) value)->is_builder_value = 1;
-
-    value->type = json_array;
-
-    if (! (value->u.array.values = (json_value **) malloc (length * sizeof (json_value *))))
+    if (arena)
+    {
+       if (length && ! (value->u.array.values = (json_value **)
+                  json_arena_alloc (arena, length * sizeof (json_value *), 0)))
+          return NULL;
+    }
+    else if (! (value->u.array.values = (json_value **) malloc (length * sizeof (json_value *))))
     {
        free (value);
        return NULL;
@@ -171,8 +327,9 @@ json_value * json_array_push (json_value * array, json_value * value)
    }
    else
    {
-      json_value ** values_new = (json_value **) realloc
-            (array->u.array.values, sizeof (json_value *) * (array->u.array.length + 1));
+      json_value ** values_new = (json_value **) values_grow
+            (array, array->u.array.values, array->u.array.length, 1,
+             sizeof (json_value *));
 
       if (!values_new)
          return NULL;
@@ -190,16 +347,23 @@ json_value * json_array_push (json_value * array, json_value * value)
 
 json_value * json_object_new (size_t length)
 {
-    json_value * value = (json_value *) calloc (1, jbv_sz);
+   return json_object_new_a (NULL, length);
+}
+
+json_value * json_object_new_a (json_arena * arena, size_t length)
+{
+    json_value * value = value_new (arena, json_object);
 
     if (!value)
        return NULL;
 
-    ((json_builder_value *) value)->is_builder_value = 1;
-
-    value->type = json_object;
-
-    if (! (value->u.object.values = (json_object_entry *) calloc
+    if (arena)
+    {
+       if (length && ! (value->u.object.values = (json_object_entry *)
+                  json_arena_alloc (arena, length * sizeof (*value->u.object.values), 1)))
+          return NULL;
+    }
+    else if (! (value->u.object.values = (json_object_entry *) calloc
            (length, sizeof (*value->u.object.values))))
     {
        free (value);
@@ -223,10 +387,16 @@ json_value * json_object_push_length (json_value * object,
                                       json_value * value)
 {
    json_char * name_copy;
+   json_arena * arena = ((json_builder_value *) object)->arena;
 
    assert (object->type == json_object);
 
-   if (! (name_copy = (json_char *) malloc ((name_length + 1) * sizeof (json_char))))
+   if (arena)
+      name_copy = (json_char *) json_arena_alloc (arena, (name_length + 1) * sizeof (json_char), 0);
+   else
+      name_copy = (json_char *) malloc ((name_length + 1) * sizeof (json_char));
+
+   if (!name_copy)
       return NULL;
    
    memcpy (name_copy, name, name_length * sizeof (json_char));
@@ -234,7 +404,8 @@ json_value * json_object_push_length (json_value * object,
 
    if (!json_object_push_nocopy (object, name_length, name_copy, value))
    {
-      free (name_copy);
+      if (!arena)
+         free (name_copy);
       return NULL;
    }
 
@@ -259,8 +430,9 @@ json_value * json_object_push_nocopy (json_value * object,
    else
    {
       json_object_entry * values_new = (json_object_entry *)
-            realloc (object->u.object.values, sizeof (*object->u.object.values)
-                            * (object->u.object.length + 1));
+            values_grow (object, object->u.object.values,
+                         object->u.object.length, 1,
+                         sizeof (*object->u.object.values));
 
       if (!values_new)
          return NULL;
@@ -286,6 +458,11 @@ json_value * json_string_new (const json_char * buf)
    return json_string_new_length (strlen (buf), buf);
 }
 
+json_value * json_string_new_a (json_arena * arena, const json_char * buf)
+{
+   return json_string_new_length_a (arena, strlen (buf), buf);
+}
+
 json_value * json_string_new_length (unsigned int length, const json_char * buf)
 {
    json_value * value;
@@ -306,16 +483,37 @@ json_value * json_string_new_length (unsigned int length, const json_char * buf)
    return value;
 }
 
+json_value * json_string_new_length_a (json_arena * arena,
+                                       unsigned int length, const json_char * buf)
+{
+   json_value * value;
+   json_char * copy;
+
+   if (!arena)
+      return json_string_new_length (length, buf);
+
+   if (! (value = value_new (arena, json_string)))
+      return NULL;
+
+   if (! (copy = (json_char *) json_arena_alloc (arena, (length + 1) * sizeof (json_char), 0)))
+      return NULL;
+
+   memcpy (copy, buf, length * sizeof (json_char));
+   copy [length] = 0;
+
+   value->u.string.length = length;
+   value->u.string.ptr = copy;
+
+   return value;
+}
+
 json_value * json_string_new_nocopy (unsigned int length, json_char * buf)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   json_value * value = value_new (NULL, json_string);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_string;
    value->u.string.length = length;
    value->u.string.ptr = buf;
 
@@ -324,14 +522,16 @@ json_value * json_string_new_nocopy (unsigned int length, json_char * buf)
 
 json_value * json_integer_new (json_int_t integer)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   return json_integer_new_a (NULL, integer);
+}
+
+json_value * json_integer_new_a (json_arena * arena, json_int_t integer)
+{
+   json_value * value = value_new (arena, json_integer);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_integer;
    value->u.integer = integer;
 
    return value;
@@ -339,14 +539,16 @@ json_value * json_integer_new (json_int_t integer)
 
 json_value * json_double_new (double dbl)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   return json_double_new_a (NULL, dbl);
+}
+
+json_value * json_double_new_a (json_arena * arena, double dbl)
+{
+   json_value * value = value_new (arena, json_double);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_double;
    value->u.dbl = dbl;
 
    return value;
@@ -354,14 +556,16 @@ json_value * json_double_new (double dbl)
 
 json_value * json_boolean_new (int b)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
+   return json_boolean_new_a (NULL, b);
+}
+
+json_value * json_boolean_new_a (json_arena * arena, int b)
+{
+   json_value * value = value_new (arena, json_boolean);
    
    if (!value)
       return NULL;
 
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_boolean;
    value->u.boolean = b;
 
    return value;
@@ -369,16 +573,12 @@ json_value * json_boolean_new (int b)
 
 json_value * json_null_new (void)
 {
-   json_value * value = (json_value *) calloc (1, jbv_sz);
-   
-   if (!value)
-      return NULL;
-
-   ((json_builder_value *) value)->is_builder_value = 1;
-
-   value->type = json_null;
+   return json_null_new_a (NULL);
+}
 
-   return value;
+json_value * json_null_new_a (json_arena * arena)
+{
+   return value_new (arena, json_null);
 }
 
 void json_object_sort (json_value * object, json_value * proto)
@@ -425,6 +625,11 @@ json_value * json_object_merge (json_value * objectA, json_value * objectB)
    if (!builderize (objectA) || !builderize (objectB))
       return NULL;
 
+   /* entry names move with the entries so must come from the same place */
+   if (((json_builder_value *) objectA)->arena !=
+        ((json_builder_value *) objectB)->arena)
+      return NULL;
+
    if (objectB->u.object.length <=
         ((json_builder_value *) objectA)->additional_length_allocated)
    {
@@ -440,8 +645,15 @@ json_value * json_object_merge (json_value * objectA, json_value * objectB)
               + ((json_builder_value *) objectA)->additional_length_allocated
               + objectB->u.object.length;
 
-      if (! (values_new = (json_object_entry *)
-            realloc (objectA->u.object.values, sizeof (json_object_entry) * alloc)))
+      if (((json_builder_value *) objectA)->arena)
+         values_new = (json_object_entry *) values_grow
+               (objectA, objectA->u.object.values, objectA->u.object.length,
+                objectB->u.object.length, sizeof (json_object_entry));
+      else
+         values_new = (json_object_entry *)
+               realloc (objectA->u.object.values, sizeof (json_object_entry) * alloc);
+
+      if (!values_new)
       {
           return NULL;
       }
@@ -459,8 +671,11 @@ json_value * json_object_merge (json_value * objectA, json_value * objectB)
 
    objectA->u.object.length += objectB->u.object.length;
 
-   free (objectB->u.object.values);
-   free (objectB);
+   if (! ((json_builder_value *) objectB)->arena)
+   {
+      free (objectB->u.object.values);
+      free (objectB);
+   }
 
    return objectA;
 }
@@ -940,6 +1155,7 @@ void json_serialize_ex (json_char * buf, json_value * value, json_serialize_opts
 void json_builder_free (json_value * value)
 {
    json_value * cur_value;
+   int heap;
 
    if (!value)
       return;
@@ -948,13 +1164,18 @@ void json_builder_free (json_value * value)
 
    while (value)
    {
+      /* arena values are released by json_arena_free (), just look for
+       * heap values attached to them */
+      heap = ! ((json_builder_value *) value)->arena;
+
       switch (value->type)
       {
          case json_array:
 
             if (!value->u.array.length)
             {
-               free (value->u.array.values);
+               if (heap)
+                  free (value->u.array.values);
                break;
             }
 
@@ -965,13 +1186,14 @@ void json_builder_free (json_value * value)
 
             if (!value->u.object.length)
             {
-               free (value->u.object.values);
+               if (heap)
+                  free (value->u.object.values);
                break;
             }
 
             -- value->u.object.length;
 
-            if (((json_builder_value *) value)->is_builder_value)
+            if (((json_builder_value *) value)->is_builder_value && heap)
             {
                /* Names are allocated separately for builder values.  In parser
                 * values, they are part of the same allocation as the values array
@@ -985,7 +1207,8 @@ void json_builder_free (json_value * value)
 
          case json_string:
 
-            free (value->u.string.ptr);
+            if (heap)
+               free (value->u.string.ptr);
             break;
 
          default:
@@ -994,7 +1217,8 @@ void json_builder_free (json_value * value)
 
       cur_value = value;
       value = value->parent;
-      free (cur_value);
+      if (heap)
+         free (cur_value);
    }
 }
 
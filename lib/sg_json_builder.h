@@ -324,6 +324,36 @@ void json_serialize_ex (json_char * buf, json_value *, json_serialize_opts);
  ***/
 void json_builder_free (json_value *);
 
+
+/*** Arenas (sg3_utils addition)
+ ***
+ * Values made by the json_*_new_a () functions, and the names and element
+ * arrays of objects and arrays so made, are carved out of an arena rather
+ * than being separate heap allocations. json_builder_free () does not free
+ * them (but does free heap values attached to them); they are all released
+ * in one shot by json_arena_free (). If the arena argument is NULL these
+ * functions are the same as their counterparts above. A chunk_size of 0
+ * selects the default. json_object_merge () fails if the two objects are
+ * not from the same arena (or both from the heap).
+ */
+typedef struct json_arena json_arena;
+
+json_arena * json_arena_new (size_t chunk_size);
+void json_arena_free (json_arena *);
+
+json_value * json_array_new_a (json_arena *, size_t length);
+json_value * json_object_new_a (json_arena *, size_t length);
+json_value * json_string_new_a (json_arena *, const json_char *);
+json_value * json_string_new_length_a (json_arena *, unsigned int length,
+                                       const json_char *);
+json_value * json_integer_new_a (json_arena *, json_int_t);
+json_value * json_double_new_a (json_arena *, double);
+json_value * json_boolean_new_a (json_arena *, int);
+json_value * json_null_new_a (json_arena *);
+
+/* Returns the arena that builder value was made from, NULL for the heap */
+json_arena * json_value_arena (const json_value *);
+
 #ifdef __cplusplus
 }
 #endif
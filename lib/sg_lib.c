@@ -607,6 +607,183 @@ sg_get_sense_progress_fld(const uint8_t * sbp, int sb_len,
     }
 }
 
+/* Largest offset read by sg_get_sense_fields() is below this: a
+ * descriptor starting at the end of the additional sense bytes (8 + 255)
+ * and its 2 byte header plus up to 255 bytes. */
+#define SG_SENSE_FIELDS_SPAN (8 + 255 + 2 + 255)
+
+/* See description in sg_lib.h header file */
+bool
+sg_get_sense_fields(const uint8_t * sbp, int sb_len,
+                    struct sg_sense_fields * sfp)
+{
+    bool sk_pr;
+    uint8_t resp_code;
+    int k, n, add_sb_len, add_d_len, off;
+    /* first descriptor of each type of interest (0x0 to 0xa), as found by
+     * sg_scsi_sense_desc_find() */
+    const uint8_t * dp[0xb];
+    const uint8_t * bp;
+    /* The bounds checks below are those of the sg_get_sense_*() functions
+     * which, given a short fixed format buffer or a truncated descriptor,
+     * read beyond sb_len. Here the bytes beyond sb_len read as zero. */
+    uint8_t sb[SG_SENSE_FIELDS_SPAN];
+
+    memset(sfp, 0, sizeof(*sfp));
+    if ((NULL == sbp) || (sb_len < 1))
+        return false;
+    resp_code = 0x7f & sbp[0];
+    if ((resp_code < 0x70) || (resp_code > 0x73))
+        return false;
+    n = (sb_len < (int)sizeof(sb)) ? sb_len : (int)sizeof(sb);
+    memcpy(sb, sbp, n);
+    memset(sb + n, 0, sizeof(sb) - n);
+    sfp->response_code = resp_code;
+    sfp->deferred = !!(0x1 & resp_code);
+    if (resp_code < 0x72) {             /* fixed format */
+        if (sb_len > 2)
+            sfp->sense_key = (0xf & sb[2]);
+        if (sb_len > 7) {
+            k = (sb_len < (sb[7] + 8)) ? sb_len : (sb[7] + 8);
+            if (k > 12)
+                sfp->asc = sb[12];
+            if (k > 13)
+                sfp->ascq = sb[13];
+        }
+        if (sb_len < 7)
+            return true;
+        sfp->info = sg_get_unaligned_be32(sb + 3);
+        sfp->info_valid = !!(0x80 & sb[0]);
+        if (0xe0 & sb[2]) {
+            sfp->fm_eom_ili_present = true;
+            sfp->filemark = !!(0x80 & sb[2]);
+            sfp->eom = !!(0x40 & sb[2]);
+            sfp->ili = !!(0x20 & sb[2]);
+        }
+        sfp->cmd_spec = sg_get_unaligned_be32(sb + 8);
+        sfp->cmd_spec_present = true;
+        if ((sb_len >= 18) && (0x80 & sb[15])) {
+            sfp->sks_valid = true;
+            memcpy(sfp->sks, sb + 15, 3);
+            if ((SPC_SK_NO_SENSE == sfp->sense_key) ||
+                (SPC_SK_NOT_READY == sfp->sense_key)) {
+                sfp->progress = sg_get_unaligned_be16(sb + 16);
+                sfp->progress_present = true;
+            }
+        }
+        return true;
+    }
+    /* descriptor format */
+    sfp->descriptor_fmt = true;
+    if (sb_len > 1)
+        sfp->sense_key = (0xf & sb[1]);
+    if (sb_len > 2)
+        sfp->asc = sb[2];
+    if (sb_len > 3)
+        sfp->ascq = sb[3];
+    if (sb_len > 4)
+        sfp->sdat_ovfl = !!(0x80 & sb[4]);
+    /* sg_scsi_sense_desc_find() ignores 0xf2 and 0xf3 */
+    if ((sb_len < 8) || (0 == sb[7]) || (sb[0] < 0x72) || (sb[0] > 0x73))
+        return true;
+    memset(dp, 0, sizeof(dp));
+    add_sb_len = (sb[7] < (sb_len - 8)) ? sb[7] : (sb_len - 8);
+    for (k = 0; k < add_sb_len; k += add_d_len + 2) {
+        off = 8 + k;
+        bp = sb + off;
+        add_d_len = (k < (add_sb_len - 1)) ? bp[1] : -1;
+        if (sfp->num_descs < SG_SENSE_MAX_DESCS)
+            sfp->desc_off[sfp->num_descs++] = off;
+        if ((bp[0] < 0xb) && (NULL == dp[bp[0]]))
+            dp[bp[0]] = bp;
+        if (add_d_len < 0)      /* short descriptor ?? */
+            break;
+    }
+    if ((bp = dp[0x0]) && (0xa == bp[1])) {     /* information */
+        sfp->info = sg_get_unaligned_be64(bp + 4);
+        sfp->info_valid = !!(0x80 & bp[2]);
+    }
+    if ((bp = dp[0x1]) && (0xa == bp[1])) {     /* command specific */
+        sfp->cmd_spec = sg_get_unaligned_be64(bp + 4);
+        sfp->cmd_spec_present = true;
+    }
+    if ((bp = dp[0x4]) && (bp[1] >= 2) && (0xe0 & bp[3])) {  /* stream */
+        sfp->fm_eom_ili_present = true;
+        sfp->filemark = !!(0x80 & bp[3]);
+        sfp->eom = !!(0x40 & bp[3]);
+        sfp->ili = !!(0x20 & bp[3]);
+    }
+    sk_pr = (SPC_SK_NO_SENSE == sfp->sense_key) ||
+            (SPC_SK_NOT_READY == sfp->sense_key);
+    if ((bp = dp[0x2]) && (0x6 == bp[1]) && (0x80 & bp[4])) {
+        sfp->sks_valid = true;                  /* sense key specific */
+        memcpy(sfp->sks, bp + 4, 3);
+        if (sk_pr) {
+            sfp->progress = sg_get_unaligned_be16(bp + 5);
+            sfp->progress_present = true;
+        }
+    }
+    if ((! sfp->progress_present) && (bp = dp[0xa]) && (0x6 == bp[1])) {
+        sfp->progress = sg_get_unaligned_be16(bp + 6);  /* progress */
+        sfp->progress_present = true;
+    }
+    return true;
+}
+
+/* See description in sg_lib.h header file */
+int
+sg_get_sense_fields_arr(const uint8_t * const * sbp_arr,
+                        const int * sb_len_arr, int num,
+                        struct sg_sense_fields * sf_arr)
+{
+    int k;
+    int n = 0;
+
+    for (k = 0; k < num; ++k) {
+        if (sg_get_sense_fields(sbp_arr[k], sb_len_arr[k], sf_arr + k))
+            ++n;
+    }
+    return n;
+}
+
+/* See description in sg_lib.h header file */
+bool
+sg_get_sense_ata_return_desc(const uint8_t * sbp, int sb_len, uint8_t * ardp)
+{
+    const uint8_t * bp;
+
+    memset(ardp, 0, SG_ATA_RETURN_DESC_LEN);
+    if ((NULL == sbp) || (sb_len < 8))
+        return false;
+    switch (0x7f & sbp[0]) {
+    case 0x70:          /* fixed format, SAT-2 and later */
+    case 0x71:
+        if (sb_len < 12)
+            return false;
+        ardp[0] = 0x9;
+        ardp[1] = SG_ATA_RETURN_DESC_LEN - 2;
+        ardp[2] = (0x80 & sbp[8]) ? 0x1 : 0x0;  /* EXTEND */
+        ardp[3] = sbp[3];       /* ERROR */
+        ardp[5] = sbp[6];       /* COUNT (7:0) */
+        ardp[7] = sbp[9];       /* LBA (7:0) */
+        ardp[9] = sbp[10];      /* LBA (15:8) */
+        ardp[11] = sbp[11];     /* LBA (23:16) */
+        ardp[12] = sbp[5];      /* DEVICE */
+        ardp[13] = sbp[4];      /* STATUS */
+        return true;
+    case 0x72:          /* descriptor format */
+    case 0x73:
+        bp = sg_scsi_sense_desc_find(sbp, sb_len, 0x9);
+        if ((NULL == bp) || (bp[1] < (SG_ATA_RETURN_DESC_LEN - 2)) ||
+            ((bp - sbp) + SG_ATA_RETURN_DESC_LEN > sb_len))
+            return false;
+        memcpy(ardp, bp, SG_ATA_RETURN_DESC_LEN);
+        return true;
+    default:
+        return false;
+    }
+}
+
 char *
 sg_get_pdt_str(int pdt, int buff_len, char * buff)
 {
@@ -2894,96 +3071,91 @@ trimTrailingSpaces(char * b)
     return n;
 }
 
+static const char hex_lc[] = "0123456789abcdef";  /* as "%x" outputs */
+
+/* Writes 'num' (1 to 16) bytes from 'bp' as ASCII hex to 'cp', each byte
+ * followed by a space, with an extra space after the 8th byte. Returns the
+ * number of characters written less the trailing space. */
+static int
+hex_line16(char * cp, const uint8_t * bp, int num)
+{
+    int k;
+    char * p = cp;
+
+    for (k = 0; k < num; ++k) {
+        if (8 == k)
+            *p++ = ' ';
+        *p++ = hex_lc[bp[k] >> 4];
+        *p++ = hex_lc[bp[k] & 0xf];
+        *p++ = ' ';
+    }
+    return (int)(p - cp) - 1;
+}
+
+/* Writes 'a' as "%.2x" would (without the trailing null) to 'cp'. Returns
+ * the number of characters written. */
+static int
+hex_addr(char * cp, uint32_t a)
+{
+    int k, n;
+
+    for (n = 2; (n < 8) && (a >> (4 * n)); ++n)
+        ;
+    for (k = n - 1; k >= 0; --k, a >>= 4)
+        cp[k] = hex_lc[a & 0xf];
+    return n;
+}
+
+#define DSHF_LINE_BLEN 80       /* longest line is 76 characters plus LF */
+#define DSHF_BLK_LINES 64       /* lines output by each fwrite() */
+
 /* Read binary starting at 'str' for 'len' bytes and output as ASCII
  * hexadecinal into file pointer (fp). 16 bytes per line are output with an
  * additional space between 8th and 9th byte on each line (for readability).
  * 'no_ascii' selects one of 3 output format types:
  *     > 0     each line has address then up to 16 ASCII-hex bytes
  *     = 0     in addition, the bytes are listed in ASCII to the right
- *     < 0     only the ASCII-hex bytes are listed (i.e. without address) */
+ *     < 0     only the ASCII-hex bytes are listed (i.e. without address)
+ * Lines are built with table lookups in a block buffer which is written
+ * with one fwrite() per DSHF_BLK_LINES lines. */
 void
 dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
 {
-    const char * p = str;
-    const char * formatstr;
-    uint8_t c;
-    char buff[82];
-    int a = 0;
-    int bpstart = 5;
+    const uint8_t * bp = (const uint8_t *)str;
+    const int bpstart = 8;      /* hex of first byte when address shown */
     const int cpstart = 60;
-    int cpos = cpstart;
-    int bpos = bpstart;
-    int i, k, blen;
+    int a, k, n, num;
+    char * lp;
+    char blk[DSHF_BLK_LINES * DSHF_LINE_BLEN];
 
     if (len <= 0)
         return;
-    blen = (int)sizeof(buff);
-    if (0 == no_ascii)  /* address at left and ASCII at right */
-        formatstr = "%.76s\n";
-    else                        /* previously when > 0 str was "%.58s\n" */
-        formatstr = "%s\n";     /* when < 0 str was: "%.48s\n" */
-    memset(buff, ' ', 80);
-    buff[80] = '\0';
-    if (no_ascii < 0) {
-        bpstart = 0;
-        bpos = bpstart;
-        for (k = 0; k < len; k++) {
-            c = *p++;
-            if (bpos == (bpstart + (8 * 3)))
-                bpos++;
-            sg_scn3pr(buff, blen, bpos, "%.2x", (int)(uint8_t)c);
-            buff[bpos + 2] = ' ';
-            if ((k > 0) && (0 == ((k + 1) % 16))) {
-                trimTrailingSpaces(buff);
-                fprintf(fp, formatstr, buff);
-                bpos = bpstart;
-                memset(buff, ' ', 80);
-            } else
-                bpos += 3;
-        }
-        if (bpos > bpstart) {
-            buff[bpos + 2] = '\0';
-            trimTrailingSpaces(buff);
-            fprintf(fp, "%s\n", buff);
-        }
-        return;
-    }
-    /* no_ascii>=0, start each line with address (offset) */
-    k = sg_scnpr(buff + 1, blen - 1, "%.2x", a);
-    buff[k + 1] = ' ';
-
-    for (i = 0; i < len; i++) {
-        c = *p++;
-        bpos += 3;
-        if (bpos == (bpstart + (9 * 3)))
-            bpos++;
-        sg_scn3pr(buff, blen, bpos, "%.2x", (int)(uint8_t)c);
-        buff[bpos + 2] = ' ';
-        if (no_ascii)
-            buff[cpos++] = ' ';
+    for (a = 0, n = 0; a < len; a += 16, bp += 16) {
+        num = ((len - a) < 16) ? (len - a) : 16;
+        lp = blk + n;
+        if (no_ascii < 0)
+            n += hex_line16(lp, bp, num);
         else {
-            if (! my_isprint(c))
-                c = '.';
-            buff[cpos++] = c;
-        }
-        if (cpos > (cpstart + 15)) {
+            memset(lp, ' ', cpstart + 16);
+            /* a long address may be overwritten by the hex that follows */
+            hex_addr(lp + 1, a);
+            k = hex_line16(lp + bpstart, bp, num);
             if (no_ascii)
-                trimTrailingSpaces(buff);
-            fprintf(fp, formatstr, buff);
-            bpos = bpstart;
-            cpos = cpstart;
-            a += 16;
-            memset(buff, ' ', 80);
-            k = sg_scnpr(buff + 1, blen - 1, "%.2x", a);
-            buff[k + 1] = ' ';
+                n += bpstart + k;
+            else {
+                for (k = 0; k < num; ++k)
+                    lp[cpstart + k] = my_isprint(bp[k]) ? bp[k] : '.';
+                n += cpstart + num;
+            }
+        }
+        blk[n++] = '\n';
+        if (n > (int)sizeof(blk) - DSHF_LINE_BLEN) {
+            fwrite(blk, 1, n, fp);
+            n = 0;
         }
     }
-    if (cpos > cpstart) {
-        buff[cpos] = '\0';
-        if (no_ascii)
-            trimTrailingSpaces(buff);
-        fprintf(fp, "%s\n", buff);
-    }
+    if (n > 0)
+        fwrite(blk, 1, n, fp);
 }
 
 void
@@ -3017,12 +3189,9 @@ dStrHexStr(const char * str, int len, const char * leadin, int oformat,
            int b_len, char * b)
 {
     bool want_ascii = (0 == oformat);
-    int bpstart, bpos, k, n, prior_ascii_len;
-    char buff[DSHS_LINE_BLEN + 2];      /* allow for trailing null */
-    char a[DSHS_BPL + 1];               /* printable ASCII bytes or '.' */
-    const char * p = str;
-    const char * lf_or = (oformat > 1) ? "  " : "\n";
-    static const int bufflen = sizeof(buff);
+    int bpstart, k, m, n, num, prior_ascii_len;
+    char buff[DSHS_LINE_BLEN + 2];
+    const uint8_t * bp = (const uint8_t *)str;
 
     if (len <= 0) {
         if (b_len > 0)
@@ -3031,10 +3200,7 @@ dStrHexStr(const char * str, int len, const char * leadin, int oformat,
     }
     if (b_len <= 0)
         return 0;
-    if (want_ascii) {
-        memset(a, ' ', DSHS_BPL);
-        a[DSHS_BPL] = '\0';
-    }
+    b[0] = '\0';
     n = 0;
     bpstart = 0;
     if (leadin) {
@@ -3045,49 +3211,34 @@ dStrHexStr(const char * str, int len, const char * leadin, int oformat,
             /* Cap leadin at (DSHS_LINE_BLEN - 70) characters */
             if (bpstart > (DSHS_LINE_BLEN - 70))
                 bpstart = DSHS_LINE_BLEN - 70;
+            memcpy(buff, leadin, bpstart);
         }
     }
-    bpos = bpstart;
     prior_ascii_len = bpstart + (DSHS_BPL * 3) + 1;
-    memset(buff, ' ', DSHS_LINE_BLEN);
-    buff[DSHS_LINE_BLEN] = '\0';
-    if (bpstart > 0)
-        memcpy(buff, leadin, bpstart);
-    for (k = 0; k < len; k++) {
-        uint8_t c = *p++;
-
-        if (bpos == (bpstart + ((DSHS_BPL / 2) * 3)))
-            bpos++;     /* for extra space in middle of each line's hex */
-        sg_scn3pr(buff, bufflen, bpos, "%.2x", (int)(uint8_t)c);
-        buff[bpos + 2] = ' ';
-        if (want_ascii)
-            a[k % DSHS_BPL] = my_isprint(c) ? c : '.';
-        if ((k > 0) && (0 == ((k + 1) % DSHS_BPL))) {
-            trimTrailingSpaces(buff);
-            if (want_ascii) {
-                n += sg_scn3pr(b, b_len, n, "%-*s   %s\n", prior_ascii_len,
-                               buff, a);
-                memset(a, ' ', DSHS_BPL);
-            } else
-                n += sg_scn3pr(b, b_len, n, "%s%s", buff, lf_or);
-            if (n >= (b_len - 1))
-                goto fini;
-            memset(buff, ' ', DSHS_LINE_BLEN);
-            bpos = bpstart;
-            if (bpstart > 0)
-                memcpy(buff, leadin, bpstart);
+    for ( ; len > 0; len -= num, bp += num) {
+        if (n >= (b_len - 1))
+            break;
+        num = (len < DSHS_BPL) ? len : DSHS_BPL;
+        m = bpstart + hex_line16(buff + bpstart, bp, num);
+        if (want_ascii) {
+            memset(buff + m, ' ', prior_ascii_len + 3 - m);
+            m = prior_ascii_len + 3;
+            for (k = 0; k < DSHS_BPL; ++k)
+                buff[m++] = (k >= num) ? ' ' :
+                            (my_isprint(bp[k]) ? bp[k] : '.');
+            buff[m++] = '\n';
+        } else if (oformat > 1) {
+            buff[m++] = ' ';
+            buff[m++] = ' ';
         } else
-            bpos += 3;
+            buff[m++] = '\n';
+        /* truncate, as snprintf() would, when 'b' is full */
+        if (m > (b_len - 1 - n))
+            m = b_len - 1 - n;
+        memcpy(b + n, buff, m);
+        n += m;
+        b[n] = '\0';
     }
-    if (bpos > bpstart) {
-        trimTrailingSpaces(buff);
-        if (want_ascii)
-            n += sg_scn3pr(b, b_len, n, "%-*s   %s\n", prior_ascii_len, buff,
-                           a);
-        else
-            n += sg_scn3pr(b, b_len, n, "%s%s", buff, lf_or);
-    }
-fini:
     if (oformat > 1)
         n = trimTrailingSpaces(b);
     return n;
@@ -3112,21 +3263,25 @@ hex2str(const uint8_t * b_str, int len, const char * leadin, int oformat,
     return dStrHexStr((const char *)b_str, len, leadin, oformat, b_len, b);
 }
 
+#define H2FP_BPC 1024         /* bytes per chunk when oformat is 0 or 1 */
+
 void
 hex2fp(const uint8_t * b_str, int len, const char * leadin, int oformat,
        FILE * fp)
 {
-    int k, num;
-    char b[800];        /* allow for 4 lines of 16 bytes (in hex) each */
+    int k, n, num, bpc;
+    char b[(H2FP_BPC / DSHS_BPL) * DSHS_LINE_BLEN + 1];
 
     if (leadin && (strlen(leadin) > 118)) {
         fprintf(fp, ">>> leadin parameter is too large\n");
         return;
     }
+    /* oformat 2 output has leadin once per chunk so keep those at 64 bytes */
+    bpc = (oformat > 1) ? 64 : H2FP_BPC;
     for (k = 0; k < len; k += num) {
-        num = ((k + 64) < len) ? 64 : (len - k);
-        hex2str(b_str + k, num, leadin, oformat, sizeof(b), b);
-        fprintf(fp, "%s", b);
+        num = ((k + bpc) < len) ? bpc : (len - k);
+        n = hex2str(b_str + k, num, leadin, oformat, sizeof(b), b);
+        fwrite(b, 1, n, fp);
     }
 }
 
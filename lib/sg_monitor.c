@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2023 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#include <time.h>
+#elif defined(HAVE_GETTIMEOFDAY)
+#include <sys/time.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_json.h"
+#include "sg_monitor.h"
+#include "sg_pr2serr.h"
+
+#if defined(SG_LIB_WIN32)
+#include <windows.h>
+#endif
+
+#define SG_MON_DEF_MIN_MS 1000
+#define SG_MON_DEF_MAX_MS 60000
+#define SG_MON_PROG_FULL 65536  /* progress indication is out of this */
+#define SG_MON_PROG_STEP 655    /* about 1% of SG_MON_PROG_FULL */
+#define SG_MON_RS_LEN 252
+
+struct sg_mon_dev {
+    bool desc;
+    bool finished;
+    int sg_fd;
+    int poll_type;
+    int res;
+    int progress;       /* last seen, -1 if none yet */
+    int first_prog;     /* first progress seen in current phase */
+    int num_polls;
+    uint32_t interval_ms;
+    uint32_t eta_ms;
+    uint64_t add_ms;
+    uint64_t due_ms;
+    uint64_t first_prog_ms;
+    uint64_t last_chg_ms;       /* time progress last changed */
+    const char * dev_name;
+    const char * op_name;
+};
+
+struct sg_monitor {
+    int num;
+    int max;
+    int verbose;
+    uint32_t min_ms;
+    uint32_t max_ms;
+    sgj_state * jsp;
+    sgj_opaque_p jop;
+    sgj_opaque_p jap;   /* "monitor_event_list" array, created when needed */
+    struct sg_mon_dev * devs;
+};
+
+static const char * sg_mon_ev_arr[] = {"start", "progress", "done", "error",
+                                       "timeout"};
+
+
+static uint64_t
+sg_mon_now_ms(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (0 == clock_gettime(CLOCK_MONOTONIC, &ts))
+        return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+    return 0;
+#elif defined(HAVE_GETTIMEOFDAY)
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+#else
+    return (uint64_t)time(NULL) * 1000;
+#endif
+}
+
+static void
+sg_mon_sleep_ms(uint32_t ms)
+{
+#if defined(SG_LIB_WIN32)
+    Sleep(ms);
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec wait_period, rem;
+
+    wait_period.tv_sec = ms / 1000;
+    wait_period.tv_nsec = (ms % 1000) * 1000000;
+    while ((nanosleep(&wait_period, &rem) < 0) && (EINTR == errno))
+        wait_period = rem;
+#else
+    sg_sleep_secs((ms + 999) / 1000);
+#endif
+}
+
+struct sg_monitor *
+sg_mon_create(int min_ms, int max_ms, sgj_state * jsp, sgj_opaque_p jop,
+              int verbose)
+{
+    struct sg_monitor * mp;
+
+    mp = (struct sg_monitor *)calloc(1, sizeof(struct sg_monitor));
+    if (NULL == mp)
+        return NULL;
+    mp->min_ms = (min_ms > 0) ? (uint32_t)min_ms : SG_MON_DEF_MIN_MS;
+    mp->max_ms = (max_ms > 0) ? (uint32_t)max_ms : SG_MON_DEF_MAX_MS;
+    if (mp->max_ms < mp->min_ms)
+        mp->max_ms = mp->min_ms;
+    if (jsp && jsp->pr_as_json) {
+        mp->jsp = jsp;
+        mp->jop = jop;
+    }
+    mp->verbose = verbose;
+    return mp;
+}
+
+void
+sg_mon_destroy(struct sg_monitor * mp)
+{
+    if (mp) {
+        free(mp->devs);
+        free(mp);
+    }
+}
+
+int
+sg_mon_add(struct sg_monitor * mp, int sg_fd, const char * dev_name,
+           const char * op_name, int poll_type, bool desc, int first_ms)
+{
+    struct sg_mon_dev * dp;
+
+    if ((NULL == mp) || (sg_fd < 0))
+        return -1;
+    if (mp->num >= mp->max) {
+        int new_max = (mp->max > 0) ? (2 * mp->max) : 8;
+
+        dp = (struct sg_mon_dev *)realloc(mp->devs,
+                                          new_max * sizeof(*dp));
+        if (NULL == dp)
+            return -1;
+        mp->devs = dp;
+        mp->max = new_max;
+    }
+    dp = mp->devs + mp->num;
+    memset(dp, 0, sizeof(*dp));
+    dp->sg_fd = sg_fd;
+    dp->dev_name = dev_name ? dev_name : "";
+    dp->op_name = op_name ? op_name : "Operation";
+    dp->poll_type = poll_type;
+    dp->desc = desc;
+    dp->progress = -1;
+    dp->first_prog = -1;
+    dp->interval_ms = mp->min_ms;
+    dp->add_ms = sg_mon_now_ms();
+    dp->due_ms = dp->add_ms + ((first_ms > 0) ? (uint32_t)first_ms :
+                                                mp->min_ms);
+    return mp->num++;
+}
+
+char *
+sg_mon_event_str(const struct sg_mon_event * evp, int blen, char * b)
+{
+    int n = 0;
+    uint32_t e;
+    char c[80];
+
+    if ((NULL == b) || (blen < 1))
+        return b;
+    n += sg_scnpr(b + n, blen - n, "%s: %s ", evp->dev_name, evp->op_name);
+    switch (evp->type) {
+    case SG_MON_EV_DONE:
+        n += sg_scnpr(b + n, blen - n, "complete");
+        break;
+    case SG_MON_EV_ERROR:
+        sg_get_category_sense_str(evp->res, sizeof(c), c, 0);
+        n += sg_scnpr(b + n, blen - n, "failed: %s", c);
+        break;
+    case SG_MON_EV_TIMEOUT:
+        n += sg_scnpr(b + n, blen - n, "still running when monitor timed "
+                      "out");
+        break;
+    default:
+        n += sg_scnpr(b + n, blen - n, "in progress");
+        break;
+    }
+    if (evp->progress >= 0)
+        n += sg_scnpr(b + n, blen - n, ", %d.%02d%% done",
+                      (evp->progress * 100) / SG_MON_PROG_FULL,
+                      ((evp->progress * 100) % SG_MON_PROG_FULL) / 656);
+    if (((SG_MON_EV_START == evp->type) || (SG_MON_EV_PROGRESS == evp->type))
+        && (evp->eta_ms > 0)) {
+        e = (evp->eta_ms + 999) / 1000;
+        n += sg_scnpr(b + n, blen - n, ", about %u:%02u:%02u remaining",
+                      e / 3600, (e / 60) % 60, e % 60);
+    }
+    if (evp->elapsed_ms > 0) {
+        e = evp->elapsed_ms / 1000;
+        sg_scnpr(b + n, blen - n, " [elapsed %u:%02u:%02u]", e / 3600,
+                 (e / 60) % 60, e % 60);
+    }
+    return b;
+}
+
+static void
+sg_mon_event_js(struct sg_monitor * mp, const struct sg_mon_event * evp)
+{
+    sgj_state * jsp = mp->jsp;
+    sgj_opaque_p jo2p;
+    char b[80];
+
+    if (NULL == mp->jap) {
+        /* streamed if the caller called sgj_stream_start() */
+        mp->jap = sgj_named_subarray_stream_r(jsp, mp->jop,
+                                              "monitor_event_list");
+        if (NULL == mp->jap)
+            return;
+    }
+    jo2p = sgj_new_unattached_object_r(jsp);
+    if (NULL == jo2p)
+        return;
+    sgj_js_nv_s(jsp, jo2p, "event", sg_mon_ev_arr[evp->type]);
+    sgj_js_nv_s(jsp, jo2p, "device", evp->dev_name);
+    sgj_js_nv_s(jsp, jo2p, "operation", evp->op_name);
+    sgj_js_nv_i(jsp, jo2p, "progress_indication", evp->progress);
+    if (evp->progress >= 0)
+        sgj_js_nv_i(jsp, jo2p, "percent_done",
+                    (evp->progress * 100) / SG_MON_PROG_FULL);
+    sgj_js_nv_i(jsp, jo2p, "elapsed_ms", evp->elapsed_ms);
+    sgj_js_nv_i(jsp, jo2p, "eta_ms", evp->eta_ms);
+    sgj_js_nv_i(jsp, jo2p, "poll_interval_ms", evp->next_poll_ms);
+    sgj_js_nv_i(jsp, jo2p, "number_of_polls", evp->num_polls);
+    sgj_js_nv_i(jsp, jo2p, "result", evp->res);
+    if (evp->res) {
+        sg_get_category_sense_str(evp->res, sizeof(b), b, 0);
+        sgj_js_nv_s(jsp, jo2p, "result_string", b);
+    }
+    sgj_js_nv_o(jsp, mp->jap, NULL /* name */, jo2p);
+}
+
+static void
+sg_mon_emit(struct sg_monitor * mp, int idx, int type, uint64_t now,
+            sg_mon_event_f event_fn, void * ctxp)
+{
+    const struct sg_mon_dev * dp = mp->devs + idx;
+    struct sg_mon_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = type;
+    ev.idx = idx;
+    ev.progress = dp->progress;
+    ev.res = dp->res;
+    ev.num_polls = dp->num_polls;
+    ev.elapsed_ms = (uint32_t)(now - dp->add_ms);
+    ev.eta_ms = dp->eta_ms;
+    ev.next_poll_ms = dp->finished ? 0 : dp->interval_ms;
+    ev.dev_name = dp->dev_name;
+    ev.op_name = dp->op_name;
+    if (mp->jsp)
+        sg_mon_event_js(mp, &ev);
+    if (event_fn)
+        event_fn(ctxp, &ev);
+}
+
+/* Given a new progress indication (or -1) at time 'now' update the poll
+ * interval and the estimated time to completion. The rate is measured from
+ * the first indication seen in this phase so a single slow or fast poll
+ * does not swing the estimate. A lower indication than last time starts a
+ * new phase (e.g. the next pass of a multi-pass SANITIZE). The interval
+ * aims at about 1% of progress per poll, backs off (doubles) while there
+ * is no change and is never more than half of the estimated remaining
+ * time, so completion is noticed promptly. Returns true if the progress
+ * indication changed. */
+static bool
+sg_mon_adapt(const struct sg_monitor * mp, struct sg_mon_dev * dp,
+             int progress, uint64_t now)
+{
+    bool changed = (progress >= 0) && (progress != dp->progress);
+    uint64_t iv = dp->interval_ms;
+    uint64_t span, remain;
+
+    if (progress < 0)   /* e.g. becoming ready, keep last indication */
+        iv *= 2;
+    else if ((dp->first_prog < 0) || (progress < dp->progress)) {
+        dp->first_prog = progress;      /* start of (new) phase */
+        dp->first_prog_ms = now;
+        dp->last_chg_ms = now;
+        dp->progress = progress;
+        dp->eta_ms = 0;
+        iv = mp->min_ms;
+    } else if (progress > dp->progress) {
+        dp->progress = progress;
+        dp->last_chg_ms = now;
+        span = now - dp->first_prog_ms;
+        if ((span > 0) && (progress > dp->first_prog)) {
+            /* eta = remaining units / (units per ms) */
+            remain = SG_MON_PROG_FULL - progress;
+            dp->eta_ms = (uint32_t)((remain * span) /
+                                    (progress - dp->first_prog));
+            iv = (SG_MON_PROG_STEP * span) / (progress - dp->first_prog);
+        }
+    } else
+        iv *= 2;        /* no change: back off */
+
+    if (dp->eta_ms > 0) {
+        /* eta counts down from when progress last changed */
+        remain = now - dp->last_chg_ms;
+        remain = (remain < dp->eta_ms) ? (dp->eta_ms - remain) : 0;
+        if (iv > (remain / 2))
+            iv = remain / 2;
+    }
+    if (iv < mp->min_ms)
+        iv = mp->min_ms;
+    if (iv > mp->max_ms)
+        iv = mp->max_ms;
+    dp->interval_ms = (uint32_t)iv;
+    return changed;
+}
+
+/* Sends one poll to the device. Returns SG_MON_EV_START (meaning still
+ * running), SG_MON_EV_DONE or SG_MON_EV_ERROR. Sets dp->res . */
+static int
+sg_mon_poll(const struct sg_monitor * mp, struct sg_mon_dev * dp,
+            int * progressp)
+{
+    int res, cat, resp_len;
+    int vb = (mp->verbose > 1) ? (mp->verbose - 1) : 0;
+    struct sg_scsi_sense_hdr ssh;
+    uint8_t rs_b[SG_MON_RS_LEN];
+
+    *progressp = -1;
+    ++dp->num_polls;
+    if (SG_MON_POLL_TUR == dp->poll_type) {
+        res = sg_ll_test_unit_ready_progress(dp->sg_fd, dp->num_polls,
+                                             progressp, false, vb);
+        dp->res = res;
+        if (*progressp >= 0)
+            return SG_MON_EV_START;
+        switch (res) {
+        case 0:
+            return SG_MON_EV_DONE;
+        case SG_LIB_CAT_UNIT_ATTENTION:
+            return SG_MON_EV_START;
+        case SG_LIB_CAT_NOT_READY:
+            /* no progress in TUR sense, REQUEST SENSE may report it */
+            if (mp->verbose)
+                pr2serr("%s: %s: TUR not ready, poll with REQUEST SENSE\n",
+                        __func__, dp->dev_name);
+            dp->poll_type = SG_MON_POLL_RS;
+            break;
+        default:
+            return SG_MON_EV_ERROR;
+        }
+    }
+    memset(rs_b, 0, sizeof(rs_b));
+    res = sg_ll_request_sense(dp->sg_fd, dp->desc, rs_b, sizeof(rs_b), false,
+                              vb);
+    if ((SG_LIB_CAT_ILLEGAL_REQ == res) && dp->desc) {
+        dp->desc = false;       /* descriptor sense may not be supported */
+        res = sg_ll_request_sense(dp->sg_fd, false, rs_b, sizeof(rs_b),
+                                  false, vb);
+    }
+    dp->res = res;
+    if (res)
+        return SG_MON_EV_ERROR;
+    /* "Additional sense length" same in descriptor and fixed */
+    resp_len = rs_b[7] + 8;
+    if (resp_len > (int)sizeof(rs_b))
+        resp_len = sizeof(rs_b);
+    if (sg_get_sense_progress_fld(rs_b, resp_len, progressp))
+        return SG_MON_EV_START;
+    if (! sg_scsi_normalize_sense(rs_b, resp_len, &ssh))
+        return SG_MON_EV_DONE;  /* no sense data: finished */
+    cat = sg_err_category_sense(rs_b, resp_len);
+    switch (cat) {
+    case SG_LIB_CAT_NO_SENSE:
+    case SG_LIB_CAT_RECOVERED:
+    case SG_LIB_CAT_UNIT_ATTENTION:
+        return SG_MON_EV_DONE;
+    case SG_LIB_CAT_NOT_READY:
+        /* logical unit is in process of becoming ready */
+        if ((0x4 == ssh.asc) && (0x1 == ssh.ascq))
+            return SG_MON_EV_START;
+        /* fall through */
+    default:
+        dp->res = cat;  /* e.g. medium format corrupted */
+        return SG_MON_EV_ERROR;
+    }
+}
+
+int
+sg_mon_run(struct sg_monitor * mp, int timeout_secs, sg_mon_event_f event_fn,
+           void * ctxp)
+{
+    bool changed;
+    int k, st, progress, num_active;
+    int ret = 0;
+    uint64_t now, next, deadline;
+    struct sg_mon_dev * dp;
+
+    if (NULL == mp)
+        return SG_LIB_CAT_OTHER;
+    now = sg_mon_now_ms();
+    deadline = (timeout_secs > 0) ? (now + (uint64_t)timeout_secs * 1000) :
+                                    0;
+    while (true) {
+        now = sg_mon_now_ms();
+        next = 0;
+        for (num_active = 0, k = 0; k < mp->num; ++k) {
+            dp = mp->devs + k;
+            if (dp->finished)
+                continue;
+            if (deadline && (now >= deadline)) {
+                dp->finished = true;
+                dp->res = SG_LIB_CAT_TIMEOUT;
+                sg_mon_emit(mp, k, SG_MON_EV_TIMEOUT, now, event_fn, ctxp);
+                continue;
+            }
+            ++num_active;
+            if (dp->due_ms > now) {
+                if ((0 == next) || (dp->due_ms < next))
+                    next = dp->due_ms;
+                continue;
+            }
+            st = sg_mon_poll(mp, dp, &progress);
+            now = sg_mon_now_ms();
+            if (SG_MON_EV_START == st) {
+                changed = sg_mon_adapt(mp, dp, progress, now);
+                dp->due_ms = now + dp->interval_ms;
+                if (1 == dp->num_polls)
+                    sg_mon_emit(mp, k, SG_MON_EV_START, now, event_fn, ctxp);
+                else if (changed)
+                    sg_mon_emit(mp, k, SG_MON_EV_PROGRESS, now, event_fn,
+                                ctxp);
+                if (mp->verbose > 1)
+                    pr2serr("%s: %s: progress=%d, next poll in %u ms\n",
+                            __func__, dp->dev_name, progress,
+                            dp->interval_ms);
+                if ((0 == next) || (dp->due_ms < next))
+                    next = dp->due_ms;
+            } else {
+                dp->finished = true;
+                dp->progress = -1;
+                dp->eta_ms = 0;
+                if (SG_MON_EV_DONE == st)
+                    dp->res = 0;
+                sg_mon_emit(mp, k, st, now, event_fn, ctxp);
+                --num_active;
+            }
+        }
+        if (num_active < 1)
+            break;
+        if (deadline && ((0 == next) || (next > deadline)))
+            next = deadline;
+        now = sg_mon_now_ms();
+        if (next > now)
+            sg_mon_sleep_ms((uint32_t)(next - now));
+    }
+    for (k = 0; k < mp->num; ++k) {
+        if (mp->devs[k].res) {
+            ret = mp->devs[k].res;
+            break;
+        }
+    }
+    return ret;
+}
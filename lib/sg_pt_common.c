@@ -31,7 +31,7 @@
 #include "sg_pt_nvme.h"
 #endif
 
-static const char * scsi_pt_version_str = "3.20 20230311";
+static const char * scsi_pt_version_str = "3.21 20231031";
 
 /* List of external functions that need to be defined for each OS are
  * listed at the top of sg_pt_dummy.c   */
@@ -97,6 +97,8 @@ static struct sg_opcode_info_t sg_opcode_info_arr[] =
     {0x41, 0, 0, {10,            /* WRITE SAME(10) */
       0xff, 0xff, 0xff, 0xff, 0xff, 0x3f, 0xff, 0xff, 0xc7, 0, 0, 0, 0,
       0, 0} },
+    {0x42, 0, 0, {10,            /* UNMAP */
+      0x0, 0, 0, 0, 0, 0x3f, 0xff, 0xff, 0xc7, 0, 0, 0, 0, 0, 0} },
     {0x55, 0, 0, {10,           /* MODE SELECT(10) */
       0x13, 0x0, 0x0, 0x0, 0x0, 0x0, 0xff, 0xff, 0xc7, 0, 0, 0, 0, 0, 0} },
     {0x5a, 0, 0, {10,           /* MODE SENSE(10) */
@@ -104,6 +106,9 @@ static struct sg_opcode_info_t sg_opcode_info_arr[] =
     {0x88, 0, 0, {16,            /* READ(16) */
       0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
       0xff, 0xff, 0xff, 0xc7} },
+    {0x89, 0, 0, {16,            /* COMPARE AND WRITE */
+      0xf8, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0, 0,
+      0xff, 0x3f, 0xc7} },
     {0x8a, 0, 0, {16,            /* WRITE(16) */
       0xfb, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
       0xff, 0xff, 0xff, 0xc7} },
@@ -119,6 +124,9 @@ static struct sg_opcode_info_t sg_opcode_info_arr[] =
     {0x9e, 0x10, F_SA_LOW, {16,  /* READ CAPACITY(16) [service action in] */
       0x10, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
       0xff, 0xff, 0x1, 0xc7} },
+    {0x9e, 0x12, F_SA_LOW, {16,  /* GET LBA STATUS(16) [service action in] */
+      0x12, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xc7} },
     {0xa0, 0, 0, {12,           /* REPORT LUNS */
       0xe3, 0xff, 0, 0, 0, 0xff, 0xff, 0xff, 0xff, 0, 0xc7, 0, 0, 0, 0} },
     {0xa3, 0xc, F_SA_LOW, {12,  /* REPORT SUPPORTED OPERATION CODES */
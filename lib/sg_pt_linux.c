@@ -7,7 +7,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
-/* sg_pt_linux version 1.56 20230412 */
+/* sg_pt_linux version 1.57 20231031 */
 
 
 #include <stdio.h>
@@ -468,6 +468,8 @@ destruct_scsi_pt_obj(struct sg_pt_base * vp)
             ptp->free_nvme_id_ctlp = NULL;
             ptp->nvme_id_ctlp = NULL;
         }
+        if (ptp->nvme_uringp)
+            sg_nvme_uring_release(ptp);
         if (vp)
             free(vp);
     }
@@ -484,6 +486,7 @@ clear_scsi_pt_obj(struct sg_pt_base * vp)
         int fd;
         uint32_t nvme_nsid;
         struct sg_sntl_dev_state_t dev_stat;
+        void * nvme_uringp;
 
         fd = ptp->dev_fd;
         is_sg = ptp->is_sg;
@@ -491,6 +494,7 @@ clear_scsi_pt_obj(struct sg_pt_base * vp)
         is_nvme = ptp->is_nvme;
         nvme_nsid = ptp->nvme_nsid;
         dev_stat = ptp->dev_stat;
+        nvme_uringp = ptp->nvme_uringp;
         if (ptp->free_nvme_id_ctlp)
             free(ptp->free_nvme_id_ctlp);
         memset(ptp, 0, sizeof(struct sg_pt_linux_scsi));
@@ -508,6 +512,7 @@ clear_scsi_pt_obj(struct sg_pt_base * vp)
         ptp->nvme_our_sntl = false;
         ptp->nvme_nsid = nvme_nsid;
         ptp->dev_stat = dev_stat;
+        ptp->nvme_uringp = nvme_uringp;
     }
 }
 
@@ -41,7 +41,7 @@
  *                   MA 02110-1301, USA.
  */
 
-/* sg_pt_linux_nvme version 1.19 20230514 */
+/* sg_pt_linux_nvme version 1.23 20231031 */
 
 /* This file contains a small "SPC-only" SNTL to support the SES pass-through
  * of SEND DIAGNOSTIC and RECEIVE DIAGNOSTIC RESULTS through NVME-MI
@@ -57,6 +57,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #include <sys/ioctl.h>
@@ -75,6 +76,17 @@
 #include <linux/major.h>
 #endif
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_NVME_URING_CMD
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/nvme_ioctl.h>   /* for NVME_URING_CMD_IO */
+#endif
+
 #include "sg_pt.h"
 #include "sg_lib.h"
 #include "sg_linux_inc.h"
@@ -105,8 +117,11 @@
 #define SCSI_WRITE16_OPC 0x8a
 #define SCSI_WRITE_SAME10_OPC 0x41
 #define SCSI_WRITE_SAME16_OPC 0x93
+#define SCSI_UNMAP_OPC 0x42
+#define SCSI_COMPARE_AND_WRITE_OPC 0x89
 #define SCSI_SERVICE_ACT_IN_OPC  0x9e
 #define SCSI_READ_CAPACITY16_SA  0x10
+#define SCSI_GET_LBA_STATUS16_SA  0x12
 #define SCSI_SA_MSK  0x1f
 
 /* Additional Sense Code (ASC) */
@@ -147,6 +162,7 @@
 #define SG_NVME_AD_DEV_SELT_TEST 0x14
 #define SG_NVME_AD_MI_RECEIVE 0x1e      /* MI: Management Interface */
 #define SG_NVME_AD_MI_SEND 0x1d         /* hmmm, same opcode as SEND DIAG */
+#define SG_NVME_AD_GET_LBA_STATUS 0x86  /* SCSI GET LBA STATUS, RT=0x10 */
 
 /* NVMe NVM (Non-Volatile Memory) commands */
 #define SG_NVME_NVM_FLUSH 0x0           /* SCSI SYNCHRONIZE CACHE */
@@ -155,6 +171,10 @@
 #define SG_NVME_NVM_VERIFY 0xc          /* SCSI VERIFY(BYTCHK=0) */
 #define SG_NVME_NVM_WRITE 0x1
 #define SG_NVME_NVM_WRITE_ZEROES 0x8    /* SCSI WRITE SAME */
+#define SG_NVME_NVM_DSM 0x9             /* SCSI UNMAP: Dataset Management */
+
+#define SG_NVME_DSM_ATTR_AD 0x4         /* DSM: Attribute - Deallocate */
+#define SG_NVME_DSM_MAX_RANGES 256      /* DSM: ranges per command */
 
 #define SG_NVME_RW_CONTROL_FUA (1 << 14) /* Force Unit Access bit */
 
@@ -294,6 +314,492 @@ mk_sense_invalid_fld(struct sg_pt_linux_scsi * ptp, bool in_cdb, int in_byte,
               ((in_bit > 0) ? (0x7 & in_bit) : 0));
 }
 
+/* Identify controller (CNS 1) and Identify namespace (CNS 0) responses are
+ * kept in a small process wide cache shared by all pt objects so that a
+ * utility that builds a pt object per command does not pay an extra NVMe
+ * Admin round trip per command. Entries are keyed by the device number of
+ * the open file, the CNS and the namespace id. User space does not see
+ * NVMe asynchronous events so entries for a device are dropped when a
+ * command to it fails with an OS error or a generic command status (e.g.
+ * "Invalid namespace or format"), when an Admin command that may change
+ * what Identify reports succeeds (e.g. Format NVM or Namespace Management)
+ * and after SNTL_ID_CACHE_SECS seconds. */
+#define SNTL_ID_CACHE_ELEMS 8
+#define SNTL_ID_CACHE_SECS 30
+#define SNTL_ID_RESP_LEN 4096   /* Identify response is always 4 KiB */
+
+struct sntl_id_cache_t {
+    dev_t rdev;
+    uint32_t nsid;
+    int cns;
+    time_t when;                /* 0 when this element is unused */
+    uint8_t resp[SNTL_ID_RESP_LEN];
+};
+
+static struct sntl_id_cache_t sntl_id_cache[SNTL_ID_CACHE_ELEMS];
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t sntl_id_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define SNTL_ID_CACHE_LOCK() pthread_mutex_lock(&sntl_id_cache_mutex)
+#define SNTL_ID_CACHE_UNLOCK() pthread_mutex_unlock(&sntl_id_cache_mutex)
+#else
+#define SNTL_ID_CACHE_LOCK()
+#define SNTL_ID_CACHE_UNLOCK()
+#endif
+
+static bool
+sntl_id_cache_rdev(const struct sg_pt_linux_scsi * ptp, dev_t * rdevp)
+{
+    struct stat a_stat;
+
+    if ((ptp->dev_fd < 0) || (fstat(ptp->dev_fd, &a_stat) < 0))
+        return false;
+    *rdevp = a_stat.st_rdev;
+    return true;
+}
+
+/* Returns true and copies the cached response to 'up' on a hit */
+static bool
+sntl_id_cache_get(struct sg_pt_linux_scsi * ptp, int cns, uint32_t nsid,
+                  int u_len, uint8_t * up, int vb)
+{
+    bool found = false;
+    int k;
+    time_t now;
+    dev_t rdev;
+    struct sntl_id_cache_t * cp;
+
+    if (((0x0 != cns) && (0x1 != cns)) || (u_len < SNTL_ID_RESP_LEN) ||
+        (! sntl_id_cache_rdev(ptp, &rdev)))
+        return false;
+    now = time(NULL);
+    SNTL_ID_CACHE_LOCK();
+    for (k = 0, cp = sntl_id_cache; k < SNTL_ID_CACHE_ELEMS; ++k, ++cp) {
+        if ((0 == cp->when) || (cp->rdev != rdev) || (cp->cns != cns) ||
+            (cp->nsid != nsid))
+            continue;
+        if ((now - cp->when) > SNTL_ID_CACHE_SECS)
+            cp->when = 0;       /* expired */
+        else {
+            memcpy(up, cp->resp, SNTL_ID_RESP_LEN);
+            found = true;
+        }
+        break;
+    }
+    SNTL_ID_CACHE_UNLOCK();
+    if (found) {
+        ptp->os_err = 0;
+        ptp->nvme_status = 0;
+        ptp->nvme_result = 0;
+        if (vb > 4)
+            pr2ws("%s: Identify CNS=%d, nsid=%u from cache\n", __func__,
+                  cns, nsid);
+    }
+    return found;
+}
+
+static void
+sntl_id_cache_put(const struct sg_pt_linux_scsi * ptp, int cns,
+                  uint32_t nsid, int u_len, const uint8_t * up)
+{
+    int k;
+    dev_t rdev;
+    struct sntl_id_cache_t * cp;
+    struct sntl_id_cache_t * oldp = NULL;
+
+    if (((0x0 != cns) && (0x1 != cns)) || (u_len < SNTL_ID_RESP_LEN) ||
+        (! sntl_id_cache_rdev(ptp, &rdev)))
+        return;
+    SNTL_ID_CACHE_LOCK();
+    /* use the matching element, else an unused one, else the oldest */
+    for (k = 0, cp = sntl_id_cache; k < SNTL_ID_CACHE_ELEMS; ++k, ++cp) {
+        if ((cp->when > 0) && (cp->rdev == rdev) && (cp->cns == cns) &&
+            (cp->nsid == nsid)) {
+            oldp = cp;
+            break;
+        }
+        if ((NULL == oldp) || (oldp->when > cp->when))
+            oldp = cp;
+    }
+    oldp->rdev = rdev;
+    oldp->cns = cns;
+    oldp->nsid = nsid;
+    oldp->when = time(NULL);
+    memcpy(oldp->resp, up, SNTL_ID_RESP_LEN);
+    SNTL_ID_CACHE_UNLOCK();
+}
+
+/* Drops all cached Identify responses of the device open on ptp->dev_fd */
+static void
+sntl_id_cache_invalidate(const struct sg_pt_linux_scsi * ptp, int vb)
+{
+    int k;
+    dev_t rdev;
+    struct sntl_id_cache_t * cp;
+
+    if (! sntl_id_cache_rdev(ptp, &rdev))
+        return;
+    if (vb > 4)
+        pr2ws("%s: dev_fd=%d\n", __func__, ptp->dev_fd);
+    SNTL_ID_CACHE_LOCK();
+    for (k = 0, cp = sntl_id_cache; k < SNTL_ID_CACHE_ELEMS; ++k, ++cp) {
+        if (cp->rdev == rdev)
+            cp->when = 0;
+    }
+    SNTL_ID_CACHE_UNLOCK();
+}
+
+/* Returns true for NVMe Admin opcodes that may change Identify data */
+static bool
+sntl_id_changing_opcode(uint8_t opcode)
+{
+    switch (opcode) {
+    case 0xd:   /* Namespace Management */
+    case 0x10:  /* Firmware Commit */
+    case 0x15:  /* Namespace Attachment */
+    case 0x1c:  /* Virtualization Management */
+    case 0x80:  /* Format NVM */
+    case 0x84:  /* Sanitize */
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Generic command status (SCT=0) covers namespace and format problems */
+#define SNTL_ID_INVALIDATING_STATUS(sct_sc) (0 == ((sct_sc) & 0x700))
+
+#define SNTL_BATCH_MAX 32       /* most NVMe commands to the OS at once */
+
+#ifdef HAVE_NVME_URING_CMD
+
+/* NVMe commands can be sent through io_uring (IORING_OP_URING_CMD, Linux
+ * 5.19 and later) rather than ioctl()s. Opt in with the
+ * SG3_UTILS_NVME_URING environment variable: "poll" sets up rings with
+ * IORING_SETUP_IOPOLL (useful when the nvme driver has poll_queues), any
+ * other value apart from "0" gives interrupt driven completions. Admin
+ * commands are never polled so use ioctl()s with "poll". Only NVMe char
+ * devices (e.g. /dev/ng0n1 and /dev/nvme0) accept io_uring commands, for
+ * other devices the ioctl()s are used. A pt object gets a ring with its
+ * first NVMe command; a destroyed pt object returns its ring to a small
+ * pool so utilities that build a pt object per command do not set up a
+ * ring per command. */
+#define SNTL_URING_POOL_SZ 8
+
+struct sntl_uring_t {
+    bool iopoll;
+    bool broken;                /* commands may be lost, don't reuse */
+    int ring_fd;
+    uint32_t sq_mask;
+    uint32_t cq_mask;
+    uint32_t * sq_tail;
+    uint32_t * sq_array;
+    uint32_t * cq_head;
+    uint32_t * cq_tail;
+    uint8_t * sqes;             /* each SQE is 128 bytes (SQE128) */
+    uint8_t * cqes;             /* each CQE is 32 bytes (CQE32) */
+    void * sq_ringp;
+    void * cq_ringp;            /* same as sq_ringp when single mmap */
+    size_t sq_ring_sz;
+    size_t cq_ring_sz;
+    size_t sqes_sz;
+};
+
+#define SNTL_SQE_SZ (2 * sizeof(struct io_uring_sqe))
+#define SNTL_CQE_SZ (2 * sizeof(struct io_uring_cqe))
+
+static int sntl_uring_mode = -1;  /* -1: unchecked, 0: off, 1: on, 2: poll */
+static int sntl_uring_pool_cnt;
+static struct sntl_uring_t * sntl_uring_pool[SNTL_URING_POOL_SZ];
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t sntl_uring_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define SNTL_URING_LOCK() pthread_mutex_lock(&sntl_uring_mutex)
+#define SNTL_URING_UNLOCK() pthread_mutex_unlock(&sntl_uring_mutex)
+#else
+#define SNTL_URING_LOCK()
+#define SNTL_URING_UNLOCK()
+#endif
+
+static void
+sntl_uring_free(struct sntl_uring_t * urp)
+{
+    if (urp->sqes)
+        munmap(urp->sqes, urp->sqes_sz);
+    if (urp->cq_ringp && (urp->cq_ringp != urp->sq_ringp))
+        munmap(urp->cq_ringp, urp->cq_ring_sz);
+    if (urp->sq_ringp)
+        munmap(urp->sq_ringp, urp->sq_ring_sz);
+    if (urp->ring_fd >= 0)
+        close(urp->ring_fd);
+    free(urp);
+}
+
+static void *
+sntl_uring_mmap(int ring_fd, size_t len, off_t offset)
+{
+    void * p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+
+    return (MAP_FAILED == p) ? NULL : p;
+}
+
+static struct sntl_uring_t *
+sntl_uring_setup(bool iopoll, int vb)
+{
+    int err;
+    uint8_t * sq;
+    uint8_t * cq;
+    struct sntl_uring_t * urp;
+    struct io_uring_params p;
+
+    urp = (struct sntl_uring_t *)calloc(1, sizeof(*urp));
+    if (NULL == urp)
+        return NULL;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+    if (iopoll)
+        p.flags |= IORING_SETUP_IOPOLL;
+    urp->ring_fd = syscall(__NR_io_uring_setup, SNTL_BATCH_MAX, &p);
+    if (urp->ring_fd < 0) {
+        err = errno;
+        if (vb > 1)
+            pr2ws("%s: io_uring_setup() failed: %s\n", __func__,
+                  strerror(err));
+        free(urp);
+        return NULL;
+    }
+    urp->iopoll = iopoll;
+    urp->sq_ring_sz = p.sq_off.array + (p.sq_entries * sizeof(uint32_t));
+    urp->cq_ring_sz = p.cq_off.cqes + (p.cq_entries * SNTL_CQE_SZ);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (urp->cq_ring_sz > urp->sq_ring_sz)
+            urp->sq_ring_sz = urp->cq_ring_sz;
+        urp->cq_ring_sz = urp->sq_ring_sz;
+    }
+    urp->sq_ringp = sntl_uring_mmap(urp->ring_fd, urp->sq_ring_sz,
+                                    IORING_OFF_SQ_RING);
+    if (NULL == urp->sq_ringp)
+        goto mmap_err;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        urp->cq_ringp = urp->sq_ringp;
+    else {
+        urp->cq_ringp = sntl_uring_mmap(urp->ring_fd, urp->cq_ring_sz,
+                                        IORING_OFF_CQ_RING);
+        if (NULL == urp->cq_ringp)
+            goto mmap_err;
+    }
+    urp->sqes_sz = p.sq_entries * SNTL_SQE_SZ;
+    urp->sqes = (uint8_t *)sntl_uring_mmap(urp->ring_fd, urp->sqes_sz,
+                                           IORING_OFF_SQES);
+    if (NULL == urp->sqes)
+        goto mmap_err;
+    sq = (uint8_t *)urp->sq_ringp;
+    urp->sq_tail = (uint32_t *)(sq + p.sq_off.tail);
+    urp->sq_mask = *(uint32_t *)(sq + p.sq_off.ring_mask);
+    urp->sq_array = (uint32_t *)(sq + p.sq_off.array);
+    cq = (uint8_t *)urp->cq_ringp;
+    urp->cq_head = (uint32_t *)(cq + p.cq_off.head);
+    urp->cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+    urp->cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+    urp->cqes = cq + p.cq_off.cqes;
+    if (vb > 3)
+        pr2ws("%s: ring_fd=%d, entries=%u%s\n", __func__, urp->ring_fd,
+              p.sq_entries, (iopoll ? ", IOPOLL" : ""));
+    return urp;
+
+mmap_err:
+    err = errno;
+    if (vb > 1)
+        pr2ws("%s: mmap() of io_uring failed: %s\n", __func__,
+              strerror(err));
+    sntl_uring_free(urp);
+    return NULL;
+}
+
+/* Returns the ring for NVMe commands to ptp or NULL if ioctl()s should be
+ * used. */
+static struct sntl_uring_t *
+sntl_uring_get(struct sg_pt_linux_scsi * ptp, bool admin, int vb)
+{
+    struct sntl_uring_t * urp;
+
+    if (sntl_uring_mode < 0) {
+        const char * cp = getenv("SG3_UTILS_NVME_URING");
+
+        if ((NULL == cp) || (0 == strcmp(cp, "0")))
+            sntl_uring_mode = 0;
+        else
+            sntl_uring_mode = (0 == strcmp(cp, "poll")) ? 2 : 1;
+    }
+    if ((sntl_uring_mode < 1) || ptp->nvme_no_uring)
+        return NULL;
+    urp = (struct sntl_uring_t *)ptp->nvme_uringp;
+    if (NULL == urp) {
+        SNTL_URING_LOCK();
+        if (sntl_uring_pool_cnt > 0)
+            urp = sntl_uring_pool[--sntl_uring_pool_cnt];
+        SNTL_URING_UNLOCK();
+        if (NULL == urp) {
+            urp = sntl_uring_setup(2 == sntl_uring_mode, vb);
+            if (NULL == urp) {  /* e.g. kernel too old: use ioctl()s */
+                sntl_uring_mode = 0;
+                return NULL;
+            }
+        }
+        ptp->nvme_uringp = urp;
+    }
+    if (admin && urp->iopoll)
+        return NULL;
+    return urp;
+}
+
+void
+sg_nvme_uring_release(struct sg_pt_linux_scsi * ptp)
+{
+    struct sntl_uring_t * urp = (struct sntl_uring_t *)ptp->nvme_uringp;
+
+    if (NULL == urp)
+        return;
+    ptp->nvme_uringp = NULL;
+    if (! urp->broken) {
+        SNTL_URING_LOCK();
+        if (sntl_uring_pool_cnt < SNTL_URING_POOL_SZ) {
+            sntl_uring_pool[sntl_uring_pool_cnt++] = urp;
+            urp = NULL;
+        }
+        SNTL_URING_UNLOCK();
+    }
+    if (urp)
+        sntl_uring_free(urp);
+}
+
+/* Places 'num' (at most SNTL_BATCH_MAX) NVMe commands on the ring and waits
+ * for all of them to complete. res_arr[k] gets what ioctl() would have
+ * returned for cmdp_arr[k] (NVMe status or negated errno) and the result
+ * field of cmdp_arr[k] gets DW0 of its completion. Returns the number of
+ * commands submitted (the others get a negated errno in res_arr). */
+static int
+sntl_uring_submit(struct sntl_uring_t * urp, int dev_fd, bool admin,
+                  struct sg_nvme_passthru_cmd ** cmdp_arr, int * res_arr,
+                  int num)
+{
+    int k, res, got;
+    int done = 0;
+    uint32_t tail, head, idx;
+    struct io_uring_sqe * sqep;
+    const struct io_uring_cqe * cqep;
+
+    tail = *urp->sq_tail;
+    for (k = 0; k < num; ++k, ++tail) {
+        idx = tail & urp->sq_mask;
+        sqep = (struct io_uring_sqe *)(urp->sqes + (idx * SNTL_SQE_SZ));
+        memset(sqep, 0, SNTL_SQE_SZ);
+        sqep->opcode = IORING_OP_URING_CMD;
+        sqep->fd = dev_fd;
+        sqep->cmd_op = admin ? NVME_URING_CMD_ADMIN : NVME_URING_CMD_IO;
+        sqep->user_data = k;
+        /* struct nvme_uring_cmd matches up to and including timeout_ms */
+        memcpy(sqep->cmd, cmdp_arr[k],
+               offsetof(struct sg_nvme_passthru_cmd, result));
+        urp->sq_array[idx] = idx;
+        res_arr[k] = -EIO;
+    }
+    __atomic_store_n(urp->sq_tail, tail, __ATOMIC_RELEASE);
+    while (done < num) {
+        res = syscall(__NR_io_uring_enter, urp->ring_fd, num - done,
+                      num - done, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (res < 0) {
+            if (EINTR == errno)
+                continue;
+            res = -errno;
+        } else if (0 == res)
+            res = -EAGAIN;
+        else {
+            done += res;
+            continue;
+        }
+        /* kernel has not consumed the rest, take them back */
+        __atomic_store_n(urp->sq_tail, tail - (num - done),
+                         __ATOMIC_RELEASE);
+        for (k = done; k < num; ++k)
+            res_arr[k] = res;
+        break;
+    }
+    head = *urp->cq_head;
+    for (got = 0; got < done; ) {
+        if (head == __atomic_load_n(urp->cq_tail, __ATOMIC_ACQUIRE)) {
+            res = syscall(__NR_io_uring_enter, urp->ring_fd, 0, 1,
+                          IORING_ENTER_GETEVENTS, NULL, 0);
+            if ((res < 0) && (EINTR != errno) && (EAGAIN != errno)) {
+                urp->broken = true;     /* leaves res_arr[k] as -EIO */
+                break;
+            }
+            continue;
+        }
+        cqep = (const struct io_uring_cqe *)
+                        (urp->cqes + ((head & urp->cq_mask) * SNTL_CQE_SZ));
+        k = (int)cqep->user_data;
+        if ((k >= 0) && (k < num)) {
+            res_arr[k] = cqep->res;
+            /* CQE32: first extra 64 bit field holds the NVMe result */
+            cmdp_arr[k]->result =
+                (uint32_t)((const uint64_t *)(cqep + 1))[0];
+        }
+        ++head;
+        ++got;
+        __atomic_store_n(urp->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return done;
+}
+
+/* Sends 'num' NVMe commands through the io_uring of ptp. Returns false,
+ * having issued nothing, if ioctl()s should be used instead. */
+static bool
+sntl_uring_cmds(struct sg_pt_linux_scsi * ptp, bool admin,
+                struct sg_nvme_passthru_cmd ** cmdp_arr, int * res_arr,
+                int num, int vb)
+{
+    int done;
+    struct sntl_uring_t * urp = sntl_uring_get(ptp, admin, vb);
+
+    if (NULL == urp)
+        return false;
+    done = sntl_uring_submit(urp, ptp->dev_fd, admin, cmdp_arr, res_arr,
+                             num);
+    if (urp->broken) {
+        ptp->nvme_uringp = NULL;
+        sntl_uring_free(urp);
+    }
+    if (0 == done)
+        return false;
+    if (-EOPNOTSUPP == res_arr[0]) {
+        /* e.g. a NVMe block device: nothing was done, don't ask again */
+        if (vb > 3)
+            pr2ws("%s: device refuses io_uring commands\n", __func__);
+        ptp->nvme_no_uring = true;
+        return false;
+    }
+    return true;
+}
+
+#else           /* HAVE_NVME_URING_CMD */
+
+static bool
+sntl_uring_cmds(struct sg_pt_linux_scsi * ptp, bool admin,
+                struct sg_nvme_passthru_cmd ** cmdp_arr, int * res_arr,
+                int num, int vb)
+{
+    if (ptp || admin || cmdp_arr || res_arr || num || vb) { }
+    return false;
+}
+
+void
+sg_nvme_uring_release(struct sg_pt_linux_scsi * ptp)
+{
+    if (ptp) { }
+}
+
+#endif          /* HAVE_NVME_URING_CMD */
+
 /* Returns 0 for success. Returns SG_LIB_NVME_STATUS if there is non-zero
  * NVMe status (from the completion queue) with the value placed in
  * ptp->nvme_status. If Unix error from ioctl then return negated value
@@ -337,9 +843,11 @@ sg_nvme_admin_cmd_f(struct sg_pt_linux_scsi * ptp,
             }
         }
     }
-    res = ioctl(ptp->dev_fd, NVME_IOCTL_ADMIN_CMD, cmdp);
+    if (! sntl_uring_cmds(ptp, true, &cmdp, &res, 1, vb))
+        res = ioctl(ptp->dev_fd, NVME_IOCTL_ADMIN_CMD, cmdp);
     if (res < 0) {  /* OS error (errno negated) */
         ptp->os_err = -res;
+        sntl_id_cache_invalidate(ptp, vb);
         if (vb > 1) {
             pr2ws("%s: ioctl for %s [0x%x] failed: %s "
                   "(errno=%d)\n", __func__, nam, *up, strerror(-res), -res);
@@ -377,8 +885,12 @@ sg_nvme_admin_cmd_f(struct sg_pt_linux_scsi * ptp,
                    __func__, nam, *up,
                   sg_get_nvme_cmd_status_str(sct_sc, sizeof(b), b), sct_sc);
         }
+        if (SNTL_ID_INVALIDATING_STATUS(sct_sc))
+            sntl_id_cache_invalidate(ptp, vb);
         return SG_LIB_NVME_STATUS;      /* == SCSI_PT_DO_NVME_STATUS */
     }
+    if (sntl_id_changing_opcode(*up))
+        sntl_id_cache_invalidate(ptp, vb);
     if ((vb > 4) && is_read && dp) {
         uint32_t len = sg_get_unaligned_le32(up + SG_NVME_PT_DATA_LEN);
 
@@ -454,15 +966,21 @@ static int
 sntl_do_identify(struct sg_pt_linux_scsi * ptp, int cns, int nsid,
                  int time_secs, int u_len, uint8_t * up, int vb)
 {
+    int res;
     struct sg_nvme_passthru_cmd cmd;
 
+    if (sntl_id_cache_get(ptp, cns, nsid, u_len, up, vb))
+        return 0;
     memset(&cmd, 0, sizeof(cmd));
     cmd.opcode = SG_NVME_AD_IDENTIFY;
     cmd.nsid = nsid;
     cmd.cdw10 = cns;
     cmd.addr = (uint64_t)(sg_uintptr_t)up;
     cmd.data_len = u_len;
-    return sg_nvme_admin_cmd_f(ptp, &cmd, up, true, time_secs, vb);
+    res = sg_nvme_admin_cmd_f(ptp, &cmd, up, true, time_secs, vb);
+    if (0 == res)
+        sntl_id_cache_put(ptp, cns, nsid, u_len, up);
+    return res;
 }
 
 /* Currently only caches associated identify controller response (4096 bytes).
@@ -482,8 +1000,11 @@ sntl_cache_identify(struct sg_pt_linux_scsi * ptp, int time_secs, int vb)
     }
     ret = sntl_do_identify(ptp, 0x1 /* CNS */, 0 /* nsid */, time_secs,
                            pg_sz, up, vb);
-    if (0 == ret)
+    if (0 == ret) {
         sntl_check_enclosure_override(ptp, vb);
+        ptp->dev_stat.id_ctl77 = up[77];
+        ptp->dev_stat.id_ctl77_valid = true;
+    }
     return (ret < 0) ? sg_convert_errno(-ret) : ret;
 }
 
@@ -1346,13 +1867,13 @@ fini:
     return res;
 }
 
+/* Completion side of do_nvm_pt_low(): 'res' is what the ioctl() (or
+ * io_uring) yielded for the NVM command in cmdp. */
 static int
-do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
-              struct sg_nvme_passthru_cmd *cmdp, void * dp, int dlen,
-              bool is_read, int time_secs, int vb)
+do_nvm_pt_fini(struct sg_pt_linux_scsi * ptp,
+               struct sg_nvme_passthru_cmd *cmdp, int res, void * dp,
+               int dlen, bool is_read, int vb)
 {
-    const uint32_t cmd_len = sizeof(struct sg_nvme_passthru_cmd);
-    int res;
     uint32_t n;
     uint16_t sct_sc;
     const uint8_t * up = ((const uint8_t *)cmdp) + SG_NVME_PT_OPCODE;
@@ -1362,27 +1883,9 @@ do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
         sg_get_nvme_opcode_name(*up, false /* NVM */ , sizeof(nam), nam);
     else
         nam[0] = '\0';
-    cmdp->timeout_ms = (time_secs < 0) ? (-time_secs) : (1000 * time_secs);
-    ptp->os_err = 0;
-    if (vb > 2) {
-        pr2ws("NVMe NVM command: %s\n", nam);
-        hex2stderr((const uint8_t *)cmdp, cmd_len, 1);
-        if ((vb > 4) && (! is_read) && dp) {
-            if (dlen > 0) {
-                n = dlen;
-                if ((dlen < 512) || (vb > 5))
-                    pr2ws("\nData-out buffer (%u bytes):\n", n);
-                else {
-                    pr2ws("\nData-out buffer (first 512 of %u bytes):\n", n);
-                    n = 512;
-                }
-                hex2stderr((const uint8_t *)dp, n, 0);
-            }
-        }
-    }
-    res = ioctl(ptp->dev_fd, NVME_IOCTL_IO_CMD, cmdp);
     if (res < 0) {  /* OS error (errno negated) */
         ptp->os_err = -res;
+        sntl_id_cache_invalidate(ptp, vb);
         if (vb > 1) {
             pr2ws("%s: ioctl for %s [0x%x] failed: %s "
                   "(errno=%d)\n", __func__, nam, *up, strerror(-res), -res);
@@ -1420,6 +1923,8 @@ do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
                    __func__, nam, *up,
                   sg_get_nvme_cmd_status_str(sct_sc, sizeof(b), b), sct_sc);
         }
+        if (SNTL_ID_INVALIDATING_STATUS(sct_sc))
+            sntl_id_cache_invalidate(ptp, vb);
         return SG_LIB_NVME_STATUS;      /* == SCSI_PT_DO_NVME_STATUS */
     }
     if ((vb > 4) && is_read && dp) {
@@ -1437,19 +1942,113 @@ do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
     return 0;
 }
 
+
+static int
+do_nvm_pt_low(struct sg_pt_linux_scsi * ptp,
+              struct sg_nvme_passthru_cmd *cmdp, void * dp, int dlen,
+              bool is_read, int time_secs, int vb)
+{
+    const uint32_t cmd_len = sizeof(struct sg_nvme_passthru_cmd);
+    int res;
+    uint32_t n;
+    const uint8_t * up = ((const uint8_t *)cmdp) + SG_NVME_PT_OPCODE;
+    char nam[64];
+
+    if (vb)
+        sg_get_nvme_opcode_name(*up, false /* NVM */ , sizeof(nam), nam);
+    else
+        nam[0] = '\0';
+    cmdp->timeout_ms = (time_secs < 0) ? (-time_secs) : (1000 * time_secs);
+    ptp->os_err = 0;
+    if (vb > 2) {
+        pr2ws("NVMe NVM command: %s\n", nam);
+        hex2stderr((const uint8_t *)cmdp, cmd_len, 1);
+        if ((vb > 4) && (! is_read) && dp) {
+            if (dlen > 0) {
+                n = dlen;
+                if ((dlen < 512) || (vb > 5))
+                    pr2ws("\nData-out buffer (%u bytes):\n", n);
+                else {
+                    pr2ws("\nData-out buffer (first 512 of %u bytes):\n", n);
+                    n = 512;
+                }
+                hex2stderr((const uint8_t *)dp, n, 0);
+            }
+        }
+    }
+    if (! sntl_uring_cmds(ptp, false, &cmdp, &res, 1, vb))
+        res = ioctl(ptp->dev_fd, NVME_IOCTL_IO_CMD, cmdp);
+    return do_nvm_pt_fini(ptp, cmdp, res, dp, dlen, is_read, vb);
+}
+
+/* Issues 'num' NVM commands that are independent of one another. With an
+ * io_uring they are submitted together (up to SNTL_BATCH_MAX at a time),
+ * otherwise one after another. The number of leading commands that
+ * succeeded is written to *num_okp. Returns as do_nvm_pt_low() does for
+ * the first failed command, if any. With an io_uring, commands after the
+ * first failed one may also have been carried out. */
+static int
+do_nvm_pt_batch(struct sg_pt_linux_scsi * ptp,
+                struct sg_nvme_passthru_cmd * cmd_arr, int num, bool is_read,
+                int time_secs, int vb, int * num_okp)
+{
+    int k, j, n;
+    int res = 0;
+    int res_arr[SNTL_BATCH_MAX];
+    struct sg_nvme_passthru_cmd * cmdp_arr[SNTL_BATCH_MAX];
+    struct sg_nvme_passthru_cmd * cmdp;
+
+    for (k = 0; k < num; k += n) {
+        n = num - k;
+        n = (n < SNTL_BATCH_MAX) ? n : SNTL_BATCH_MAX;
+        for (j = 0; j < n; ++j) {
+            cmdp = cmd_arr + k + j;
+            cmdp->timeout_ms = (time_secs < 0) ? (-time_secs) :
+                                                 (1000 * time_secs);
+            cmdp_arr[j] = cmdp;
+        }
+        ptp->os_err = 0;
+        if ((n < 2) ||
+            (! sntl_uring_cmds(ptp, false, cmdp_arr, res_arr, n, vb))) {
+            for (j = 0; j < n; ++j) {   /* one at a time */
+                cmdp = cmdp_arr[j];
+                res = do_nvm_pt_low(ptp, cmdp,
+                                    (void *)(sg_uintptr_t)cmdp->addr,
+                                    cmdp->data_len, is_read, time_secs, vb);
+                if (res)
+                    break;
+            }
+        } else {
+            if (vb > 2)
+                pr2ws("%s: %d NVMe NVM commands via io_uring\n", __func__,
+                      n);
+            for (j = 0; j < n; ++j) {
+                cmdp = cmdp_arr[j];
+                res = do_nvm_pt_fini(ptp, cmdp, res_arr[j],
+                                     (void *)(sg_uintptr_t)cmdp->addr,
+                                     cmdp->data_len, is_read, vb);
+                if (res)
+                    break;
+            }
+        }
+        if (res) {
+            k += j;
+            break;
+        }
+    }
+    *num_okp = k;
+    return res;
+}
+
 /* Since ptp can be a char device (e.g. /dev/nvme0) or a blocks device
  * (e.g. /dev/nvme0n1 or /dev/nvme0n1p3) use NVME_IOCTL_IO_CMD which is
  * common to both (and takes a timeout). The difficult is that
  * NVME_IOCTL_IO_CMD takes a nvme_passthru_cmd object point. */
-static int
-sntl_do_nvm_cmd(struct sg_pt_linux_scsi * ptp, struct sg_nvme_user_io * iop,
-                uint32_t dlen, bool is_read, int time_secs, int vb)
+static void
+sntl_mk_nvm_cmd(const struct sg_pt_linux_scsi * ptp,
+                const struct sg_nvme_user_io * iop, uint32_t dlen,
+                struct sg_nvme_passthru_cmd * cmdp)
 {
-
-    struct sg_nvme_passthru_cmd nvme_pt_cmd;
-    struct sg_nvme_passthru_cmd *cmdp = &nvme_pt_cmd;
-    void * dp = (void *)(sg_uintptr_t)iop->addr;
-
     memset(cmdp, 0, sizeof(*cmdp));
     cmdp->opcode = iop->opcode;
     cmdp->flags = iop->flags;
@@ -1459,10 +2058,117 @@ sntl_do_nvm_cmd(struct sg_pt_linux_scsi * ptp, struct sg_nvme_user_io * iop,
     cmdp->cdw10 = iop->slba & 0xffffffff;
     cmdp->cdw11 = (iop->slba >> 32) & 0xffffffff;
     cmdp->cdw12 = iop->nblocks; /* lower 16 bits already "0's based" count */
+}
+
+static int
+sntl_do_nvm_cmd(struct sg_pt_linux_scsi * ptp, struct sg_nvme_user_io * iop,
+                uint32_t dlen, bool is_read, int time_secs, int vb)
+{
 
+    struct sg_nvme_passthru_cmd nvme_pt_cmd;
+    struct sg_nvme_passthru_cmd *cmdp = &nvme_pt_cmd;
+    void * dp = (void *)(sg_uintptr_t)iop->addr;
+
+    sntl_mk_nvm_cmd(ptp, iop, dlen, cmdp);
     return do_nvm_pt_low(ptp, cmdp, dp, dlen, is_read, time_secs, vb);
 }
 
+/* MDTS is a power of two in units of the controller's minimum memory page
+ * size (CAP.MPSMIN) which is not visible from here. Assume the usual 4 KiB
+ * which is also the smallest allowed. */
+#define SNTL_MPSMIN_BYTES 4096
+
+/* Issues the NVMe Read or Write prepared in 'iop' for 'nblks_t10' logical
+ * blocks held in the 'dlen' byte buffer. When that is more than a single
+ * NVMe command can carry (65536 blocks or the controller's MDTS) it is split
+ * into several commands issued back-to-back (submitted together when an
+ * io_uring is in use). The first error stops the sequence and the residual
+ * count then covers the blocks from the failed command onward. Returns as
+ * sntl_do_nvm_cmd() does. */
+static int
+sntl_do_nvm_rw(struct sg_pt_linux_scsi * ptp, struct sg_nvme_user_io * iop,
+               uint32_t nblks_t10, uint32_t dlen, bool is_read,
+               int time_secs, int vb)
+{
+    int k, j, num_ok;
+    int res = 0;
+    uint32_t max_blks = UINT16_MAX + 1;
+    uint32_t max_bytes = 0;     /* 0 for no MDTS limit */
+    uint32_t lb_sz, n, d, done, resid;
+    uint64_t slba, addr;
+    struct sg_nvme_passthru_cmd cmd_arr[SNTL_BATCH_MAX];
+
+    if ((nblks_t10 > max_blks) || (dlen > (2 * SNTL_MPSMIN_BYTES))) {
+        if (! ptp->dev_stat.id_ctl77_valid) {
+            if ((NULL == ptp->nvme_id_ctlp) &&
+                sntl_cache_identify(ptp, time_secs, vb)) {
+                /* proceed as if there is no MDTS limit, don't ask again */
+                if (vb > 3)
+                    pr2ws("%s: Identify controller failed, ignore MDTS\n",
+                          __func__);
+                if (ptp->free_nvme_id_ctlp)
+                    free(ptp->free_nvme_id_ctlp);
+                ptp->free_nvme_id_ctlp = NULL;
+                ptp->nvme_id_ctlp = NULL;
+            } else if (ptp->nvme_id_ctlp)
+                ptp->dev_stat.id_ctl77 = ptp->nvme_id_ctlp[77];
+            ptp->dev_stat.id_ctl77_valid = true;
+        }
+        if ((ptp->dev_stat.id_ctl77 > 0) && (ptp->dev_stat.id_ctl77 < 20))
+            max_bytes = SNTL_MPSMIN_BYTES << ptp->dev_stat.id_ctl77;
+    }
+    if ((nblks_t10 <= max_blks) && ((0 == max_bytes) || (dlen <= max_bytes))) {
+        iop->nblocks = nblks_t10 - 1;   /* crazy "0's based" */
+        return sntl_do_nvm_cmd(ptp, iop, dlen, is_read, time_secs, vb);
+    }
+    /* need the logical block size to split the buffer */
+    if ((dlen < nblks_t10) || (dlen % nblks_t10)) {
+        if (nblks_t10 > max_blks) {
+            mk_sense_invalid_fld(ptp, true, 11, -1, vb);
+            return 0;
+        }
+        iop->nblocks = nblks_t10 - 1;
+        return sntl_do_nvm_cmd(ptp, iop, dlen, is_read, time_secs, vb);
+    }
+    lb_sz = dlen / nblks_t10;
+    if (max_bytes && ((max_bytes / lb_sz) < max_blks))
+        max_blks = max_bytes / lb_sz;
+    if (0 == max_blks) {        /* logical block bigger than MDTS ?? */
+        iop->nblocks = nblks_t10 - 1;
+        return sntl_do_nvm_cmd(ptp, iop, dlen, is_read, time_secs, vb);
+    }
+    if (vb > 3)
+        pr2ws("%s: splitting %u blocks into %u NVMe %s commands\n", __func__,
+              nblks_t10, (nblks_t10 + max_blks - 1) / max_blks,
+              (is_read ? "Read" : "Write"));
+    slba = iop->slba;
+    addr = iop->addr;
+    for (done = 0; done < nblks_t10; ) {
+        /* prepare a batch of commands, each for up to max_blks blocks */
+        for (k = 0, d = done; (k < SNTL_BATCH_MAX) && (d < nblks_t10);
+             ++k, d += n) {
+            n = nblks_t10 - d;
+            n = (n < max_blks) ? n : max_blks;
+            iop->slba = slba + d;
+            iop->nblocks = n - 1;
+            iop->addr = addr + ((uint64_t)d * lb_sz);
+            sntl_mk_nvm_cmd(ptp, iop, n * lb_sz, cmd_arr + k);
+        }
+        res = do_nvm_pt_batch(ptp, cmd_arr, k, is_read, time_secs, vb,
+                              &num_ok);
+        for (j = 0; j < num_ok; ++j)
+            done += (cmd_arr[j].cdw12 & 0xffff) + 1;
+        if (res)
+            break;
+    }
+    resid = (nblks_t10 - done) * lb_sz;
+    if (is_read)
+        ptp->io_hdr.din_resid = resid;
+    else
+        ptp->io_hdr.dout_resid = resid;
+    return res;
+}
+
 static int
 sntl_rread(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
            int time_secs, int vb)
@@ -1485,10 +2191,6 @@ sntl_rread(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
     } else {
         iop->slba = sg_get_unaligned_be64(cdbp + 2);
         nblks_t10 = sg_get_unaligned_be32(cdbp + 10);
-        if (nblks_t10 > (UINT16_MAX + 1)) {
-            mk_sense_invalid_fld(ptp, true, 11, -1, vb);
-            return 0;
-        }
     }
     if (0 == nblks_t10) {         /* NOP in SCSI */
         if (vb > 4)
@@ -1496,12 +2198,11 @@ sntl_rread(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
                   __func__);
         return 0;
     }
-    iop->nblocks = nblks_t10 - 1;       /* crazy "0's based" */
     if (have_fua)
         iop->control |= SG_NVME_RW_CONTROL_FUA;
     iop->addr = (uint64_t)ptp->io_hdr.din_xferp;
-    res = sntl_do_nvm_cmd(ptp, iop, ptp->io_hdr.din_xfer_len,
-                          true /* is_read */, time_secs, vb);
+    res = sntl_do_nvm_rw(ptp, iop, nblks_t10, ptp->io_hdr.din_xfer_len,
+                         true /* is_read */, time_secs, vb);
     if (SG_LIB_NVME_STATUS == res) {
         mk_sense_from_nvme_status(ptp, vb);
         return 0;
@@ -1531,10 +2232,6 @@ sntl_write(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
     } else {
         iop->slba = sg_get_unaligned_be64(cdbp + 2);
         nblks_t10 = sg_get_unaligned_be32(cdbp + 10);
-        if (nblks_t10 > (UINT16_MAX + 1)) {
-            mk_sense_invalid_fld(ptp, true, 11, -1, vb);
-            return 0;
-        }
     }
     if (0 == nblks_t10) { /* NOP in SCSI */
         if (vb > 4)
@@ -1542,12 +2239,11 @@ sntl_write(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
                   __func__);
         return 0;
     }
-    iop->nblocks = nblks_t10 - 1;
     if (have_fua)
         iop->control |= SG_NVME_RW_CONTROL_FUA;
     iop->addr = (uint64_t)ptp->io_hdr.dout_xferp;
-    res = sntl_do_nvm_cmd(ptp, iop, ptp->io_hdr.dout_xfer_len, false,
-                          time_secs, vb);
+    res = sntl_do_nvm_rw(ptp, iop, nblks_t10, ptp->io_hdr.dout_xfer_len,
+                         false, time_secs, vb);
     if (SG_LIB_NVME_STATUS == res) {
         mk_sense_from_nvme_status(ptp, vb);
         return 0;
@@ -1620,26 +2316,38 @@ sntl_write_same(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
         pr2ws("%s: ndob=%d, time_secs=%d\n", __func__, (int)ndob, time_secs);
     if (! ndob) {
         int flbas, index, lbafx, lbads, lbsize;
+        uint32_t pg_sz = sg_get_page_size();
         uint8_t * up;
         uint8_t * dp;
+        uint8_t * free_up = NULL;
 
         dp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
         if (dp == NULL)
             return sg_convert_errno(ENOMEM);
-        if (NULL == ptp->nvme_id_ctlp) {
-            res = sntl_cache_identify(ptp, time_secs, vb);
+        up = sg_memalign(pg_sz, pg_sz, &free_up, false);
+        if (NULL == up) {
+            pr2ws("%s: sg_memalign() failed to get memory\n", __func__);
+            return sg_convert_errno(ENOMEM);
+        }
+        /* the LBA format is in the Identify namespace response */
+        res = sntl_do_identify(ptp, 0x0 /* CNS */, ptp->nvme_nsid,
+                               time_secs, pg_sz, up, vb);
+        if (res) {
+            free(free_up);
             if (SG_LIB_NVME_STATUS == res) {
                 mk_sense_from_nvme_status(ptp, vb);
                 return 0;
-            } else if (res)
-                return res;
+            }
+            return (res < 0) ? sg_convert_errno(-res) : res;
         }
-        up = ptp->nvme_id_ctlp;
         flbas = up[26];     /* NVME FLBAS field from Identify */
         index = 128 + (4 * (flbas & 0xf));
         lbafx = sg_get_unaligned_le32(up + index);
+        free(free_up);
         lbads = (lbafx >> 16) & 0xff;  /* bits 16 to 23 inclusive, pow2 */
         lbsize = 1 << lbads;
+        if ((uint32_t)lbsize > ptp->io_hdr.dout_xfer_len)
+            lbsize = ptp->io_hdr.dout_xfer_len;
         if (! sg_all_zeros(dp, lbsize)) {
             mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST, PCIE_ERR_ASC,
                               PCIE_UNSUPP_REQ_ASCQ, vb);
@@ -1701,6 +2409,290 @@ sntl_sync_cache(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
     return res;
 }
 
+/* Translates UNMAP to NVMe Dataset Management commands with the Deallocate
+ * attribute. Each DSM command carries up to 256 ranges so a long list of
+ * UNMAP block descriptors needs few NVMe commands. The first error stops
+ * the sequence. */
+static int
+sntl_unmap(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
+           int time_secs, int vb)
+{
+    bool anchor = !!(0x1 & cdbp[1]);
+    int res = 0;
+    int k, nr, num_bd;
+    uint32_t pl_len, bd_len, nblks;
+    const uint8_t * bp;
+    const uint8_t * bdp;
+    uint8_t * rp;
+    uint8_t * free_rp = NULL;
+    struct sg_nvme_passthru_cmd cmd;
+
+    if (vb > 5)
+        pr2ws("%s: anchor=%d, time_secs=%d\n", __func__, (int)anchor,
+              time_secs);
+    if (anchor) {       /* no NVMe equivalent of an anchored LBA */
+        mk_sense_invalid_fld(ptp, true, 1, 0, vb);
+        return 0;
+    }
+    pl_len = sg_get_unaligned_be16(cdbp + 7);
+    if (pl_len > ptp->io_hdr.dout_xfer_len)
+        pl_len = ptp->io_hdr.dout_xfer_len;
+    if (0 == pl_len) {  /* NOP in SCSI */
+        if (vb > 4)
+            pr2ws("%s: parameter list length is 0, a NOP in SCSI\n",
+                  __func__);
+        return 0;
+    }
+    if (pl_len < 8) {
+        mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST,
+                          PARAMETER_LIST_LENGTH_ERR, 0, vb);
+        return 0;
+    }
+    if (NULL == ptp->nvme_id_ctlp) {
+        res = sntl_cache_identify(ptp, time_secs, vb);
+        if (SG_LIB_NVME_STATUS == res) {
+            mk_sense_from_nvme_status(ptp, vb);
+            return 0;
+        } else if (res)
+            return res;
+    }
+    /* ONCS bit 2: controller supports Dataset Management */
+    if (! (0x4 & sg_get_unaligned_le16(ptp->nvme_id_ctlp + 520))) {
+        if (vb > 2)
+            pr2ws("%s: controller lacks Dataset Management\n", __func__);
+        mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST, INVALID_OPCODE,
+                          0, vb);
+        return 0;
+    }
+    bp = (const uint8_t *)(sg_uintptr_t)ptp->io_hdr.dout_xferp;
+    bd_len = sg_get_unaligned_be16(bp + 2);
+    if (bd_len > (pl_len - 8))
+        bd_len = pl_len - 8;
+    num_bd = bd_len / 16;
+    if (0 == num_bd)
+        return 0;
+    rp = sg_memalign(SG_NVME_DSM_MAX_RANGES * 16, 0, &free_rp, false);
+    if (NULL == rp) {
+        pr2ws("%s: sg_memalign() failed to get memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0, nr = 0; k < num_bd; ++k) {
+        bdp = bp + 8 + (16 * k);
+        nblks = sg_get_unaligned_be32(bdp + 8);
+        if (nblks > 0) {        /* SCSI ignores descriptors of 0 blocks */
+            uint8_t * np = rp + (16 * nr);
+
+            sg_put_unaligned_le32(0, np + 0);   /* Context Attributes */
+            sg_put_unaligned_le32(nblks, np + 4);
+            sg_put_unaligned_le64(sg_get_unaligned_be64(bdp), np + 8);
+            ++nr;
+        }
+        if ((nr < 1) ||
+            ((nr < SG_NVME_DSM_MAX_RANGES) && ((k + 1) < num_bd)))
+            continue;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = SG_NVME_NVM_DSM;
+        cmd.nsid = ptp->nvme_nsid;
+        cmd.addr = (uint64_t)(sg_uintptr_t)rp;
+        cmd.data_len = 16 * nr;
+        cmd.cdw10 = nr - 1;     /* NR: "0's based" number of ranges */
+        cmd.cdw11 = SG_NVME_DSM_ATTR_AD;
+        res = do_nvm_pt_low(ptp, &cmd, rp, 16 * nr, false, time_secs, vb);
+        if (res)
+            break;
+        nr = 0;
+    }
+    free(free_rp);
+    if (SG_LIB_NVME_STATUS == res) {
+        mk_sense_from_nvme_status(ptp, vb);
+        return 0;
+    }
+    return res;
+}
+
+/* NVMe can't say whether an LBA is deallocated short of reading it. So
+ * for report types 0 and 2 one descriptor from the given LBA is returned
+ * with a provisioning status of "mapped (or unknown)"; report types 1, 3
+ * and 4 return no descriptors. Report type 0x10 (LBAs that may return
+ * unrecovered errors) maps to the NVMe Get LBA Status command when the
+ * controller supports it (OACS bit 9). That examines at most 65535 LBAs
+ * from the given LBA. */
+static int
+sntl_get_lba_status(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
+                    int time_secs, int vb)
+{
+    int res, k, n, num, len, rt;
+    uint32_t alloc_len, nlb;
+    uint32_t pg_sz = sg_get_page_size();
+    uint64_t lba, nsze;
+    uint8_t * bp;
+    uint8_t * up;
+    uint8_t * rp;
+    uint8_t * free_up = NULL;
+    uint8_t * free_rp = NULL;
+    struct sg_nvme_passthru_cmd cmd;
+
+    lba = sg_get_unaligned_be64(cdbp + 2);
+    alloc_len = sg_get_unaligned_be32(cdbp + 10);
+    rt = cdbp[14];
+    if (vb > 5)
+        pr2ws("%s: report_type=0x%x, time_secs=%d\n", __func__, rt,
+              time_secs);
+    if (0 == alloc_len)
+        return 0;
+    switch (rt) {
+    case 0x0: case 0x1: case 0x2: case 0x3: case 0x4: case 0x10:
+        break;
+    default:
+        mk_sense_invalid_fld(ptp, true, 14, -1, vb);
+        return 0;
+    }
+    up = sg_memalign(pg_sz, pg_sz, &free_up, false);
+    rp = sg_memalign(pg_sz, pg_sz, &free_rp, false);
+    if ((NULL == up) || (NULL == rp)) {
+        pr2ws("%s: sg_memalign() failed to get memory\n", __func__);
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    res = sntl_do_identify(ptp, 0x0 /* CNS */, ptp->nvme_nsid, time_secs,
+                           pg_sz, up, vb);
+    if (res < 0) {
+        res = sg_convert_errno(-res);
+        goto fini;
+    } else if (SG_LIB_NVME_STATUS == res) {
+        mk_sense_from_nvme_status(ptp, vb);
+        res = 0;
+        goto fini;
+    }
+    nsze = sg_get_unaligned_le64(up + 0);
+    if (lba >= nsze) {
+        mk_sense_asc_ascq(ptp, SPC_SK_ILLEGAL_REQUEST, LBA_OUT_OF_RANGE,
+                          0, vb);
+        goto fini;
+    }
+    num = 0;
+    if ((0x0 == rt) || (0x2 == rt)) {
+        sg_put_unaligned_be64(lba, rp + 8);
+        nlb = ((nsze - lba) > UINT32_MAX) ? UINT32_MAX :
+                                            (uint32_t)(nsze - lba);
+        sg_put_unaligned_be32(nlb, rp + 16);
+        num = 1;        /* provisioning status 0: mapped (or unknown) */
+    } else if (0x10 == rt) {
+        if (NULL == ptp->nvme_id_ctlp) {
+            res = sntl_cache_identify(ptp, time_secs, vb);
+            if (SG_LIB_NVME_STATUS == res) {
+                mk_sense_from_nvme_status(ptp, vb);
+                res = 0;
+                goto fini;
+            } else if (res)
+                goto fini;
+        }
+        /* OACS bit 9: controller supports Get LBA Status */
+        if (! (0x200 & sg_get_unaligned_le16(ptp->nvme_id_ctlp + 256))) {
+            mk_sense_invalid_fld(ptp, true, 14, -1, vb);
+            goto fini;
+        }
+        memset(up, 0, pg_sz);
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.opcode = SG_NVME_AD_GET_LBA_STATUS;
+        cmd.nsid = ptp->nvme_nsid;
+        cmd.addr = (uint64_t)(sg_uintptr_t)up;
+        cmd.data_len = pg_sz;
+        cmd.cdw10 = lba & 0xffffffff;
+        cmd.cdw11 = (lba >> 32) & 0xffffffff;
+        cmd.cdw12 = (pg_sz / 4) - 1;    /* MNDW: "0's based" dwords */
+        cmd.cdw13 = (0x10 << 24) | UINT16_MAX;  /* ATYPE and RL */
+        res = sg_nvme_admin_cmd_f(ptp, &cmd, up, true, time_secs, vb);
+        if (res < 0) {
+            res = sg_convert_errno(-res);
+            goto fini;
+        } else if (SG_LIB_NVME_STATUS == res) {
+            mk_sense_from_nvme_status(ptp, vb);
+            res = 0;
+            goto fini;
+        }
+        num = sg_get_unaligned_le32(up + 0);    /* NLSD */
+        n = (pg_sz - 8) / 16;
+        num = (num < n) ? num : n;
+        for (k = 0; k < num; ++k) {
+            const uint8_t * dp = up + 8 + (16 * k);
+            uint8_t * sp = rp + 8 + (16 * k);
+
+            sg_put_unaligned_be64(sg_get_unaligned_le64(dp + 0), sp + 0);
+            sg_put_unaligned_be32(sg_get_unaligned_le32(dp + 8), sp + 8);
+            sp[13] = 0x1;       /* may contain unrecovered errors */
+        }
+    }
+    n = 8 + (16 * num);
+    sg_put_unaligned_be32(n - 4, rp + 0);
+    len = ptp->io_hdr.din_xfer_len;
+    bp = (uint8_t *)(sg_uintptr_t)ptp->io_hdr.din_xferp;
+    n = ((uint32_t)n < alloc_len) ? n : (int)alloc_len;
+    n = (n < len) ? n : len;
+    ptp->io_hdr.din_resid = len - n;
+    if (n > 0)
+        memcpy(bp, rp, n);
+fini:
+    if (free_up)
+        free(free_up);
+    if (free_rp)
+        free(free_rp);
+    return res;
+}
+
+/* COMPARE AND WRITE is issued as an NVMe Compare followed, if that
+ * succeeds, by a Write. NVMe makes that pair atomic by fusing them but
+ * fused commands must be adjacent in a submission queue and the Linux
+ * passthrough ioctl submits each command on its own. So, unlike on a SCSI
+ * device, another initiator may write between the two. A failed compare
+ * yields MISCOMPARE sense and nothing is written. */
+static int
+sntl_comp_write(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
+                int time_secs, int vb)
+{
+    bool have_fua = !!(cdbp[1] & 0x8);
+    int res;
+    uint32_t nblks_t10, dlen;
+    struct sg_nvme_user_io io;
+    struct sg_nvme_user_io * iop = &io;
+
+    if (vb > 5)
+        pr2ws("%s: fua=%d, time_secs=%d\n", __func__, (int)have_fua,
+              time_secs);
+    nblks_t10 = cdbp[13];
+    if (0 == nblks_t10) { /* NOP in SCSI */
+        if (vb > 4)
+            pr2ws("%s: nblks_t10 is 0, a NOP in SCSI, can't map to NVMe\n",
+                  __func__);
+        return 0;
+    }
+    /* data-out holds the verify instance then the write instance */
+    dlen = ptp->io_hdr.dout_xfer_len;
+    if ((dlen < (2 * nblks_t10)) || (dlen % (2 * nblks_t10))) {
+        mk_sense_invalid_fld(ptp, true, 13, -1, vb);
+        return 0;
+    }
+    dlen /= 2;
+    memset(iop, 0, sizeof(*iop));
+    iop->opcode = SG_NVME_NVM_COMPARE;
+    iop->slba = sg_get_unaligned_be64(cdbp + 2);
+    iop->nblocks = nblks_t10 - 1;
+    iop->addr = (uint64_t)ptp->io_hdr.dout_xferp;
+    res = sntl_do_nvm_cmd(ptp, iop, dlen, false, time_secs, vb);
+    if (0 == res) {
+        iop->opcode = SG_NVME_NVM_WRITE;
+        if (have_fua)
+            iop->control |= SG_NVME_RW_CONTROL_FUA;
+        iop->addr += dlen;
+        res = sntl_do_nvm_cmd(ptp, iop, dlen, false, time_secs, vb);
+    }
+    if (SG_LIB_NVME_STATUS == res) {
+        mk_sense_from_nvme_status(ptp, vb);
+        return 0;
+    }
+    return res;
+}
+
 static int
 sntl_start_stop(struct sg_pt_linux_scsi * ptp, const uint8_t * cdbp,
                 int time_secs, int vb)
@@ -1794,9 +2786,16 @@ sg_do_nvme_pt(struct sg_pt_base * vp, int fd, int time_secs, int vb)
         case SCSI_SYNC_CACHE10_OPC:
         case SCSI_SYNC_CACHE16_OPC:
             return sntl_sync_cache(ptp, cdbp, time_secs, vb);
+        case SCSI_UNMAP_OPC:
+            return sntl_unmap(ptp, cdbp, time_secs, vb);
+        case SCSI_COMPARE_AND_WRITE_OPC:
+            return sntl_comp_write(ptp, cdbp, time_secs, vb);
         case SCSI_SERVICE_ACT_IN_OPC:
-            if (SCSI_READ_CAPACITY16_SA == (cdbp[1] & SCSI_SA_MSK))
+            sa = SCSI_SA_MSK & cdbp[1];        /* service action */
+            if (SCSI_READ_CAPACITY16_SA == sa)
                 return sntl_readcap(ptp, cdbp, time_secs, vb);
+            else if (SCSI_GET_LBA_STATUS16_SA == sa)
+                return sntl_get_lba_status(ptp, cdbp, time_secs, vb);
             goto fini;
         case SCSI_MAINT_IN_OPC:
             sa = SCSI_SA_MSK & cdbp[1];        /* service action */
@@ -1949,4 +2948,10 @@ do_nvm_pt(struct sg_pt_base * vp, int submq, int timeout_secs, int vb)
     return SCSI_PT_DO_NOT_SUPPORTED;
 }
 
+void
+sg_nvme_uring_release(struct sg_pt_linux_scsi * ptp)
+{
+    if (ptp) { }
+}
+
 #endif          /* (HAVE_NVME && (! IGNORE_NVME)) */
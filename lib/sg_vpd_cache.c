@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2023 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_vpd_cache.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+#ifdef SG_LIB_LINUX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#endif
+
+/* See sg_vpd_cache.h . Each entry is a file in the cache directory whose
+ * name is made from the device identity and the page. The file holds one
+ * text line ("SGVC1 <identity>") followed by the response bytes. */
+
+#define SG_VPD_CACHE_MAGIC "SGVC1 "
+#define SG_VPD_CACHE_ID_LEN 256
+#define SG_VPD_CACHE_MAX_RESP 0xffff
+
+static const char * const cache_ev = "SG3_UTILS_VPD_CACHE";
+static const char * const cache_ttl_ev = "SG3_UTILS_VPD_CACHE_TTL";
+
+/* Page numbers of cached VPD pages */
+static const uint8_t cacheable_vpd_arr[] = {
+    0x0,        /* Supported VPD pages */
+    0x80,       /* Unit serial number */
+    0x83,       /* Device identification */
+    0x86,       /* Extended INQUIRY data */
+    0xb0,       /* Block limits (SBC) */
+    0xb1,       /* Block device characteristics (SBC) */
+};
+
+
+bool
+sg_vpd_cache_active(void)
+{
+    return !! getenv(cache_ev);
+}
+
+bool
+sg_vpd_cache_pg_cacheable(bool evpd, int pg)
+{
+    int k;
+
+    if (! evpd)
+        return (0 == pg);
+    for (k = 0; k < (int)sizeof(cacheable_vpd_arr); ++k) {
+        if (pg == cacheable_vpd_arr[k])
+            return true;
+    }
+    return false;
+}
+
+bool
+sg_vpd_cache_sense_invalidates(const uint8_t * sbp, int sb_len)
+{
+    struct sg_scsi_sense_hdr ssh;
+
+    if ((NULL == sbp) || (! sg_scsi_normalize_sense(sbp, sb_len, &ssh)))
+        return false;
+    /* 0x3f,0x1: MICROCODE HAS BEEN CHANGED (revision level in INQUIRY),
+     * 0x3f,0x3: INQUIRY DATA HAS CHANGED */
+    return (SPC_SK_UNIT_ATTENTION == ssh.sense_key) && (0x3f == ssh.asc) &&
+           ((0x1 == ssh.ascq) || (0x3 == ssh.ascq));
+}
+
+#ifdef SG_LIB_LINUX
+
+static int
+sg_vpd_cache_ttl(void)
+{
+    int n;
+    const char * cp = getenv(cache_ttl_ev);
+
+    if (NULL == cp)
+        return SG_VPD_CACHE_DEF_TTL;
+    n = sg_get_num_nomult(cp);
+    return (n < 0) ? SG_VPD_CACHE_DEF_TTL : n;
+}
+
+static const char *
+sg_vpd_cache_dir(void)
+{
+    const char * cp = getenv(cache_ev);
+
+    if ((NULL == cp) || ('\0' == *cp) || (0 == strcmp(cp, "1")))
+        return SG_VPD_CACHE_DEF_DIR;
+    return cp;
+}
+
+/* Reads the logical unit identity of the device open on sg_fd from sysfs
+ * into 'b' (up to blen bytes including trailing null). Returns true if
+ * found. No command is sent to the device. */
+static bool
+sg_vpd_cache_identity(int sg_fd, char * b, int blen)
+{
+    static const char * const attr_arr[] = {"device/wwid", "wwid"};
+    int k, n;
+    FILE * fp;
+    struct stat st;
+    char path[128];
+
+    if ((sg_fd < 0) || (fstat(sg_fd, &st) < 0))
+        return false;
+    if ((! S_ISCHR(st.st_mode)) && (! S_ISBLK(st.st_mode)))
+        return false;
+    for (k = 0; k < (int)(sizeof(attr_arr) / sizeof(attr_arr[0])); ++k) {
+        snprintf(path, sizeof(path), "/sys/dev/%s/%u:%u/%s",
+                 S_ISCHR(st.st_mode) ? "char" : "block",
+                 major(st.st_rdev), minor(st.st_rdev), attr_arr[k]);
+        fp = fopen(path, "r");
+        if (NULL == fp)
+            continue;
+        if (NULL == fgets(b, blen, fp)) {
+            fclose(fp);
+            continue;
+        }
+        fclose(fp);
+        for (n = (int)strlen(b); (n > 0) && isspace((uint8_t)b[n - 1]); --n)
+            b[n - 1] = '\0';
+        if (n > 0)
+            return true;
+    }
+    return false;
+}
+
+/* Builds the entry file name for identity 'idp' into 'b'. Characters of
+ * the identity that are awkward in file names are replaced by '_' and a
+ * hash of the whole identity is appended so names remain distinct. */
+static void
+sg_vpd_cache_fname(const char * idp, bool evpd, int pg, char * b, int blen)
+{
+    int k, n;
+    uint32_t h = 2166136261U;   /* FNV-1a */
+    const char * cp;
+    char nm[64];
+
+    for (cp = idp; *cp; ++cp) {
+        h ^= (uint8_t)*cp;
+        h *= 16777619U;
+    }
+    for (n = 0, k = 0; idp[k] && (n < (int)sizeof(nm) - 1); ++k) {
+        if (isalnum((uint8_t)idp[k]) || ('.' == idp[k]) || ('-' == idp[k]))
+            nm[n++] = idp[k];
+        else if ((n > 0) && ('_' != nm[n - 1]))
+            nm[n++] = '_';
+    }
+    nm[n] = '\0';
+    snprintf(b, blen, "%s/%s_%08x.%c%02x", sg_vpd_cache_dir(), nm, h,
+             evpd ? 'v' : 's', pg & 0xff);
+}
+
+/* Creates the cache directory (and, for the default, its parent) */
+static bool
+sg_vpd_cache_mkdir(void)
+{
+    const char * dp = sg_vpd_cache_dir();
+    char b[128];
+
+    if (0 == strcmp(dp, SG_VPD_CACHE_DEF_DIR)) {
+        snprintf(b, sizeof(b), "%s", SG_VPD_CACHE_DEF_DIR);
+        *strrchr(b, '/') = '\0';
+        if ((mkdir(b, 0700) < 0) && (EEXIST != errno))
+            return false;
+    }
+    if ((mkdir(dp, 0700) < 0) && (EEXIST != errno))
+        return false;
+    return true;
+}
+
+int
+sg_vpd_cache_get(int sg_fd, bool evpd, int pg, uint8_t * resp,
+                 int mx_resp_len, int * residp, int verbose)
+{
+    int ttl, len, full, n;
+    FILE * fp;
+    uint8_t * bp = NULL;
+    struct stat st;
+    char id[SG_VPD_CACHE_ID_LEN];
+    char fn[PATH_MAX];
+    char line[SG_VPD_CACHE_ID_LEN + 16];
+
+    if ((! sg_vpd_cache_active()) || (! sg_vpd_cache_pg_cacheable(evpd, pg))
+        || (mx_resp_len <= 0) || (! sg_vpd_cache_identity(sg_fd, id,
+                                                          sizeof(id))))
+        return -1;
+    sg_vpd_cache_fname(id, evpd, pg, fn, sizeof(fn));
+    if (stat(fn, &st) < 0)
+        return -1;
+    ttl = sg_vpd_cache_ttl();
+    if ((ttl > 0) && ((time(NULL) - st.st_mtime) > ttl)) {
+        if (verbose > 1)
+            pr2ws("%s: %s expired\n", __func__, fn);
+        return -1;
+    }
+    fp = fopen(fn, "r");
+    if (NULL == fp)
+        return -1;
+    snprintf(line, sizeof(line), SG_VPD_CACHE_MAGIC "%s\n", id);
+    n = strlen(line);
+    bp = (uint8_t *)malloc(SG_VPD_CACHE_MAX_RESP + n);
+    if (NULL == bp) {
+        fclose(fp);
+        return -1;
+    }
+    len = fread(bp, 1, SG_VPD_CACHE_MAX_RESP + n, fp);
+    fclose(fp);
+    /* guard against the unlikely case of two identities sharing a name */
+    if ((len < (n + 4)) || memcmp(bp, line, n)) {
+        free(bp);
+        return -1;
+    }
+    len -= n;
+    if (evpd)
+        full = sg_get_unaligned_be16(bp + n + 2) + 4;
+    else
+        full = (len > 4) ? (bp[n + 4] + 5) : len + 1;
+    /* a truncated response only serves requests no longer than it */
+    if ((len < full) && (mx_resp_len > len)) {
+        free(bp);
+        return -1;
+    }
+    if (len > mx_resp_len)
+        len = mx_resp_len;
+    memcpy(resp, bp + n, len);
+    if (len < mx_resp_len)
+        memset(resp + len, 0, mx_resp_len - len);
+    if (residp)
+        *residp = mx_resp_len - len;
+    free(bp);
+    if (verbose)
+        pr2ws("    inquiry: %s 0x%x response (%d bytes) from cache\n",
+              evpd ? "VPD page" : "standard", pg, len);
+    return 0;
+}
+
+void
+sg_vpd_cache_put(int sg_fd, bool evpd, int pg, const uint8_t * resp,
+                 int len, int verbose)
+{
+    int fd, full;
+    FILE * fp;
+    struct stat st;
+    char id[SG_VPD_CACHE_ID_LEN];
+    char fn[PATH_MAX];
+    char tmp[PATH_MAX + 8];
+
+    if ((! sg_vpd_cache_active()) || (! sg_vpd_cache_pg_cacheable(evpd, pg))
+        || (len < 4) || (len > SG_VPD_CACHE_MAX_RESP) ||
+        (! sg_vpd_cache_identity(sg_fd, id, sizeof(id))))
+        return;
+    /* only store complete responses: a truncated one can't serve a later
+     * request with a larger allocation length */
+    full = evpd ? (sg_get_unaligned_be16(resp + 2) + 4) :
+                  ((len > 4) ? (resp[4] + 5) : (len + 1));
+    if (len < full) {
+        if (verbose > 1)
+            pr2ws("%s: %s 0x%x response truncated (%d < %d), not cached\n",
+                  __func__, evpd ? "VPD page" : "standard", pg, len, full);
+        return;
+    }
+    if (! sg_vpd_cache_mkdir()) {
+        if (verbose)
+            pr2ws("%s: unable to create %s: %s\n", __func__,
+                  sg_vpd_cache_dir(), safe_strerror(errno));
+        return;
+    }
+    sg_vpd_cache_fname(id, evpd, pg, fn, sizeof(fn));
+    /* a longer entry already cached is kept, it serves more requests */
+    if ((stat(fn, &st) == 0) &&
+        (st.st_size > (off_t)(strlen(SG_VPD_CACHE_MAGIC) + strlen(id) + 1 +
+                              len))) {
+        if (verbose > 1)
+            pr2ws("%s: %s holds a longer response, kept\n", __func__, fn);
+        return;
+    }
+    /* write to a unique temporary name then rename() so that readers
+     * never see a partially written entry */
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", fn);
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        if (verbose)
+            pr2ws("%s: mkstemp(%s): %s\n", __func__, tmp,
+                  safe_strerror(errno));
+        return;
+    }
+    fp = fdopen(fd, "w");
+    if (NULL == fp) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    fprintf(fp, SG_VPD_CACHE_MAGIC "%s\n", id);
+    if ((1 != fwrite(resp, len, 1, fp)) || fclose(fp) ||
+        (rename(tmp, fn) < 0)) {
+        if (verbose)
+            pr2ws("%s: unable to write %s: %s\n", __func__, fn,
+                  safe_strerror(errno));
+        unlink(tmp);
+        return;
+    }
+    if (verbose > 1)
+        pr2ws("%s: %s written\n", __func__, fn);
+}
+
+void
+sg_vpd_cache_invalidate(int sg_fd, int verbose)
+{
+    int k;
+    char id[SG_VPD_CACHE_ID_LEN];
+    char fn[PATH_MAX];
+
+    if ((! sg_vpd_cache_active()) ||
+        (! sg_vpd_cache_identity(sg_fd, id, sizeof(id))))
+        return;
+    sg_vpd_cache_fname(id, false, 0, fn, sizeof(fn));
+    unlink(fn);
+    for (k = 0; k < (int)sizeof(cacheable_vpd_arr); ++k) {
+        sg_vpd_cache_fname(id, true, cacheable_vpd_arr[k], fn, sizeof(fn));
+        unlink(fn);
+    }
+    if (verbose)
+        pr2ws("%s: entries for %s removed\n", __func__, id);
+}
+
+#else   /* not SG_LIB_LINUX: no way to find device identity, so bypass */
+
+int
+sg_vpd_cache_get(int sg_fd, bool evpd, int pg, uint8_t * resp,
+                 int mx_resp_len, int * residp, int verbose)
+{
+    if (sg_fd) { ; }
+    if (evpd) { ; }
+    if (pg) { ; }
+    if (resp) { ; }
+    if (mx_resp_len) { ; }
+    if (residp) { ; }
+    if (verbose) { ; }
+    return -1;
+}
+
+void
+sg_vpd_cache_put(int sg_fd, bool evpd, int pg, const uint8_t * resp,
+                 int len, int verbose)
+{
+    if (sg_fd) { ; }
+    if (evpd) { ; }
+    if (pg) { ; }
+    if (resp) { ; }
+    if (len) { ; }
+    if (verbose) { ; }
+}
+
+void
+sg_vpd_cache_invalidate(int sg_fd, int verbose)
+{
+    if (sg_fd) { ; }
+    if (verbose) { ; }
+}
+
+#endif  /* SG_LIB_LINUX */
@@ -28,6 +28,11 @@
  * This command performs a SCSI COMPARE AND WRITE. See SBC-3 at
  * https://www.t10.org
  *
+ * It also has a benchmark mode (--bench=) in which several threads loop
+ * doing read-modify-COMPARE AND WRITE on one or more shared blocks, the
+ * way clustered file systems use that command as a distributed lock. It
+ * counts miscompares and retries and reports latency percentiles.
+ *
  */
 
 #ifndef __sun
@@ -43,6 +48,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <signal.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #include <getopt.h>
@@ -55,8 +61,9 @@
 #include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
-static const char * version_str = "1.33 20230618";
+static const char * version_str = "1.34 20231031";
 
 #define DEF_BLOCK_SIZE 512
 #define DEF_NUM_BLOCKS (1)
@@ -65,12 +72,24 @@ static const char * version_str = "1.33 20230618";
 
 #define COMPARE_AND_WRITE_OPCODE (0x89)
 #define COMPARE_AND_WRITE_CDB_SIZE (16)
+#define READ16_OPCODE (0x88)
+#define READ16_CDB_SIZE (16)
+#define RCAP10_RESP_LEN 8
+
+/* Lock record placed at the start of the first block by benchmark mode */
+#define LK_OWNER_OFF 0          /* 8 byte host identifier */
+#define LK_PID_OFF 8            /* 4 byte process identifier */
+#define LK_THREAD_OFF 12        /* 4 byte thread index */
+#define LK_SEQ_OFF 16           /* 8 byte acquisition sequence number */
+#define LK_TIME_OFF 24          /* 8 byte monotonic time (ns) */
+#define LK_REC_LEN 32
 
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 
 #define ME "sg_compare_and_write: "
 
 static const struct option long_options[] = {
+        {"bench", required_argument, 0, 'b'},
         {"dpo", no_argument, 0, 'd'},
         {"fua", no_argument, 0, 'f'},
         {"fua_nv", no_argument, 0, 'F'},
@@ -82,7 +101,9 @@ static const struct option long_options[] = {
         {"inc", required_argument, 0, 'C'},
         {"inw", required_argument, 0, 'D'},
         {"lba", required_argument, 0, 'l'},
+        {"locks", required_argument, 0, 'L'},
         {"num", required_argument, 0, 'n'},
+        {"parallel", required_argument, 0, 'P'},
         {"quiet", no_argument, 0, 'q'},
         {"timeout", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
@@ -101,14 +122,19 @@ struct caw_flags {
 };
 
 struct opts_t {
+        bool bench;             /* --bench=CNT[,SECS] given */
         bool quiet;
         bool verbose_given;
         bool version_given;
         bool wfn_given;
         int numblocks;
+        int num_locks;          /* --locks=LK, blocks contended for */
+        int num_threads;        /* --parallel=P */
         int verbose;
         int timeout;
         int xfer_len;
+        uint32_t bench_secs;    /* 0 -> no time limit */
+        uint64_t bench_cnt;     /* acquisitions per thread, 0 -> no limit */
         uint64_t lba;
         const char * ifn;
         const char * wfn;
@@ -120,16 +146,25 @@ struct opts_t {
 static void
 usage()
 {
-        pr2serr("Usage: sg_compare_and_write [--dpo] [--fua] [--fua_nv] "
-                "[--grpnum=GN] [--help]\n"
-                "                            --in=IF|--inc=IF [--inw=WF] "
-                "--lba=LBA "
-                "[--num=NUM]\n"
-                "                            [--quiet] [--timeout=TO] "
-                "[--verbose] [--version]\n"
-                "                            [--wrprotect=WP] [--xferlen=LEN] "
-                "DEVICE\n"
+        pr2serr("Usage: sg_compare_and_write [--bench=CNT[,SECS]] [--dpo] "
+                "[--fua] [--fua_nv]\n"
+                "                            [--grpnum=GN] [--help] "
+                "--in=IF|--inc=IF\n"
+                "                            [--inw=WF] --lba=LBA "
+                "[--locks=LK] [--num=NUM]\n"
+                "                            [--parallel=P] [--quiet] "
+                "[--timeout=TO]\n"
+                "                            [--verbose] [--version] "
+                "[--wrprotect=WP]\n"
+                "                            [--xferlen=LEN] DEVICE\n"
                 "  where:\n"
+                "    --bench=CNT[,SECS]|-b CNT[,SECS]    benchmark: each "
+                "thread loops\n"
+                "                        read-modify-COMPARE AND WRITE "
+                "until it has\n"
+                "                        acquired CNT times (0: no limit) "
+                "or SECS\n"
+                "                        seconds pass; --in=IF not needed\n"
                 "    --dpo|-d            set the dpo bit in cdb (def: "
                 "clear)\n"
                 "    --fua|-f            set the fua bit in cdb (def: "
@@ -149,8 +184,14 @@ usage()
                 "buffer\n"
                 "    --lba=LBA|-l LBA    LBA of the first block to compare "
                 "and write\n"
+                "    --locks=LK|-L LK    benchmark: LK lock blocks starting "
+                "at LBA, thread\n"
+                "                        k uses lock (k %% LK) (def: 1, "
+                "all contend)\n"
                 "    --num=NUM|-n NUM    number of blocks to "
                 "compare/write (def: 1)\n"
+                "    --parallel=P|-P P    benchmark: number of threads "
+                "(def: 8)\n"
                 "    --quiet|-q          suppress MISCOMPARE report to "
                 "stderr,\n"
                 "                        still sets exit status of 14\n"
@@ -170,7 +211,10 @@ usage()
                 "size\nbuffer, the first half is used to compare what is at "
                 "LBA for NUM\nblocks. If and only if the comparison is "
                 "equal, then the second\nhalf of the buffer is written to "
-                "LBA for NUM blocks.\n");
+                "LBA for NUM blocks.\n"
+                "With --bench= several threads contend for lock blocks "
+                "with COMPARE AND\nWRITE and acquisitions, miscompares, "
+                "retries and latencies are reported.\n");
 }
 
 static int
@@ -178,8 +222,9 @@ parse_args(int argc, char* argv[], struct opts_t * op)
 {
         bool lba_given = false;
         bool if_given = false;
-        int c;
+        int c, n;
         int64_t ll;
+        const char * cp;
 
         op->numblocks = DEF_NUM_BLOCKS;
         /* COMPARE AND WRITE defines 2*buffers compare + write */
@@ -189,12 +234,31 @@ parse_args(int argc, char* argv[], struct opts_t * op)
         while (1) {
                 int option_index = 0;
 
-                c = getopt_long(argc, argv, "C:dD:fFg:hi:l:n:qt:vVw:x:",
+                c = getopt_long(argc, argv, "b:C:dD:fFg:hi:l:L:n:P:qt:vVw:x:",
                                 long_options, &option_index);
                 if (c == -1)
                         break;
 
                 switch (c) {
+                case 'b':
+                        ll = sg_get_llnum(optarg);
+                        if (ll < 0) {
+                                pr2serr("bad first argument to '--bench='\n");
+                                goto out_err_no_usage;
+                        }
+                        op->bench_cnt = (uint64_t)ll;
+                        cp = strchr(optarg, ',');
+                        if (cp) {
+                                n = sg_get_num(cp + 1);
+                                if (n < 0) {
+                                        pr2serr("bad second argument to "
+                                                "'--bench='\n");
+                                        goto out_err_no_usage;
+                                }
+                                op->bench_secs = (uint32_t)n;
+                        }
+                        op->bench = true;
+                        break;
                 case 'C':
                 case 'i':
                         op->ifn = optarg;
@@ -235,6 +299,14 @@ parse_args(int argc, char* argv[], struct opts_t * op)
                         op->lba = (uint64_t)ll;
                         lba_given = true;
                         break;
+                case 'L':
+                        op->num_locks = sg_get_num(optarg);
+                        if (op->num_locks < 1) {
+                                pr2serr("bad argument to '--locks', expect "
+                                        "1 or more\n");
+                                goto out_err_no_usage;
+                        }
+                        break;
                 case 'n':
                         op->numblocks = sg_get_num(optarg);
                         if ((op->numblocks < 0) || (op->numblocks > 255))  {
@@ -243,6 +315,16 @@ parse_args(int argc, char* argv[], struct opts_t * op)
                                 goto out_err_no_usage;
                         }
                         break;
+                case 'P':
+                        op->num_threads = sg_get_num(optarg);
+                        if ((op->num_threads < 1) ||
+                            (op->num_threads > SG_PAR_MAX_WORKERS)) {
+                                pr2serr("bad argument to '--parallel=', "
+                                        "expect 1 to %d\n",
+                                        SG_PAR_MAX_WORKERS);
+                                goto out_err_no_usage;
+                        }
+                        break;
                 case 'q':
                         op->quiet = true;
                         break;
@@ -298,15 +380,20 @@ parse_args(int argc, char* argv[], struct opts_t * op)
                 pr2serr("missing device name!\n");
                 goto out_err;
         }
-        if (! if_given) {
+        if ((! if_given) && (! op->bench)) {
                 pr2serr("missing input file\n");
                 goto out_err;
         }
+        if ((op->num_locks || op->num_threads) && (! op->bench)) {
+                pr2serr("--locks= and --parallel= only apply to "
+                        "--bench=\n");
+                goto out_err_no_usage;
+        }
         if (! lba_given) {
                 pr2serr("missing lba\n");
                 goto out_err;
         }
-        if (0 == op->xfer_len)
+        if ((0 == op->xfer_len) && (! op->bench))
             op->xfer_len = 2 * op->numblocks * DEF_BLOCK_SIZE;
         return 0;
 
@@ -469,6 +556,414 @@ open_dev(const char * outf, int verbose)
         return sg_fd;
 }
 
+/* Benchmark mode follows. Each thread opens DEVICE and loops doing
+ * read-modify-COMPARE AND WRITE on its lock block: the compare buffer is
+ * the lock's expected content and the write buffer is that content with
+ * a new lock record (owner, sequence number, time) at its start. After a
+ * successful COMPARE AND WRITE (an acquisition) the expected content is
+ * what was written; after a MISCOMPARE (another thread or host got there
+ * first) the lock block is read again. */
+
+static volatile sig_atomic_t bench_stop = 0;
+
+struct caw_thr_t {
+        int res;                /* 0 or first SG_LIB_* error */
+        uint64_t caws;          /* COMPARE AND WRITE commands completed */
+        uint64_t acquired;      /* ... of which compared equal */
+        uint64_t miscompares;
+        uint64_t reads;
+        uint64_t retries;       /* unit attentions and aborted commands */
+        uint64_t start_ns;
+        uint64_t end_ns;
+        struct sg_par_lat_hist caw_lat;
+        struct sg_par_lat_hist acq_lat; /* from first try to acquisition */
+};
+
+struct caw_bench_t {
+        int bs;                 /* logical block size */
+        uint64_t host_id;
+        uint64_t deadline;      /* 0 -> no time limit */
+        const struct opts_t * op;
+        struct caw_thr_t * thr_arr;
+};
+
+
+static void
+bench_interrupt_handler(int sig)
+{
+        struct sigaction sigact;
+
+        /* a second signal of the same type terminates */
+        sigact.sa_handler = SIG_DFL;
+        sigemptyset(&sigact.sa_mask);
+        sigact.sa_flags = 0;
+        sigaction(sig, &sigact, NULL);
+        bench_stop = 1;
+}
+
+static void
+install_handler(int sig_num, void (*sig_handler)(int sig))
+{
+        struct sigaction sigact;
+
+        sigaction(sig_num, NULL, &sigact);
+        if (sigact.sa_handler != SIG_IGN) {
+                sigact.sa_handler = sig_handler;
+                sigemptyset(&sigact.sa_mask);
+                sigact.sa_flags = 0;
+                sigaction(sig_num, &sigact, NULL);
+        }
+}
+
+/* Identifies this host in lock records so that contention between hosts
+ * can be told apart. FNV-1a hash of the host name. */
+static uint64_t
+bench_host_id(void)
+{
+        int k;
+        uint64_t h = 0xcbf29ce484222325ULL;
+        char b[256];
+
+        memset(b, 0, sizeof(b));
+        if (gethostname(b, sizeof(b) - 1) < 0)
+                snprintf(b, sizeof(b), "unknown");
+        for (k = 0; b[k]; ++k) {
+                h ^= (uint8_t)b[k];
+                h *= 0x100000001b3ULL;
+        }
+        return h;
+}
+
+/* Returns 0 for success, various SG_LIB_CAT_* values, otherwise -1 . */
+static int
+sg_ll_read16(int sg_fd, uint8_t * buff, int blocks, int64_t lba,
+             int xfer_len, int verbose)
+{
+        int sense_cat, res, ret;
+        struct sg_pt_base * ptvp;
+        uint8_t rCmd[READ16_CDB_SIZE];
+        uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+
+        memset(rCmd, 0, sizeof(rCmd));
+        rCmd[0] = READ16_OPCODE;
+        sg_put_unaligned_be64((uint64_t)lba, rCmd + 2);
+        sg_put_unaligned_be32((uint32_t)blocks, rCmd + 10);
+        ptvp = construct_scsi_pt_obj();
+        if (NULL == ptvp) {
+                pr2serr("Could not construct scsit_pt_obj, out of memory\n");
+                return -1;
+        }
+        set_scsi_pt_cdb(ptvp, rCmd, READ16_CDB_SIZE);
+        set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+        set_scsi_pt_data_in(ptvp, buff, xfer_len);
+        if (verbose > 1) {
+                char b[128];
+
+                pr2serr("    Read(16) cdb: %s\n",
+                        sg_get_command_str(rCmd, READ16_CDB_SIZE, false,
+                                           sizeof(b), b));
+        }
+        res = do_scsi_pt(ptvp, sg_fd, DEF_TIMEOUT_SECS, verbose);
+        ret = sg_cmds_process_resp(ptvp, "READ(16)", res, true, verbose,
+                                   &sense_cat);
+        if (-1 == ret) {
+                if (get_scsi_pt_transport_err(ptvp))
+                        ret = SG_LIB_TRANSPORT_ERROR;
+                else
+                        ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+        } else if (-2 == ret) {
+                switch (sense_cat) {
+                case SG_LIB_CAT_RECOVERED:
+                case SG_LIB_CAT_NO_SENSE:
+                        ret = 0;
+                        break;
+                default:
+                        ret = sense_cat;
+                        break;
+                }
+        } else
+                ret = 0;
+        destruct_scsi_pt_obj(ptvp);
+        return ret;
+}
+
+static bool
+bench_more(const struct caw_bench_t * bp, const struct caw_thr_t * tp)
+{
+        if (bench_stop || tp->res)
+                return false;
+        if (bp->op->bench_cnt && (tp->acquired >= bp->op->bench_cnt))
+                return false;
+        if (bp->deadline && (sg_par_mono_ns() >= bp->deadline))
+                return false;
+        return true;
+}
+
+/* Worker for sg_par_run(), one call per benchmark thread */
+static int
+bench_work(void * ctxp, int idx)
+{
+        bool have_cmp = false;
+        int fd, res, half_xlen;
+        int vb;
+        int64_t lba;
+        uint64_t t, acq_start;
+        struct caw_bench_t * bp = (struct caw_bench_t *)ctxp;
+        const struct opts_t * op = bp->op;
+        struct caw_thr_t * tp = bp->thr_arr + idx;
+        uint8_t * buff;
+        uint8_t * free_buff = NULL;
+        uint8_t * wp;
+
+        vb = (op->verbose > 1) ? op->verbose - 1 : 0;
+        half_xlen = op->numblocks * bp->bs;
+        lba = op->lba + ((int64_t)(idx % op->num_locks) * op->numblocks);
+        fd = sg_cmds_open_device(op->device_name, false /* rw */, vb);
+        if (fd < 0) {
+                sg_par_lock();
+                pr2serr(ME "thread %d: open error: %s: %s\n", idx,
+                        op->device_name, safe_strerror(-fd));
+                sg_par_unlock();
+                tp->res = sg_convert_errno(-fd);
+                return tp->res;
+        }
+        buff = sg_memalign(2 * half_xlen, 0, &free_buff, false);
+        if (NULL == buff) {
+                tp->res = sg_convert_errno(ENOMEM);
+                goto fini;
+        }
+        wp = buff + half_xlen;
+        tp->start_ns = sg_par_mono_ns();
+        while (bench_more(bp, tp)) {
+                acq_start = sg_par_mono_ns();
+                while (bench_more(bp, tp)) {
+                        if (! have_cmp) {
+                                res = sg_ll_read16(fd, buff, op->numblocks,
+                                                   lba, half_xlen, vb);
+                                ++tp->reads;
+                                if ((SG_LIB_CAT_UNIT_ATTENTION == res) ||
+                                    (SG_LIB_CAT_ABORTED_COMMAND == res)) {
+                                        ++tp->retries;
+                                        continue;
+                                } else if (res) {
+                                        tp->res = (res > 0) ? res :
+                                                  SG_LIB_CAT_OTHER;
+                                        break;
+                                }
+                                have_cmp = true;
+                        }
+                        memcpy(wp, buff, half_xlen);
+                        sg_put_unaligned_be64(bp->host_id, wp + LK_OWNER_OFF);
+                        sg_put_unaligned_be32((uint32_t)getpid(),
+                                              wp + LK_PID_OFF);
+                        sg_put_unaligned_be32((uint32_t)idx,
+                                              wp + LK_THREAD_OFF);
+                        sg_put_unaligned_be64(sg_get_unaligned_be64(buff +
+                                                        LK_SEQ_OFF) + 1,
+                                              wp + LK_SEQ_OFF);
+                        t = sg_par_mono_ns();
+                        sg_put_unaligned_be64(t, wp + LK_TIME_OFF);
+                        res = sg_ll_compare_and_write(fd, buff,
+                                        op->numblocks, lba, 2 * half_xlen,
+                                        op->flags, false, vb);
+                        if ((0 == res) || (SG_LIB_CAT_MISCOMPARE == res)) {
+                                sg_par_lat_add(&tp->caw_lat,
+                                               sg_par_mono_ns() - t);
+                                ++tp->caws;
+                        }
+                        if (0 == res) {
+                                ++tp->acquired;
+                                sg_par_lat_add(&tp->acq_lat,
+                                               sg_par_mono_ns() - acq_start);
+                                /* what we wrote is expected next time */
+                                memcpy(buff, wp, half_xlen);
+                                break;
+                        } else if (SG_LIB_CAT_MISCOMPARE == res) {
+                                ++tp->miscompares;
+                                have_cmp = false;
+                        } else if ((SG_LIB_CAT_UNIT_ATTENTION == res) ||
+                                   (SG_LIB_CAT_ABORTED_COMMAND == res))
+                                ++tp->retries;
+                        else
+                                tp->res = (res > 0) ? res : SG_LIB_CAT_OTHER;
+                }
+        }
+        tp->end_ns = sg_par_mono_ns();
+        if (tp->res)
+                bench_stop = 1;         /* stop the other threads */
+fini:
+        if (free_buff)
+                free(free_buff);
+        sg_cmds_close_device(fd);
+        return tp->res;
+}
+
+static void
+bench_prt_lat(const char * name, const struct sg_par_lat_hist * lhp)
+{
+        int k;
+        static const double pc_arr[] = {50.0, 90.0, 99.0, 99.9};
+        static const char * pc_nm_arr[] = {"p50", "p90", "p99", "p99.9"};
+
+        printf("  %s latency (usecs): min=%" PRIu64 ", mean=%" PRIu64,
+               name, lhp->min / 1000,
+               (lhp->count ? (lhp->sum / lhp->count) / 1000 : 0));
+        for (k = 0; k < (int)SG_ARRAY_SIZE(pc_arr); ++k)
+                printf(", %s=%" PRIu64, pc_nm_arr[k],
+                       sg_par_lat_percentile(lhp, pc_arr[k]) / 1000);
+        printf(", max=%" PRIu64 "\n", lhp->max / 1000);
+}
+
+/* Runs the COMPARE AND WRITE contention benchmark and prints its results.
+ * Returns 0 on success, otherwise the first error reported by a thread. */
+static int
+do_bench(struct opts_t * op)
+{
+        int k, res, fd;
+        int ret = 0;
+        int vb = op->verbose;
+        uint64_t caws, acquired, miscompares, reads, retries;
+        uint64_t min_start, max_end;
+        double secs;
+        struct caw_thr_t * thr_arr;
+        struct caw_bench_t bench;
+        struct sg_par_lat_hist caw_all, acq_all;
+        uint8_t rcap[RCAP10_RESP_LEN];
+
+        memset(&bench, 0, sizeof(bench));
+        if (op->num_threads < 1)
+                op->num_threads = SG_PAR_DEF_WORKERS;
+        if (op->num_locks < 1)
+                op->num_locks = 1;
+        if (0 == op->numblocks) {
+                pr2serr(ME "--bench= needs --num=NUM of 1 or more\n");
+                return SG_LIB_SYNTAX_ERROR;
+        }
+        if (op->xfer_len > 0)   /* user knows the block size (plus PI) */
+                bench.bs = op->xfer_len / (2 * op->numblocks);
+        else {
+                fd = sg_cmds_open_device(op->device_name, true /* ro */,
+                                         vb);
+                if (fd < 0) {
+                        pr2serr(ME "open error: %s: %s\n", op->device_name,
+                                safe_strerror(-fd));
+                        return sg_convert_errno(-fd);
+                }
+                res = sg_ll_readcap_10(fd, false, 0, rcap, sizeof(rcap),
+                                       true, vb);
+                sg_cmds_close_device(fd);
+                if (0 == res)
+                        bench.bs = sg_get_unaligned_be32(rcap + 4);
+                else {
+                        bench.bs = DEF_BLOCK_SIZE;
+                        if (vb)
+                                pr2serr("READ CAPACITY failed, assume a "
+                                        "block size of %d\n", bench.bs);
+                }
+        }
+        if (bench.bs < LK_REC_LEN) {
+                pr2serr(ME "block size (%d) too small\n", bench.bs);
+                return SG_LIB_SYNTAX_ERROR;
+        }
+        thr_arr = (struct caw_thr_t *)calloc(op->num_threads,
+                                             sizeof(*thr_arr));
+        if (NULL == thr_arr) {
+                pr2serr(ME "out of memory\n");
+                return sg_convert_errno(ENOMEM);
+        }
+        bench.op = op;
+        bench.thr_arr = thr_arr;
+        bench.host_id = bench_host_id();
+        if (vb)
+                pr2serr("Starting %d thread%s on %d lock block%s at LBA "
+                        "0x%" PRIx64 ", host id 0x%" PRIx64 "\n",
+                        op->num_threads, (op->num_threads > 1 ? "s" : ""),
+                        op->num_locks, (op->num_locks > 1 ? "s" : ""),
+                        op->lba, bench.host_id);
+        install_handler(SIGINT, bench_interrupt_handler);
+        install_handler(SIGQUIT, bench_interrupt_handler);
+        install_handler(SIGPIPE, bench_interrupt_handler);
+        if (op->bench_secs > 0)
+                bench.deadline = sg_par_mono_ns() +
+                                 ((uint64_t)op->bench_secs * 1000000000ULL);
+        res = sg_par_run(op->num_threads, op->num_threads, bench_work, NULL,
+                         &bench);
+        if (res) {
+                pr2serr(ME "unable to start threads: %s\n",
+                        safe_strerror(res));
+                free(thr_arr);
+                return sg_convert_errno(res);
+        }
+
+        sg_par_lat_init(&caw_all);
+        sg_par_lat_init(&acq_all);
+        caws = 0;
+        acquired = 0;
+        miscompares = 0;
+        reads = 0;
+        retries = 0;
+        min_start = 0;
+        max_end = 0;
+        for (k = 0; k < op->num_threads; ++k) {
+                const struct caw_thr_t * tp = thr_arr + k;
+
+                if (tp->res && (0 == ret))
+                        ret = tp->res;
+                if (0 == tp->start_ns)
+                        continue;       /* did not get as far as starting */
+                if ((0 == min_start) || (tp->start_ns < min_start))
+                        min_start = tp->start_ns;
+                if (tp->end_ns > max_end)
+                        max_end = tp->end_ns;
+                caws += tp->caws;
+                acquired += tp->acquired;
+                miscompares += tp->miscompares;
+                reads += tp->reads;
+                retries += tp->retries;
+                sg_par_lat_merge(&caw_all, &tp->caw_lat);
+                sg_par_lat_merge(&acq_all, &tp->acq_lat);
+        }
+        secs = (max_end > min_start) ?
+               (max_end - min_start) / 1000000000.0 : 0.0;
+        printf("COMPARE AND WRITE benchmark on %s: %d thread%s, %d lock "
+               "block%s at LBA 0x%" PRIx64 ", %d block%s each\n",
+               op->device_name, op->num_threads,
+               (op->num_threads > 1 ? "s" : ""), op->num_locks,
+               (op->num_locks > 1 ? "s" : ""), op->lba, op->numblocks,
+               (op->numblocks > 1 ? "s" : ""));
+        printf("  elapsed: %.3f secs%s, acquisitions: %" PRIu64 " (%.1f/sec)"
+               "\n", secs, (bench_stop && (0 == ret) ? " [interrupted]" :
+                            ""), acquired,
+               (secs > 0.0) ? acquired / secs : 0.0);
+        printf("  COMPARE AND WRITEs: %" PRIu64 ", miscompares: %" PRIu64
+               " (%.1f%%), reads: %" PRIu64 ", retries: %" PRIu64 "\n",
+               caws, miscompares,
+               caws ? (100.0 * miscompares) / caws : 0.0, reads, retries);
+        bench_prt_lat("CAW", &caw_all);
+        bench_prt_lat("acquire", &acq_all);
+        if (vb) {
+                for (k = 0; k < op->num_threads; ++k) {
+                        const struct caw_thr_t * tp = thr_arr + k;
+
+                        printf("  thread %d: lock %d, acquisitions=%" PRIu64
+                               ", miscompares=%" PRIu64 ", acquire p99=%"
+                               PRIu64 " usecs, result=%d\n", k,
+                               k % op->num_locks, tp->acquired,
+                               tp->miscompares,
+                               sg_par_lat_percentile(&tp->acq_lat, 99.0) /
+                               1000, tp->res);
+                }
+        }
+        if (ret) {
+                char b[80];
+
+                sg_get_category_sense_str(ret, sizeof(b), b, vb);
+                pr2serr(ME "benchmark stopped: %s\n", b);
+        }
+        free(thr_arr);
+        return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -514,6 +1009,11 @@ main(int argc, char * argv[])
                 return 0;
         }
         vb = op->verbose;
+        if (op->bench) {
+                ifn_stdin = false;
+                res = do_bench(op);
+                goto out;
+        }
 
         if (vb) {
                 pr2serr("Running COMPARE AND WRITE command with the "
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <ctype.h>
 #include <unistd.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
@@ -36,11 +37,12 @@
 #include "sg_lib.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_monitor.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
 #include "sg_pt.h"
 
-static const char * version_str = "1.73 20230618";
+static const char * version_str = "1.74 20231023";
 
 
 #define MY_NAME "sg_format"
@@ -56,6 +58,8 @@ static const char * version_str = "1.73 20230618";
 
 #define POLL_DURATION_SECS 60
 #define POLL_DURATION_FFMT_SECS 10
+#define POLL_MIN_MS 5000        /* adaptive poll interval bounds */
+#define POLL_MAX_MS (10 * 60 * 1000)
 #define DEF_POLL_TYPE_RS false     /* false -> test unit ready;
                                       true -> request sense */
 #define MAX_BUFF_SZ     252
@@ -396,13 +400,80 @@ sg_ll_format_with_preset(int sg_fd, bool immed, bool fmtmaxlba,
         return ret;
 }
 
+/* Progress monitor callback, keeps the output of earlier versions */
+static void
+format_event(void * ctxp, const struct sg_mon_event * evp)
+{
+        int vb = *(const int *)ctxp;
+        uint32_t e;
+        char b[160];
+
+        switch (evp->type) {
+        case SG_MON_EV_START:
+        case SG_MON_EV_PROGRESS:
+                if (evp->progress < 0)
+                        break;
+                printf("%s in progress, %d.%02d%% done", evp->op_name,
+                       (evp->progress * 100) / 65536,
+                       ((evp->progress * 100) % 65536) / 656);
+                if (evp->eta_ms > 0) {
+                        e = (evp->eta_ms + 999) / 1000;
+                        printf(", about %u:%02u:%02u remaining", e / 3600,
+                               (e / 60) % 60, e % 60);
+                }
+                printf("\n");
+                break;
+        case SG_MON_EV_DONE:
+                if ((1 == evp->num_polls) && vb)
+                        pr2serr("%s seems to be successful and finished "
+                                "quickly\n", evp->op_name);
+                break;
+        default:
+                pr2serr("%s\n", sg_mon_event_str(evp, sizeof(b), b));
+                break;
+        }
+}
+
+/* Polls with TEST UNIT READY (or REQUEST SENSE if --poll=1) until the
+ * progress indication goes away. The first poll is after 'first_secs'
+ * seconds, thereafter the interval adapts to the rate of progress.
+ * Returns 0 on success. */
+static int
+poll_for_completion(int fd, const struct opts_t * op, const char * cmd_s,
+                    int first_secs)
+{
+        int k, res;
+        int vb = op->verbose;
+        struct sg_monitor * mp;
+        char b[32];
+
+        mp = sg_mon_create(POLL_MIN_MS, POLL_MAX_MS, NULL, NULL, vb);
+        if ((NULL == mp) ||
+            (sg_mon_add(mp, fd, op->device_name, cmd_s,
+                        (op->poll_type ? SG_MON_POLL_RS : SG_MON_POLL_TUR),
+                        false, first_secs * 1000) < 0)) {
+                pr2serr("%s: unable to start progress monitor\n", __func__);
+                sg_mon_destroy(mp);
+                return sg_convert_errno(ENOMEM);
+        }
+        res = sg_mon_run(mp, 0 /* no timeout */, format_event, &vb);
+        sg_mon_destroy(mp);
+        if (res)
+                return res;
+        for (k = 0; cmd_s[k] && (k < (int)sizeof(b) - 1); ++k)
+                b[k] = toupper((uint8_t)cmd_s[k]);
+        b[k] = '\0';
+        printf("%s Complete\n", b);
+        return 0;
+}
+
 /* Return 0 on success, else see sg_ll_format_unit_v2() */
 static int
 scsi_format_unit(int fd, const struct opts_t * op)
 {
-        bool need_param_lst, longlist, ip_desc, first;
+        bool need_param_lst, longlist, ip_desc;
         bool immed = ! op->fwait;
-        int res, progress, pr, rem, param_sz, off, resp_len, tmout;
+        int res, param_sz, off, tmout;
         int poll_wait_secs;
         int vb = op->verbose;
         const int SH_FORMAT_HEADER_SZ = 4;
@@ -516,82 +587,15 @@ scsi_format_unit(int fd, const struct opts_t * op)
         }
         poll_wait_secs = op->ffmt ? POLL_DURATION_FFMT_SECS :
                                     POLL_DURATION_SECS;
-        if (! op->poll_type) {
-                for(first = true; ; first = false) {
-                        sg_sleep_secs(poll_wait_secs);
-                        progress = -1;
-                        res = sg_ll_test_unit_ready_progress(fd, 0, &progress,
-                                             true, (vb > 1) ? (vb - 1) : 0);
-                        if (progress >= 0) {
-                                pr = (progress * 100) / 65536;
-                                rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fu_s, pr, rem);
-                        } else {
-                                if (first && op->verbose)
-                                        pr2serr("%s seems to be successful "
-                                                "and finished quickly\n",
-                                                fu_s);
-                                break;
-                        }
-                }
-        }
-        if (op->poll_type || (SG_LIB_CAT_NOT_READY == res)) {
-                uint8_t * reqSense;
-                uint8_t * free_reqSense = NULL;
-
-                reqSense = sg_memalign(MAX_BUFF_SZ, 0, &free_reqSense, false);
-                if (NULL == reqSense) {
-                        pr2serr("%s: unable to obtain heap for Request "
-                                "Sense\n", __func__);
-                        return sg_convert_errno(ENOMEM);
-                }
-                for(first = true; ; first = false) {
-                        sg_sleep_secs(poll_wait_secs);
-                        memset(reqSense, 0x0, MAX_BUFF_SZ);
-                        res = sg_ll_request_sense(fd, false, reqSense,
-                                                  MAX_BUFF_SZ, false,
-                                                  (vb > 1) ? (vb - 1) : 0);
-                        if (res) {
-                                pr2serr("polling with Request Sense command "
-                                        "failed [res=%d]\n", res);
-                                break;
-                        }
-                        resp_len = reqSense[7] + 8;
-                        if (vb > 1) {
-                                pr2serr("Parameter data in hex:\n");
-                                hex2stderr(reqSense, resp_len, 1);
-                        }
-                        progress = -1;
-                        sg_get_sense_progress_fld(reqSense, resp_len,
-                                                  &progress);
-                        if (progress >= 0) {
-                                pr = (progress * 100) / 65536;
-                                rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fu_s, pr, rem);
-                        } else {
-                                if (first && op->verbose)
-                                        pr2serr("%s seems to be successful "
-                                                "and finished quickly\n",
-                                                fu_s);
-                                break;
-                        }
-                }
-                if (free_reqSense)
-                        free(free_reqSense);
-        }
-        printf("FORMAT UNIT Complete\n");
-        return 0;
+        return poll_for_completion(fd, op, fu_s, poll_wait_secs);
 }
 
 /* Return 0 on success, else see sg_ll_format_medium() above */
 static int
 scsi_format_medium(int fd, const struct opts_t * op)
 {
-        bool first;
         bool immed = ! op->fwait;
-        int res, progress, pr, rem, resp_len, tmout;
+        int res, tmout;
         int vb = op->verbose;
         char b[80];
 
@@ -637,82 +641,15 @@ scsi_format_medium(int fd, const struct opts_t * op)
                 printf("No point in polling for progress, so exit\n");
                 return 0;
         }
-        if (! op->poll_type) {
-                for(first = true; ; first = false) {
-                        sg_sleep_secs(POLL_DURATION_SECS);
-                        progress = -1;
-                        res = sg_ll_test_unit_ready_progress(fd, 0, &progress,
-                                             true, (vb > 1) ? (vb - 1) : 0);
-                        if (progress >= 0) {
-                                pr = (progress * 100) / 65536;
-                                rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fm_s, pr, rem);
-                        } else {
-                                if (first && op->verbose)
-                                        pr2serr("%s seems to be successful "
-                                                "and finished quickly\n",
-                                                fm_s);
-                                break;
-                        }
-                }
-        }
-        if (op->poll_type || (SG_LIB_CAT_NOT_READY == res)) {
-                uint8_t * reqSense;
-                uint8_t * free_reqSense = NULL;
-
-                reqSense = sg_memalign(MAX_BUFF_SZ, 0, &free_reqSense, false);
-                if (NULL == reqSense) {
-                        pr2serr("%s: unable to obtain heap for Request "
-                                "Sense\n", __func__);
-                        return sg_convert_errno(ENOMEM);
-                }
-                for(first = true; ; first = false) {
-                        sg_sleep_secs(POLL_DURATION_SECS);
-                        memset(reqSense, 0x0, MAX_BUFF_SZ);
-                        res = sg_ll_request_sense(fd, false, reqSense,
-                                                  MAX_BUFF_SZ, false,
-                                                  (vb > 1) ? (vb - 1) : 0);
-                        if (res) {
-                                pr2serr("polling with Request Sense command "
-                                        "failed [res=%d]\n", res);
-                                break;
-                        }
-                        resp_len = reqSense[7] + 8;
-                        if (vb > 1) {
-                                pr2serr("Parameter data in hex:\n");
-                                hex2stderr(reqSense, resp_len, 1);
-                        }
-                        progress = -1;
-                        sg_get_sense_progress_fld(reqSense, resp_len,
-                                                  &progress);
-                        if (progress >= 0) {
-                                pr = (progress * 100) / 65536;
-                                rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fm_s, pr, rem);
-                        } else {
-                                if (first && op->verbose)
-                                        pr2serr("%s seems to be successful "
-                                                "and finished quickly\n",
-                                                fm_s);
-                                break;
-                        }
-                }
-                if (free_reqSense)
-                        free(free_reqSense);
-        }
-        printf("FORMAT MEDIUM Complete\n");
-        return 0;
+        return poll_for_completion(fd, op, fm_s, POLL_DURATION_SECS);
 }
 
 /* Return 0 on success, else see sg_ll_format_medium() above */
 static int
 scsi_format_with_preset(int fd, const struct opts_t * op)
 {
-        bool first;
         bool immed = ! op->fwait;
-        int res, progress, pr, rem, resp_len, tmout;
+        int res, tmout;
         int vb = op->verbose;
         char b[80];
 
@@ -756,73 +693,7 @@ scsi_format_with_preset(int fd, const struct opts_t * op)
                 printf("No point in polling for progress, so exit\n");
                 return 0;
         }
-        if (! op->poll_type) {
-                for(first = true; ; first = false) {
-                        sg_sleep_secs(POLL_DURATION_SECS);
-                        progress = -1;
-                        res = sg_ll_test_unit_ready_progress(fd, 0, &progress,
-                                             true, (vb > 1) ? (vb - 1) : 0);
-                        if (progress >= 0) {
-                                pr = (progress * 100) / 65536;
-                                rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fwp_s, pr, rem);
-                        } else {
-                                if (first && op->verbose)
-                                        pr2serr("%s seems to be successful "
-                                                "and finished quickly\n",
-                                                fwp_s);
-                                break;
-                        }
-                }
-        }
-        if (op->poll_type || (SG_LIB_CAT_NOT_READY == res)) {
-                uint8_t * reqSense;
-                uint8_t * free_reqSense = NULL;
-
-                reqSense = sg_memalign(MAX_BUFF_SZ, 0, &free_reqSense, false);
-                if (NULL == reqSense) {
-                        pr2serr("%s: unable to obtain heap for Request "
-                                "Sense\n", __func__);
-                        return sg_convert_errno(ENOMEM);
-                }
-                for(first = true; ; first = false) {
-                        sg_sleep_secs(POLL_DURATION_SECS);
-                        memset(reqSense, 0x0, MAX_BUFF_SZ);
-                        res = sg_ll_request_sense(fd, false, reqSense,
-                                                  MAX_BUFF_SZ, false,
-                                                  (vb > 1) ? (vb - 1) : 0);
-                        if (res) {
-                                pr2serr("polling with Request Sense command "
-                                        "failed [res=%d]\n", res);
-                                break;
-                        }
-                        resp_len = reqSense[7] + 8;
-                        if (vb > 1) {
-                                pr2serr("Parameter data in hex:\n");
-                                hex2stderr(reqSense, resp_len, 1);
-                        }
-                        progress = -1;
-                        sg_get_sense_progress_fld(reqSense, resp_len,
-                                                  &progress);
-                        if (progress >= 0) {
-                                pr = (progress * 100) / 65536;
-                                rem = ((progress * 100) % 65536) / 656;
-                                printf("%s in progress, %d.%02d%% done\n",
-                                       fwp_s, pr, rem);
-                        } else {
-                                if (first && op->verbose)
-                                        pr2serr("%s seems to be successful "
-                                                "and finished quickly\n",
-                                                fwp_s);
-                                break;
-                        }
-                }
-                if (free_reqSense)
-                        free(free_reqSense);
-        }
-        printf("FORMAT WITH PRESET Complete\n");
-        return 0;
+        return poll_for_completion(fd, op, fwp_s, POLL_DURATION_SECS);
 }
 
 // #define VPD_DEVICE_ID 0x83
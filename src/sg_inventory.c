@@ -0,0 +1,835 @@
+/*
+ * Copyright (c) 2023 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <getopt.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_lib_data.h"
+#include "sg_pt.h"
+#include "sg_cmds_basic.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
+
+#include "sg_vpd_common.h"
+#include "sg_par_common.h"
+
+/* A utility program originally written for the Linux OS SCSI subsystem.
+ *
+ * This program collects an inventory record from one or more SCSI devices:
+ * the standard INQUIRY response, every supported VPD page, the capacity
+ * (for direct access devices), all current mode pages and all supported
+ * log pages. Each device is opened once and its standard INQUIRY is
+ * fetched once. Devices are visited concurrently by a pool of workers and
+ * one JSON document is output for each device. The VPD decoders shared by
+ * sg_inq and sg_vpd (in sg_vpd_common.c) are used.
+ */
+
+static const char * version_str = "1.00 20231026";
+
+#define MY_NAME "sg_inventory"
+
+#define INV_STD_INQ_LEN 252
+#define INV_MS_ALLOC_LEN 0xfffc         /* MODE SENSE(10) maximum, even */
+#define INV_LS_ALLOC_LEN 0xfffc         /* LOG SENSE maximum, even */
+#define INV_LS_PROBE_LEN 4
+#define INV_BUFF_LEN MX_ALLOC_LEN       /* big enough for all of the above */
+#define INV_READCAP16_LEN 32
+
+struct inv_dev_t {
+    const char * dev_name;
+    int res;            /* 0 or first SG_LIB_* error of device */
+    int num_cmds;       /* number of SCSI commands sent */
+    uint64_t elapsed_ns;
+    struct opts_t opts; /* holds per device JSON state */
+};
+
+struct inv_ctx_t {
+    bool quick;         /* skip mode and log pages */
+    int argc;
+    int tmo;
+    int maxlen;         /* if > 0 then used as log page allocation length */
+    int verbose;
+    int num_devs;
+    int num_failed;
+    char ** argv;
+    const char * json_arg;
+    const char * out_dir;
+    struct inv_dev_t * devp;
+};
+
+struct inv_vpd_dec_t {
+    int pn;             /* VPD page number */
+    bool sbc;           /* only decode if device has a block PDT */
+    const char ** namepp;       /* points to the shared name string */
+};
+
+/* VPD pages that are decoded, others are output in hex */
+static const struct inv_vpd_dec_t inv_vpd_dec_arr[] = {
+    {VPD_SUPPORTED_VPDS, false, &svp_vpdp},
+    {VPD_UNIT_SERIAL_NUM, false, &usn_vpdp},
+    {VPD_DEVICE_ID, false, &di_vpdp},
+    {VPD_EXT_INQ, false, &eid_vpdp},
+    {VPD_ATA_INFO, false, &ai_vpdp},
+    {VPD_POWER_CONDITION, false, &pc_vpdp},
+    {VPD_BLOCK_LIMITS, true, &bl_vpdp},
+    {VPD_BLOCK_DEV_CHARS, true, &bdc_vpdp},
+    {VPD_LB_PROVISIONING, true, &lbpv_vpdp},
+    {VPD_ZBC_DEV_CHARS, true, &zbdc_vpdp},
+    {-1, false, NULL},
+};
+
+
+static const struct option long_options[] = {
+    {"help", no_argument, 0, 'h'},
+    {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+    {"list", required_argument, 0, 'L'},
+    {"maxlen", required_argument, 0, 'm'},
+    {"out-dir", required_argument, 0, 'o'},
+    {"out_dir", required_argument, 0, 'o'},
+    {"parallel", required_argument, 0, 'p'},
+    {"quick", no_argument, 0, 'q'},
+    {"timeout", required_argument, 0, 't'},
+    {"verbose", no_argument, 0, 'v'},
+    {"version", no_argument, 0, 'V'},
+    {0, 0, 0, 0},
+};
+
+
+static void
+usage()
+{
+    pr2serr("Usage: "
+            "sg_inventory  [--help] [--json[=JO]] [--list=DLF] "
+            "[--maxlen=LEN]\n"
+            "                     [--out-dir=DIR] [--parallel=PN] "
+            "[--quick]\n"
+            "                     [--timeout=SECS] [--verbose] [--version] "
+            "[DEVICE...]\n");
+    pr2serr("  where:\n"
+            "    --help|-h          print out usage message\n"
+            "    --json[=JO]|-j[=JO]    JO are JSON control characters, "
+            "output is\n"
+            "                           always JSON. Use --json=? for "
+            "JSON help\n"
+            "    --list=DLF|-L DLF    DLF is a file of device names (or "
+            "globs), one\n"
+            "                         per line. If DLF is '-' then read "
+            "stdin\n"
+            "    --maxlen=LEN|-m LEN    allocation length of each LOG "
+            "SENSE; when\n"
+            "                           given the probe for each page's "
+            "length is\n"
+            "                           skipped (def: probe then fetch)\n"
+            "    --out-dir=DIR|-o DIR    write each device's JSON "
+            "document to\n"
+            "                            DIR/<basename_of_DEVICE>.json "
+            "(def: stdout)\n"
+            "    --parallel=PN|-p PN    visit up to PN devices at the "
+            "same time\n"
+            "                           (def: %d)\n"
+            "    --quick|-q         skip mode pages and log pages\n"
+            "    --timeout=SECS|-t SECS    command timeout in seconds "
+            "(def: %d)\n"
+            "    --verbose|-v       increase verbosity\n"
+            "    --version|-V       print version string and exit\n\n"
+            "Collects an inventory record from each DEVICE: standard "
+            "INQUIRY, all\nsupported VPD pages, READ CAPACITY, all current "
+            "mode pages and all\nsupported log pages. One JSON document is "
+            "output per DEVICE.\n", SG_PAR_DEF_WORKERS, DEF_PT_TIMEOUT);
+}
+
+/* Adds the sense category string of 'res' as "<prefix>_error" to jop and
+ * remembers the first error of the device. */
+static void
+inv_js_err(struct inv_dev_t * dp, sgj_opaque_p jop, const char * prefix,
+           int res)
+{
+    sgj_state * jsp = &dp->opts.json_st;
+    char b[80];
+    char n[64];
+
+    if (0 == dp->res)
+        dp->res = res;
+    sg_get_category_sense_str(res, sizeof(b), b, dp->opts.verbose);
+    snprintf(n, sizeof(n), "%s_error", prefix);
+    sgj_js_nv_s(jsp, jop, n, b);
+}
+
+static bool
+inv_is_block_pdt(int pdt)
+{
+    return (PDT_DISK == pdt) || (PDT_ZBC == pdt) || (PDT_OPTICAL == pdt) ||
+           (PDT_RBC == pdt);
+}
+
+static void
+inv_decode_vpd(struct inv_dev_t * dp, struct sg_pt_base * ptvp,
+               uint8_t * rp, int pdt, sgj_opaque_p jop)
+{
+    bool protect;
+    int k, j, n, pn, res, len;
+    sgj_state * jsp = &dp->opts.json_st;
+    struct opts_t * op = &dp->opts;
+    const struct inv_vpd_dec_t * vdp;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jap;
+    uint8_t svp[256];
+    char b[32];
+
+    ++dp->num_cmds;
+    res = vpd_fetch_page(ptvp, rp, VPD_SUPPORTED_VPDS, 0, true, op->verbose,
+                         &len);
+    if (res) {
+        inv_js_err(dp, jop, "supported_vpd_pages", res);
+        return;
+    }
+    n = len - 4;
+    if (n > (int)sizeof(svp))
+        n = sizeof(svp);
+    memcpy(svp, rp + 4, n);
+    jo2p = sg_vpd_js_hdr(jsp, jop, svp_vpdp, rp);
+    jap = sgj_named_subarray_r(jsp, jo2p, "supported_vpd_page_list");
+    for (k = 0; k < n; ++k)
+        sgj_js_nv_ihex(jsp, jap, NULL, svp[k]);
+
+    /* the supported list has already been fetched, fetch all the others */
+    for (k = 0; k < n; ++k) {
+        pn = svp[k];
+        if (VPD_SUPPORTED_VPDS == pn)
+            continue;
+        ++dp->num_cmds;
+        res = vpd_fetch_page(ptvp, rp, pn, 0, true, op->verbose, &len);
+        if (res) {
+            snprintf(b, sizeof(b), "vpd_page_0x%x", pn);
+            inv_js_err(dp, jop, b, res);
+            continue;
+        }
+        for (vdp = inv_vpd_dec_arr; vdp->pn >= 0; ++vdp) {
+            if ((vdp->pn == pn) && ((! vdp->sbc) || inv_is_block_pdt(pdt)))
+                break;
+        }
+        if (vdp->pn < 0) {
+            snprintf(b, sizeof(b), "vpd_page_0x%x", pn);
+            jo2p = sg_vpd_js_hdr(jsp, jop, b, rp);
+            sgjv_js_hex_long(jsp, jo2p, rp, len);
+            continue;
+        }
+        jo2p = sg_vpd_js_hdr(jsp, jop, *vdp->namepp, rp);
+        switch (pn) {
+        case VPD_UNIT_SERIAL_NUM:
+            j = (len > 4) ? (len - 4) : 0;
+            sgj_js_nv_s_len_chk(jsp, jo2p, "product_serial_number",
+                                rp + 4, j);
+            break;
+        case VPD_DEVICE_ID:
+            jap = sgj_named_subarray_r(jsp, jo2p,
+                                       "designation_descriptor_list");
+            res = filter_json_dev_ids(rp + 4, len - 4, -1, op, jap);
+            if (res)
+                inv_js_err(dp, jo2p, "decode", res);
+            break;
+        case VPD_EXT_INQ:
+            protect = op->std_inq_a_valid && !!(0x1 & op->std_inq_a[5]);
+            decode_x_inq_vpd(rp, len, protect, op, jo2p);
+            break;
+        case VPD_ATA_INFO:
+            decode_ata_info_vpd(rp, len, op, jo2p);
+            break;
+        case VPD_POWER_CONDITION:
+            decode_power_condition(rp, len, op, jo2p);
+            break;
+        case VPD_BLOCK_LIMITS:
+            decode_block_limits_vpd(rp, len, op, jo2p);
+            break;
+        case VPD_BLOCK_DEV_CHARS:
+            decode_block_dev_ch_vpd(rp, len, op, jo2p);
+            break;
+        case VPD_LB_PROVISIONING:
+            decode_block_lb_prov_vpd(rp, len, op, jo2p);
+            break;
+        case VPD_ZBC_DEV_CHARS:
+            decode_zbdch_vpd(rp, len, op, jo2p);
+            break;
+        default:
+            sgjv_js_hex_long(jsp, jo2p, rp, len);
+            break;
+        }
+    }
+}
+
+static void
+inv_capacity(struct inv_dev_t * dp, int sg_fd, uint8_t * rp,
+             sgj_opaque_p jop)
+{
+    int res, vb;
+    uint32_t lbl;
+    uint64_t llba;
+    sgj_state * jsp = &dp->opts.json_st;
+    sgj_opaque_p jo2p;
+
+    vb = dp->opts.verbose;
+    memset(rp, 0, INV_READCAP16_LEN);
+    ++dp->num_cmds;
+    res = sg_ll_readcap_16(sg_fd, false, 0, rp, INV_READCAP16_LEN, false, vb);
+    if (0 == res) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "read_capacity_16");
+        llba = sg_get_unaligned_be64(rp + 0);
+        lbl = sg_get_unaligned_be32(rp + 8);
+        sgj_js_nv_ihex(jsp, jo2p, "returned_logical_block_address",
+                       (int64_t)llba);
+        sgj_js_nv_ihex(jsp, jo2p, "logical_block_length_in_bytes", lbl);
+        sgj_js_nv_ihex(jsp, jo2p, "p_type", (rp[12] >> 1) & 0x7);
+        sgj_js_nv_ihex(jsp, jo2p, "prot_en", rp[12] & 0x1);
+        sgj_js_nv_ihex(jsp, jo2p, "p_i_exponent", (rp[13] >> 4) & 0xf);
+        sgj_js_nv_ihex(jsp, jo2p,
+                       "logical_blocks_per_physical_block_exponent",
+                       rp[13] & 0xf);
+        sgj_js_nv_ihex(jsp, jo2p, "lbpme", !!(rp[14] & 0x80));
+        sgj_js_nv_ihex(jsp, jo2p, "lbprz", !!(rp[14] & 0x40));
+        sgj_js_nv_ihex(jsp, jo2p, "lowest_aligned_logical_block_address",
+                       sg_get_unaligned_be16(rp + 14) & 0x3fff);
+        sgj_js_nv_i(jsp, jo2p, "capacity_in_bytes",
+                    (int64_t)((llba + 1) * lbl));
+        return;
+    }
+    /* fall back to READ CAPACITY(10) for older devices */
+    ++dp->num_cmds;
+    res = sg_ll_readcap_10(sg_fd, false, 0, rp, 8, false, vb);
+    if (res) {
+        inv_js_err(dp, jop, "read_capacity", res);
+        return;
+    }
+    jo2p = sgj_named_subobject_r(jsp, jop, "read_capacity_10");
+    llba = sg_get_unaligned_be32(rp + 0);
+    lbl = sg_get_unaligned_be32(rp + 4);
+    sgj_js_nv_ihex(jsp, jo2p, "returned_logical_block_address",
+                   (int64_t)llba);
+    sgj_js_nv_ihex(jsp, jo2p, "logical_block_length_in_bytes", lbl);
+    sgj_js_nv_i(jsp, jo2p, "capacity_in_bytes", (int64_t)((llba + 1) * lbl));
+}
+
+/* Fetches all current mode pages (and subpages) with one MODE SENSE(10)
+ * command, then splits the response into its pages. */
+static void
+inv_mode_pages(struct inv_dev_t * dp, int sg_fd, uint8_t * rp, int tmo,
+               sgj_opaque_p jop)
+{
+    bool spf;
+    int res, resid, rlen, calc, bd_len, off, plen, vb;
+    sgj_state * jsp = &dp->opts.json_st;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jap;
+
+    vb = dp->opts.verbose;
+    ++dp->num_cmds;
+    res = sg_ll_mode_sense10_v2(sg_fd, false, false, 0 /* current */, 0x3f,
+                                0xff, rp, INV_MS_ALLOC_LEN, tmo, &resid,
+                                false, vb);
+    if (SG_LIB_CAT_ILLEGAL_REQ == res) {
+        /* device may not support subpages, so try without */
+        ++dp->num_cmds;
+        res = sg_ll_mode_sense10_v2(sg_fd, false, false, 0, 0x3f, 0, rp,
+                                    INV_MS_ALLOC_LEN, tmo, &resid, false, vb);
+    }
+    if (res) {
+        inv_js_err(dp, jop, "mode_sense", res);
+        return;
+    }
+    rlen = INV_MS_ALLOC_LEN - resid;
+    calc = sg_msense_calc_length(rp, rlen, false, &bd_len);
+    if (calc < rlen)
+        rlen = calc;
+    jap = sgj_named_subarray_r(jsp, jop, "mode_page_list");
+    for (off = 8 + bd_len; off < rlen; off += plen) {
+        spf = !!(rp[off] & 0x40);
+        if (spf) {
+            if ((off + 4) > rlen)
+                break;
+            plen = sg_get_unaligned_be16(rp + off + 2) + 4;
+        } else {
+            if ((off + 2) > rlen)
+                break;
+            plen = rp[off + 1] + 2;
+        }
+        if ((off + plen) > rlen)
+            plen = rlen - off;          /* truncated last page */
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_ihex(jsp, jo2p, "page_code", rp[off] & 0x3f);
+        sgj_js_nv_ihex(jsp, jo2p, "subpage_code", spf ? rp[off + 1] : 0);
+        sgj_js_nv_ihex(jsp, jo2p, "ps", !!(rp[off] & 0x80));
+        sgj_js_nv_hex_bytes(jsp, jo2p, "mode_page_hex", rp + off, plen);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+}
+
+/* Returns 0 and the response length in *rlenp on success */
+static int
+inv_log_sense(struct inv_dev_t * dp, int sg_fd, int pg, int subpg,
+              uint8_t * rp, int maxlen, int tmo, int * rlenp)
+{
+    int res, resid, len, vb;
+
+    vb = dp->opts.verbose;
+    len = maxlen;
+    if (len <= 0) {
+        /* probe for the page length first, as sg_logs does */
+        ++dp->num_cmds;
+        res = sg_ll_log_sense_v2(sg_fd, false, false, 1 /* cumulative */, pg,
+                                 subpg, 0, rp, INV_LS_PROBE_LEN, tmo, &resid,
+                                 false, vb);
+        if (res)
+            return res;
+        len = sg_get_unaligned_be16(rp + 2) + 4;
+        if (len % 2)
+            ++len;      /* some HBAs don't like odd transfer lengths */
+        if (len > INV_LS_ALLOC_LEN)
+            len = INV_LS_ALLOC_LEN;
+    }
+    ++dp->num_cmds;
+    res = sg_ll_log_sense_v2(sg_fd, false, false, 1, pg, subpg, 0, rp, len,
+                             tmo, &resid, false, vb);
+    if (res)
+        return res;
+    len -= resid;
+    if (len < 4)
+        return SG_LIB_CAT_MALFORMED;
+    if (len > (sg_get_unaligned_be16(rp + 2) + 4))
+        len = sg_get_unaligned_be16(rp + 2) + 4;
+    *rlenp = len;
+    return 0;
+}
+
+/* Fetches the supported log pages (and subpages) list, then each page in
+ * that list. Each page is broken into its log parameters. */
+static void
+inv_log_pages(struct inv_dev_t * dp, int sg_fd, uint8_t * rp, int maxlen,
+              int tmo, sgj_opaque_p jop)
+{
+    bool have_subpgs = true;
+    int k, n, res, len, off, plen, pg, subpg;
+    sgj_state * jsp = &dp->opts.json_st;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jo3p;
+    sgj_opaque_p jap;
+    sgj_opaque_p ja2p;
+    uint8_t * sup;
+    char b[40];
+
+    res = inv_log_sense(dp, sg_fd, 0, 0xff, rp, maxlen, tmo, &len);
+    if (res) {
+        have_subpgs = false;
+        res = inv_log_sense(dp, sg_fd, 0, 0, rp, maxlen, tmo, &len);
+    }
+    if (res) {
+        inv_js_err(dp, jop, "log_sense", res);
+        return;
+    }
+    n = len - 4;
+    sup = (uint8_t *)malloc(n > 0 ? n : 1);
+    if (NULL == sup) {
+        inv_js_err(dp, jop, "log_sense", sg_convert_errno(ENOMEM));
+        return;
+    }
+    memcpy(sup, rp + 4, n);
+    jap = sgj_named_subarray_r(jsp, jop, "log_page_list");
+    for (k = 0; k < n; k += (have_subpgs ? 2 : 1)) {
+        pg = sup[k] & 0x3f;
+        subpg = have_subpgs ? sup[k + 1] : 0;
+        if ((0 == pg) && ((0 == subpg) || (0xff == subpg)))
+            continue;   /* skip the supported pages lists */
+        if (0xff == subpg)
+            continue;   /* supported subpages of one page: not needed */
+        res = inv_log_sense(dp, sg_fd, pg, subpg, rp, maxlen, tmo, &len);
+        if (res) {
+            snprintf(b, sizeof(b), "log_page_0x%x_0x%x", pg, subpg);
+            inv_js_err(dp, jop, b, res);
+            continue;
+        }
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_ihex(jsp, jo2p, "page_code", rp[0] & 0x3f);
+        sgj_js_nv_ihex(jsp, jo2p, "subpage_code", rp[1]);
+        sgj_js_nv_ihex(jsp, jo2p, "ds", !!(rp[0] & 0x80));
+        sgj_js_nv_ihex(jsp, jo2p, "spf", !!(rp[0] & 0x40));
+        ja2p = sgj_named_subarray_r(jsp, jo2p, "log_parameter_list");
+        for (off = 4; (off + 4) <= len; off += plen) {
+            plen = rp[off + 3] + 4;
+            if ((off + plen) > len)
+                plen = len - off;
+            jo3p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_ihex(jsp, jo3p, "parameter_code",
+                           sg_get_unaligned_be16(rp + off));
+            sgj_js_nv_ihex(jsp, jo3p, "parameter_control_byte",
+                           rp[off + 2]);
+            sgj_js_nv_hex_bytes(jsp, jo3p, "parameter_value_hex",
+                                rp + off + 4, plen - 4);
+            sgj_js_nv_o(jsp, ja2p, NULL /* name */, jo3p);
+        }
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    free(sup);
+}
+
+/* Called from a worker thread. All commands to one device are sent over
+ * a single file descriptor (and pass-through object) in sequence. */
+static int
+inv_work(void * ctxp, int idx)
+{
+    int sg_fd, res, resid, len, pdt;
+    uint64_t start_ns;
+    struct inv_ctx_t * icp = (struct inv_ctx_t *)ctxp;
+    struct inv_dev_t * dp = icp->devp + idx;
+    struct opts_t * op = &dp->opts;
+    sgj_state * jsp = &op->json_st;
+    struct sg_pt_base * ptvp = NULL;
+    uint8_t * rp = NULL;
+    uint8_t * free_rp = NULL;
+    sgj_opaque_p jop;
+
+    start_ns = sg_par_mono_ns();
+    op->verbose = icp->verbose;
+    op->do_json = true;
+    op->device_name = dp->dev_name;
+    if (! sgj_init_state(jsp, icp->json_arg))
+        return SG_LIB_SYNTAX_ERROR;     /* checked in main() already */
+    jsp->pr_as_json = true;
+    sgj_start_r(MY_NAME, version_str, icp->argc, icp->argv, jsp);
+    jop = sgj_named_subobject_r(jsp, NULL, "device_inventory");
+    sgj_js_nv_s(jsp, jop, "device_name", dp->dev_name);
+
+    sg_fd = sg_cmds_open_device(dp->dev_name, true /* ro */, op->verbose);
+    if (sg_fd < 0) {
+        res = sg_convert_errno(-sg_fd);
+        inv_js_err(dp, jop, "open", res);
+        goto fini;
+    }
+    rp = sg_memalign(INV_BUFF_LEN, 0, &free_rp, false);
+    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, op->verbose);
+    if ((NULL == rp) || (NULL == ptvp)) {
+        inv_js_err(dp, jop, "setup", sg_convert_errno(ENOMEM));
+        goto fini;
+    }
+
+    /* standard INQUIRY, once; the VPD decoders use the saved copy */
+    ++dp->num_cmds;
+    res = sg_ll_inquiry_pt(ptvp, false, 0, rp, INV_STD_INQ_LEN, icp->tmo,
+                           &resid, false, op->verbose);
+    if (res) {
+        inv_js_err(dp, jop, "inquiry", res);
+        goto fini;
+    }
+    len = INV_STD_INQ_LEN - resid;
+    if (len > (rp[4] + 5))
+        len = rp[4] + 5;
+    if (len < 36) {
+        inv_js_err(dp, jop, "inquiry", SG_LIB_CAT_MALFORMED);
+        goto fini;
+    }
+    memcpy(op->std_inq_a, rp, sizeof(op->std_inq_a));
+    op->std_inq_a_valid = true;
+    pdt = rp[0] & PDT_MASK;
+    std_inq_decode_js(rp, len, op, jop);
+
+    inv_decode_vpd(dp, ptvp, rp, pdt, sgj_named_subobject_r(jsp, jop,
+                                                           "vpd_pages"));
+    if (inv_is_block_pdt(pdt))
+        inv_capacity(dp, sg_fd, rp, jop);
+    if (! icp->quick) {
+        inv_mode_pages(dp, sg_fd, rp, icp->tmo, jop);
+        inv_log_pages(dp, sg_fd, rp, icp->maxlen, icp->tmo, jop);
+    }
+fini:
+    if (ptvp)
+        destruct_scsi_pt_obj(ptvp);
+    if (sg_fd >= 0)
+        sg_cmds_close_device(sg_fd);
+    if (free_rp)
+        free(free_rp);
+    dp->elapsed_ns = sg_par_mono_ns() - start_ns;
+    sgj_js_nv_i(jsp, jop, "scsi_commands_sent", dp->num_cmds);
+    sgj_js_nv_i(jsp, jop, "elapsed_ms",
+                (int64_t)(dp->elapsed_ns / 1000000));
+    return dp->res;
+}
+
+/* Called serialized: outputs the JSON document of one device then frees
+ * its JSON tree. */
+static void
+inv_done(void * ctxp, int idx, int res)
+{
+    struct inv_ctx_t * icp = (struct inv_ctx_t *)ctxp;
+    struct inv_dev_t * dp = icp->devp + idx;
+    sgj_state * jsp = &dp->opts.json_st;
+    FILE * fp = stdout;
+    const char * cp;
+    char b[PATH_MAX];
+
+    if (res)
+        ++icp->num_failed;
+    if (NULL == jsp->basep)
+        return;
+    if (icp->out_dir) {
+        cp = strrchr(dp->dev_name, '/');
+        cp = cp ? (cp + 1) : dp->dev_name;
+        snprintf(b, sizeof(b), "%s/%s.json", icp->out_dir, cp);
+        fp = fopen(b, "w");     /* truncate if exists */
+        if (NULL == fp) {
+            int e = errno;
+
+            pr2serr("unable to open file: %s [%s]\n", b, safe_strerror(e));
+            if (0 == res) {
+                ++icp->num_failed;
+                dp->res = sg_convert_errno(e);
+            }
+        }
+    }
+    if (fp)
+        sgj_js2file(jsp, NULL, res, fp);
+    if (fp && (stdout != fp))
+        fclose(fp);
+    sgj_finish(jsp);
+    if (icp->verbose)
+        pr2serr("%s: %d commands in %" PRIu64 " ms, %s\n", dp->dev_name,
+                dp->num_cmds, dp->elapsed_ns / 1000000,
+                res ? "with errors" : "good");
+}
+
+/* Processes the options that can be in the same argument as '-j' such
+ * as '-jv'. Returns 0 if okay, else SG_LIB_SYNTAX_ERROR. */
+static int
+chk_short_opts(const char sopt_ch, bool * verbose_givenp, int * verbosep,
+               bool * version_givenp)
+{
+    /* only need to process short, non-argument options used with -j */
+    switch (sopt_ch) {
+    case 'j':
+        break;  /* simply ignore second 'j' (e.g. '-jxj') */
+    case 'v':
+        *verbose_givenp = true;
+        ++*verbosep;
+        break;
+    case 'V':
+        *version_givenp = true;
+        break;
+    default:
+        pr2serr("unrecognised option code %c [0x%x] ??\n", sopt_ch,
+                sopt_ch);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    bool verbose_given = false;
+    bool version_given = false;
+    int k, c, n, err;
+    int num_workers = SG_PAR_DEF_WORKERS;
+    int ret = 0;
+    const char * dl_fn = NULL;
+    struct inv_ctx_t ctx;
+    struct inv_ctx_t * icp = &ctx;
+    struct sg_par_dev_list dlist;
+    sgj_state json_st SG_C_CPP_ZERO_INIT;
+
+    memset(icp, 0, sizeof(*icp));
+    memset(&dlist, 0, sizeof(dlist));
+    icp->tmo = DEF_PT_TIMEOUT;
+    if (getenv("SG3_UTILS_INVOCATION"))
+        sg_rep_invocation(MY_NAME, version_str, argc, argv, stderr);
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "^hj::L:m:o:p:qt:vV", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                if ('^' == c) {
+                    icp->json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    icp->json_arg = optarg + 1;
+                    break;
+                }
+                n = strlen(optarg);
+                for (k = 0; k < n; ++k) {
+                    if (chk_short_opts(*(optarg + k), &verbose_given,
+                                       &icp->verbose, &version_given))
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+            } else
+                icp->json_arg = NULL;
+            break;
+        case 'L':
+            dl_fn = optarg;
+            break;
+        case 'm':
+            icp->maxlen = sg_get_num(optarg);
+            if ((icp->maxlen < INV_LS_PROBE_LEN) ||
+                (icp->maxlen > INV_LS_ALLOC_LEN)) {
+                pr2serr("--maxlen= expects an argument between %d and %d "
+                        "inclusive\n", INV_LS_PROBE_LEN, INV_LS_ALLOC_LEN);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'o':
+            icp->out_dir = optarg;
+            break;
+        case 'p':
+            num_workers = sg_get_num(optarg);
+            if ((num_workers < 1) || (num_workers > SG_PAR_MAX_WORKERS)) {
+                pr2serr("--parallel= expects an argument between 1 and %d "
+                        "inclusive\n", SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'q':
+            icp->quick = true;
+            break;
+        case 't':
+            icp->tmo = sg_get_num(optarg);
+            if (icp->tmo < 0) {
+                pr2serr("bad argument to '--timeout='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'v':
+            verbose_given = true;
+            ++icp->verbose;
+            break;
+        case 'V':
+            version_given = true;
+            break;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    for (; optind < argc; ++optind) {
+        ret = sg_par_dev_list_add(&dlist, argv[optind], icp->verbose);
+        if (ret)
+            goto fini;
+    }
+
+#ifdef DEBUG
+    pr2serr("In DEBUG mode, ");
+    if (verbose_given && version_given) {
+        pr2serr("but override: '-vV' given, zero verbose and continue\n");
+        verbose_given = false;
+        version_given = false;
+        icp->verbose = 0;
+    } else if (! verbose_given) {
+        pr2serr("set '-vv'\n");
+        icp->verbose = 2;
+    } else
+        pr2serr("keep verbose=%d\n", icp->verbose);
+#else
+    if (verbose_given && version_given)
+        pr2serr("Not in DEBUG mode, so '-vV' has no special action\n");
+#endif
+    if (version_given) {
+        pr2serr("version: %s\n", version_str);
+        goto fini;
+    }
+    /* check JSON control characters once, before any worker starts */
+    if (! sgj_init_state(&json_st, icp->json_arg)) {
+        int bad_char = json_st.first_bad_char;
+        char e[1500];
+
+        if (bad_char)
+            pr2serr("bad argument to --json= option, unrecognized "
+                    "character '%c'\n\n", bad_char);
+        sg_json_usage(0, e, sizeof(e));
+        pr2serr("%s", e);
+        ret = SG_LIB_SYNTAX_ERROR;
+        goto fini;
+    }
+    if (dl_fn) {
+        ret = sg_par_dev_list_from_file(&dlist, dl_fn, icp->verbose);
+        if (ret)
+            goto fini;
+    }
+    if (0 == dlist.num) {
+        pr2serr("missing device name!\n");
+        usage();
+        ret = SG_LIB_SYNTAX_ERROR;
+        goto fini;
+    }
+    if (0 == icp->tmo)
+        icp->tmo = DEF_PT_TIMEOUT;
+
+    icp->devp = (struct inv_dev_t *)calloc(dlist.num, sizeof(*icp->devp));
+    if (NULL == icp->devp) {
+        pr2serr("out of memory\n");
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < dlist.num; ++k)
+        icp->devp[k].dev_name = dlist.names[k];
+    icp->num_devs = dlist.num;
+    icp->argc = argc;
+    icp->argv = argv;
+    err = sg_par_run(icp->num_devs, num_workers, inv_work, inv_done, icp);
+    if (err) {
+        pr2serr("unable to start workers: %s\n", safe_strerror(err));
+        ret = sg_convert_errno(err);
+        goto fini;
+    }
+    if (icp->verbose || (icp->num_failed > 0))
+        pr2serr("%d device%s inventoried, %d with errors\n", icp->num_devs,
+                (1 == icp->num_devs) ? "" : "s", icp->num_failed);
+    if (icp->num_failed > 0) {
+        /* report the first failure, in the order devices were given */
+        for (k = 0; k < icp->num_devs; ++k) {
+            if (icp->devp[k].res) {
+                ret = icp->devp[k].res;
+                break;
+            }
+        }
+    }
+fini:
+    if (icp->devp)
+        free(icp->devp);
+    sg_par_dev_list_free(&dlist);
+    if (0 == icp->verbose) {
+        if (! sg_if_can2stderr("sg_inventory failed: ", ret))
+            pr2serr("Some error occurred, try again with '-v' or '-vv' for "
+                    "more information\n");
+    }
+    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+}
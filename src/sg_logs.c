@@ -24,7 +24,9 @@
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -37,10 +39,11 @@
 #endif
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
 #include "sg_logs.h"
 
-static const char * version_str = "2.35 20230622";    /* spc6r08 + sbc5r04 */
+static const char * version_str = "2.37 20231029";    /* spc6r08 + sbc5r04 */
 
 #define MY_NAME "sg_logs"
 
@@ -116,6 +119,7 @@ static const struct option long_options[] = {
     {"vendor", required_argument, 0, 'M'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
+    {"watch", required_argument, 0, 'w'},
     {0, 0, 0, 0},
 };
 
@@ -420,7 +424,8 @@ usage(int hval)
            "[--temperature]\n"
            "               [--transport] [--undefined] [--vendor=VP] "
            "[--verbose]\n"
-           "               [--version] DEVICE\n"
+           "               [--version] [--watch=SECS[,CNT]] DEVICE "
+           "[DEVICE...]\n"
            "  where the main options are:\n"
            "    --ALL|-A        fetch and decode all log pages and "
            "subpages\n"
@@ -471,7 +476,15 @@ usage(int hval)
            "0x18) page\n"
            "    --vendor=VP|-M VP    vendor/product abbreviation [or "
            "number]\n"
-           "    --verbose|-v    increase verbosity\n\n"
+           "    --verbose|-v    increase verbosity\n"
+           "    --watch=SECS[,CNT]|-w SECS[,CNT]    fetch page(s) every SECS "
+           "seconds,\n"
+           "                                        CNT times (def: 0 -> "
+           "forever); outputs\n"
+           "                                        counter deltas and rates "
+           "as JSON lines\n"
+           "                                        for one or more "
+           "DEVICEs\n\n"
            "Performs a SCSI LOG SENSE (or LOG SELECT) command and decodes "
            "the response.\nIf only DEVICE is given then '-p sp' (supported "
            "pages) is assumed. Use\n'-e' to see known pages and their "
@@ -987,9 +1000,10 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int c, n;
         int option_index = 0;
+        const char * cp;
 
         c = getopt_long(argc, argv, "^aAbc:D:eEf:FhHi:j::J:lLm:M:nNOp:P:qQrR"
-                        "sStTuvVxX", long_options, &option_index);
+                        "sStTuvVw:xX", long_options, &option_index);
         if (c == -1)
             break;
 
@@ -1183,6 +1197,24 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'V':
             op->version_given = true;
             break;
+        case 'w':
+            n = sg_get_num_nomult(optarg);
+            if (n < 1) {
+                pr2serr("bad argument to '--watch=', expect SECS of 1 or "
+                        "more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->watch_secs = n;
+            cp = strchr(optarg, ',');
+            if (cp) {
+                n = sg_get_num_nomult(cp + 1);
+                if (n < 0) {
+                    pr2serr("bad CNT in '--watch=SECS,CNT'\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                op->watch_count = n;
+            }
+            break;
         case 'x':
             ++op->no_inq;
             break;
@@ -1200,9 +1232,13 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     if (optind < argc) {
         if (NULL == op->device_name) {
             op->device_name = argv[optind];
+            op->dev_argv = argv + optind;
+            op->dev_argc = argc - optind;
             ++optind;
         }
         if (optind < argc) {
+            if (op->watch_secs > 0)
+                return 0;       /* --watch takes more than one DEVICE */
             for (; optind < argc; ++optind)
                 pr2serr("Unexpected extra argument: %s\n", argv[optind]);
             usage(1);
@@ -1708,7 +1744,7 @@ show_supported_pgs_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, slpgs, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p, "supported_pages_list");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p, "supported_pages_list");
     }
 
     for (k = 0; k < num; ++k) {
@@ -1779,12 +1815,12 @@ show_supported_pgs_sub_page(const uint8_t * resp, int len,
     if (jsp->pr_as_json) {
         if (spf) {
             jo2p = sg_log_js_hdr(jsp, jop, my_name, resp);
-            jap = sgj_named_subarray_r(jsp, jo2p,
-                                       "supported_subpage_descriptors");
+            jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                              "supported_subpage_descriptors");
         } else {
             jo2p = sg_log_js_hdr(jsp, jop, my_name, resp);
-            jap = sgj_named_subarray_r(jsp, jo2p,
-                               "supported_page_subpage_descriptors");
+            jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                      "supported_page_subpage_descriptors");
         }
     }
 
@@ -1863,8 +1899,8 @@ show_buffer_over_under_run_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, bourlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                        "buffer_over_run_under_run_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                               "buffer_over_run_under_run_log_parameters");
     }
     while (num > 3) {
         cp = NULL;
@@ -2054,7 +2090,7 @@ show_error_counter_page(const uint8_t * resp, int len,
         n = strlen(b);
         memcpy(b + n, " parameters", 11 + 1);
         sgj_convert2snake(b, d, sizeof(d) - 1);
-        jap = sgj_named_subarray_r(jsp, jo2p, d);
+        jap = sgj_named_subarray_stream_r(jsp, jo2p, d);
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -2192,8 +2228,8 @@ show_non_medium_error_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, nmelp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                        "non_medium_error_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                               "non_medium_error_log_parameters");
     }
     while (num > 3) {
         pc = sg_get_unaligned_be16(bp + 0);
@@ -2297,8 +2333,8 @@ show_power_condition_transitions_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, pctlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                        "power_condition_transition_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                               "power_condition_transition_log_parameters");
     }
 
     while (num > 3) {
@@ -2445,8 +2481,8 @@ show_environmental_reporting_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, erlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "environmental_reporting_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                     "environmental_reporting_log_parameters");
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -2624,8 +2660,8 @@ show_environmental_limits_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, ellp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "environmental_limits_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                        "environmental_limits_log_parameters");
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -2792,8 +2828,8 @@ show_cmd_dur_limits_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, cdllp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                        "command_duration_limits_statistcs_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                           "command_duration_limits_statistcs_log_parameters");
     }
 
     while (num > 3) {
@@ -2971,7 +3007,8 @@ show_last_n_error_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, lneelp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p, "error_event_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "error_event_log_parameters");
     }
 
     for (k = num; k > 0; k -= pl, bp += pl) {
@@ -3071,8 +3108,8 @@ show_last_n_deferred_error_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, lndeoaelp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                "deferred_error_or_asynchronous_event_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                       "deferred_error_or_asynchronous_event_log_parameters");
     }
 
     for (k = num; k > 0; k -= pl, bp += pl) {
@@ -3167,8 +3204,8 @@ show_last_n_inq_data_ch_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, lnidclp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "inquiry_data_changed_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                        "inquiry_data_changed_log_parameters");
     }
 
     while (num > 3) {
@@ -3298,8 +3335,8 @@ show_last_n_mode_pg_data_ch_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, lnmpdclp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "mode_page_data_changed_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                      "mode_page_data_changed_log_parameters");
     }
 
     while (num > 3) {
@@ -3452,8 +3489,8 @@ show_self_test_page(const uint8_t * resp, int len, struct opts_t * op,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, strlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "self_test_results_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "self_test_results_log_parameters");
     }
 
     for (k = 0, bp = resp + 4; k < 20; ++k, bp += 20 ) {
@@ -3584,7 +3621,8 @@ show_temperature_page(const uint8_t * resp, int len, struct opts_t * op,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, tlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p, "temperature_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "temperature_log_parameters");
     }
 
     for (k = num; k > 0; k -= extra, bp += extra) {
@@ -3724,8 +3762,8 @@ show_start_stop_page(const uint8_t * resp, int len, struct opts_t * op,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, sscclp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "start_stop_cycle_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "start_stop_cycle_log_parameters");
     }
 
     for (k = num; k > 0; k -= extra, bp += extra) {
@@ -3927,8 +3965,8 @@ show_app_client_page(const uint8_t * resp, int len, struct opts_t * op,
         return true;
     }
     if (jsp->pr_as_json)
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "application_client_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "application_client_log_parameters");
 
     /* here if filter_given set or --full given */
     for (k = num; k > 0; k -= extra, bp += extra) {
@@ -4022,8 +4060,8 @@ show_ie_page(const uint8_t * resp, int len, struct opts_t * op,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, ielp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                           "informational_exceptions_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                  "informational_exceptions_log_parameters");
     }
 
     for (k = num; k > 0; k -= param_len, bp += param_len) {
@@ -4736,8 +4774,8 @@ show_protocol_specific_port_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, psplp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                           "protocol_specific_port_log_parameter_list");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                  "protocol_specific_port_log_parameter_list");
     }
 
     for (k = 0, bp = resp + 4; k < num; ) {
@@ -4850,9 +4888,9 @@ show_stats_perform_pages(const uint8_t * resp, int len,
         return false;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, pg_name, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p, 0 == subpg_code ?
-                        "general_statistics_and_performance_log_parameters" :
-                        "group_statistics_and_performance_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p, 0 == subpg_code ?
+                          "general_statistics_and_performance_log_parameters" :
+                            "group_statistics_and_performance_log_parameters");
     }
     if (0 == subpg_code) { /* General statistics and performance log page */
         if (num < 0x5c)
@@ -5179,8 +5217,8 @@ show_cache_stats_page(const uint8_t * resp, int len, struct opts_t * op,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, cmslp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "cache_memory_statistics_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                     "cache_memory_statistics_log_parameters");
     }
 
     for (k = num; k > 0; k -= extra, bp += extra) {
@@ -5328,7 +5366,8 @@ show_format_status_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, fslp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p, "format_status_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "format_status_log_parameters");
     }
 
     while (num > 3) {
@@ -5476,8 +5515,8 @@ show_non_volatile_cache_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, nvclp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "nonvolatile_cache_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "nonvolatile_cache_log_parameters");
     }
 
     while (num > 3) {
@@ -5616,8 +5655,8 @@ show_lb_provisioning_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, lbplp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                           "logical_block_provisioning_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                  "logical_block_provisioning_log_parameters");
     }
 
     while (num > 3) {
@@ -5769,8 +5808,8 @@ show_utilization_page(const uint8_t * resp, int len, struct opts_t * op,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, ulp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "utilitization_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "utilitization_log_parameters");
     }
 
     while (num > 3) {
@@ -5884,8 +5923,8 @@ show_solid_state_media_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, ssmlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "solid_state_media_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "solid_state_media_log_parameters");
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -6006,8 +6045,8 @@ show_dt_device_status_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, dds_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "dt_device_status_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "dt_device_status_log_parameters");
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -6314,8 +6353,8 @@ show_tapealert_response_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, tar_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "tapealert_response_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "tapealert_response_log_parameters");
     }
 
     while (num > 3) {
@@ -6466,8 +6505,8 @@ show_requested_recovery_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, rr_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "requested_recovery_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "requested_recovery_log_parameters");
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -6600,8 +6639,8 @@ show_ata_pt_results_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, aptrlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "ata_pass_through_results_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                    "ata_pass_through_results_log_parameters");
     }
 
     while (num > 3) {
@@ -6755,7 +6794,8 @@ show_background_scan_results_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, bsrlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p, "background_scan_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "background_scan_parameters");
     }
 
     while (num > 3) {
@@ -6993,8 +7033,8 @@ show_zoned_block_dev_stats(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, zbdslp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                        "zoned_block_device_statistics_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                               "zoned_block_device_statistics_log_parameters");
     }
 
     while (num > 3) {
@@ -7240,7 +7280,8 @@ show_pending_defects_page(const uint8_t * resp, int len, struct opts_t * op,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, pdlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p, "pending_defect_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "pending_defect_parameters");
     }
 
     while (num > 3) {
@@ -7368,8 +7409,8 @@ show_background_op_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, bolp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "background_operation_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "background_operation_parameters");
     }
 
     while (num > 3) {
@@ -7466,8 +7507,8 @@ show_lps_misalignment_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, lmlp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "lps_misalignment_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "lps_misalignment_log_parameters");
     }
 
     while (num > 3) {
@@ -7582,8 +7623,8 @@ show_service_buffers_info_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, sbi_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                           "service_buffers_information_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                 "service_buffers_information_log_parameters");
     }
 
     while (num > 3) {
@@ -7709,8 +7750,8 @@ show_sequential_access_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, sad_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "sequential_access_device_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                    "sequential_access_device_log_parameters");
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -7924,8 +7965,8 @@ show_device_stats_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, ds_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "device_statistics_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "device_statistics_log_parameters");
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -8202,8 +8243,8 @@ show_media_stats_page(const uint8_t * resp, int len, struct opts_t * op,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, mcs_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "media_changer_statistics_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                    "media_changer_statistics_log_parameters");
     }
 
     while (num > 3) {
@@ -8377,8 +8418,8 @@ show_element_stats_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, es_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "element_statistics_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "element_statistics_log_parameters");
     }
 
     while (num > 3) {
@@ -8470,8 +8511,8 @@ show_tape_diag_data_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, tdd_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "tape_diagnostic_data_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                        "tape_diagnostic_data_log_parameters");
     }
 
     while (num > 3) {
@@ -8628,8 +8669,8 @@ show_mchanger_diag_data_page(const uint8_t * resp, int len,
     bp = &resp[0] + 4;
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, mcdd_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                           "medium_changer_diagnostic_data_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                              "medium_changer_diagnostic_data_log_parameters");
     }
 
     while (num > 3) {
@@ -8932,8 +8973,8 @@ show_volume_stats_pages(const uint8_t * resp, int len,
     if (jsp->pr_as_json) {
         snprintf(b, blen, "%s subpage=0x%x?",  vs_lp, subpg_code);
         jo2p = sg_log_js_hdr(jsp, jop, b, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p,
-                                   "volume_statistics_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "volume_statistics_log_parameters");
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -9307,7 +9348,8 @@ show_tape_alert_ssc_page(const uint8_t * resp, int len,
     }
     if (jsp->pr_as_json) {
         jo2p = sg_log_js_hdr(jsp, jop, ta_lp, resp);
-        jap = sgj_named_subarray_r(jsp, jo2p, "tapealert_log_parameters");
+        jap = sgj_named_subarray_stream_r(jsp, jo2p,
+                                          "tapealert_log_parameters");
     }
     num = len - 4;
     bp = &resp[0] + 4;
@@ -9424,7 +9466,7 @@ show_unknown_page(const char * lp_name, const uint8_t * resp, int len,
             int rem;
 
             if (gt256)
-                jap = sgj_named_subarray_r(jsp, jop, "in_hex_list");
+                jap = sgj_named_subarray_stream_r(jsp, jop, "in_hex_list");
             for (k = 0; k < len; bp += 256, k += 256) {
                 rem = len - k;
                 if (gt256)
@@ -9650,6 +9692,465 @@ merge_both_supported(const uint8_t * supp_pgs_p, int su_p_pg_len, int pg_len)
 }
 
 
+/* The --watch=SECS option: each DEVICE is kept open and the chosen log
+ * pages are fetched every SECS seconds. Parameters that are counters
+ * (i.e. format and linking field of 0 or 2, and no more than 8 bytes long)
+ * are compared with the previous sample and the value, delta and rate (per
+ * second) are output, one JSON object per line for each page sample.
+ *
+ * Devices are sampled by a pool of worker threads (see sg_par_common.h).
+ * Workers only call do_logs() with their own response buffer: they never
+ * touch the file scope rsp_buff and rsp_buff_sz used by the page decoders
+ * (watch mode returns before those are set up). Each worker builds its
+ * JSON objects on the heap (the JSON state has no arena by then, and is
+ * only read by workers); watch_done(), which is serialized, writes them
+ * out. On Windows do_logs() may toggle the file scope
+ * win32_spt_curr_state, so there a single worker is used. */
+
+#define WATCH_MX_RESP_LEN MX_ALLOC_LEN
+
+/* Default pages to watch when no --page=PG is given */
+static const uint8_t watch_def_pg_arr[] = {
+    BUFF_OVER_UNDER_LPAGE, WRITE_ERR_LPAGE, READ_ERR_LPAGE,
+    VERIFY_ERR_LPAGE, NON_MEDIUM_LPAGE, STATS_LPAGE,
+};
+
+struct watch_prm_t {
+    uint16_t pc;
+    uint64_t val;
+};
+
+struct watch_pg_t {
+    bool active;        /* cleared if device rejects this page */
+    int pg_code;
+    int subpg_code;
+    int num_prm;
+    int max_prm;
+    uint64_t prev_ns;   /* 0 before first sample */
+    struct watch_prm_t * prm_arr;       /* ascending parameter code */
+};
+
+struct watch_dev_t {
+    bool dead;          /* open failed, no further samples */
+    bool pgs_checked;   /* supported pages checked against page list */
+    int sg_fd;
+    int res;
+    int num_pgs;
+    int num_jo;
+    int max_jo;
+    const char * name;
+    uint8_t * resp;
+    uint8_t * free_resp;
+    sgj_opaque_p * jo_arr;      /* to be written by watch_done() */
+    struct watch_pg_t * pg_arr;
+};
+
+struct watch_t {
+    const struct opts_t * op;
+    sgj_state * jsp;
+    FILE * fp;
+    int sample;
+    struct watch_dev_t * dev_arr;
+};
+
+/* Starts a new JSON object, holding the sample time and the device name,
+ * that watch_done() will write out. Returns NULL if out of memory. */
+static sgj_opaque_p
+watch_line_start(const struct watch_t * wp, struct watch_dev_t * dp)
+{
+    struct timeval tv;
+    sgj_state * jsp = wp->jsp;
+    sgj_opaque_p jop;
+    sgj_opaque_p * jopp;
+
+    if (dp->num_jo >= dp->max_jo) {
+        jopp = (sgj_opaque_p *)realloc(dp->jo_arr,
+                                       (dp->max_jo + 8) * sizeof(*jopp));
+        if (NULL == jopp)
+            return NULL;
+        dp->jo_arr = jopp;
+        dp->max_jo += 8;
+    }
+    jop = sgj_new_unattached_object_r(jsp);
+    if (NULL == jop)
+        return NULL;
+    dp->jo_arr[dp->num_jo++] = jop;
+    gettimeofday(&tv, NULL);
+    sgj_js_nv_i(jsp, jop, "time_ms", (int64_t)tv.tv_sec * 1000 +
+                                     tv.tv_usec / 1000);
+    sgj_js_nv_s(jsp, jop, "device", dp->name);
+    sgj_js_nv_i(jsp, jop, "sample", wp->sample);
+    return jop;
+}
+
+/* Returns pointer to parameter with parameter code 'pc', adding it if it is
+ * not there. 'hint' is where the search starts: since parameters are in
+ * ascending order it is usually the one after the previous parameter. */
+static struct watch_prm_t *
+watch_find_prm(struct watch_pg_t * wpp, int pc, int * hint, bool * newp)
+{
+    int k;
+    struct watch_prm_t * pp;
+
+    *newp = false;
+    k = ((*hint > 0) && (wpp->prm_arr[*hint - 1].pc < pc)) ? *hint : 0;
+    for ( ; (k < wpp->num_prm) && (wpp->prm_arr[k].pc < pc); ++k)
+        ;
+    if ((k >= wpp->num_prm) || (wpp->prm_arr[k].pc != pc)) {
+        if (wpp->num_prm >= wpp->max_prm) {
+            pp = (struct watch_prm_t *)realloc(wpp->prm_arr,
+                                (wpp->max_prm + 32) * sizeof(*pp));
+            if (NULL == pp)
+                return NULL;
+            wpp->prm_arr = pp;
+            wpp->max_prm += 32;
+        }
+        pp = wpp->prm_arr + k;
+        if (k < wpp->num_prm)
+            memmove(pp + 1, pp, (wpp->num_prm - k) * sizeof(*pp));
+        ++wpp->num_prm;
+        pp->pc = pc;
+        pp->val = 0;
+        *newp = true;
+    }
+    *hint = k + 1;
+    return wpp->prm_arr + k;
+}
+
+/* Compares the log page in dp->resp with the previous sample of that page
+ * and adds one JSON object for watch_done() to output. */
+static void
+watch_page_delta(struct watch_t * wp, struct watch_dev_t * dp,
+                 struct watch_pg_t * wpp, uint64_t now_ns)
+{
+    bool first = (0 == wpp->prev_ns);
+    bool is_new;
+    int k, len, num, pl, pc, fl, hint;
+    uint64_t val, delta;
+    uint64_t dt_ns = now_ns - wpp->prev_ns;
+    const struct opts_t * op = wp->op;
+    sgj_state * jsp = wp->jsp;
+    const uint8_t * bp;
+    struct watch_prm_t * pp;
+    sgj_opaque_p jop, jo2p, jap;
+
+    len = sg_get_unaligned_be16(dp->resp + 2) + 4;
+    if (len > WATCH_MX_RESP_LEN)
+        len = WATCH_MX_RESP_LEN;
+    jop = watch_line_start(wp, dp);
+    if (NULL == jop)
+        return;
+    sgj_js_nv_i(jsp, jop, pg_c_sn, wpp->pg_code);
+    sgj_js_nv_i(jsp, jop, spg_c_sn, wpp->subpg_code);
+    if (! first)
+        sgj_js_nv_i(jsp, jop, "interval_ms", dt_ns / 1000000);
+    jap = sgj_named_subarray_r(jsp, jop, "parameters");
+    hint = 0;
+    for (k = 4, bp = dp->resp + 4; (k + 4) <= len; k += num, bp += num) {
+        pc = sg_get_unaligned_be16(bp + 0);
+        pl = bp[3];
+        num = pl + 4;
+        fl = bp[2] & 0x3;
+        if ((k + num) > len)
+            break;
+        if (op->filter_given && (op->filter >= 0) && (pc != op->filter))
+            continue;
+        /* only bounded or unbounded data counters */
+        if (((0 != fl) && (2 != fl)) || (pl < 1) || (pl > 8))
+            continue;
+        val = sg_get_unaligned_be(pl, bp + 4);
+        pp = watch_find_prm(wpp, pc, &hint, &is_new);
+        if (NULL == pp)
+            break;
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo2p, param_c_sn, pc);
+        sgj_js_nv_i(jsp, jo2p, "value", (int64_t)val);
+        if ((! first) && (! is_new)) {
+            if (val >= pp->val)
+                delta = val - pp->val;
+            else {      /* counter reset (e.g. LOG SELECT) */
+                delta = val;
+                sgj_js_nv_b(jsp, jo2p, "reset", true);
+            }
+            sgj_js_nv_i(jsp, jo2p, "delta", (int64_t)delta);
+            sgj_js_nv_d(jsp, jo2p, "rate",
+                        dt_ns ? ((double)delta * 1e9) / dt_ns : 0.0);
+        }
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        pp->val = val;
+    }
+    wpp->prev_ns = now_ns;
+}
+
+/* Drops pages from the watch list that do not appear in the Supported log
+ * pages (and subpages) log page. If that page can't be fetched then all
+ * pages stay active and failures are dealt with as they occur. */
+static void
+watch_check_supported(const struct opts_t * op, struct watch_dev_t * dp)
+{
+    bool spf;
+    int k, j, len, res;
+    struct watch_pg_t * wpp;
+    struct opts_t lopts;
+
+    lopts = *op;
+    lopts.pg_code = SUPP_PAGES_LPAGE;
+    lopts.subpg_code = SUPP_SPGS_SUBPG;
+    lopts.do_ppc = false;
+    lopts.paramp = 0;
+    res = do_logs(dp->sg_fd, dp->resp, WATCH_MX_RESP_LEN, &lopts);
+    if (res) {
+        lopts.subpg_code = NOT_SPG_SUBPG;
+        res = do_logs(dp->sg_fd, dp->resp, WATCH_MX_RESP_LEN, &lopts);
+        if (res)
+            return;
+    }
+    spf = !! (dp->resp[0] & 0x40);
+    len = sg_get_unaligned_be16(dp->resp + 2) + 4;
+    if (len > WATCH_MX_RESP_LEN)
+        len = WATCH_MX_RESP_LEN;
+    for (j = 0, wpp = dp->pg_arr; j < dp->num_pgs; ++j, ++wpp) {
+        if ((! spf) && (wpp->subpg_code > 0))
+            continue;   /* can't tell from the pages only list */
+        for (k = 4; k < len; k += (spf ? 2 : 1)) {
+            if (((dp->resp[k] & 0x3f) == wpp->pg_code) &&
+                ((! spf) || (((k + 1) < len) &&
+                             (dp->resp[k + 1] == wpp->subpg_code))))
+                break;
+        }
+        if (k >= len)
+            wpp->active = false;
+    }
+}
+
+/* Worker for sg_par_run(), fetches each watched log page of one device */
+static int
+watch_work(void * ctxp, int idx)
+{
+    int j, res;
+    uint64_t now_ns;
+    struct watch_t * wp = (struct watch_t *)ctxp;
+    const struct opts_t * op = wp->op;
+    sgj_state * jsp = wp->jsp;
+    struct watch_dev_t * dp = wp->dev_arr + idx;
+    struct watch_pg_t * wpp;
+    sgj_opaque_p jop;
+    struct opts_t lopts;
+    char b[160];
+
+    if (dp->dead)
+        return dp->res;
+    if (dp->sg_fd < 0) {
+        dp->sg_fd = sg_cmds_open_device(dp->name, true /* ro */,
+                                        op->verbose);
+        if (dp->sg_fd < 0) {
+            dp->res = sg_convert_errno(-dp->sg_fd);
+            dp->dead = true;
+            jop = watch_line_start(wp, dp);
+            if (jop) {
+                snprintf(b, sizeof(b), "open: %s",
+                         safe_strerror(-dp->sg_fd));
+                sgj_js_nv_s(jsp, jop, "error", b);
+                sgj_js_nv_i(jsp, jop, "exit_status", dp->res);
+            }
+            return dp->res;
+        }
+    }
+    if (! dp->pgs_checked) {
+        dp->pgs_checked = true;
+        if (dp->num_pgs > 1)
+            watch_check_supported(op, dp);
+    }
+    lopts = *op;
+    /* --filter=PC without --paramp=PP: the device can skip parameters
+     * below PC */
+    if (op->filter_given && (op->filter > 0) && (0 == op->paramp))
+        lopts.paramp = op->filter;
+    dp->res = 0;
+    for (j = 0, wpp = dp->pg_arr; j < dp->num_pgs; ++j, ++wpp) {
+        if (! wpp->active)
+            continue;
+        lopts.pg_code = wpp->pg_code;
+        lopts.subpg_code = wpp->subpg_code;
+        res = do_logs(dp->sg_fd, dp->resp, WATCH_MX_RESP_LEN, &lopts);
+        now_ns = sg_par_mono_ns();
+        if (0 == res) {
+            watch_page_delta(wp, dp, wpp, now_ns);
+            continue;
+        }
+        if ((SG_LIB_CAT_ILLEGAL_REQ == res) ||
+            (SG_LIB_CAT_INVALID_OP == res))
+            wpp->active = false;        /* don't ask again */
+        jop = watch_line_start(wp, dp);
+        if (jop) {
+            sg_get_category_sense_str(res, sizeof(b), b, 0);
+            sgj_js_nv_i(jsp, jop, pg_c_sn, wpp->pg_code);
+            sgj_js_nv_i(jsp, jop, spg_c_sn, wpp->subpg_code);
+            sgj_js_nv_s(jsp, jop, "error", b);
+            sgj_js_nv_i(jsp, jop, "exit_status", res);
+        }
+        if (0 == dp->res)
+            dp->res = res;
+    }
+    return dp->res;
+}
+
+/* Called (serialized) when all pages of a device have been sampled */
+static void
+watch_done(void * ctxp, int idx, int res)
+{
+    struct watch_t * wp = (struct watch_t *)ctxp;
+    struct watch_dev_t * dp = wp->dev_arr + idx;
+
+    int k;
+
+    if (res) { ; }
+    for (k = 0; k < dp->num_jo; ++k) {
+        sgj_js2file(wp->jsp, dp->jo_arr[k], 0, wp->fp);
+        sgj_free_unattached(dp->jo_arr[k]);
+    }
+    if (dp->num_jo > 0)
+        fflush(wp->fp);
+    dp->num_jo = 0;
+}
+
+#if defined(SG_LIB_MINGW)
+#include <windows.h>
+#endif
+
+static void
+watch_sleep_ns(uint64_t ns)
+{
+#if defined(SG_LIB_MINGW)
+    Sleep((DWORD)(ns / 1000000));
+#else
+    struct timespec ts, rem;
+
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    while ((nanosleep(&ts, &rem) < 0) && (EINTR == errno))
+        ts = rem;
+#endif
+}
+
+/* Handles --watch=SECS[,CNT], writing JSON lines to 'fp'. Returns 0 if the
+ * last sample of every device was successful, else the first error found
+ * in the last sample. */
+static int
+do_watch(struct opts_t * op, FILE * fp)
+{
+    int k, j, n, num_pgs, res;
+    int ret = 0;
+    uint64_t start_ns, next_ns, now_ns;
+    struct sg_par_dev_list dev_list SG_C_CPP_ZERO_INIT;
+    struct watch_t w SG_C_CPP_ZERO_INIT;
+    struct watch_dev_t * dp;
+
+    for (k = 0; k < op->dev_argc; ++k) {
+        res = sg_par_dev_list_add(&dev_list, op->dev_argv[k], op->verbose);
+        if (res) {
+            sg_par_dev_list_free(&dev_list);
+            return res;
+        }
+    }
+    num_pgs = op->pg_arg ? 1 : (int)sizeof(watch_def_pg_arr);
+    w.op = op;
+    w.jsp = &op->json_st;
+    w.fp = fp;
+    w.dev_arr = (struct watch_dev_t *)calloc(dev_list.num, sizeof(*dp));
+    if (NULL == w.dev_arr) {
+        sg_par_dev_list_free(&dev_list);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0, dp = w.dev_arr; k < dev_list.num; ++k, ++dp) {
+        dp->name = dev_list.names[k];
+        dp->sg_fd = -1;
+        dp->num_pgs = num_pgs;
+        dp->resp = sg_memalign(WATCH_MX_RESP_LEN, 0, &dp->free_resp, false);
+        dp->pg_arr = (struct watch_pg_t *)calloc(num_pgs,
+                                                 sizeof(struct watch_pg_t));
+        if ((NULL == dp->resp) || (NULL == dp->pg_arr)) {
+            pr2serr("%s: out of memory\n", __func__);
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        for (j = 0; j < num_pgs; ++j) {
+            dp->pg_arr[j].active = true;
+            if (op->pg_arg) {
+                dp->pg_arr[j].pg_code = op->pg_code;
+                dp->pg_arr[j].subpg_code = op->subpg_code;
+            } else
+                dp->pg_arr[j].pg_code = watch_def_pg_arr[j];
+        }
+    }
+#ifdef SG_LIB_WIN32
+    n = 1;      /* see win32_spt_curr_state in do_logs() */
+#else
+    n = (dev_list.num < SG_PAR_DEF_WORKERS) ? dev_list.num :
+                                              SG_PAR_DEF_WORKERS;
+#endif
+    start_ns = sg_par_mono_ns();
+    for (w.sample = 0; (0 == op->watch_count) || (w.sample < op->watch_count);
+         ++w.sample) {
+        res = sg_par_run(dev_list.num, n, watch_work, watch_done, &w);
+        if (res) {
+            pr2serr("%s: unable to start workers: %s\n", __func__,
+                    safe_strerror(res));
+            ret = sg_convert_errno(res);
+            break;
+        }
+        for (k = 0, ret = 0; k < dev_list.num; ++k) {
+            if (w.dev_arr[k].res) {
+                ret = w.dev_arr[k].res;
+                break;
+            }
+        }
+        if ((op->watch_count > 0) && ((w.sample + 1) >= op->watch_count))
+            break;
+        /* keep to a fixed schedule so the interval does not drift */
+        next_ns = start_ns + ((uint64_t)(w.sample + 1) * op->watch_secs *
+                              1000000000);
+        now_ns = sg_par_mono_ns();
+        if (next_ns > now_ns)
+            watch_sleep_ns(next_ns - now_ns);
+    }
+fini:
+    for (k = 0, dp = w.dev_arr; k < dev_list.num; ++k, ++dp) {
+        if (dp->sg_fd >= 0)
+            sg_cmds_close_device(dp->sg_fd);
+        if (dp->free_resp)
+            free(dp->free_resp);
+        if (dp->pg_arr) {
+            for (j = 0; j < dp->num_pgs; ++j)
+                free(dp->pg_arr[j].prm_arr);
+            free(dp->pg_arr);
+        }
+        for (j = 0; j < dp->num_jo; ++j)
+            sgj_free_unattached(dp->jo_arr[j]);
+        free(dp->jo_arr);
+    }
+    free(w.dev_arr);
+    sg_par_dev_list_free(&dev_list);
+    return ret;
+}
+
+/* Returns stdout unless --js-file=JFN is given with JFN other than "-" in
+ * which case that file is opened (truncated if it exists). Returns NULL
+ * if that fails. */
+static FILE *
+js_file_open(const struct opts_t * op)
+{
+    FILE * fp = stdout;
+
+    if (op->js_file &&
+        ((1 != strlen(op->js_file)) || ('-' != op->js_file[0]))) {
+        fp = fopen(op->js_file, "w");
+        if (NULL == fp)
+            pr2serr("unable to open file: %s\n", op->js_file);
+    }
+    return fp;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -9667,6 +10168,7 @@ main(int argc, char * argv[])
     sgj_opaque_p jop = NULL;
     struct sg_simple_inquiry_resp inq_out;
     struct opts_t opts SG_C_CPP_ZERO_INIT;
+    FILE * js_fp = NULL;
     uint8_t supp_pgs_rsp[256];
     char b[128];
     static const int blen = sizeof(b);
@@ -9789,6 +10291,55 @@ main(int argc, char * argv[])
         enumerate_pages(op);
         return 0;
     }
+    if (op->watch_secs > 0) {
+        if (op->do_select || op->inhex_fn || op->do_all || op->do_list ||
+            op->do_temperature || op->do_transport || op->do_raw ||
+            op->do_hex) {
+            pr2serr("--watch= conflicts with --all, --hex, --inhex=, --list, "
+                    "--raw,\n--select, --temperature and --transport\n");
+            ret = SG_LIB_CONTRADICT;
+            goto err_out;
+        }
+        if (NULL == op->device_name) {
+            pr2serr("--watch= needs at least one DEVICE\n");
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto err_out;
+        }
+        if (op->pg_arg && (ret = decode_pg_arg(op)))
+            goto err_out;
+        /* JSON lines are output, with or without --json=JO. Each line is
+         * made of heap objects built by worker threads (so no arena and no
+         * streaming) and must be on one line (so not "pretty"). */
+        if (as_json) {
+            sgj_finish(jsp);
+            as_json = false;
+        } else
+            sgj_init_state(jsp, NULL);
+        jsp->pr_pretty = false;
+        js_fp = js_file_open(op);
+        if (NULL == js_fp) {
+            ret = SG_LIB_FILE_ERROR;
+            goto err_out;
+        }
+        ret = do_watch(op, js_fp);
+        if (stdout != js_fp)
+            fclose(js_fp);
+        js_fp = NULL;
+        goto err_out;
+    }
+    if (as_json) {
+        js_fp = js_file_open(op);
+        if (NULL == js_fp) {
+            sgj_finish(jsp);
+            as_json = false;
+            ret = SG_LIB_FILE_ERROR;
+            goto err_out;
+        }
+        /* --all may decode many pages, write each out as it is completed.
+         * Hex and raw output also go to stdout so don't interleave. */
+        if ((0 == op->do_hex) && (0 == op->do_raw))
+            sgj_stream_start(jsp, js_fp);
+    }
     if (op->inhex_fn) {
         int flen = DEF_INLEN_ALLOC_LEN;
         struct stat f_stat;
@@ -10290,22 +10841,14 @@ err_out:
                     "more information\n");
     }
     if (as_json) {
-        FILE * fp = stdout;
-
-        if (op->js_file) {
-            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
-                fp = fopen(op->js_file, "w");   /* truncate if exists */
-                if (NULL == fp) {
-                    pr2serr("unable to open file: %s\n", op->js_file);
-                    ret = SG_LIB_FILE_ERROR;
-                }
-            }
-            /* '--js-file=-' will send JSON output to stdout */
-        }
-        if (fp)
-            sgj_js2file(jsp, NULL, ret, fp);
-        if (op->js_file && fp && (stdout != fp))
-            fclose(fp);
+        if (NULL == js_fp)
+            js_fp = js_file_open(op);
+        if (js_fp)
+            sgj_js2file(jsp, NULL, ret, js_fp);
+        else
+            ret = SG_LIB_FILE_ERROR;
+        if (js_fp && (stdout != js_fp))
+            fclose(js_fp);
         sgj_finish(jsp);
     }
 no_json:
@@ -159,6 +159,10 @@ struct opts_t {
     int dev_pdt;        /* from device or --pdt=DT */
     int decod_subpg_code;
     int undefined_hex;  /* hex format of undefined/unrecognized fields */
+    int watch_secs;     /* --watch=SECS[,CNT] */
+    int watch_count;    /* 0 -> until interrupted */
+    int dev_argc;       /* number of DEVICE arguments */
+    char ** dev_argv;   /* first DEVICE argument */
     const char * device_name;
     const char * inhex_fn;
     const char * json_arg;
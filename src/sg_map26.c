@@ -53,7 +53,7 @@
 
 #include "sg_lib.h"
 
-static const char * version_str = "1.23 20230717";
+static const char * version_str = "1.24 20231025";
 
 #define ME "sg_map26: "
 
@@ -118,6 +118,9 @@ static const char * def_dev_dir = "/dev";
 
 
 static const struct option long_options[] = {
+    {"all", no_argument, 0, 'a'},
+    {"batch", no_argument, 0, 'b'},
+    {"cache", required_argument, 0, 'c'},
     {"dev_dir", required_argument, 0, 'd'},
     {"given_is", required_argument, 0, 'g'},
     {"help", no_argument, 0, 'h'},
@@ -137,6 +140,9 @@ static const char * nt_names[] = {
     "tape (osst)",
     "generic (sg)",
     "changer",
+    "bsg",
+    "nvme",
+    "nvme generic",
     "regular file",
     "directory",
 };
@@ -165,11 +171,23 @@ pr2serr(const char * fmt, ...)
 static void
 usage()
 {
-        pr2serr("Usage: sg_map26 [--dev_dir=DIR] [--given_is=0..1] [--help] "
-                "[--result=0..3]\n"
-                "                [--symlink] [--verbose] [--version] "
-                "DEVICE\n"
+        pr2serr("Usage: sg_map26 [--all] [--batch] [--cache=CF] "
+                "[--dev_dir=DIR]\n"
+                "                [--given_is=0..1] [--help] [--result=0..3] "
+                "[--symlink]\n"
+                "                [--verbose] [--version] [DEVICE]\n"
                 "  where:\n"
+                "    --all | -a        list each SCSI device with its sg, "
+                "primary and bsg\n"
+                "                      nodes (one line each)\n"
+                "    --batch | -b      read DEVICE names from stdin, one per "
+                "line; each\n"
+                "                      output line starts with the given "
+                "name\n"
+                "    --cache=CF | -c CF    keep topology index in file CF, "
+                "reused until\n"
+                "                          devices are added or "
+                "removed, or reboot\n"
                 "    --dev_dir=DIR | -d DIR    search in DIR for "
                 "resulting special\n"
                 "                            (def: directory of DEVICE "
@@ -196,7 +214,9 @@ usage()
                 "    --version | -V    print version string and exit\n\n"
                 "Maps SCSI device node to corresponding generic node (and "
                 "vv). Users may\nfind the lsscsi utility more convenient "
-                "as it doesn't need root\npermissions.\n"
+                "as it doesn't need root\npermissions. With --all, --batch "
+                "or --cache=CF an index of sysfs and\nDIR (def: '/dev') is "
+                "built in one pass and all mappings use it.\n"
                 );
 }
 
@@ -1193,10 +1213,858 @@ skip:
         return 0;
 }
 
+/* Index mode (--all, --batch or --cache=CF). Rather than one or more
+ * scandir() passes per mapping, the sysfs class directories and the device
+ * directory are each read once to build an in-memory index. Each sysfs
+ * class entry (sg, sd, sr, st, sch, osst, bsg) becomes a node holding its
+ * major:minor and the SCSI device (H:C:T:L) it belongs to; nodes of the
+ * same SCSI device are peers. Device directory entries are sorted by
+ * major:minor so each lookup is a binary search. Any number of queries are
+ * then answered from the index. */
+
+#define IDX_CACHE_MAGIC "sg_map26-index"
+#define IDX_CACHE_VER 1
+
+struct idx_node_t {
+        int nt;                 /* NT_SG, NT_SD, etc */
+        int ft;                 /* FT_CHAR or FT_BLOCK */
+        int ma;
+        int mi;
+        int grp;                /* index into idx_t::grps, -1 if none */
+        bool primary;           /* sd, sr, st<n>, sch or osst<n> */
+        char * cls_path;        /* e.g. /sys/class/scsi_generic/sg1 */
+        char * real_path;       /* with symlinks resolved */
+};
+
+struct idx_dev_t {
+        int ft;
+        int ma;
+        int mi;
+        char * path;            /* e.g. /dev/sg1 */
+};
+
+struct idx_grp_t {
+        char * dev_path;        /* sysfs path of SCSI device, the key */
+        const char * hctl;      /* basename of dev_path */
+};
+
+struct idx_t {
+        int num_nodes;
+        int max_nodes;
+        int num_devs;
+        int max_devs;
+        int num_grps;
+        int max_grps;
+        struct idx_node_t * nodes;
+        struct idx_dev_t * devs;
+        struct idx_grp_t * grps;
+        char key[128];          /* see idx_get_key(), "" if unknown */
+};
+
+struct idx_cls_t {
+        const char * dir;
+        int nt;                 /* NT_NO_MATCH -> decide from major */
+        int ft;
+};
+
+static const struct idx_cls_t idx_cls_arr[] = {
+        {"/sys/class/scsi_generic", NT_SG, FT_CHAR},
+        {"/sys/class/block", NT_NO_MATCH, FT_BLOCK},
+        {"/sys/class/scsi_tape", NT_ST, FT_CHAR},
+        {"/sys/class/onstream_tape", NT_OSST, FT_CHAR},
+        {"/sys/class/scsi_changer", NT_CH, FT_CHAR},
+        {"/sys/class/bsg", NT_BSG, FT_CHAR},
+};
+
+static void *
+idx_grow(void * p, int * maxp, int num, size_t elem_sz)
+{
+        void * np;
+        int new_max;
+
+        if (num < *maxp)
+                return p;
+        new_max = (*maxp > 0) ? (2 * *maxp) : 64;
+        np = realloc(p, new_max * elem_sz);
+        if (NULL == np) {
+                pr2serr("%s: out of memory\n", __func__);
+                return NULL;
+        }
+        *maxp = new_max;
+        return np;
+}
+
+static void
+idx_free(struct idx_t * ip)
+{
+        int k;
+
+        for (k = 0; k < ip->num_nodes; ++k) {
+                free(ip->nodes[k].cls_path);
+                free(ip->nodes[k].real_path);
+        }
+        for (k = 0; k < ip->num_devs; ++k)
+                free(ip->devs[k].path);
+        for (k = 0; k < ip->num_grps; ++k)
+                free(ip->grps[k].dev_path);
+        free(ip->nodes);
+        free(ip->devs);
+        free(ip->grps);
+        memset(ip, 0, sizeof(*ip));
+}
+
+/* Returns index of group whose key is 'dev_path', adding it if needed.
+ * Returns -1 if out of memory. */
+static int
+idx_grp_find_add(struct idx_t * ip, const char * dev_path)
+{
+        int k;
+        const char * cp;
+        struct idx_grp_t * gp;
+
+        for (k = 0; k < ip->num_grps; ++k) {
+                if (0 == strcmp(dev_path, ip->grps[k].dev_path))
+                        return k;
+        }
+        gp = (struct idx_grp_t *)idx_grow(ip->grps, &ip->max_grps,
+                                          ip->num_grps, sizeof(*gp));
+        if (NULL == gp)
+                return -1;
+        ip->grps = gp;
+        gp += ip->num_grps;
+        gp->dev_path = strdup(dev_path);
+        if (NULL == gp->dev_path)
+                return -1;
+        cp = strrchr(gp->dev_path, '/');
+        gp->hctl = cp ? cp + 1 : gp->dev_path;
+        return ip->num_grps++;
+}
+
+static int
+idx_add_node(struct idx_t * ip, int nt, int ft, int ma, int mi,
+             const char * grp_path, const char * cls_path,
+             const char * real_path, bool primary)
+{
+        struct idx_node_t * np;
+
+        np = (struct idx_node_t *)idx_grow(ip->nodes, &ip->max_nodes,
+                                           ip->num_nodes, sizeof(*np));
+        if (NULL == np)
+                return 1;
+        ip->nodes = np;
+        np += ip->num_nodes;
+        memset(np, 0, sizeof(*np));
+        np->nt = nt;
+        np->ft = ft;
+        np->ma = ma;
+        np->mi = mi;
+        np->primary = primary;
+        np->grp = grp_path[0] ? idx_grp_find_add(ip, grp_path) : -1;
+        np->cls_path = strdup(cls_path);
+        np->real_path = strdup(real_path);
+        if ((NULL == np->cls_path) || (NULL == np->real_path))
+                return 1;
+        ++ip->num_nodes;
+        return 0;
+}
+
+/* One pass over each sysfs class directory of interest */
+static int
+idx_scan_sysfs(struct idx_t * ip, int verbose)
+{
+        bool primary, is_part;
+        int k, nt, ma, mi;
+        size_t j;
+        DIR * dirp;
+        struct dirent * dep;
+        const struct idx_cls_t * clsp;
+        struct stat a_stat;
+        char value[64];
+        char cls[D_NAME_LEN_MAX];
+        char b[PATH_MAX];
+        char real[PATH_MAX];
+        char grp[PATH_MAX];
+
+        for (k = 0; k < (int)(sizeof(idx_cls_arr) / sizeof(idx_cls_arr[0]));
+             ++k) {
+                clsp = idx_cls_arr + k;
+                dirp = opendir(clsp->dir);
+                if (NULL == dirp) {
+                        if (verbose > 1)
+                                pr2serr("%s: %s: %s\n", __func__, clsp->dir,
+                                        ssafe_strerror(errno));
+                        continue;
+                }
+                while ((dep = readdir(dirp))) {
+                        if ('.' == dep->d_name[0])
+                                continue;
+                        snprintf(cls, sizeof(cls), "%s/%.*s", clsp->dir,
+                                 NAME_LEN_MAX, dep->d_name);
+                        if ((! get_value(cls, "dev", value, sizeof(value))) ||
+                            (2 != sscanf(value, "%d:%d", &ma, &mi)))
+                                continue;
+                        nt = clsp->nt;
+                        is_part = false;
+                        if (NT_NO_MATCH == nt) {        /* block */
+                                nt = nt_typ_from_major(ma);
+                                if (NT_NO_MATCH == nt)
+                                        continue;
+                                snprintf(b, sizeof(b), "%s/partition", cls);
+                                is_part = (stat(b, &a_stat) >= 0);
+                        }
+                        if (NULL == realpath(cls, real))
+                                continue;
+                        /* a partition's parent is the whole disk */
+                        snprintf(b, sizeof(b), "%s/%sdevice", cls,
+                                 is_part ? "../" : "");
+                        if (NULL == realpath(b, grp))
+                                grp[0] = '\0';
+                        if (NT_ST == nt) {
+                                /* st<n> is primary, not st<n>l, nst<n> .. */
+                                j = strlen(dep->d_name);
+                                primary = (0 == strncmp(dep->d_name, "st",
+                                                        2)) &&
+                                          isdigit(dep->d_name[j - 1]);
+                        } else if (NT_OSST == nt) {
+                                j = strlen(dep->d_name);
+                                primary = (0 == strncmp(dep->d_name, "osst",
+                                                        4)) &&
+                                          isdigit(dep->d_name[j - 1]);
+                        } else
+                                primary = ((NT_SD == nt) || (NT_SR == nt) ||
+                                           (NT_CH == nt)) && (! is_part);
+                        if ((FT_BLOCK == clsp->ft) && (! is_part))
+                                snprintf(cls, sizeof(cls), "%s%.*s",
+                                         sys_sd_dir, NAME_LEN_MAX,
+                                         dep->d_name);
+                        if (idx_add_node(ip, nt, clsp->ft, ma, mi, grp, cls,
+                                         real, primary)) {
+                                closedir(dirp);
+                                return 1;
+                        }
+                }
+                closedir(dirp);
+        }
+        if (verbose)
+                pr2serr("%s: %d sysfs nodes, %d SCSI devices\n", __func__,
+                        ip->num_nodes, ip->num_grps);
+        return 0;
+}
+
+static int
+idx_dev_cmp(const void * ap, const void * bp)
+{
+        const struct idx_dev_t * a = (const struct idx_dev_t *)ap;
+        const struct idx_dev_t * b = (const struct idx_dev_t *)bp;
+
+        if (a->ft != b->ft)
+                return a->ft - b->ft;
+        if (a->ma != b->ma)
+                return a->ma - b->ma;
+        if (a->mi != b->mi)
+                return a->mi - b->mi;
+        return strcmp(a->path, b->path);
+}
+
+/* One pass over the device directory (and its bsg sub-directory) */
+static int
+idx_scan_dev_dir(struct idx_t * ip, const char * dev_dir,
+                 bool follow_symlink, int verbose)
+{
+        int k, ft;
+        DIR * dirp;
+        struct dirent * dep;
+        struct idx_dev_t * dp;
+        struct stat st;
+        char sub[D_NAME_LEN_MAX];
+        char name[D_NAME_LEN_MAX];
+        const char * dirs[2];
+
+        dirs[0] = dev_dir;
+        snprintf(sub, sizeof(sub), "%.*s/bsg", NAME_LEN_MAX, dev_dir);
+        dirs[1] = sub;
+        for (k = 0; k < 2; ++k) {
+                dirp = opendir(dirs[k]);
+                if (NULL == dirp) {
+                        if (0 == k) {
+                                pr2serr("%s: %s: %s\n", __func__, dirs[k],
+                                        ssafe_strerror(errno));
+                                return 1;
+                        }
+                        continue;
+                }
+                while ((dep = readdir(dirp))) {
+                        if ((DT_BLK != dep->d_type) &&
+                            (DT_CHR != dep->d_type) &&
+                            ((DT_LNK != dep->d_type) || (! follow_symlink)))
+                                continue;
+                        snprintf(name, sizeof(name), "%.*s/%.*s",
+                                 NAME_LEN_MAX, dirs[k], NAME_LEN_MAX,
+                                 dep->d_name);
+                        if (stat(name, &st) < 0)
+                                continue;
+                        if (S_ISBLK(st.st_mode))
+                                ft = FT_BLOCK;
+                        else if (S_ISCHR(st.st_mode))
+                                ft = FT_CHAR;
+                        else
+                                continue;
+                        dp = (struct idx_dev_t *)idx_grow(ip->devs,
+                                        &ip->max_devs, ip->num_devs,
+                                        sizeof(*dp));
+                        if (NULL == dp) {
+                                closedir(dirp);
+                                return 1;
+                        }
+                        ip->devs = dp;
+                        dp += ip->num_devs;
+                        dp->ft = ft;
+                        dp->ma = major(st.st_rdev);
+                        dp->mi = minor(st.st_rdev);
+                        dp->path = strdup(name);
+                        if (NULL == dp->path) {
+                                closedir(dirp);
+                                return 1;
+                        }
+                        ++ip->num_devs;
+                }
+                closedir(dirp);
+        }
+        if (ip->num_devs > 1)
+                qsort(ip->devs, ip->num_devs, sizeof(struct idx_dev_t),
+                      idx_dev_cmp);
+        if (verbose)
+                pr2serr("%s: %d special files in %s\n", __func__,
+                        ip->num_devs, dev_dir);
+        return 0;
+}
+
+/* Index generation key: boot_id, then a hash of the names listed in each
+ * sysfs class directory, then the modification times of the device
+ * directory and its bsg sub-directory. Unlike uevent_seqnum this does not
+ * change for uevents (e.g. "change" events during coldplug) that leave the
+ * topology alone. Key must not contain whitespace. */
+static void
+idx_get_key(struct idx_t * ip, const char * dev_dir)
+{
+        int k, n;
+        uint32_t h, sum;
+        DIR * dirp;
+        struct dirent * dep;
+        const char * cp;
+        struct stat d_stat;
+        struct stat b_stat;
+        char a[64];
+        char b[PATH_MAX];
+
+        ip->key[0] = '\0';
+        if (! get_value("/proc/sys/kernel/random", "boot_id", a, sizeof(a)))
+                return;
+        /* sum of per name FNV-1a hashes so readdir() order does not matter */
+        for (n = 0, sum = 0, k = 0;
+             k < (int)(sizeof(idx_cls_arr) / sizeof(idx_cls_arr[0])); ++k) {
+                dirp = opendir(idx_cls_arr[k].dir);
+                if (NULL == dirp)
+                        continue;
+                while ((dep = readdir(dirp))) {
+                        if ('.' == dep->d_name[0])
+                                continue;
+                        for (h = 2166136261U + k, cp = dep->d_name; *cp; ++cp)
+                                h = (h ^ (uint8_t)*cp) * 16777619U;
+                        sum += h;
+                        ++n;
+                }
+                closedir(dirp);
+        }
+        if (stat(dev_dir, &d_stat) < 0)
+                return;
+        snprintf(b, sizeof(b), "%.*s/bsg", NAME_LEN_MAX, dev_dir);
+        if (stat(b, &b_stat) < 0)
+                memset(&b_stat, 0, sizeof(b_stat));
+        snprintf(ip->key, sizeof(ip->key), "%s/%d.%x/%lld.%ld/%lld.%ld", a,
+                 n, sum, (long long)d_stat.st_mtim.tv_sec,
+                 (long)d_stat.st_mtim.tv_nsec,
+                 (long long)b_stat.st_mtim.tv_sec,
+                 (long)b_stat.st_mtim.tv_nsec);
+}
+
+/* Returns 0 if cache file was read and its key (and device directory)
+ * matched; the index is then complete. Otherwise returns 1 and the index
+ * is empty. */
+static int
+idx_cache_read(struct idx_t * ip, const char * fn, const char * dev_dir,
+               bool follow_symlink, int verbose)
+{
+        bool ok = false;
+        int n, ver, nt, ft, ma, mi, prim;
+        FILE * fp;
+        char * cp;
+        char line[3 * PATH_MAX];
+        char p1[PATH_MAX];
+        char p2[PATH_MAX];
+        char p3[PATH_MAX];
+        char key[sizeof(ip->key)];
+
+        if (NULL == (fp = fopen(fn, "r")))
+                return 1;
+        if ((NULL == fgets(line, sizeof(line), fp)) ||
+            (4 != sscanf(line, IDX_CACHE_MAGIC " %d %127s %4095s %d", &ver,
+                         key, p1, &n)) ||
+            (IDX_CACHE_VER != ver) || strcmp(key, ip->key) ||
+            strcmp(p1, dev_dir) || (n != (int)follow_symlink)) {
+                if (verbose)
+                        pr2serr("cache file %s is stale or unknown, "
+                                "rebuild\n", fn);
+                fclose(fp);
+                return 1;
+        }
+        while (fgets(line, sizeof(line), fp)) {
+                cp = strchr(line, '\n');
+                if (cp)
+                        *cp = '\0';
+                if (0 == strcmp(line, "END")) {
+                        ok = true;
+                        break;
+                }
+                if (('N' == line[0]) &&
+                    (8 == sscanf(line + 1, " %d %d %d %d %d %4095[^\t]\t"
+                                 "%4095[^\t]\t%4095s", &nt, &ft, &ma, &mi,
+                                 &prim, p1, p2, p3))) {
+                        if (idx_add_node(ip, nt, ft, ma, mi,
+                                         ('-' == p3[0]) ? "" : p3, p1, p2,
+                                         !! prim))
+                                break;
+                } else if (('D' == line[0]) &&
+                           (4 == sscanf(line + 1, " %d %d %d %4095[^\n]",
+                                        &ft, &ma, &mi, p1))) {
+                        struct idx_dev_t * dp;
+
+                        dp = (struct idx_dev_t *)idx_grow(ip->devs,
+                                        &ip->max_devs, ip->num_devs,
+                                        sizeof(*dp));
+                        if (NULL == dp)
+                                break;
+                        ip->devs = dp;
+                        dp += ip->num_devs;
+                        dp->ft = ft;
+                        dp->ma = ma;
+                        dp->mi = mi;
+                        dp->path = strdup(p1);
+                        if (NULL == dp->path)
+                                break;
+                        ++ip->num_devs;
+                } else
+                        break;
+        }
+        fclose(fp);
+        if (! ok) {
+                if (verbose)
+                        pr2serr("cache file %s is corrupt, rebuild\n", fn);
+                idx_free(ip);
+                idx_get_key(ip, dev_dir);
+                return 1;
+        }
+        if (verbose)
+                pr2serr("index read from cache file %s\n", fn);
+        return 0;
+}
+
+/* Writes to a temporary file then renames so concurrent readers never see
+ * a partial cache file. The temporary file is created by mkstemp() in the
+ * same directory as the cache file: its name is not predictable and it is
+ * never opened through an existing (sym)link, which matters when this runs
+ * as root from a udev rule. */
+static void
+idx_cache_write(const struct idx_t * ip, const char * fn,
+                const char * dev_dir, bool follow_symlink, int verbose)
+{
+        int k, fd;
+        FILE * fp;
+        const struct idx_node_t * np;
+        const struct idx_dev_t * dp;
+        char tmp[PATH_MAX];
+
+        if ('\0' == ip->key[0]) {
+                if (verbose)
+                        pr2serr("no sysfs generation available, cache file "
+                                "not written\n");
+                return;
+        }
+        snprintf(tmp, sizeof(tmp), "%.*s.XXXXXX", PATH_MAX - 16, fn);
+        fd = mkstemp(tmp);
+        if (fd < 0) {
+                pr2serr("unable to create temporary file %s: %s\n", tmp,
+                        ssafe_strerror(errno));
+                return;
+        }
+        /* mkstemp() creates with mode 0600, cache is world readable */
+        if ((fchmod(fd, 0644) < 0) || (NULL == (fp = fdopen(fd, "w")))) {
+                pr2serr("unable to write cache file %s: %s\n", tmp,
+                        ssafe_strerror(errno));
+                close(fd);
+                unlink(tmp);
+                return;
+        }
+        fprintf(fp, IDX_CACHE_MAGIC " %d %s %s %d\n", IDX_CACHE_VER, ip->key,
+                dev_dir, (int)follow_symlink);
+        for (k = 0; k < ip->num_nodes; ++k) {
+                np = ip->nodes + k;
+                fprintf(fp, "N %d %d %d %d %d %s\t%s\t%s\n", np->nt, np->ft,
+                        np->ma, np->mi, (int)np->primary, np->cls_path,
+                        np->real_path,
+                        (np->grp >= 0) ? ip->grps[np->grp].dev_path : "-");
+        }
+        for (k = 0; k < ip->num_devs; ++k) {
+                dp = ip->devs + k;
+                fprintf(fp, "D %d %d %d %s\n", dp->ft, dp->ma, dp->mi,
+                        dp->path);
+        }
+        fprintf(fp, "END\n");
+        if (fclose(fp) || (rename(tmp, fn) < 0)) {
+                pr2serr("unable to write cache file %s: %s\n", fn,
+                        ssafe_strerror(errno));
+                unlink(tmp);
+        } else if (verbose)
+                pr2serr("index written to cache file %s\n", fn);
+}
+
+static int
+idx_build(struct idx_t * ip, const char * cache_fn, const char * dev_dir,
+          bool follow_symlink, int verbose)
+{
+        memset(ip, 0, sizeof(*ip));
+        if (cache_fn) {
+                idx_get_key(ip, dev_dir);
+                if (0 == idx_cache_read(ip, cache_fn, dev_dir,
+                                        follow_symlink, verbose))
+                        return 0;
+        }
+        if (idx_scan_sysfs(ip, verbose) ||
+            idx_scan_dev_dir(ip, dev_dir, follow_symlink, verbose))
+                return 1;
+        if (cache_fn)
+                idx_cache_write(ip, cache_fn, dev_dir, follow_symlink,
+                                verbose);
+        return 0;
+}
+
+/* Returns index of first device directory entry matching ft, ma and mi,
+ * or -1 if none. */
+static int
+idx_find_dev(const struct idx_t * ip, int ft, int ma, int mi)
+{
+        int lo = 0;
+        int hi = ip->num_devs - 1;
+        int mid, found = -1;
+        const struct idx_dev_t * dp;
+
+        while (lo <= hi) {
+                mid = (lo + hi) / 2;
+                dp = ip->devs + mid;
+                if ((dp->ft < ft) || ((dp->ft == ft) && ((dp->ma < ma) ||
+                    ((dp->ma == ma) && (dp->mi < mi)))))
+                        lo = mid + 1;
+                else {
+                        if ((dp->ft == ft) && (dp->ma == ma) && (dp->mi == mi))
+                                found = mid;
+                        hi = mid - 1;
+                }
+        }
+        return found;
+}
+
+static const struct idx_node_t *
+idx_find_node(const struct idx_t * ip, int ft, int ma, int mi)
+{
+        int k;
+        const struct idx_node_t * np;
+
+        for (k = 0; k < ip->num_nodes; ++k) {
+                np = ip->nodes + k;
+                if ((np->ma == ma) && (np->mi == mi) &&
+                    ((FT_OTHER == ft) || (np->ft == ft)))
+                        return np;
+        }
+        return NULL;
+}
+
+/* Returns the peer of 'np' that it maps to: sg nodes map to the primary
+ * (sd, sr, st, sch or osst) node, others map to the sg node. A bsg node
+ * maps to the primary node if there is one, else to the sg node. */
+static const struct idx_node_t *
+idx_mapped_node(const struct idx_t * ip, const struct idx_node_t * np)
+{
+        int k;
+        const struct idx_node_t * pp;
+        const struct idx_node_t * sgp = NULL;
+        const struct idx_node_t * prp = NULL;
+
+        if (np->grp < 0)
+                return NULL;
+        for (k = 0; k < ip->num_nodes; ++k) {
+                pp = ip->nodes + k;
+                if ((pp == np) || (pp->grp != np->grp))
+                        continue;
+                if ((NT_SG == pp->nt) && (NULL == sgp))
+                        sgp = pp;
+                else if (pp->primary && (NULL == prp))
+                        prp = pp;
+        }
+        if (NT_SG == np->nt)
+                return prp;
+        if (NT_BSG == np->nt)
+                return prp ? prp : sgp;
+        return sgp;
+}
+
+/* Prints device directory entries of node, each prefixed by 'leadin' if
+ * non-NULL. Returns number printed. */
+static int
+idx_prt_devs(const struct idx_t * ip, const struct idx_node_t * np,
+             const char * leadin)
+{
+        int k, n;
+
+        k = idx_find_dev(ip, np->ft, np->ma, np->mi);
+        for (n = 0; (k >= 0) && (k < ip->num_devs); ++k, ++n) {
+                if ((ip->devs[k].ft != np->ft) || (ip->devs[k].ma != np->ma) ||
+                    (ip->devs[k].mi != np->mi))
+                        break;
+                if (leadin)
+                        printf("%s ", leadin);
+                printf("%s\n", ip->devs[k].path);
+        }
+        return n;
+}
+
+/* Answers one query from the index, output as in the non-index mode but
+ * each line is prefixed by 'leadin' when that is non-NULL. Returns 0 if
+ * a result is found, else 1. */
+static int
+idx_query(const struct idx_t * ip, const char * dev_name, int op_result,
+          const char * leadin, int verbose)
+{
+        int ma, mi, ft;
+        const struct idx_node_t * np;
+        const struct idx_node_t * mp;
+        struct stat st;
+        char value[D_NAME_LEN_MAX];
+
+        if (stat(dev_name, &st) < 0) {
+                pr2serr("stat failed on %s: %s\n", dev_name,
+                        ssafe_strerror(errno));
+                return 1;
+        }
+        if (S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode)) {
+                ft = S_ISBLK(st.st_mode) ? FT_BLOCK : FT_CHAR;
+                ma = major(st.st_rdev);
+                mi = minor(st.st_rdev);
+        } else {
+                /* sysfs 'dev' file or directory holding one */
+                if (! get_value(S_ISDIR(st.st_mode) ? dev_name : NULL,
+                                S_ISDIR(st.st_mode) ? "dev" : dev_name,
+                                value, sizeof(value)) ||
+                    (2 != sscanf(value, "%d:%d", &ma, &mi))) {
+                        pr2serr("Couldn't fetch dev value from: %s\n",
+                                dev_name);
+                        return 1;
+                }
+                ft = FT_OTHER;
+        }
+        np = idx_find_node(ip, ft, ma, mi);
+        if (NULL == np) {
+                pr2serr("%s [maj=%d, min=%d] not found in sysfs index\n",
+                        dev_name, ma, mi);
+                return 1;
+        }
+        if (verbose)
+                pr2serr(" %s: %s device [maj=%d, min=%d] sysfs: %s\n",
+                        dev_name, nt_names[np->nt], ma, mi, np->cls_path);
+        if (op_result >= 2)
+                mp = np;
+        else {
+                mp = idx_mapped_node(ip, np);
+                if (NULL == mp) {
+                        pr2serr("%s device: %s does not map to another SCSI "
+                                "device\n", nt_names[np->nt], dev_name);
+                        return 1;
+                }
+        }
+        switch (op_result) {
+        case 1:
+                if (leadin)
+                        printf("%s ", leadin);
+                printf("%s\n", mp->real_path);
+                return 0;
+        case 3:
+                if (leadin)
+                        printf("%s ", leadin);
+                printf("%s\n", mp->cls_path);
+                return 0;
+        default:
+                return (idx_prt_devs(ip, mp, leadin) > 0) ? 0 : 1;
+        }
+}
+
+struct idx_ord_t {
+        int grp;
+        const char * hctl;
+};
+
+/* Sorts on H:C:T:L numerically, falling back to a string compare */
+static int
+idx_hctl_cmp(const void * ap, const void * bp)
+{
+        const char * a = ((const struct idx_ord_t *)ap)->hctl;
+        const char * b = ((const struct idx_ord_t *)bp)->hctl;
+        unsigned long long av[4], bv[4];
+        int k;
+
+        if ((4 == sscanf(a, "%llu:%llu:%llu:%llu", av, av + 1, av + 2,
+                         av + 3)) &&
+            (4 == sscanf(b, "%llu:%llu:%llu:%llu", bv, bv + 1, bv + 2,
+                         bv + 3))) {
+                for (k = 0; k < 4; ++k) {
+                        if (av[k] != bv[k])
+                                return (av[k] < bv[k]) ? -1 : 1;
+                }
+                return 0;
+        }
+        return strcmp(a, b);
+}
+
+/* First device directory entry of node, or "-" */
+static const char *
+idx_dev_name(const struct idx_t * ip, const struct idx_node_t * np)
+{
+        int k;
+
+        if (NULL == np)
+                return "-";
+        k = idx_find_dev(ip, np->ft, np->ma, np->mi);
+        return (k >= 0) ? ip->devs[k].path : "-";
+}
+
+/* Lists each SCSI device (sorted by H:C:T:L) that has a sg or primary
+ * node, followed by its sg, primary and bsg device nodes. '-' is printed
+ * for a missing node. With op_result 1 or 3 sysfs paths are printed
+ * instead. Returns number of SCSI devices listed. */
+static int
+idx_list_all(const struct idx_t * ip, int op_result)
+{
+        int j, k, n;
+        const struct idx_node_t * np;
+        const struct idx_node_t * arr[3];
+        struct idx_ord_t * ordp;
+
+        if (ip->num_grps < 1)
+                return 0;
+        ordp = (struct idx_ord_t *)calloc(ip->num_grps, sizeof(*ordp));
+        if (NULL == ordp) {
+                pr2serr("%s: out of memory\n", __func__);
+                return 0;
+        }
+        for (k = 0; k < ip->num_grps; ++k) {
+                ordp[k].grp = k;
+                ordp[k].hctl = ip->grps[k].hctl;
+        }
+        qsort(ordp, ip->num_grps, sizeof(*ordp), idx_hctl_cmp);
+        for (n = 0, k = 0; k < ip->num_grps; ++k) {
+                arr[0] = arr[1] = arr[2] = NULL;
+                for (j = 0; j < ip->num_nodes; ++j) {
+                        np = ip->nodes + j;
+                        if (np->grp != ordp[k].grp)
+                                continue;
+                        if ((NT_SG == np->nt) && (NULL == arr[0]))
+                                arr[0] = np;
+                        else if (np->primary && (NULL == arr[1]))
+                                arr[1] = np;
+                        else if ((NT_BSG == np->nt) && (NULL == arr[2]))
+                                arr[2] = np;
+                }
+                if ((NULL == arr[0]) && (NULL == arr[1]))
+                        continue;       /* e.g. bsg node of a SAS host */
+                printf("[%s]", ordp[k].hctl);
+                for (j = 0; j < 3; ++j) {
+                        if (1 == op_result)
+                                printf(" %s", arr[j] ? arr[j]->real_path :
+                                                       "-");
+                        else if (3 == op_result)
+                                printf(" %s", arr[j] ? arr[j]->cls_path :
+                                                       "-");
+                        else
+                                printf(" %s", idx_dev_name(ip, arr[j]));
+                }
+                printf("\n");
+                ++n;
+        }
+        free(ordp);
+        return n;
+}
+
+/* Reads device names from stdin, one per line, answering each from the
+ * index. Each output line starts with the name given. Returns 0 if all
+ * names were mapped, else SG_LIB_FILE_ERROR. */
+static int
+idx_batch(const struct idx_t * ip, int op_result, int verbose)
+{
+        int k, n;
+        int ret = 0;
+        char * cp;
+        char line[D_NAME_LEN_MAX];
+
+        while (fgets(line, sizeof(line), stdin)) {
+                for (cp = line; isspace((unsigned char)*cp); ++cp)
+                        ;
+                if (('\0' == *cp) || ('#' == *cp))
+                        continue;
+                for (k = (int)strlen(cp) - 1;
+                     (k >= 0) && isspace((unsigned char)cp[k]); --k)
+                        cp[k] = '\0';
+                n = idx_query(ip, cp, op_result, cp, verbose);
+                if (n) {
+                        printf("%s -\n", cp);
+                        ret = SG_LIB_FILE_ERROR;
+                }
+        }
+        return ret;
+}
+
+static int
+index_mode(const char * device_name, const char * dev_dir,
+           const char * cache_fn, bool do_all, bool do_batch, int op_result,
+           bool follow_symlink, int verbose)
+{
+        int ret = 0;
+        struct idx_t idx;
+
+        if ((! do_all) && (! do_batch) && ('\0' == device_name[0])) {
+                pr2serr("missing device name!\n");
+                usage();
+                return SG_LIB_SYNTAX_ERROR;
+        }
+        if (idx_build(&idx, cache_fn, dev_dir, follow_symlink, verbose)) {
+                idx_free(&idx);
+                return SG_LIB_FILE_ERROR;
+        }
+        if (do_all && (0 == idx_list_all(&idx, op_result)) && verbose)
+                pr2serr("no SCSI devices found in sysfs\n");
+        if (do_batch)
+                ret = idx_batch(&idx, op_result, verbose);
+        if (device_name[0] && idx_query(&idx, device_name, op_result, NULL,
+                                        verbose))
+                ret = SG_LIB_FILE_ERROR;
+        idx_free(&idx);
+        return ret;
+}
+
+
 int
 main(int argc, char * argv[])
 {
         bool cont;
+        bool do_all = false;
+        bool do_batch = false;
         int c, num, tt, res;
         int given_is = -1;
         int opt_result = 0;
@@ -1208,18 +2076,28 @@ main(int argc, char * argv[])
         char device_name[D_NAME_LEN_MAX];
         char device_dir[D_NAME_LEN_MAX];
         char value[D_NAME_LEN_MAX];
+        const char * cache_fn = NULL;
 
         memset(device_name, 0, sizeof(device_name));
         memset(device_dir, 0, sizeof(device_dir));
         while (1) {
                 int option_index = 0;
 
-                c = getopt_long(argc, argv, "d:hg:r:svV", long_options,
+                c = getopt_long(argc, argv, "abc:d:hg:r:svV", long_options,
                                 &option_index);
                 if (c == -1)
                         break;
 
                 switch (c) {
+                case 'a':
+                        do_all = true;
+                        break;
+                case 'b':
+                        do_batch = true;
+                        break;
+                case 'c':
+                        cache_fn = optarg;
+                        break;
                 case 'd':
                         strncpy(device_dir, optarg, sizeof(device_dir) - 1);
                         do_dev_dir = true;
@@ -1279,6 +2157,10 @@ main(int argc, char * argv[])
                 }
         }
 
+        if (do_all || do_batch || cache_fn)
+                return index_mode(device_name, do_dev_dir ? device_dir :
+                                  def_dev_dir, cache_fn, do_all, do_batch,
+                                  opt_result, follow_symlink, verbose);
         if (0 == device_name[0]) {
                 pr2serr("missing device name!\n");
                 usage();
@@ -0,0 +1,494 @@
+/*
+ * Copyright (c) 2023 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_GLOB_H
+#include <glob.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#include <time.h>
+#elif defined(HAVE_GETTIMEOFDAY)
+#include <sys/time.h>
+#endif
+
+#include "sg_lib.h"
+#include "sg_pr2serr.h"
+
+#include "sg_par_common.h"
+
+/* This file holds common code for utilities that work on several devices
+ * (or several parts of one device) concurrently. See sg_par_common.h . */
+
+struct sg_par_pool_t {
+    int num_items;
+    int next_idx;
+    sg_par_work_f work_fn;
+    sg_par_done_f done_fn;
+    void * ctxp;
+};
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t sg_par_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+void
+sg_par_lock(void)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&sg_par_mutex);
+#endif
+}
+
+void
+sg_par_unlock(void)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&sg_par_mutex);
+#endif
+}
+
+/* Each worker (and the caller's thread when there are no workers) loops
+ * here taking the next unclaimed item until none are left. */
+static void *
+sg_par_worker(void * v_poolp)
+{
+    int idx, res;
+    struct sg_par_pool_t * poolp = (struct sg_par_pool_t *)v_poolp;
+
+    while (true) {
+        sg_par_lock();
+        idx = poolp->next_idx;
+        if (idx < poolp->num_items)
+            ++poolp->next_idx;
+        sg_par_unlock();
+        if (idx >= poolp->num_items)
+            break;
+        res = poolp->work_fn(poolp->ctxp, idx);
+        if (poolp->done_fn) {
+            sg_par_lock();
+            poolp->done_fn(poolp->ctxp, idx, res);
+            sg_par_unlock();
+        }
+    }
+    return NULL;
+}
+
+int
+sg_par_run(int num_items, int max_workers, sg_par_work_f work_fn,
+           sg_par_done_f done_fn, void * ctxp)
+{
+    struct sg_par_pool_t pool;
+
+    if ((num_items < 1) || (NULL == work_fn))
+        return 0;
+    pool.num_items = num_items;
+    pool.next_idx = 0;
+    pool.work_fn = work_fn;
+    pool.done_fn = done_fn;
+    pool.ctxp = ctxp;
+    if (max_workers > num_items)
+        max_workers = num_items;
+    if (max_workers > SG_PAR_MAX_WORKERS)
+        max_workers = SG_PAR_MAX_WORKERS;
+#ifdef HAVE_PTHREAD_H
+    if (max_workers > 1) {
+        int k, n, err;
+        pthread_t * tidp;
+
+        tidp = (pthread_t *)calloc(max_workers, sizeof(pthread_t));
+        if (NULL == tidp)
+            return ENOMEM;
+        for (err = 0, n = 0; n < max_workers; ++n) {
+            err = pthread_create(tidp + n, NULL, sg_par_worker, &pool);
+            if (err)
+                break;
+        }
+        if (0 == n) {
+            free(tidp);
+            return err;
+        }
+        /* if only some threads started, those will do all the work */
+        for (k = 0; k < n; ++k)
+            pthread_join(tidp[k], NULL);
+        free(tidp);
+        return 0;
+    }
+#endif
+    sg_par_worker(&pool);
+    return 0;
+}
+
+uint64_t
+sg_par_mono_ns(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (0 == clock_gettime(CLOCK_MONOTONIC, &ts))
+        return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+    return 0;
+#elif defined(HAVE_GETTIMEOFDAY)
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000000000) + (tv.tv_usec * 1000);
+#else
+    return (uint64_t)time(NULL) * 1000000000;
+#endif
+}
+
+void
+sg_par_lat_init(struct sg_par_lat_hist * lhp)
+{
+    memset(lhp, 0, sizeof(*lhp));
+}
+
+static int
+sg_par_lat_idx(uint64_t val)
+{
+    int msb;
+    const int sub_n = 1 << SG_PAR_LAT_SUB_BITS;
+
+    if (val < (uint64_t)sub_n)
+        return (int)val;
+#if defined(__GNUC__) || defined(__clang__)
+    msb = 63 - __builtin_clzll(val);
+#else
+    for (msb = 0; (val >> msb) > 1; ++msb)
+        ;
+#endif
+    return ((msb - SG_PAR_LAT_SUB_BITS + 1) << SG_PAR_LAT_SUB_BITS) +
+           (int)((val >> (msb - SG_PAR_LAT_SUB_BITS)) & (sub_n - 1));
+}
+
+/* Returns the value in the middle of bucket 'idx' */
+static uint64_t
+sg_par_lat_val(int idx)
+{
+    int grp = idx >> SG_PAR_LAT_SUB_BITS;
+    int sub = idx & ((1 << SG_PAR_LAT_SUB_BITS) - 1);
+    uint64_t lo, width;
+
+    if (0 == grp)
+        return (uint64_t)idx;
+    lo = (uint64_t)((1 << SG_PAR_LAT_SUB_BITS) + sub) << (grp - 1);
+    width = (uint64_t)1 << (grp - 1);
+    return lo + (width / 2);
+}
+
+void
+sg_par_lat_add(struct sg_par_lat_hist * lhp, uint64_t val)
+{
+    if ((0 == lhp->count) || (val < lhp->min))
+        lhp->min = val;
+    if (val > lhp->max)
+        lhp->max = val;
+    ++lhp->count;
+    lhp->sum += val;
+    ++lhp->bucket[sg_par_lat_idx(val)];
+}
+
+void
+sg_par_lat_merge(struct sg_par_lat_hist * to_lhp,
+                 const struct sg_par_lat_hist * from_lhp)
+{
+    int k;
+
+    if (0 == from_lhp->count)
+        return;
+    if ((0 == to_lhp->count) || (from_lhp->min < to_lhp->min))
+        to_lhp->min = from_lhp->min;
+    if (from_lhp->max > to_lhp->max)
+        to_lhp->max = from_lhp->max;
+    to_lhp->count += from_lhp->count;
+    to_lhp->sum += from_lhp->sum;
+    for (k = 0; k < SG_PAR_LAT_NUM_BUCKETS; ++k)
+        to_lhp->bucket[k] += from_lhp->bucket[k];
+}
+
+uint64_t
+sg_par_lat_percentile(const struct sg_par_lat_hist * lhp, double pc)
+{
+    int k;
+    uint64_t target, acc, v;
+
+    if (0 == lhp->count)
+        return 0;
+    if (pc >= 100.0)
+        return lhp->max;
+    target = (uint64_t)((pc / 100.0) * (double)lhp->count);
+    if (target < 1)
+        target = 1;
+    for (acc = 0, k = 0; k < SG_PAR_LAT_NUM_BUCKETS; ++k) {
+        acc += lhp->bucket[k];
+        if (acc >= target) {
+            v = sg_par_lat_val(k);
+            /* bucket mid point may lie outside the observed range */
+            if (v < lhp->min)
+                return lhp->min;
+            return (v > lhp->max) ? lhp->max : v;
+        }
+    }
+    return lhp->max;
+}
+
+static int
+sg_par_dev_list_push(struct sg_par_dev_list * dlp, const char * name)
+{
+    char * cp;
+
+    if (dlp->num >= dlp->max) {
+        int new_max = (dlp->max > 0) ? (2 * dlp->max) : 16;
+        char ** npp = (char **)realloc(dlp->names,
+                                       new_max * sizeof(char *));
+
+        if (NULL == npp)
+            return sg_convert_errno(ENOMEM);
+        dlp->names = npp;
+        dlp->max = new_max;
+    }
+    cp = strdup(name);
+    if (NULL == cp)
+        return sg_convert_errno(ENOMEM);
+    dlp->names[dlp->num++] = cp;
+    return 0;
+}
+
+int
+sg_par_dev_list_add(struct sg_par_dev_list * dlp, const char * name,
+                    int vb)
+{
+#ifdef HAVE_GLOB_H
+    if (strpbrk(name, "*?[")) {
+        int k, res, ret;
+        glob_t gl;
+
+        memset(&gl, 0, sizeof(gl));
+        res = glob(name, 0, NULL, &gl);
+        if (res) {
+            if (GLOB_NOMATCH == res)
+                pr2serr("%s: no match for %s\n", __func__, name);
+            else
+                pr2serr("%s: glob(%s) failed, res=%d\n", __func__, name,
+                        res);
+            globfree(&gl);
+            return SG_LIB_FILE_ERROR;
+        }
+        if (vb > 1)
+            pr2serr("%s: %s expanded to %d names\n", __func__, name,
+                    (int)gl.gl_pathc);
+        for (ret = 0, k = 0; k < (int)gl.gl_pathc; ++k) {
+            ret = sg_par_dev_list_push(dlp, gl.gl_pathv[k]);
+            if (ret)
+                break;
+        }
+        globfree(&gl);
+        return ret;
+    }
+#else
+    if (vb > 2)
+        pr2serr("%s: no glob support, take %s literally\n", __func__, name);
+#endif
+    return sg_par_dev_list_push(dlp, name);
+}
+
+int
+sg_par_dev_list_from_file(struct sg_par_dev_list * dlp, const char * fn,
+                          int vb)
+{
+    bool from_stdin = ((1 == strlen(fn)) && ('-' == fn[0]));
+    int k, ret = 0;
+    char * cp;
+    FILE * fp;
+    char line[512];
+
+    if (from_stdin)
+        fp = stdin;
+    else {
+        fp = fopen(fn, "r");
+        if (NULL == fp) {
+            int err = errno;
+
+            pr2serr("%s: unable to open %s: %s\n", __func__, fn,
+                    safe_strerror(err));
+            return sg_convert_errno(err);
+        }
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        for (cp = line; isspace((uint8_t)*cp); ++cp)
+            ;
+        if (('\0' == *cp) || ('#' == *cp))
+            continue;
+        for (k = (int)strlen(cp) - 1; (k >= 0) && isspace((uint8_t)cp[k]);
+             --k)
+            cp[k] = '\0';
+        ret = sg_par_dev_list_add(dlp, cp, vb);
+        if (ret)
+            break;
+    }
+    if (! from_stdin)
+        fclose(fp);
+    if ((0 == ret) && (vb > 1))
+        pr2serr("%s: device list now holds %d names\n", __func__, dlp->num);
+    return ret;
+}
+
+void
+sg_par_dev_list_free(struct sg_par_dev_list * dlp)
+{
+    int k;
+
+    if (NULL == dlp)
+        return;
+    for (k = 0; k < dlp->num; ++k)
+        free(dlp->names[k]);
+    free(dlp->names);
+    dlp->names = NULL;
+    dlp->num = 0;
+    dlp->max = 0;
+}
+
+int
+sg_par_file_map(struct sg_par_file_map * fmp, const char * fn,
+                 int64_t skip, int64_t len, int vb)
+{
+    int fd, err;
+    int ret = 0;
+    int64_t avail, pg_off;
+    struct stat a_stat;
+
+    memset(fmp, 0, sizeof(*fmp));
+    fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        err = errno;
+        pr2serr("%s: unable to open %s: %s\n", __func__, fn,
+                safe_strerror(err));
+        return sg_convert_errno(err);
+    }
+    sg_set_binary_mode(fd);
+    if (fstat(fd, &a_stat) < 0) {
+        err = errno;
+        pr2serr("%s: fstat(%s) failed: %s\n", __func__, fn,
+                safe_strerror(err));
+        ret = sg_convert_errno(err);
+        goto fini;
+    }
+    if (! S_ISREG(a_stat.st_mode)) {
+        pr2serr("%s: %s is not a regular file\n", __func__, fn);
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    avail = (int64_t)a_stat.st_size - skip;
+    if ((skip < 0) || (avail <= 0)) {
+        pr2serr("%s: skip of %" PRId64 " leaves nothing to use in %s\n",
+                __func__, skip, fn);
+        ret = SG_LIB_FILE_ERROR;
+        goto fini;
+    }
+    fmp->len = ((len > 0) && (len < avail)) ? len : avail;
+#ifdef HAVE_SYS_MMAN_H
+    /* mmap() offset must be page aligned so map from the page holding
+     * 'skip' and point p at the requested byte */
+    pg_off = skip % sysconf(_SC_PAGESIZE);
+    fmp->base_len = (size_t)(pg_off + fmp->len);
+    fmp->base = mmap(NULL, fmp->base_len, PROT_READ, MAP_PRIVATE, fd,
+                     (off_t)(skip - pg_off));
+    if (MAP_FAILED != fmp->base) {
+        fmp->mapped = true;
+        fmp->p = (const uint8_t *)fmp->base + pg_off;
+#ifdef MADV_SEQUENTIAL
+        madvise(fmp->base, fmp->base_len, MADV_SEQUENTIAL);
+#endif
+        if (vb > 1)
+            pr2serr("%s: mmap-ed %" PRId64 " bytes of %s\n", __func__,
+                    fmp->len, fn);
+        goto fini;
+    }
+    if (vb)
+        pr2serr("%s: mmap(%s) failed: %s, read instead\n", __func__, fn,
+                safe_strerror(errno));
+#else
+    pg_off = 0;
+#endif
+    fmp->base_len = (size_t)fmp->len;
+    fmp->base = malloc(fmp->base_len);
+    if (NULL == fmp->base) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    if (lseek(fd, (off_t)skip, SEEK_SET) < 0) {
+        err = errno;
+        pr2serr("%s: lseek(%s) failed: %s\n", __func__, fn,
+                safe_strerror(err));
+        ret = sg_convert_errno(err);
+        goto fini;
+    }
+    for (pg_off = 0; pg_off < fmp->len; ) {
+        ssize_t n = read(fd, (uint8_t *)fmp->base + pg_off,
+                         (size_t)(fmp->len - pg_off));
+
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            err = errno;
+            pr2serr("%s: read(%s) failed: %s\n", __func__, fn,
+                    safe_strerror(err));
+            ret = sg_convert_errno(err);
+            goto fini;
+        } else if (0 == n)
+            break;
+        pg_off += n;
+    }
+    fmp->len = pg_off;
+    fmp->p = (const uint8_t *)fmp->base;
+fini:
+    close(fd);
+    if (ret)
+        sg_par_file_unmap(fmp);
+    return ret;
+}
+
+void
+sg_par_file_unmap(struct sg_par_file_map * fmp)
+{
+    if ((NULL == fmp) || (NULL == fmp->base))
+        return;
+#ifdef HAVE_SYS_MMAN_H
+    if (fmp->mapped)
+        munmap(fmp->base, fmp->base_len);
+    else
+#endif
+        free(fmp->base);
+    memset(fmp, 0, sizeof(*fmp));
+}
@@ -0,0 +1,136 @@
+#ifndef SG_PAR_COMMON_H
+#define SG_PAR_COMMON_H
+
+/*
+ * Copyright (c) 2023 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/* This is a common header file for utilities that act on several devices
+ * (or several objects within one device, such as zones) at the same time.
+ * It holds a small bounded worker pool and helpers for building device
+ * lists. If the build platform has no POSIX threads then the worker pool
+ * degenerates into a simple loop in the caller's thread. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SG_PAR_DEF_WORKERS 8
+#define SG_PAR_MAX_WORKERS 1024
+
+/* Called from a worker thread for item 'idx' (0 to num_items-1). Each
+ * item is handed out exactly once. The return value is passed to the
+ * matching sg_par_done_f callback. This function should not print to
+ * stdout; use the done callback (or sg_par_lock()) for that. */
+typedef int (*sg_par_work_f)(void * ctxp, int idx);
+
+/* Called once for each item after its sg_par_work_f has returned. Calls
+ * are serialized by the pool's mutex so this callback may print or build
+ * a JSON tree without further locking. May be NULL. */
+typedef void (*sg_par_done_f)(void * ctxp, int idx, int res);
+
+/* Runs work_fn() on each of num_items items with at most max_workers
+ * running at the same time. If max_workers is 1 (or less) or threads are
+ * not available, everything is done in the caller's thread. Returns 0 on
+ * success, otherwise an errno value if no worker thread could be started.
+ * Once this function returns all items have been processed. */
+int sg_par_run(int num_items, int max_workers, sg_par_work_f work_fn,
+               sg_par_done_f done_fn, void * ctxp);
+
+/* Take and release the mutex that serializes sg_par_done_f callbacks. For
+ * worker functions that need to print diagnostics (e.g. when verbose). */
+void sg_par_lock(void);
+void sg_par_unlock(void);
+
+/* Returns a monotonic time in nanoseconds, suitable for measuring elapsed
+ * times. Only differences between two calls are meaningful. */
+uint64_t sg_par_mono_ns(void);
+
+/* Latency histogram with bounded memory. Values (typically nanoseconds)
+ * below 16 have their own bucket, above that each power of 2 is split
+ * into 16 buckets so a reported percentile is within about 6% of the
+ * true value. Zero initialize (or call sg_par_lat_init()) before use. */
+#define SG_PAR_LAT_SUB_BITS 4
+#define SG_PAR_LAT_NUM_BUCKETS (64 << SG_PAR_LAT_SUB_BITS)
+
+struct sg_par_lat_hist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t bucket[SG_PAR_LAT_NUM_BUCKETS];
+};
+
+void sg_par_lat_init(struct sg_par_lat_hist * lhp);
+void sg_par_lat_add(struct sg_par_lat_hist * lhp, uint64_t val);
+/* Adds the counts in 'from_lhp' to 'to_lhp' */
+void sg_par_lat_merge(struct sg_par_lat_hist * to_lhp,
+                      const struct sg_par_lat_hist * from_lhp);
+/* Returns the value at or below which 'pc' percent (0.0 to 100.0) of the
+ * added values fall. Returns 0 if the histogram is empty. */
+uint64_t sg_par_lat_percentile(const struct sg_par_lat_hist * lhp,
+                               double pc);
+
+/* A growable list of device names. Zero initialize before first use and
+ * call sg_par_dev_list_free() when finished. */
+struct sg_par_dev_list {
+    int num;
+    int max;
+    char ** names;
+};
+
+/* Adds 'name' to the list. If 'name' contains glob(7) meta characters
+ * (i.e. '*', '?' or '[') it is expanded and each match is added; a glob
+ * that matches nothing is an error. Returns 0 on success, otherwise an
+ * SG_LIB_* error value. */
+int sg_par_dev_list_add(struct sg_par_dev_list * dlp, const char * name,
+                        int vb);
+
+/* Reads device names (or globs) from file 'fn', one per line. Leading and
+ * trailing whitespace is ignored, as are blank lines and lines whose
+ * first non-whitespace character is '#'. If 'fn' is "-" then stdin is
+ * read. Returns 0 on success, otherwise an SG_LIB_* error value. */
+int sg_par_dev_list_from_file(struct sg_par_dev_list * dlp, const char * fn,
+                              int vb);
+
+void sg_par_dev_list_free(struct sg_par_dev_list * dlp);
+
+/* A read-only view of part of a file that many workers can share, for
+ * example a firmware image being downloaded to a fleet of devices. It is
+ * mmap()-ed when the platform allows, otherwise it is read into a heap
+ * buffer. Zero initialize before use. */
+struct sg_par_file_map {
+    bool mapped;        /* true -> base is mmap()-ed, false -> malloc()-ed */
+    const uint8_t * p;  /* first byte after the requested skip */
+    int64_t len;        /* number of bytes available at p */
+    void * base;
+    size_t base_len;
+};
+
+/* Maps 'len' bytes of regular file 'fn' starting 'skip' bytes into it. If
+ * 'len' is 0 then everything from 'skip' to the end of the file is mapped.
+ * If the file holds fewer than 'len' bytes after 'skip' then fmp->len is
+ * the (smaller) number available. Returns 0 on success, otherwise an
+ * SG_LIB_* error value. */
+int sg_par_file_map(struct sg_par_file_map * fmp, const char * fn,
+                    int64_t skip, int64_t len, int vb);
+
+void sg_par_file_unmap(struct sg_par_file_map * fmp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* SG_PAR_COMMON_H */
@@ -34,8 +34,11 @@
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_pt.h"
+#include "sg_json_sg_lib.h"
+#include "sg_par_common.h"
 
-static const char * version_str = "0.73 20230622";
+static const char * version_str = "0.74 20231031";
 static const char * my_name = "sg_persist: ";
 
 
@@ -56,10 +59,18 @@ static const char * my_name = "sg_persist: ";
 #define MX_TIDS 32
 #define MX_TID_LEN 256
 
+#define PRIN_CMD 0x5e
+#define PROUT_CMD 0x5f
+#define PR_CMDLEN 10
+#define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
+#define DEF_PT_TIMEOUT 60       /* 60 seconds */
+#define PR_BATCH_MAX_TRIES 2    /* second try if first gets a UA */
+
 
 #define SG_PERSIST_IN_RDONLY "SG_PERSIST_IN_RDONLY"
 
 struct opts_t {
+    bool do_json;
     bool inquiry;       /* set true by default (unlike most bools) */
     bool param_alltgpt;
     bool param_aptpl;
@@ -72,14 +83,19 @@ struct opts_t {
     bool version_given;
     int hex;
     int num_transportids;
+    int num_workers;    /* batch mode: maximum devices in flight */
     int prin_sa;
     int prout_sa;
+    int tmo;            /* batch mode: command timeout in seconds */
     int verbose;
     uint32_t alloc_len;
     uint32_t param_rtp;
     uint32_t prout_type;
     uint64_t param_rk;
     uint64_t param_sark;
+    const char * json_arg;      /* batch mode: argument to --json= */
+    const char * js_file;
+    const char * list_fn;       /* batch mode: --list=LF */
     uint8_t transportid_arr[MX_TIDS * MX_TID_LEN];
 };
 
@@ -92,10 +108,15 @@ static const struct option long_options[] = {
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
     {"in", no_argument, 0, 'i'},
+    {"js-file", required_argument, 0, 'J'},
+    {"js_file", required_argument, 0, 'J'},
+    {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+    {"list", required_argument, 0, 'F'},
     {"maxlen", required_argument, 0, 'm'},
     {"no-inquiry", no_argument, 0, 'n'},
     {"no_inquiry", no_argument, 0, 'n'},
     {"out", no_argument, 0, 'o'},
+    {"parallel", required_argument, 0, 'p'},
     {"param-alltgpt", no_argument, 0, 'Y'},
     {"param_alltgpt", no_argument, 0, 'Y'},
     {"param-aptpl", no_argument, 0, 'Z'},
@@ -133,6 +154,7 @@ static const struct option long_options[] = {
     {"report-capabilities", no_argument, 0, 'c'},
     {"report_capabilities", no_argument, 0, 'c'},
     {"reserve", no_argument, 0, 'R'},
+    {"timeout", required_argument, 0, 't'},
     {"transport-id", required_argument, 0, 'X'},
     {"transport_id", required_argument, 0, 'X'},
     {"unreg", no_argument, 0, 'U'},
@@ -189,7 +211,7 @@ static void
 usage(int help)
 {
     if (help < 2) {
-        pr2serr("Usage: sg_persist [OPTIONS] [DEVICE]\n"
+        pr2serr("Usage: sg_persist [OPTIONS] [DEVICE...]\n"
                 "  where the main OPTIONS are:\n"
                 "    --clear|-C                 PR Out: Clear\n"
                 "    --help|-h                  print usage message, "
@@ -226,9 +248,10 @@ usage(int help)
                 "Register and Move\n\n"
                 "Performs a SCSI PERSISTENT RESERVE (IN or OUT) command. "
                 "Invoking\n'sg_persist DEVICE' will do a PR In Read Keys "
-                "command. Use '-hh'\nfor more options and TYPE meanings.\n");
+                "command. Use '-hh'\nfor more options and TYPE meanings. "
+                "More than one DEVICE (or a glob) selects\nbatch mode.\n");
     } else {
-        pr2serr("Usage: sg_persist [OPTIONS] [DEVICE]\n"
+        pr2serr("Usage: sg_persist [OPTIONS] [DEVICE...]\n"
                 "  where the other OPTIONS are:\n"
                 "    --alloc-length=LEN|-l LEN    allocation length hex "
                 "value (used with\n"
@@ -239,12 +262,23 @@ usage(int help)
                 "                                 an argument\n"
                 "    --hex|-H                   output response in hex (for "
                 "PR In commands)\n"
+                "    --js-file=JFN|-J JFN       batch mode: send JSON output "
+                "to file JFN\n"
+                "    --json[=JO]|-j[=JO]        batch mode: output results "
+                "in JSON\n"
+                "    --list=LF|-F LF            batch mode: read DEVICE names "
+                "(or globs)\n"
+                "                               from file LF ('-' for "
+                "stdin)\n"
                 "    --maxlen=LEN|-m LEN        allocation length in "
                 "decimal, by default.\n"
                 "                               like --alloc-len= "
                 "(def: 8192, 8k, 2000h)\n"
                 "    --no-inquiry|-n            skip INQUIRY (default: do "
                 "INQUIRY)\n"
+                "    --parallel=P|-p P          batch mode: at most P devices "
+                "in flight\n"
+                "                               (def: %d)\n"
                 "    --param-alltgpt|-Y         PR Out parameter "
                 "'ALL_TG_PT'\n"
                 "    --param-aptpl|-Z           PR Out parameter 'APTPL'\n"
@@ -253,6 +287,9 @@ usage(int help)
                 "    --relative-target-port=RTPI|-Q RTPI    relative target "
                 "port "
                 "identifier\n"
+                "    --timeout=SECS|-t SECS     batch mode: command timeout "
+                "on each\n"
+                "                               device (def: %d seconds)\n"
                 "    --transport-id=TIDS|-X TIDS    one or more "
                 "TransportIDs can\n"
                 "                                   be given in several "
@@ -260,7 +297,10 @@ usage(int help)
                 "    --verbose|-v               output additional debug "
                 "information\n"
                 "    --version|-V               output version string\n\n"
-                "For the main options use '--help' or '-h' once.\n\n\n");
+                "For the main options use '--help' or '-h' once. In batch "
+                "mode the same\nPR Out command, or PR In Read keys or Read "
+                "reservation, is sent to\neach DEVICE concurrently without "
+                "INQUIRY.\n\n\n", SG_PAR_DEF_WORKERS, DEF_PT_TIMEOUT);
         pr2serr("PR Out TYPE field value meanings:\n"
                 "  0:    obsolete (was 'read shared' in SPC)\n"
                 "  1:    write exclusive\n"
@@ -478,24 +518,15 @@ compact_transportid_array(struct opts_t * op)
     return compact_len;
 }
 
+/* Builds the PR Out parameter list for all service actions other than
+ * Register and move in pr_buff (zeroed, at least alloc_len bytes long).
+ * Returns the length of the parameter list. */
 static int
-prout_work(int sg_fd, struct opts_t * op)
+prout_build_param(struct opts_t * op, uint8_t * pr_buff)
 {
     int len, t_arr_len;
-    int res = 0;
-    uint8_t * pr_buff = NULL;
-    uint8_t * free_pr_buff = NULL;
-    char b[64];
-    char bb[80];
 
     t_arr_len = compact_transportid_array(op);
-    pr_buff = sg_memalign(op->alloc_len, 0 /* page aligned */, &free_pr_buff,
-                          false);
-    if (NULL == pr_buff) {
-        pr2serr("%s: unable to allocate %d bytes on heap\n", __func__,
-                op->alloc_len);
-        return sg_convert_errno(ENOMEM);
-    }
     sg_put_unaligned_be64(op->param_rk, pr_buff + 0);
     sg_put_unaligned_be64(op->param_sark, pr_buff + 8);
     if (op->param_alltgpt)
@@ -509,6 +540,27 @@ prout_work(int sg_fd, struct opts_t * op)
         len += (t_arr_len + 4);
         sg_put_unaligned_be32((uint32_t)t_arr_len, pr_buff + 24);
     }
+    return len;
+}
+
+static int
+prout_work(int sg_fd, struct opts_t * op)
+{
+    int len;
+    int res = 0;
+    uint8_t * pr_buff = NULL;
+    uint8_t * free_pr_buff = NULL;
+    char b[64];
+    char bb[80];
+
+    pr_buff = sg_memalign(op->alloc_len, 0 /* page aligned */, &free_pr_buff,
+                          false);
+    if (NULL == pr_buff) {
+        pr2serr("%s: unable to allocate %d bytes on heap\n", __func__,
+                op->alloc_len);
+        return sg_convert_errno(ENOMEM);
+    }
+    len = prout_build_param(op, pr_buff);
     res = sg_ll_persistent_reserve_out(sg_fd, op->prout_sa, 0 /* rq_scope */,
                                        op->prout_type, pr_buff, len, true,
                                        op->verbose);
@@ -539,23 +591,15 @@ fini:
     return res;
 }
 
+/* Builds the PR Out Register and move parameter list in pr_buff (zeroed,
+ * at least alloc_len bytes long). Returns the length of the parameter
+ * list. */
 static int
-prout_reg_move_work(int sg_fd, struct opts_t * op)
+prout_reg_move_build_param(struct opts_t * op, uint8_t * pr_buff)
 {
     int len, t_arr_len;
-    int res = 0;
-    uint8_t * pr_buff = NULL;
-    uint8_t * free_pr_buff = NULL;
-    static const char * ram_s = "register and move";
 
     t_arr_len = compact_transportid_array(op);
-    pr_buff = sg_memalign(op->alloc_len, 0 /* page aligned */, &free_pr_buff,
-                          false);
-    if (NULL == pr_buff) {
-        pr2serr("%s: unable to allocate %d bytes on heap\n", __func__,
-                op->alloc_len);
-        return sg_convert_errno(ENOMEM);
-    }
     sg_put_unaligned_be64(op->param_rk, pr_buff + 0);
     sg_put_unaligned_be64(op->param_sark, pr_buff + 8);
     if (op->param_unreg)
@@ -569,6 +613,26 @@ prout_reg_move_work(int sg_fd, struct opts_t * op)
         len += t_arr_len;
         sg_put_unaligned_be32((uint32_t)t_arr_len, pr_buff + 20);
     }
+    return len;
+}
+
+static int
+prout_reg_move_work(int sg_fd, struct opts_t * op)
+{
+    int len;
+    int res = 0;
+    uint8_t * pr_buff = NULL;
+    uint8_t * free_pr_buff = NULL;
+    static const char * ram_s = "register and move";
+
+    pr_buff = sg_memalign(op->alloc_len, 0 /* page aligned */, &free_pr_buff,
+                          false);
+    if (NULL == pr_buff) {
+        pr2serr("%s: unable to allocate %d bytes on heap\n", __func__,
+                op->alloc_len);
+        return sg_convert_errno(ENOMEM);
+    }
+    len = prout_reg_move_build_param(op, pr_buff);
     res = sg_ll_persistent_reserve_out(sg_fd, PROUT_REG_MOVE_SA,
                                        0 /* rq_scope */, op->prout_type,
                                        pr_buff, len, true, op->verbose);
@@ -944,6 +1008,430 @@ my_cont_b:
 }
 
 
+/* Batch mode: the same PR Out command, or a PR In Read keys or Read
+ * reservation command, is sent to each device in a list with at most
+ * num_workers in flight. Each command has its own timeout and is retried
+ * once if it gets a unit attention, common after a cluster failover. */
+
+struct pr_batch_dev_t {
+    int res;            /* 0 or SG_LIB_CAT_* or errno based value */
+    int num_tries;
+    uint64_t el_ns;     /* time to open, send and close */
+    const char * name;
+    uint8_t * resp;     /* PR In response, alloc_len bytes */
+    uint8_t * free_resp;
+};
+
+struct pr_batch_t {
+    const struct opts_t * op;
+    struct pr_batch_dev_t * dev_arr;
+    const uint8_t * param;      /* PR Out parameter list, shared */
+    int param_len;
+    int sa;                     /* service action */
+    sgj_state * jsp;
+};
+
+/* Sends one PR In (into resp) or PR Out (from param) command to sg_fd
+ * with a command timeout of op->tmo seconds. Prints nothing unless
+ * verbose. Returns 0 when successful, various SG_LIB_CAT_* positive values
+ * or an errno based value. */
+static int
+batch_pr_cmd(int sg_fd, const struct pr_batch_t * bp, uint8_t * resp,
+             int vb)
+{
+    const struct opts_t * op = bp->op;
+    int res, ret, sense_cat;
+    uint8_t cdb[PR_CMDLEN] SG_C_CPP_ZERO_INIT;
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    struct sg_pt_base * ptvp;
+
+    cdb[1] = (uint8_t)(bp->sa & 0x1f);
+    if (op->pr_in) {
+        cdb[0] = PRIN_CMD;
+        sg_put_unaligned_be16((uint16_t)op->alloc_len, cdb + 7);
+    } else {
+        cdb[0] = PROUT_CMD;
+        cdb[2] = (uint8_t)(op->prout_type & 0xf);
+        sg_put_unaligned_be32((uint32_t)bp->param_len, cdb + 5);
+    }
+    ptvp = construct_scsi_pt_obj_with_fd(sg_fd, vb);
+    if (NULL == ptvp)
+        return sg_convert_errno(ENOMEM);
+    if ((ret = get_scsi_pt_os_err(ptvp)))
+        goto fini;
+    set_scsi_pt_cdb(ptvp, cdb, sizeof(cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    if (op->pr_in)
+        set_scsi_pt_data_in(ptvp, resp, op->alloc_len);
+    else
+        set_scsi_pt_data_out(ptvp, bp->param, bp->param_len);
+    res = do_scsi_pt(ptvp, -1, op->tmo, vb);
+    if (SCSI_PT_DO_TIMEOUT == res) {
+        ret = SG_LIB_CAT_TIMEOUT;
+        goto fini;
+    }
+    ret = sg_cmds_process_resp(ptvp, (op->pr_in ? prin_s : prout_s), res,
+                               false /* noisy */, vb, &sense_cat);
+    if (-1 == ret) {
+        if (get_scsi_pt_transport_err(ptvp)) {
+            /* some pass-throughs report a timeout as a transport error */
+            if (get_scsi_pt_duration_ms(ptvp) >= (op->tmo * 1000))
+                ret = SG_LIB_CAT_TIMEOUT;
+            else
+                ret = SG_LIB_TRANSPORT_ERROR;
+        } else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+    } else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+fini:
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+/* Worker for sg_par_run(), does the PR command on device idx */
+static int
+batch_work(void * ctxp, int idx)
+{
+    int k, sg_fd;
+    struct pr_batch_t * bp = (struct pr_batch_t *)ctxp;
+    const struct opts_t * op = bp->op;
+    struct pr_batch_dev_t * dp = bp->dev_arr + idx;
+    int vb = (op->verbose > 1) ? op->verbose - 1 : 0;
+    uint64_t start_ns = sg_par_mono_ns();
+
+    sg_fd = sg_cmds_open_device(dp->name, op->readonly, vb);
+    if (sg_fd < 0) {
+        dp->res = sg_convert_errno(-sg_fd);
+        goto fini;
+    }
+    if (op->pr_in) {
+        dp->resp = sg_memalign(op->alloc_len, 0 /* page aligned */,
+                               &dp->free_resp, false);
+        if (NULL == dp->resp) {
+            dp->res = sg_convert_errno(ENOMEM);
+            goto close_fini;
+        }
+    }
+    for (k = 0; k < PR_BATCH_MAX_TRIES; ++k) {
+        ++dp->num_tries;
+        dp->res = batch_pr_cmd(sg_fd, bp, dp->resp, vb);
+        if (SG_LIB_CAT_UNIT_ATTENTION != dp->res)
+            break;
+    }
+close_fini:
+    sg_cmds_close_device(sg_fd);
+fini:
+    dp->el_ns = sg_par_mono_ns() - start_ns;
+    return dp->res;
+}
+
+/* Returns the number of bytes of PR In response after the 8 byte header
+ * that are both valid and were fetched */
+static int
+batch_prin_len(const struct opts_t * op, const struct pr_batch_dev_t * dp)
+{
+    int add_len = sg_get_unaligned_be32(dp->resp + 4);
+
+    if (add_len < 0)
+        return 0;
+    return (add_len > ((int)op->alloc_len - 8)) ? ((int)op->alloc_len - 8) :
+                                                  add_len;
+}
+
+/* Called (serialized) as each device completes, prints its row */
+static void
+batch_done(void * ctxp, int idx, int res)
+{
+    int k, j;
+    int num = 0;
+    struct pr_batch_t * bp = (struct pr_batch_t *)ctxp;
+    const struct opts_t * op = bp->op;
+    const struct pr_batch_dev_t * dp = bp->dev_arr + idx;
+    sgj_state * jsp = bp->jsp;
+    const uint8_t * ucp;
+    uint64_t el_us = dp->el_ns / 1000;
+    char b[80];
+
+    if (res)
+        sg_get_category_sense_str(res, sizeof(b), b, 0);
+    else if (op->pr_in) {
+        num = batch_prin_len(op, dp);
+        if (PRIN_RKEY_SA == bp->sa)
+            snprintf(b, sizeof(b), "PR generation=0x%x, %d key%s",
+                     sg_get_unaligned_be32(dp->resp + 0), num / 8,
+                     ((8 == num) ? "" : "s"));
+        else if (num >= 16) {
+            j = dp->resp[8 + 13];
+            snprintf(b, sizeof(b), "PR generation=0x%x, held, type: %s",
+                     sg_get_unaligned_be32(dp->resp + 0),
+                     pr_type_strs[j & 0xf]);
+        } else
+            snprintf(b, sizeof(b), "PR generation=0x%x, NO reservation",
+                     sg_get_unaligned_be32(dp->resp + 0));
+    } else
+        b[0] = '\0';
+    sgj_pr_hr(jsp, "  %-22s %-6s %5d %8" PRIu64 ".%03u%s%s\n", dp->name,
+              (res ? "error" : "ok"), dp->num_tries, el_us / 1000,
+              (unsigned int)(el_us % 1000), (b[0] ? "  " : ""), b);
+    if (op->pr_in && (0 == res)) {
+        ucp = dp->resp + 8;
+        if (PRIN_RKEY_SA == bp->sa) {
+            for (k = 0; k < (num / 8); ++k, ucp += 8)
+                sgj_pr_hr(jsp, "      0x%" PRIx64 "\n",
+                          sg_get_unaligned_be64(ucp));
+        } else if (num >= 16)
+            sgj_pr_hr(jsp, "      Key=0x%" PRIx64 "\n",
+                      sg_get_unaligned_be64(ucp));
+    }
+}
+
+/* Adds the JSON object for one device to array jap */
+static void
+batch_js_dev(const struct pr_batch_t * bp, const struct pr_batch_dev_t * dp,
+             sgj_opaque_p jap)
+{
+    int k, num;
+    const struct opts_t * op = bp->op;
+    sgj_state * jsp = bp->jsp;
+    const uint8_t * ucp;
+    sgj_opaque_p jop = sgj_new_unattached_object_r(jsp);
+    sgj_opaque_p jo2p;
+    sgj_opaque_p ja2p;
+    char b[80];
+
+    sgj_js_nv_s(jsp, jop, "device_name", dp->name);
+    if (dp->res)
+        sg_get_category_sense_str(dp->res, sizeof(b), b, 0);
+    else
+        snprintf(b, sizeof(b), "ok");
+    sgj_js_nv_istr(jsp, jop, "result", dp->res, NULL, b);
+    sgj_js_nv_i(jsp, jop, "tries", dp->num_tries);
+    sgj_js_nv_i(jsp, jop, "elapsed_usecs", (int64_t)(dp->el_ns / 1000));
+    if (op->pr_in && (0 == dp->res)) {
+        num = batch_prin_len(op, dp);
+        ucp = dp->resp + 8;
+        sgj_js_nv_ihex(jsp, jop, "pr_generation",
+                       sg_get_unaligned_be32(dp->resp + 0));
+        if (PRIN_RKEY_SA == bp->sa) {
+            ja2p = sgj_named_subarray_r(jsp, jop,
+                                        "reservation_key_list");
+            for (k = 0; k < (num / 8); ++k, ucp += 8) {
+                jo2p = sgj_new_unattached_object_r(jsp);
+                sgj_js_nv_ihex(jsp, jo2p, "reservation_key",
+                               sg_get_unaligned_be64(ucp));
+                sgj_js_nv_o(jsp, ja2p, NULL /* name */, jo2p);
+            }
+        } else {
+            sgj_js_nv_b(jsp, jop, "reservation_held", num >= 16);
+            if (num >= 16) {
+                jo2p = sgj_named_subobject_r(jsp, jop, "reservation");
+                sgj_js_nv_ihex(jsp, jo2p, "reservation_key",
+                               sg_get_unaligned_be64(ucp));
+                sgj_js_nv_i(jsp, jo2p, "scope", (ucp[13] >> 4) & 0xf);
+                sgj_js_nv_ihexstr(jsp, jo2p, "type", ucp[13] & 0xf, NULL,
+                                  pr_type_strs[ucp[13] & 0xf]);
+            }
+        }
+    }
+    sgj_js_nv_o(jsp, jap, NULL /* name */, jop);
+}
+
+/* Batch mode entry point, returns exit status */
+static int
+batch_persist(struct opts_t * op, const struct sg_par_dev_list * dlp,
+              int argc, char * argv[])
+{
+    int k, res, num;
+    int ret = 0;
+    int num_err = 0;
+    uint64_t el_ns;
+    uint8_t * param = NULL;
+    uint8_t * free_param = NULL;
+    const char * sa_s;
+    struct pr_batch_dev_t * dp;
+    struct pr_batch_t batch;
+    struct pr_batch_t * bp = &batch;
+    sgj_state json_st SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &json_st;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p jap = NULL;
+    char b[64];
+
+    num = dlp->num;
+    if (num < 1) {
+        pr2serr("no devices given\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    memset(bp, 0, sizeof(*bp));
+    bp->op = op;
+    bp->jsp = jsp;
+    if (op->pr_in) {
+        bp->sa = op->prin_sa;
+        if ((PRIN_RKEY_SA != bp->sa) && (PRIN_RRES_SA != bp->sa)) {
+            pr2serr("in batch mode only the PR In Read keys and Read "
+                    "reservation service\nactions are supported\n");
+            return SG_LIB_CONTRADICT;
+        }
+        sa_s = prin_sa_strs[bp->sa];
+    } else {
+        bp->sa = op->prout_sa;
+        param = sg_memalign(op->alloc_len, 0 /* page aligned */,
+                            &free_param, false);
+        if (NULL == param) {
+            pr2serr("%s: unable to allocate %d bytes on heap\n", __func__,
+                    op->alloc_len);
+            return sg_convert_errno(ENOMEM);
+        }
+        if (PROUT_REG_MOVE_SA == bp->sa)
+            bp->param_len = prout_reg_move_build_param(op, param);
+        else
+            bp->param_len = prout_build_param(op, param);
+        bp->param = param;
+        sa_s = (bp->sa < num_prout_sa_strs) ? prout_sa_strs[bp->sa] :
+                                              "unknown";
+    }
+    if (op->do_json) {
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char) {
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            }
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto fini;
+        }
+        sgj_start_r("sg_persist", version_str, argc, argv, jsp);
+        jop = sgj_named_subobject_r(jsp, NULL, "persistent_reserve_batch");
+        sgj_js_nv_s(jsp, jop, "command", op->pr_in ? prin_s : prout_s);
+        sgj_js_nv_ihexstr(jsp, jop, "service_action", bp->sa, NULL, sa_s);
+        if (! op->pr_in)
+            sgj_js_nv_ihexstr(jsp, jop, "type", op->prout_type, NULL,
+                              pr_type_strs[op->prout_type & 0xf]);
+        sgj_js_nv_i(jsp, jop, "parallel", op->num_workers);
+        sgj_js_nv_i(jsp, jop, "timeout_secs", op->tmo);
+    }
+    bp->dev_arr = (struct pr_batch_dev_t *)
+                        calloc(num, sizeof(struct pr_batch_dev_t));
+    if (NULL == bp->dev_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < num; ++k)
+        bp->dev_arr[k].name = dlp->names[k];
+    sgj_pr_hr(jsp, "%s (%s) on %d device%s, up to %d in parallel\n",
+              (op->pr_in ? prin_s : prout_s), sa_s, num,
+              ((num > 1) ? "s" : ""), op->num_workers);
+    sgj_pr_hr(jsp, "  %-22s %-6s %5s %12s  %s\n", "Device", "Result",
+              "Tries", "Elapsed(ms)", "Details");
+
+    el_ns = sg_par_mono_ns();
+    res = sg_par_run(num, op->num_workers, batch_work, batch_done, bp);
+    el_ns = sg_par_mono_ns() - el_ns;
+    if (res) {
+        pr2serr("unable to start worker threads: %s\n", safe_strerror(res));
+        ret = sg_convert_errno(res);
+        goto fini;
+    }
+    if (jsp->pr_as_json)
+        jap = sgj_named_subarray_r(jsp, jop, "device_list");
+    for (k = 0; k < num; ++k) {
+        dp = bp->dev_arr + k;
+        if (dp->res) {
+            ++num_err;
+            if (0 == ret)       /* first failure in list order */
+                ret = dp->res;
+        }
+        if (jsp->pr_as_json)
+            batch_js_dev(bp, dp, jap);
+    }
+    snprintf(b, sizeof(b), "%" PRIu64 ".%03u", el_ns / 1000000000,
+             (unsigned int)((el_ns / 1000000) % 1000));
+    sgj_pr_hr(jsp, "%d device%s: %d ok, %d error%s in %s seconds\n", num,
+              ((num > 1) ? "s" : ""), num - num_err, num_err,
+              ((1 == num_err) ? "" : "s"), b);
+    sgj_js_nv_i(jsp, jop, "devices", num);
+    sgj_js_nv_i(jsp, jop, "ok", num - num_err);
+    sgj_js_nv_i(jsp, jop, "errors", num_err);
+    sgj_js_nv_i(jsp, jop, "elapsed_usecs", (int64_t)(el_ns / 1000));
+fini:
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp->pr_as_json) {
+        FILE * fp = stdout;
+
+        if (op->js_file) {
+            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
+                fp = fopen(op->js_file, "w");   /* truncate if exists */
+                if (NULL == fp) {
+                    int e = errno;
+
+                    pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                            safe_strerror(e));
+                    ret = sg_convert_errno(e);
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        if (fp)
+            sgj_js2file(jsp, NULL, ret, fp);
+        if (op->js_file && fp && (stdout != fp))
+            fclose(fp);
+        sgj_finish(jsp);
+    }
+    if (bp->dev_arr) {
+        for (k = 0; k < num; ++k) {
+            if (bp->dev_arr[k].free_resp)
+                free(bp->dev_arr[k].free_resp);
+        }
+        free(bp->dev_arr);
+    }
+    if (free_param)
+        free(free_param);
+    return ret;
+}
+
+/* Processes the options that can be in the same argument as '-j' such
+ * as '-jv'. Returns 0 if okay, else SG_LIB_SYNTAX_ERROR. */
+static int
+chk_short_opts(const char sopt_ch, struct opts_t * op, int * helpp)
+{
+    /* only need to process short, non-argument options used with -j */
+    switch (sopt_ch) {
+    case 'h':
+        ++*helpp;
+        break;
+    case 'j':
+        break;  /* simply ignore second 'j' (e.g. '-jxj') */
+    case 'v':
+        op->verbose_given = true;
+        ++op->verbose;
+        break;
+    case 'V':
+        op->version_given = true;
+        break;
+    default:
+        pr2serr("unrecognised option code %c [0x%x] ??\n", sopt_ch,
+                sopt_ch);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
+
 int
 main(int argc, char * argv[])
 {
@@ -965,9 +1453,11 @@ main(int argc, char * argv[])
     char buff[48];
     struct opts_t opts;
     struct sg_simple_inquiry_resp inq_resp;
+    struct sg_par_dev_list dev_list;    /* batch mode devices */
 
     op = &opts;
     memset(op, 0, sizeof(opts));
+    memset(&dev_list, 0, sizeof(dev_list));
     op->pr_in = true;
     op->prin_sa = -1;
     op->prout_sa = -1;
@@ -980,7 +1470,8 @@ main(int argc, char * argv[])
         int option_index = 0;
 
         c = getopt_long(argc, argv,
-                        "AcCd:GHhiIkK:l:Lm:MnoPQ:rRsS:T:UvVX:yYzZ",
+                        "AcCd:F:GHhiIj::J:kK:l:Lm:Mnop:PQ:rRsS:t:T:UvVX:"
+                        "yYzZ",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -1001,6 +1492,9 @@ main(int argc, char * argv[])
         case 'd':
             device_name = optarg;
             break;
+        case 'F':
+            op->list_fn = optarg;
+            break;
         case 'G':
             op->prout_sa = PROUT_REG_SA;
             ++num_prout_sa;
@@ -1018,6 +1512,29 @@ main(int argc, char * argv[])
             op->prout_sa = PROUT_REG_IGN_SA;
             ++num_prout_sa;
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            op->do_json = true;
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                if ('^' == c) {
+                    op->json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    op->json_arg = optarg + 1;
+                    break;
+                }
+                for (k = 0; k < (int)strlen(optarg); ++k) {
+                    if (chk_short_opts(*(optarg + k), op, &help))
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+            } else
+                op->json_arg = NULL;
+            break;
+        case 'J':
+            op->do_json = true;
+            op->js_file = optarg;
+            break;
         case 'k':
             op->prin_sa = PRIN_RKEY_SA;
             ++num_prin_sa;
@@ -1062,6 +1579,15 @@ main(int argc, char * argv[])
         case 'o':
             want_prout = true;
             break;
+        case 'p':
+            k = sg_get_num(optarg);
+            if ((k < 1) || (k > SG_PAR_MAX_WORKERS)) {
+                pr2serr("bad argument to '--parallel=', expect 1 to %d\n",
+                        SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_workers = k;
+            break;
         case 'P':
             op->prout_sa = PROUT_PREE_SA;
             ++num_prout_sa;
@@ -1090,6 +1616,14 @@ main(int argc, char * argv[])
             op->prin_sa = PRIN_RFSTAT_SA;
             ++num_prin_sa;
             break;
+        case 't':
+            k = sg_get_num(optarg);
+            if (k < 0) {
+                pr2serr("bad argument to '--timeout='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->tmo = k;
+            break;
         case 'S':
             if (1 != sscanf(optarg, "%" SCNx64 "", &op->param_sark)) {
                 pr2serr("bad argument to '--param-sark'\n");
@@ -1151,16 +1685,19 @@ main(int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
+    if (device_name) {
+        res = sg_par_dev_list_add(&dev_list, device_name, op->verbose);
+        if (res)
+            return res;
+    }
     if (optind < argc) {
-        if (NULL == device_name) {
+        if (NULL == device_name)
             device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage(1);
-            return SG_LIB_SYNTAX_ERROR;
+        /* more than one DEVICE (or a glob) is for batch mode */
+        for (; optind < argc; ++optind) {
+            res = sg_par_dev_list_add(&dev_list, argv[optind], op->verbose);
+            if (res)
+                return res;
         }
     }
     if (help > 0) {
@@ -1189,6 +1726,13 @@ main(int argc, char * argv[])
         return 0;
     }
 
+    if (op->list_fn) {
+        res = sg_par_dev_list_from_file(&dev_list, op->list_fn, op->verbose);
+        if (res)
+            return res;
+        if (NULL == device_name)
+            device_name = op->list_fn;
+    }
     if (NULL == device_name) {
         pr2serr("No device name given\n");
         usage(1);
@@ -1263,6 +1807,28 @@ main(int argc, char * argv[])
         }
     }
 
+    if (! op->readwrite_force) {
+        cp = getenv(SG_PERSIST_IN_RDONLY);
+        if (cp && op->pr_in)
+            op->readonly = true;  /* SG_PERSIST_IN_RDONLY overrides default
+                                     which is open(RW) */
+    } else
+        op->readonly = false;      /* '-yy' force open(RW) */
+    if ((dev_list.num > 1) || op->list_fn ||
+        strpbrk(device_name, "*?[")) {
+        if (0 == op->num_workers)
+            op->num_workers = SG_PAR_DEF_WORKERS;
+        if (0 == op->tmo)
+            op->tmo = DEF_PT_TIMEOUT;
+        ret = batch_persist(op, &dev_list, argc, argv);
+        sg_par_dev_list_free(&dev_list);
+        return ret;
+    }
+    if (op->do_json || op->num_workers || op->tmo)
+        pr2serr("--json, --parallel= and --timeout= are only used in batch "
+                "mode\n");
+    sg_par_dev_list_free(&dev_list);
+
     if (op->inquiry) {
         if ((sg_fd = sg_cmds_open_device(device_name, true /* ro */,
                                          op->verbose)) < 0) {
@@ -1298,13 +1864,6 @@ main(int argc, char * argv[])
             pr2serr("%ssg_cmds_close_device() failed res=%d\n", my_name, res);
     }
 
-    if (! op->readwrite_force) {
-        cp = getenv(SG_PERSIST_IN_RDONLY);
-        if (cp && op->pr_in)
-            op->readonly = true;  /* SG_PERSIST_IN_RDONLY overrides default
-                                     which is open(RW) */
-    } else
-        op->readonly = false;      /* '-yy' force open(RW) */
     sg_fd = sg_cmds_open_device(device_name, op->readonly, op->verbose);
     if (sg_fd < 0) {
         pr2serr("%serror opening file %s (r%s): %s\n", my_name, device_name,
@@ -10,6 +10,11 @@
  * This program uses the SCSI command READ BUFFER on the given
  * device, first to find out how big it is and then to read that
  * buffer (data mode, buffer id 0).
+ *
+ * With --sweep it measures READ BUFFER bandwidth across a matrix of
+ * transfer sizes, transfer paths (indirect, direct and mmap-ed IO) and
+ * pass-through interfaces (sg v3, sg v4 and bsg), optionally with several
+ * threads per device.
  */
 
 
@@ -26,22 +31,29 @@
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <dirent.h>
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/mman.h>
 #include <sys/time.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#ifdef HAVE_LINUX_BSG_H
+#include <linux/bsg.h>
+#endif
 #include "sg_lib.h"
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
+#include "sg_json_sg_lib.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
 #define RB_MODE_DESC 3
 #define RB_MODE_DATA 2
@@ -57,18 +69,25 @@
 #endif
 
 
-static const char * version_str = "5.10 20230622";
+static const char * version_str = "5.11 20231021";
+
+#define MY_NAME "sg_rbuf"
 
 static const struct option long_options[] = {
     {"buffer", required_argument, 0, 'b'},
     {"dio", no_argument, 0, 'd'},
     {"echo", no_argument, 0, 'e'},
     {"help", no_argument, 0, 'h'},
+    {"js-file", required_argument, 0, 'J'},
+    {"js_file", required_argument, 0, 'J'},
+    {"json", optional_argument, 0, '^'},    /* short option is '-j' */
     {"mmap", no_argument, 0, 'm'},
     {"new", no_argument, 0, 'N'},
     {"old", no_argument, 0, 'O'},
     {"quick", no_argument, 0, 'q'},
     {"size", required_argument, 0, 's'},
+    {"sweep", optional_argument, 0, 'S'},
+    {"threads", required_argument, 0, 'T'},
     {"time", no_argument, 0, 't'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
@@ -78,17 +97,25 @@ static const struct option long_options[] = {
 struct opts_t {
     bool do_dio;
     bool do_echo;
+    bool do_json;
     bool do_mmap;
     bool do_quick;
+    bool do_sweep;
     bool do_time;
     bool verbose_given;
     bool version_given;
     bool opt_new;
     int do_buffer;
     int do_help;
+    int num_threads;
+    int num_devs;       /* only sweep mode accepts more than one DEVICE */
     int verbose;
     int64_t do_size;
     const char * device_name;
+    const char * json_arg;
+    const char * js_file;
+    const char * sweep_arg;     /* comma separated list of sizes */
+    char ** dev_arr;
 };
 
 
@@ -99,16 +126,30 @@ usage()
             "[--help] [--mmap]\n"
             "               [--quick] [--size=OVERALL] [--time] [--verbose] "
             "[--version]\n"
-            "               SG_DEVICE\n");
+            "               SG_DEVICE\n"
+            "       sg_rbuf --sweep[=SL] [--buffer=MAX] [--echo] "
+            "[--js-file=JFN]\n"
+            "               [--json[=JO]] [--size=CELL] [--threads=TH] "
+            "[--verbose]\n"
+            "               SG_DEVICE [SG_DEVICE...]\n");
     pr2serr("  where:\n"
             "    --buffer=EACH|-b EACH    buffer size to use (in bytes)\n"
             "    --dio|-d        requests dio ('-q' overrides it)\n"
             "    --echo|-e       use echo buffer (def: use data mode)\n"
             "    --help|-h       print usage message then exit\n"
+            "    --js-file=JFN|-J JFN    JSON output to JFN rather than "
+            "stdout\n"
+            "    --json[=JO]|-j[=JO]    output sweep matrix in JSON\n"
             "    --mmap|-m       requests mmap-ed IO (overrides -q, -d)\n"
             "    --quick|-q      quick, don't xfer to user space\n");
     pr2serr("    --size=OVERALL|-s OVERALL    total size to read (in bytes)\n"
-            "                    default: 200 MiB\n"
+            "                    default: 200 MiB (per cell with --sweep)\n"
+            "    --sweep[=SL]|-S    sweep transfer sizes (SL: comma "
+            "separated list,\n"
+            "                       def: powers of 2 from 4 KiB), paths "
+            "and interfaces\n"
+            "    --threads=TH|-T TH    threads per device in sweep mode "
+            "(def: 1)\n"
             "    --time|-t       time the data transfer\n"
             "    --verbose|-v    increase verbosity (more debug)\n"
             "    --old|-O        use old interface (use as first option)\n"
@@ -150,6 +191,39 @@ usage_for(const struct opts_t * op)
         usage_old();
 }
 
+/* Processes the options that can be in the same argument as '-j' such
+ * as '-jv'. Returns 0 if okay, else SG_LIB_SYNTAX_ERROR. */
+static int
+chk_short_opts(const char sopt_ch, struct opts_t * op)
+{
+    /* only need to process short, non-argument options used with -j */
+    switch (sopt_ch) {
+    case 'e':
+        op->do_echo = true;
+        break;
+    case 'h':
+        ++op->do_help;
+        break;
+    case 'j':
+        break;  /* simply ignore second 'j' (e.g. '-jxj') */
+    case 'S':
+        op->do_sweep = true;
+        break;
+    case 'v':
+        op->verbose_given = true;
+        ++op->verbose;
+        break;
+    case 'V':
+        op->version_given = true;
+        break;
+    default:
+        pr2serr("unrecognised option code %c [0x%x] ??\n", sopt_ch,
+                sopt_ch);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
 static int
 new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
 {
@@ -159,7 +233,7 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:dehmNOqs:tvV", long_options,
+        c = getopt_long(argc, argv, "^b:dehj::J:mNOqs:StT:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -184,6 +258,32 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case '?':
             ++op->do_help;
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            op->do_json = true;
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                int k;
+
+                if ('^' == c) {
+                    op->json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    op->json_arg = optarg + 1;
+                    break;
+                }
+                n = strlen(optarg);
+                for (k = 0; k < n; ++k) {
+                    if (chk_short_opts(*(optarg + k), op))
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+            } else
+                op->json_arg = NULL;
+            break;
+        case 'J':
+            op->do_json = true;
+            op->js_file = optarg;
+            break;
         case 'm':
             op->do_mmap = true;
             break;
@@ -204,9 +304,22 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
             }
             op->do_size = nn;
             break;
+        case 'S':
+            op->do_sweep = true;
+            op->sweep_arg = optarg;
+            break;
         case 't':
             op->do_time = true;
             break;
+        case 'T':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > SG_PAR_MAX_WORKERS)) {
+                pr2serr("--threads= expects an argument between 1 and %d "
+                        "inclusive\n", SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_threads = n;
+            break;
         case 'v':
             op->verbose_given = true;
             ++op->verbose;
@@ -222,6 +335,12 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
             return SG_LIB_SYNTAX_ERROR;
         }
     }
+    if (op->do_sweep && (optind < argc)) {
+        op->dev_arr = argv + optind;
+        op->num_devs = argc - optind;
+        op->device_name = argv[optind];
+        return 0;
+    }
     if (optind < argc) {
         if (NULL == op->device_name) {
             op->device_name = argv[optind];
@@ -352,6 +471,622 @@ parse_cmd_line(struct opts_t * op, int argc, char * argv[])
 }
 
 
+/* Sweep mode: for each DEVICE measure READ BUFFER bandwidth for each
+ * transfer size, each transfer path (indirect, direct and mmap-ed IO) and
+ * each pass-through interface (sg v3 and v4 on the sg device, v4 on the
+ * matching bsg device). Each cell of the resulting matrix is measured with
+ * op->num_threads threads, each with its own file descriptor. */
+
+#define RB_IF_V3 0
+#define RB_IF_V4 1
+#define RB_IF_BSG 2
+#define RB_NUM_IFS 3
+
+#define RB_PATH_IND 0
+#define RB_PATH_DIO 1
+#define RB_PATH_MMAP 2
+#define RB_NUM_PATHS 3
+
+#define RB_NUM_COLS 7   /* v3 and v4 have 3 paths each, bsg only indirect */
+#define RB_SWEEP_MIN_SZ 4096
+#define RB_SWEEP_MAX_SIZES 32
+
+static const char * rb_if_arr[] = {"sg_v3", "sg_v4", "bsg"};
+static const char * rb_path_arr[] = {"indirect", "direct", "mmap"};
+static const char * rb_col_hdr_arr[] = {"v3-ind", "v3-dio", "v3-mmap",
+                                        "v4-ind", "v4-dio", "v4-mmap",
+                                        "bsg"};
+
+struct rb_cell_t {
+    bool supported;
+    bool dio_incomplete;
+    int res;
+    uint64_t cmds;
+    uint64_t ns;
+};
+
+struct rb_thr_t {
+    bool dio_incomplete;
+    int res;
+    uint64_t cmds;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+struct rb_sweep_ctx_t {
+    const struct opts_t * op;
+    const char * dev_name;      /* sg or bsg device node */
+    int iface;
+    int path;
+    int xfer_sz;
+    int64_t cmds_per_thr;
+    struct rb_thr_t * thr_arr;
+};
+
+static void
+rb_col2if(int col, int * ifacep, int * pathp)
+{
+    if (col < 6) {
+        *ifacep = col / RB_NUM_PATHS;
+        *pathp = col % RB_NUM_PATHS;
+    } else {
+        *ifacep = RB_IF_BSG;
+        *pathp = RB_PATH_IND;
+    }
+}
+
+/* Finds the bsg device node that matches the sg device 'sg_name' by way
+ * of sysfs. Returns true and places the name in 'b' if found. */
+static bool
+rb_find_bsg(const char * sg_name, char * b, int blen, int vb)
+{
+    bool found = false;
+    struct stat st;
+    struct dirent * dep;
+    DIR * dirp;
+    char d[128];
+
+    if ((stat(sg_name, &st) < 0) || (! S_ISCHR(st.st_mode)))
+        return false;
+    snprintf(d, sizeof(d), "/sys/dev/char/%u:%u/device/bsg",
+             major(st.st_rdev), minor(st.st_rdev));
+    dirp = opendir(d);
+    if (NULL == dirp) {
+        if (vb > 1)
+            pr2serr("%s: no %s directory\n", __func__, d);
+        return false;
+    }
+    while ((dep = readdir(dirp))) {
+        if ('.' == dep->d_name[0])
+            continue;
+        snprintf(b, blen, "/dev/bsg/%s", dep->d_name);
+        found = (0 == stat(b, &st)) && S_ISCHR(st.st_mode);
+        if (found)
+            break;
+    }
+    closedir(dirp);
+    if (vb && found)
+        pr2serr("%s: matching bsg device is %s\n", sg_name, b);
+    return found;
+}
+
+/* Issues one READ BUFFER (data or echo data mode) of 'xfer_sz' bytes.
+ * Returns 0 on success, else SG_LIB_CAT_* or SG_LIB_OS_BASE_ERR+errno. */
+static int
+rb_sweep_cmd(int fd, const struct rb_sweep_ctx_t * cp, uint8_t * buff,
+             int pack_id, bool * dio_incompletep)
+{
+    int res;
+    unsigned int info;
+    int vb = cp->op->verbose;
+    uint8_t cdb[RB_CMD_LEN];
+    uint8_t sense_buffer[32] SG_C_CPP_ZERO_INIT;
+
+    memset(cdb, 0, RB_CMD_LEN);
+    cdb[0] = RB_OPCODE;
+    cdb[1] = cp->op->do_echo ? RB_MODE_ECHO_DATA : RB_MODE_DATA;
+    sg_put_unaligned_be24((uint32_t)cp->xfer_sz, cdb + 6);
+    if (RB_IF_V3 == cp->iface) {
+        struct sg_io_hdr io_hdr;
+
+        memset(&io_hdr, 0, sizeof(io_hdr));
+        io_hdr.interface_id = 'S';
+        io_hdr.cmd_len = RB_CMD_LEN;
+        io_hdr.mx_sb_len = sizeof(sense_buffer);
+        io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+        io_hdr.dxfer_len = cp->xfer_sz;
+        if (RB_PATH_MMAP == cp->path)
+            io_hdr.flags |= SG_FLAG_MMAP_IO;
+        else {
+            io_hdr.dxferp = buff;
+            if (RB_PATH_DIO == cp->path)
+                io_hdr.flags |= SG_FLAG_DIRECT_IO;
+        }
+        io_hdr.cmdp = cdb;
+        io_hdr.sbp = sense_buffer;
+        io_hdr.timeout = 20000;     /* 20000 millisecs == 20 seconds */
+        io_hdr.pack_id = pack_id;
+        if (ioctl(fd, SG_IO, &io_hdr) < 0)
+            return sg_convert_errno(errno);
+        res = sg_err_category3(&io_hdr);
+        if ((SG_LIB_CAT_CLEAN != res) && (SG_LIB_CAT_RECOVERED != res) &&
+            vb)
+            sg_chk_n_print3("READ BUFFER data error", &io_hdr, vb > 1);
+        info = io_hdr.info;
+    } else {
+#ifdef HAVE_LINUX_BSG_H
+        struct sg_io_v4 h4;
+
+        memset(&h4, 0, sizeof(h4));
+        h4.guard = 'Q';
+        h4.protocol = BSG_PROTOCOL_SCSI;
+        h4.subprotocol = BSG_SUB_PROTOCOL_SCSI_CMD;
+        h4.request_len = RB_CMD_LEN;
+        h4.request = (uint64_t)(sg_uintptr_t)cdb;
+        h4.max_response_len = sizeof(sense_buffer);
+        h4.response = (uint64_t)(sg_uintptr_t)sense_buffer;
+        h4.din_xfer_len = cp->xfer_sz;
+        if (RB_PATH_MMAP == cp->path)
+            h4.flags |= SG_FLAG_MMAP_IO;        /* same value in sg v4 */
+        else {
+            h4.din_xferp = (uint64_t)(sg_uintptr_t)buff;
+            if (RB_PATH_DIO == cp->path)
+                h4.flags |= SG_FLAG_DIRECT_IO;  /* same value in sg v4 */
+        }
+        h4.timeout = 20000;
+        h4.request_extra = pack_id;
+        if (ioctl(fd, SG_IO, &h4) < 0)
+            return sg_convert_errno(errno);
+        res = sg_err_category_new(h4.device_status, h4.transport_status,
+                                  h4.driver_status, sense_buffer,
+                                  h4.response_len);
+        if ((SG_LIB_CAT_CLEAN != res) && (SG_LIB_CAT_RECOVERED != res) &&
+            vb)
+            sg_linux_sense_print("READ BUFFER data error", h4.device_status,
+                                 h4.transport_status, h4.driver_status,
+                                 sense_buffer, h4.response_len, vb > 1);
+        info = h4.info;
+#else
+        if (buff && pack_id) { ; }      /* suppress warning */
+        return SG_LIB_CAT_OTHER;
+#endif
+    }
+    if ((SG_LIB_CAT_CLEAN != res) && (SG_LIB_CAT_RECOVERED != res))
+        return (res >= 0) ? res : SG_LIB_CAT_OTHER;
+    if ((RB_PATH_DIO == cp->path) &&
+        ((info & SG_INFO_DIRECT_IO_MASK) != SG_INFO_DIRECT_IO))
+        *dio_incompletep = true;
+    return 0;
+}
+
+/* Worker for sg_par_run(), one call for each thread in a cell */
+static int
+rb_sweep_work(void * ctxp, int idx)
+{
+    bool is_sg_node;
+    int fd, k, t;
+    int64_t j;
+    uint32_t mmap_sz = 0;
+    struct rb_sweep_ctx_t * cp = (struct rb_sweep_ctx_t *)ctxp;
+    struct rb_thr_t * tp = cp->thr_arr + idx;
+    uint8_t * buff = NULL;
+    uint8_t * free_buff = NULL;
+
+    is_sg_node = (RB_IF_BSG != cp->iface);
+    fd = open(cp->dev_name, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+        tp->res = sg_convert_errno(errno);
+        return tp->res;
+    }
+    if (is_sg_node && (RB_PATH_DIO != cp->path)) {
+        k = cp->xfer_sz;
+        if (RB_PATH_MMAP == cp->path)
+            k = ((k + sg_get_page_size() - 1) / sg_get_page_size()) *
+                sg_get_page_size();
+        if ((ioctl(fd, SG_SET_RESERVED_SIZE, &k) < 0) && cp->op->verbose)
+            perror("SG_SET_RESERVED_SIZE error");
+        if (RB_PATH_MMAP == cp->path) {
+            /* reserved buffer may have been trimmed by the sg driver */
+            if ((ioctl(fd, SG_GET_RESERVED_SIZE, &t) < 0) ||
+                (t < cp->xfer_sz)) {
+                tp->res = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+            mmap_sz = k;
+            buff = (uint8_t *)mmap(NULL, mmap_sz, PROT_READ, MAP_SHARED, fd,
+                                   0);
+            if (MAP_FAILED == buff) {
+                buff = NULL;
+                tp->res = sg_convert_errno(errno);
+                goto fini;
+            }
+        }
+    }
+    if (NULL == buff) {
+        buff = sg_memalign(cp->xfer_sz, 0 /* page */, &free_buff, false);
+        if (NULL == buff) {
+            tp->res = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+    }
+    tp->start_ns = sg_par_mono_ns();
+    for (j = 0; j < cp->cmds_per_thr; ++j) {
+        tp->res = rb_sweep_cmd(fd, cp, buff, (int)j, &tp->dio_incomplete);
+        if (tp->res)
+            break;
+        ++tp->cmds;
+    }
+    tp->end_ns = sg_par_mono_ns();
+fini:
+    if (mmap_sz && buff)
+        munmap(buff, mmap_sz);
+    if (free_buff)
+        free(free_buff);
+    close(fd);
+    return tp->res;
+}
+
+/* Uses the READ BUFFER descriptor mode to find the buffer capacity. Returns
+ * 0 on success. */
+static int
+rb_sweep_capacity(const char * dev_name, const struct opts_t * op,
+                  int * capp)
+{
+    int fd, res;
+    uint8_t rb_cdb[RB_CMD_LEN] SG_C_CPP_ZERO_INIT;
+    uint8_t resp[RB_DESC_LEN] SG_C_CPP_ZERO_INIT;
+    uint8_t sense_buffer[32] SG_C_CPP_ZERO_INIT;
+    struct sg_io_hdr io_hdr;
+
+    fd = open(dev_name, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+        res = errno;
+        pr2serr("unable to open %s: %s\n", dev_name, safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    rb_cdb[0] = RB_OPCODE;
+    rb_cdb[1] = op->do_echo ? RB_MODE_ECHO_DESC : RB_MODE_DESC;
+    rb_cdb[8] = RB_DESC_LEN;
+    memset(&io_hdr, 0, sizeof(struct sg_io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = sizeof(rb_cdb);
+    io_hdr.mx_sb_len = sizeof(sense_buffer);
+    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    io_hdr.dxfer_len = RB_DESC_LEN;
+    io_hdr.dxferp = resp;
+    io_hdr.cmdp = rb_cdb;
+    io_hdr.sbp = sense_buffer;
+    io_hdr.timeout = 60000;     /* 60000 millisecs == 60 seconds */
+    if (ioctl(fd, SG_IO, &io_hdr) < 0) {
+        res = errno;
+        pr2serr("%s: SG_IO READ BUFFER descriptor error: %s\n", dev_name,
+                safe_strerror(res));
+        close(fd);
+        return sg_convert_errno(res);
+    }
+    close(fd);
+    res = sg_err_category3(&io_hdr);
+    if ((SG_LIB_CAT_CLEAN != res) && (SG_LIB_CAT_RECOVERED != res)) {
+        sg_chk_n_print3("READ BUFFER descriptor error", &io_hdr,
+                        op->verbose > 1);
+        return (res >= 0) ? res : SG_LIB_CAT_OTHER;
+    }
+    if (op->do_echo)
+        *capp = 0x1fff & sg_get_unaligned_be16(resp + 2);
+    else
+        *capp = sg_get_unaligned_be24(resp + 1);
+    return 0;
+}
+
+/* Places transfer sizes for the sweep in sz_arr, returns the number of
+ * them or -1 on a syntax error. */
+static int
+rb_sweep_sizes(const struct opts_t * op, int capacity, int * sz_arr)
+{
+    int n, sz;
+    const char * cp;
+
+    if (NULL == op->sweep_arg) {
+        sz = (capacity < RB_SWEEP_MIN_SZ) ? capacity : RB_SWEEP_MIN_SZ;
+        for (n = 0; (sz < capacity) && (n < (RB_SWEEP_MAX_SIZES - 1));
+             sz *= 2)
+            sz_arr[n++] = sz;
+        sz_arr[n++] = capacity;
+        return n;
+    }
+    for (n = 0, cp = op->sweep_arg; cp && *cp; ) {
+        sz = sg_get_num(cp);      /* stops at ',' */
+        if (sz <= 0) {
+            pr2serr("bad size in --sweep=%s\n", op->sweep_arg);
+            return -1;
+        }
+        if (sz > capacity)
+            pr2serr("skip size %d as it exceeds buffer capacity (%d)\n", sz,
+                    capacity);
+        else if (n < RB_SWEEP_MAX_SIZES)
+            sz_arr[n++] = sz;
+        cp = strchr(cp, ',');
+        if (cp)
+            ++cp;
+    }
+    return n;
+}
+
+static int
+rb_sweep_dev(const char * dev_name, struct opts_t * op, sgj_state * jsp,
+             sgj_opaque_p jap)
+{
+    bool have_bsg;
+    int k, col, res, num_sz, sg_ver, best;
+    int capacity = 0;
+    int ret = 0;
+    int sz_arr[RB_SWEEP_MAX_SIZES];
+    uint64_t min_start, max_end;
+    double mbps, best_mbps;
+    struct rb_cell_t * cell_arr = NULL;
+    struct rb_thr_t * thr_arr = NULL;
+    struct rb_sweep_ctx_t ctx;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p ja2p = NULL;
+    sgj_opaque_p ja3p = NULL;
+    char bsg_name[300];
+    char b[32];
+
+    res = rb_sweep_capacity(dev_name, op, &capacity);
+    if (res)
+        return res;
+    if (capacity <= 0) {
+        pr2serr("%s: READ BUFFER reports zero capacity\n", dev_name);
+        return SG_LIB_CAT_MALFORMED;
+    }
+    if ((op->do_buffer > 0) && (op->do_buffer < capacity))
+        capacity = op->do_buffer;
+    num_sz = rb_sweep_sizes(op, capacity, sz_arr);
+    if (num_sz <= 0)
+        return SG_LIB_SYNTAX_ERROR;
+    sg_ver = 0;
+    k = open(dev_name, O_RDONLY | O_NONBLOCK);
+    if (k >= 0) {
+        if (ioctl(k, SG_GET_VERSION_NUM, &sg_ver) < 0)
+            sg_ver = 0;
+        close(k);
+    }
+    have_bsg = false;
+#ifdef HAVE_LINUX_BSG_H
+    have_bsg = rb_find_bsg(dev_name, bsg_name, sizeof(bsg_name),
+                           op->verbose);
+#endif
+    if (! have_bsg)
+        bsg_name[0] = '\0';
+    cell_arr = (struct rb_cell_t *)calloc(num_sz * RB_NUM_COLS,
+                                          sizeof(*cell_arr));
+    thr_arr = (struct rb_thr_t *)calloc(op->num_threads, sizeof(*thr_arr));
+    if ((NULL == cell_arr) || (NULL == thr_arr)) {
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+
+    for (k = 0; k < num_sz; ++k) {
+        for (col = 0; col < RB_NUM_COLS; ++col) {
+            struct rb_cell_t * clp = cell_arr + (k * RB_NUM_COLS) + col;
+            int j;
+
+            rb_col2if(col, &ctx.iface, &ctx.path);
+#ifdef HAVE_LINUX_BSG_H
+            if (RB_IF_V4 == ctx.iface)
+                clp->supported = (sg_ver >= 40000);
+            else
+                clp->supported = (RB_IF_V3 == ctx.iface) || have_bsg;
+#else
+            clp->supported = (RB_IF_V3 == ctx.iface);
+#endif
+            if (! clp->supported)
+                continue;
+            if (op->verbose > 0)
+                pr2serr("  %s: size=%d %s %s\n", dev_name, sz_arr[k],
+                        rb_if_arr[ctx.iface], rb_path_arr[ctx.path]);
+            memset(thr_arr, 0, op->num_threads * sizeof(*thr_arr));
+            ctx.op = op;
+            ctx.dev_name = (RB_IF_BSG == ctx.iface) ? bsg_name : dev_name;
+            ctx.xfer_sz = sz_arr[k];
+            ctx.cmds_per_thr = op->do_size / sz_arr[k] / op->num_threads;
+            if (ctx.cmds_per_thr < 1)
+                ctx.cmds_per_thr = 1;
+            ctx.thr_arr = thr_arr;
+            res = sg_par_run(op->num_threads, op->num_threads,
+                             rb_sweep_work, NULL, &ctx);
+            if (res) {
+                clp->res = sg_convert_errno(res);
+                continue;
+            }
+            min_start = 0;
+            max_end = 0;
+            for (j = 0; j < op->num_threads; ++j) {
+                const struct rb_thr_t * tp = thr_arr + j;
+
+                if (tp->res && (0 == clp->res))
+                    clp->res = tp->res;
+                if (tp->dio_incomplete)
+                    clp->dio_incomplete = true;
+                clp->cmds += tp->cmds;
+                if (0 == tp->start_ns)
+                    continue;
+                if ((0 == min_start) || (tp->start_ns < min_start))
+                    min_start = tp->start_ns;
+                if (tp->end_ns > max_end)
+                    max_end = tp->end_ns;
+            }
+            clp->ns = (max_end > min_start) ? (max_end - min_start) : 0;
+            if (clp->res && (op->verbose > 0))
+                pr2serr("  %s: size=%d %s %s failed: %s\n", dev_name,
+                        sz_arr[k], rb_if_arr[ctx.iface],
+                        rb_path_arr[ctx.path],
+                        sg_get_category_sense_str(clp->res, sizeof(b), b,
+                                                  op->verbose));
+        }
+    }
+
+    /* output the matrix */
+    if (jsp->pr_as_json) {
+        jop = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jop, "device_name", dev_name);
+        if (have_bsg)
+            sgj_js_nv_s(jsp, jop, "bsg_device_name", bsg_name);
+        sgj_js_nv_i(jsp, jop, "sg_driver_version", sg_ver);
+        sgj_js_nv_i(jsp, jop, "buffer_capacity", capacity);
+        sgj_js_nv_i(jsp, jop, "threads", op->num_threads);
+        sgj_js_nv_i(jsp, jop, "bytes_per_cell", op->do_size);
+        ja2p = sgj_named_subarray_r(jsp, jop, "cell_list");
+        ja3p = sgj_named_subarray_r(jsp, jop, "best_list");
+    }
+    sgj_pr_hr(jsp, "%s: READ BUFFER (%s) bandwidth in MB/sec, %d thread%s, "
+              "%" PRId64 " bytes per cell\n", dev_name,
+              (op->do_echo ? "echo" : "data"), op->num_threads,
+              ((op->num_threads > 1) ? "s" : ""), op->do_size);
+    if (have_bsg)
+        sgj_pr_hr(jsp, "  bsg device: %s\n", bsg_name);
+    sgj_pr_hr(jsp, "  %-9s", "size");
+    for (col = 0; col < RB_NUM_COLS; ++col)
+        sgj_pr_hr(jsp, " %9s", rb_col_hdr_arr[col]);
+    sgj_pr_hr(jsp, "  best\n");
+    for (k = 0; k < num_sz; ++k) {
+        sgj_pr_hr(jsp, "  %-9d", sz_arr[k]);
+        best = -1;
+        best_mbps = 0.0;
+        for (col = 0; col < RB_NUM_COLS; ++col) {
+            const struct rb_cell_t * clp = cell_arr + (k * RB_NUM_COLS) +
+                                           col;
+            int iface, path;
+
+            rb_col2if(col, &iface, &path);
+            mbps = 0.0;
+            if (! clp->supported)
+                snprintf(b, sizeof(b), "%s", "-");
+            else if (clp->res) {
+                snprintf(b, sizeof(b), "%s", "err");
+                if (0 == ret)
+                    ret = clp->res;
+            } else {
+                if (clp->ns > 0)
+                    mbps = ((double)clp->cmds * sz_arr[k] * 1000.0) /
+                           (double)clp->ns;
+                snprintf(b, sizeof(b), "%.1f%s", mbps,
+                         (clp->dio_incomplete ? "*" : ""));
+                /* dio that fell back to indirect IO is not a candidate */
+                if ((mbps > best_mbps) && (! clp->dio_incomplete)) {
+                    best_mbps = mbps;
+                    best = col;
+                }
+            }
+            sgj_pr_hr(jsp, " %9s", b);
+            if (ja2p && clp->supported) {
+                sgj_opaque_p jo2p = sgj_new_unattached_object_r(jsp);
+
+                sgj_js_nv_i(jsp, jo2p, "transfer_size", sz_arr[k]);
+                sgj_js_nv_s(jsp, jo2p, "interface", rb_if_arr[iface]);
+                sgj_js_nv_s(jsp, jo2p, "path", rb_path_arr[path]);
+                sgj_js_nv_i(jsp, jo2p, "commands", (int64_t)clp->cmds);
+                sgj_js_nv_i(jsp, jo2p, "elapsed_usecs",
+                            (int64_t)(clp->ns / 1000));
+                sgj_js_nv_i(jsp, jo2p, "bytes_per_sec",
+                            (int64_t)(mbps * 1000000.0));
+                sgj_js_nv_i(jsp, jo2p, "iops", (int64_t)(clp->ns ?
+                            (clp->cmds * 1000000000.0) / clp->ns : 0));
+                sgj_js_nv_b(jsp, jo2p, "dio_incomplete",
+                            clp->dio_incomplete);
+                sgj_js_nv_i(jsp, jo2p, "result", clp->res);
+                sgj_js_nv_o(jsp, ja2p, NULL /* name */, jo2p);
+            }
+        }
+        sgj_pr_hr(jsp, "  %s\n", (best >= 0) ? rb_col_hdr_arr[best] : "-");
+        if (ja3p && (best >= 0)) {
+            sgj_opaque_p jo2p = sgj_new_unattached_object_r(jsp);
+            int iface, path;
+
+            rb_col2if(best, &iface, &path);
+            sgj_js_nv_i(jsp, jo2p, "transfer_size", sz_arr[k]);
+            sgj_js_nv_s(jsp, jo2p, "interface", rb_if_arr[iface]);
+            sgj_js_nv_s(jsp, jo2p, "path", rb_path_arr[path]);
+            sgj_js_nv_i(jsp, jo2p, "bytes_per_sec",
+                        (int64_t)(best_mbps * 1000000.0));
+            sgj_js_nv_o(jsp, ja3p, NULL /* name */, jo2p);
+        }
+    }
+    sgj_pr_hr(jsp, "  ['-': not supported, '*': direct IO fell back to "
+              "indirect IO]\n\n");
+    if (jap)
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jop);
+fini:
+    free(cell_arr);
+    free(thr_arr);
+    return ret;
+}
+
+/* Sweep mode entry point, returns exit status */
+static int
+rb_sweep(struct opts_t * op, int argc, char * argv[])
+{
+    int k, res;
+    int ret = 0;
+    sgj_state json_st SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &json_st;
+    sgj_opaque_p jap = NULL;
+
+    if (op->do_json) {
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char) {
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            }
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+        jap = sgj_named_subarray_r(jsp, NULL, "buffer_sweep_list");
+    }
+    if (op->do_size <= 0)
+        op->do_size = RB_DEF_SIZE;
+    for (k = 0; k < op->num_devs; ++k) {
+        res = rb_sweep_dev(op->dev_arr[k], op, jsp, jap);
+        if (res && (0 == ret))
+            ret = res;
+    }
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp->pr_as_json) {
+        FILE * fp = stdout;
+
+        if (op->js_file) {
+            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
+                fp = fopen(op->js_file, "w");   /* truncate if exists */
+                if (NULL == fp) {
+                    int e = errno;
+
+                    pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                            safe_strerror(e));
+                    ret = sg_convert_errno(e);
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        if (fp)
+            sgj_js2file(jsp, NULL, ret, fp);
+        if (op->js_file && fp && (stdout != fp))
+            fclose(fp);
+        sgj_finish(jsp);
+    }
+    if (ret && (0 == op->verbose)) {
+        if (! sg_if_can2stderr("sg_rbuf failed: ", ret))
+            pr2serr("Some error occurred, try again with '-v' or '-vv' for "
+                    "more information\n");
+    }
+    return ret;
+}
+
+
 int
 main(int argc, char * argv[])
 {
@@ -381,6 +1116,7 @@ main(int argc, char * argv[])
 #endif
     op = &opts;
     memset(op, 0, sizeof(opts));
+    op->num_threads = 1;
     res = parse_cmd_line(op, argc, argv);
     if (res)
         return SG_LIB_SYNTAX_ERROR;
@@ -414,6 +1150,14 @@ main(int argc, char * argv[])
         usage_for(op);
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (op->do_sweep) {
+        if (op->do_dio || op->do_mmap || op->do_quick)
+            pr2serr("--dio, --mmap and --quick are ignored by --sweep which "
+                    "tries all paths\n");
+        return rb_sweep(op, argc, argv);
+    }
+    if (op->do_json || (op->num_threads > 1))
+        pr2serr("--json and --threads= are only used with --sweep\n");
 
     if (op->do_buffer > 0)
         buf_size = op->do_buffer;
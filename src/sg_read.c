@@ -16,6 +16,11 @@
    or a seekable file. Streams such as stdin are not acceptable. The block
    size ('bs') is assumed to be 512 if not given.
 
+   There is also a benchmark mode which runs several threads, each with
+   one or more commands outstanding, using sequential or random access
+   and optionally mixing in WRITEs. It reports IOPS, bandwidth and
+   latency percentiles, optionally in JSON.
+
    This version should compile with Linux sg drivers with version numbers
    >= 30000 . For mmap-ed IO the sg version number >= 30122 .
 
@@ -53,17 +58,21 @@
 
 #ifdef HAVE_LINUX_MAJOR_H
 #include <linux/major.h>
+#include <linux/fs.h>           /* for BLKGETSIZE64 */
 #else
 #include "sg_pt_linux_missing.h"
 #endif
 
 #include "sg_lib.h"
+#include "sg_cmds_basic.h"
 #include "sg_io_linux.h"
 #include "sg_unaligned.h"
+#include "sg_json_sg_lib.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
 
-static const char * version_str = "1.40 20230716";
+static const char * version_str = "1.41 20231020";
 
 #define DEF_BLOCK_SIZE 512
 #define DEF_BLOCKS_PER_TRANSFER 128
@@ -73,6 +82,7 @@ static const char * version_str = "1.40 20230716";
 #define MAX_COUNT_SKIP_SEEK (1LL << 48) /* coverity wants upper bound */
 
 #define ME "sg_read: "
+#define MY_NAME "sg_read"
 
 #ifndef SG_FLAG_MMAP_IO
 #define SG_FLAG_MMAP_IO 4
@@ -186,7 +196,12 @@ usage()
             "[skip=SKIP]\n"
             "                [time=TI] [verbose=VERB] [--help] "
             "[--verbose]\n"
-            "                [--version] "
+            "                [--version]\n"
+            "       sg_read  [pattern=same|seq|rand] [qd=QD] [range=RA] "
+            "[runtime=SECS]\n"
+            "                [rwmix=PC] [threads=TH] [--js-file=JFN] "
+            "[--json[=JO]]\n"
+            "                [--quick] <other operands as above>\n"
             "  where:\n"
             "    blk_sgio 0->normal IO for block devices, 1->SCSI commands "
             "via SG_IO\n"
@@ -212,16 +227,33 @@ usage()
             "    no_dxfer 1->DMA to kernel buffers only, not user space, "
             "0->normal(def)\n"
             "    odir     1->open block device O_DIRECT, 0->don't (def)\n"
+            "    pattern  same->every command at SKIP (def), seq->"
+            "sequential, rand->\n"
+            "             random; benchmark mode\n"
+            "    qd       commands outstanding per thread on sg device (def: "
+            "1)\n"
+            "    range    number of blocks (from SKIP) for seq and rand "
+            "(def: to end)\n"
+            "    runtime  stop after SECS seconds (def: when COUNT done)\n"
+            "    rwmix    percentage of commands that are WRITEs (def: 0); "
+            "destroys data!\n"
             "    skip     each transfer starts at this logical address "
             "(def=0)\n"
+            "    threads  number of threads, each with own file descriptor "
+            "(def: 1)\n"
             "    time     0->do nothing(def), 1->time from 1st cmd, 2->time "
             "from 2nd, ...\n"
             "    verbose  increase level of verbosity (def: 0)\n"
             "    --help|-h    print this usage message then exit\n"
+            "    --js-file=JFN    JSON output to JFN rather than stdout\n"
+            "    --json[=JO]|-j    output benchmark results in JSON\n"
+            "    --quick|-q    no 15 second pause before rwmix writes\n"
             "    --verbose|-v   increase level of verbosity (def: 0)\n"
             "    --version|-V   print version number then exit\n\n"
             "Issue SCSI READ commands, each starting from the same logical "
-            "block address\n");
+            "block address.\nIf any benchmark operand is given, run a "
+            "benchmark and report IOPS, bandwidth\nand latency "
+            "percentiles.\n");
 }
 
 static int
@@ -404,10 +436,843 @@ num_chs_in_str(const char * s, int slen, int ch)
 #define INF_SZ 512
 #define EBUFF_SZ 768
 
+/* Benchmark mode. Entered when any of the threads=, qd=, pattern=, rwmix=,
+ * runtime= or range= operands (or --json) is given. Each thread opens its
+ * own file descriptor. On sg devices the sg driver's asynchronous
+ * write()/read() interface is used so each thread can keep up to 'qd'
+ * commands outstanding; block devices with blk_sgio=1 use the SG_IO
+ * ioctl and other files use pread()/pwrite(), both with a queue depth of 1.
+ */
+
+#define PAT_SAME 0      /* every command starts at 'skip', the original mode */
+#define PAT_SEQ 1
+#define PAT_RAND 2
+
+#define MAX_BENCH_QD 256
+#define RCAP16_REPLY_LEN 32
+#define READ_CAP_REPLY_LEN 8
+
+static volatile sig_atomic_t bench_stop = 0;
+
+struct bench_opts_t {
+    bool dio;
+    bool do_mmap;
+    bool no_dxfer;
+    bool odir;
+    bool fua;
+    bool dpo;
+    int in_type;
+    int bs;
+    int bpt;
+    int cdbsz;
+    int qd;
+    int pattern;
+    int rwmix;          /* percentage of commands that are WRITEs */
+    int num_threads;
+    int64_t skip;
+    int64_t range;      /* in blocks, starting at 'skip' */
+    int64_t total_cmds; /* -1 for no limit (then runtime applies) */
+    uint64_t runtime_ns;
+    const char * inf;
+};
+
+struct bench_slot_t {
+    bool is_write;
+    int blocks;
+    uint64_t start_ns;
+    uint8_t * buffp;
+    uint8_t * free_buffp;
+    uint8_t cdb[MAX_SCSI_CDBSZ];
+    uint8_t sense[SENSE_BUFF_LEN];
+    struct sg_io_hdr io_hdr;
+};
+
+struct bench_thr_t {
+    int res;            /* 0 or first SG_LIB_* error */
+    int dio_incomplete;
+    int retries;
+    uint64_t rnd_state;
+    int64_t seq_start;
+    int64_t seq_end;    /* one past last block of this thread's slice */
+    int64_t seq_lba;
+    int64_t cmds_left;  /* -1 for no limit */
+    uint64_t rd_cmds;
+    uint64_t wr_cmds;
+    uint64_t blks;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    struct sg_par_lat_hist lat;
+};
+
+struct bench_ctx_t {
+    const struct bench_opts_t * op;
+    struct bench_thr_t * thr_arr;
+};
+
+static const char * pattern_arr[] = {"same", "seq", "rand"};
+
+
+static void
+bench_interrupt_handler(int sig)
+{
+    struct sigaction sigact;
+
+    /* a second signal of the same type terminates */
+    sigact.sa_handler = SIG_DFL;
+    sigemptyset (&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigaction (sig, &sigact, NULL);
+    bench_stop = 1;
+}
+
+/* xorshift64* generator, each thread has its own state. Plays the same role
+ * as the Rand_uint class in testing/sg_tst_async.cpp . */
+static uint64_t
+bench_rand(uint64_t * statep)
+{
+    uint64_t x = *statep;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *statep = x;
+    return x * UINT64_C(2685821657736338717);
+}
+
+/* Places number of blocks in *num_blks. Uses READ CAPACITY on sg devices
+ * (and when blk_sgio=1), otherwise the block device size or file size.
+ * Returns 0 on success. */
+static int
+bench_capacity(int fd, const struct bench_opts_t * op, int64_t * num_blks)
+{
+    int res, blk_sz;
+    int vb = (verbose > 1) ? verbose - 1 : 0;
+    uint8_t rcBuff[RCAP16_REPLY_LEN];
+
+    if (FT_SG & op->in_type) {
+        res = sg_ll_readcap_10(fd, false, 0, rcBuff, READ_CAP_REPLY_LEN,
+                               true, vb);
+        if (res)
+            return res;
+        if (0xffffffff == sg_get_unaligned_be32(rcBuff)) {
+            res = sg_ll_readcap_16(fd, false, 0, rcBuff, RCAP16_REPLY_LEN,
+                                   true, vb);
+            if (res)
+                return res;
+            *num_blks = (int64_t)sg_get_unaligned_be64(rcBuff) + 1;
+            blk_sz = (int)sg_get_unaligned_be32(rcBuff + 8);
+        } else {
+            *num_blks = (int64_t)sg_get_unaligned_be32(rcBuff) + 1;
+            blk_sz = (int)sg_get_unaligned_be32(rcBuff + 4);
+        }
+        if (blk_sz != op->bs)
+            pr2serr(ME "warning: logical block size is %d but bs=%d\n",
+                    blk_sz, op->bs);
+    } else if (FT_BLOCK & op->in_type) {
+#ifdef BLKGETSIZE64
+        uint64_t ull;
+
+        if (ioctl(fd, BLKGETSIZE64, &ull) < 0) {
+            res = errno;
+            perror(ME "BLKGETSIZE64 ioctl error");
+            return sg_convert_errno(res);
+        }
+        *num_blks = (int64_t)(ull / op->bs);
+#else
+        pr2serr(ME "unable to get block device size, give 'range='\n");
+        return SG_LIB_SYNTAX_ERROR;
+#endif
+    } else {
+        struct stat st;
+
+        if (fstat(fd, &st) < 0) {
+            res = errno;
+            perror(ME "fstat error");
+            return sg_convert_errno(res);
+        }
+        *num_blks = (int64_t)st.st_size / op->bs;
+    }
+    if (verbose)
+        pr2serr("  %s: number of blocks=%" PRId64 " [0x%" PRIx64 "]\n",
+                op->inf, *num_blks, *num_blks);
+    return 0;
+}
+
+/* Returns starting LBA of next command for this thread */
+static int64_t
+bench_next_lba(const struct bench_opts_t * op, struct bench_thr_t * tp)
+{
+    int64_t lba;
+
+    switch (op->pattern) {
+    case PAT_SEQ:
+        lba = tp->seq_lba;
+        tp->seq_lba += op->bpt;
+        if ((tp->seq_lba + op->bpt) > tp->seq_end)
+            tp->seq_lba = tp->seq_start;        /* wrap within slice */
+        return lba;
+    case PAT_RAND:
+        if (op->range > op->bpt) {
+            uint64_t slots = (op->bpt > 0) ? (op->range / op->bpt) :
+                                             op->range;
+
+            lba = (int64_t)(bench_rand(&tp->rnd_state) % slots);
+            return op->skip + ((op->bpt > 0) ? lba * op->bpt : lba);
+        }
+        return op->skip;
+    case PAT_SAME:
+    default:
+        return op->skip;
+    }
+}
+
+/* Same categories as returned by sg_bread() */
+static int
+bench_chk_hdr(struct sg_io_hdr * hp, bool is_write)
+{
+    const char * leadin = is_write ? "writing" : "reading";
+
+    switch (sg_err_category3(hp)) {
+    case SG_LIB_CAT_CLEAN:
+        return 0;
+    case SG_LIB_CAT_RECOVERED:
+        if (verbose > 1)
+            sg_chk_n_print3(leadin, hp, true);
+        return 0;
+    case SG_LIB_CAT_UNIT_ATTENTION:
+        if (verbose)
+            sg_chk_n_print3(leadin, hp, (verbose > 1));
+        return 2;
+    case SG_LIB_CAT_ABORTED_COMMAND:
+        if (verbose)
+            sg_chk_n_print3(leadin, hp, (verbose > 1));
+        return 3;
+    case SG_LIB_CAT_NOT_READY:
+        if (verbose)
+            sg_chk_n_print3(leadin, hp, (verbose > 1));
+        return -2;
+    case SG_LIB_CAT_MEDIUM_HARD:
+        if (verbose)
+            sg_chk_n_print3(leadin, hp, (verbose > 1));
+        return -3;
+    default:
+        sg_chk_n_print3(leadin, hp, !! verbose);
+        return -1;
+    }
+}
+
+static int
+bench_res2ret(int res)
+{
+    switch (res) {
+    case -3:
+        return SG_LIB_CAT_MEDIUM_HARD;
+    case -2:
+        return SG_LIB_CAT_NOT_READY;
+    case 2:
+        return SG_LIB_CAT_UNIT_ATTENTION;
+    case 3:
+        return SG_LIB_CAT_ABORTED_COMMAND;
+    default:
+        return SG_LIB_CAT_OTHER;
+    }
+}
+
+/* Builds the SCSI command in slot 'sp' and either queues it (sg device via
+ * write()) or executes it (SG_IO ioctl or pread()/pwrite()). Returns 0 on
+ * success, an errno value if the submission failed or -1 on a cdb build
+ * error. */
+static int
+bench_submit(int fd, const struct bench_opts_t * op, struct bench_slot_t * sp,
+             int64_t lba, bool use_async)
+{
+    int n;
+    struct sg_io_hdr * hp = &sp->io_hdr;
+
+    sp->start_ns = sg_par_mono_ns();
+    if (! (FT_SG & op->in_type)) {
+        off_t off = (off_t)lba * op->bs;
+        int num = sp->blocks * op->bs;
+
+        do {
+            n = sp->is_write ? pwrite(fd, sp->buffp, num, off) :
+                               pread(fd, sp->buffp, num, off);
+        } while ((n < 0) && (EINTR == errno));
+        if (n < 0)
+            return errno;
+        if (n < num)
+            return EIO;         /* short transfer, treat as an error */
+        return 0;
+    }
+    if (sg_build_scsi_cdb(sp->cdb, op->cdbsz, sp->blocks, lba, sp->is_write,
+                          op->fua, op->dpo))
+        return -1;
+    memset(hp, 0, sizeof(*hp));
+    hp->interface_id = 'S';
+    hp->cmd_len = op->cdbsz;
+    hp->cmdp = sp->cdb;
+    if (sp->blocks > 0) {
+        hp->dxfer_direction = sp->is_write ? SG_DXFER_TO_DEV :
+                                             SG_DXFER_FROM_DEV;
+        hp->dxfer_len = op->bs * sp->blocks;
+        if (! op->do_mmap)
+            hp->dxferp = sp->buffp;
+        if (op->dio)
+            hp->flags |= SG_FLAG_DIRECT_IO;
+        else if (op->do_mmap)
+            hp->flags |= SG_FLAG_MMAP_IO;
+        else if (op->no_dxfer)
+            hp->flags |= SG_FLAG_NO_DXFER;
+    } else
+        hp->dxfer_direction = SG_DXFER_NONE;
+    hp->mx_sb_len = SENSE_BUFF_LEN;
+    hp->sbp = sp->sense;
+    hp->timeout = DEF_TIMEOUT;
+    hp->usr_ptr = sp;
+    if (verbose > 2) {
+        char b[128];
+
+        sg_par_lock();
+        pr2serr("    %s cdb: %s\n", (sp->is_write ? "WRITE" : "READ"),
+                sg_get_command_str(sp->cdb, op->cdbsz, false, sizeof(b), b));
+        sg_par_unlock();
+    }
+    if (use_async) {
+        while (((n = write(fd, hp, sizeof(*hp))) < 0) && (EINTR == errno))
+            ;
+    } else {
+        while (((n = ioctl(fd, SG_IO, hp)) < 0) && (EINTR == errno))
+            ;
+    }
+    return (n < 0) ? errno : 0;
+}
+
+/* Waits for a command queued by bench_submit() to finish. Returns the slot
+ * (via *spp) and 0, or an errno value. */
+static int
+bench_reap(int fd, struct bench_slot_t ** spp)
+{
+    int n;
+    struct sg_io_hdr io_hdr;
+
+    memset(&io_hdr, 0, sizeof(io_hdr));
+    io_hdr.interface_id = 'S';
+    io_hdr.pack_id = -1;        /* any completed command will do */
+    while (((n = read(fd, &io_hdr, sizeof(io_hdr))) < 0) && (EINTR == errno))
+        ;
+    if (n < 0)
+        return errno;
+    *spp = (struct bench_slot_t *)io_hdr.usr_ptr;
+    (*spp)->io_hdr = io_hdr;
+    return 0;
+}
+
+static bool
+bench_more(const struct bench_opts_t * op, const struct bench_thr_t * tp,
+           uint64_t deadline)
+{
+    if (bench_stop || tp->res || (0 == tp->cmds_left))
+        return false;
+    if (op->runtime_ns && (sg_par_mono_ns() >= deadline))
+        return false;
+    return true;
+}
+
+/* Accounts for a finished command in slot 'sp' whose sg_bread() style
+ * result is 'res'. */
+static void
+bench_account(const struct bench_opts_t * op, struct bench_thr_t * tp,
+              const struct bench_slot_t * sp, int res, uint64_t now)
+{
+    if (0 == res) {
+        sg_par_lat_add(&tp->lat, now - sp->start_ns);
+        if (sp->is_write)
+            ++tp->wr_cmds;
+        else
+            ++tp->rd_cmds;
+        tp->blks += sp->blocks;
+        if (op->dio && (sp->blocks > 0) &&
+            ((sp->io_hdr.info & SG_INFO_DIRECT_IO_MASK) != SG_INFO_DIRECT_IO))
+            ++tp->dio_incomplete;
+    } else if ((2 == res) || (3 == res)) {
+        ++tp->retries;      /* re-issue (at a new LBA if not 'same') */
+        if (tp->cmds_left >= 0)
+            ++tp->cmds_left;
+    } else if (0 == tp->res)
+        tp->res = bench_res2ret(res);
+}
+
+/* Worker for sg_par_run(), one call per benchmark thread */
+static int
+bench_work(void * ctxp, int idx)
+{
+    bool use_async, ok;
+    int k, fd, flags, t, res, err, num_free, active;
+    int qd;
+    uint32_t buf_sz;
+    uint64_t deadline = 0;
+    int64_t lba;
+    struct bench_ctx_t * cp = (struct bench_ctx_t *)ctxp;
+    const struct bench_opts_t * op = cp->op;
+    struct bench_thr_t * tp = cp->thr_arr + idx;
+    struct bench_slot_t * slot_arr = NULL;
+    struct bench_slot_t * sp;
+    struct bench_slot_t ** free_arr = NULL;
+    uint8_t * mmap_p = NULL;
+
+    use_async = (FT_SG & op->in_type) && (! (FT_BLOCK & op->in_type));
+    qd = use_async ? op->qd : 1;
+    buf_sz = op->bs * (op->bpt > 0 ? op->bpt : 1);
+    flags = ((FT_SG & op->in_type) || op->rwmix) ? O_RDWR : O_RDONLY;
+    if (op->odir)
+        flags |= O_DIRECT;
+    fd = open(op->inf, flags);
+    if (fd < 0) {
+        err = errno;
+        sg_par_lock();
+        pr2serr(ME "thread %d could not open %s: %s\n", idx, op->inf,
+                safe_strerror(err));
+        sg_par_unlock();
+        tp->res = sg_convert_errno(err);
+        return tp->res;
+    }
+    if (use_async) {
+        t = buf_sz;
+        if (op->do_mmap && (0 != (t % sg_get_page_size())))
+            t = ((t / sg_get_page_size()) + 1) * sg_get_page_size();
+        if (ioctl(fd, SG_SET_RESERVED_SIZE, &t) < 0)
+            perror(ME "SG_SET_RESERVED_SIZE error");
+        res = ioctl(fd, SG_GET_VERSION_NUM, &t);
+        if ((res < 0) || (t < 30000) || (op->do_mmap && (t < 30122))) {
+            sg_par_lock();
+            pr2serr(ME "sg driver too old for this benchmark\n");
+            sg_par_unlock();
+            tp->res = SG_LIB_CAT_OTHER;
+            goto fini;
+        }
+        if (op->do_mmap) {
+            mmap_p = (uint8_t *)mmap(NULL, buf_sz, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED, fd, 0);
+            if (MAP_FAILED == mmap_p) {
+                mmap_p = NULL;
+                perror(ME "error from mmap()");
+                tp->res = SG_LIB_CAT_OTHER;
+                goto fini;
+            }
+        }
+    }
+    slot_arr = (struct bench_slot_t *)calloc(qd, sizeof(*slot_arr));
+    free_arr = (struct bench_slot_t **)calloc(qd, sizeof(*free_arr));
+    if ((NULL == slot_arr) || (NULL == free_arr)) {
+        tp->res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < qd; ++k) {
+        sp = slot_arr + k;
+        if (mmap_p)
+            sp->buffp = mmap_p;
+        else {
+            sp->buffp = sg_memalign(buf_sz, 0, &sp->free_buffp, false);
+            if (NULL == sp->buffp) {
+                tp->res = sg_convert_errno(ENOMEM);
+                goto fini;
+            }
+        }
+        free_arr[k] = sp;
+    }
+    num_free = qd;
+    active = 0;
+    tp->start_ns = sg_par_mono_ns();
+    if (op->runtime_ns)
+        deadline = tp->start_ns + op->runtime_ns;
+
+    while (true) {
+        while ((num_free > 0) && bench_more(op, tp, deadline)) {
+            sp = free_arr[--num_free];
+            sp->is_write = (op->rwmix > 0) &&
+                           ((int)(bench_rand(&tp->rnd_state) % 100) <
+                            op->rwmix);
+            sp->blocks = op->bpt;
+            lba = bench_next_lba(op, tp);
+            err = bench_submit(fd, op, sp, lba, use_async);
+            if (err) {
+                free_arr[num_free++] = sp;
+                if ((EDOM == err) && (active > 0))
+                    break;      /* sg driver queue is full, reap first */
+                tp->res = (err > 0) ? sg_convert_errno(err) :
+                                      SG_LIB_SYNTAX_ERROR;
+                sg_par_lock();
+                pr2serr(ME "thread %d: submit failed: %s\n", idx,
+                        (err > 0) ? safe_strerror(err) : "bad cdb");
+                sg_par_unlock();
+                break;
+            }
+            if (tp->cmds_left > 0)
+                --tp->cmds_left;
+            if (use_async)
+                ++active;
+            else {      /* already done */
+                free_arr[num_free++] = sp;
+                res = (FT_SG & op->in_type) ?
+                      bench_chk_hdr(&sp->io_hdr, sp->is_write) : 0;
+                bench_account(op, tp, sp, res, sg_par_mono_ns());
+            }
+        }
+        if (0 == active)
+            break;
+        err = bench_reap(fd, &sp);
+        if (err) {
+            sg_par_lock();
+            pr2serr(ME "thread %d: read() failed: %s\n", idx,
+                    safe_strerror(err));
+            sg_par_unlock();
+            if (0 == tp->res)
+                tp->res = sg_convert_errno(err);
+            break;      /* can't reliably reap the others */
+        }
+        --active;
+        free_arr[num_free++] = sp;
+        res = bench_chk_hdr(&sp->io_hdr, sp->is_write);
+        bench_account(op, tp, sp, res, sg_par_mono_ns());
+    }
+    tp->end_ns = sg_par_mono_ns();
+fini:
+    ok = (0 == tp->res);
+    if (slot_arr) {
+        for (k = 0; k < qd; ++k) {
+            if (slot_arr[k].free_buffp)
+                free(slot_arr[k].free_buffp);
+        }
+        free(slot_arr);
+    }
+    if (free_arr)
+        free(free_arr);
+    if (mmap_p)
+        munmap(mmap_p, buf_sz);
+    close(fd);
+    return ok ? 0 : tp->res;
+}
+
+static void
+bench_prt_lat(sgj_state * jsp, sgj_opaque_p jop,
+              const struct sg_par_lat_hist * lhp)
+{
+    int k;
+    uint64_t v;
+    sgj_opaque_p jo2p;
+    static const double pc_arr[] = {50.0, 90.0, 99.0, 99.9};
+    static const char * pc_nm_arr[] = {"p50", "p90", "p99", "p99_9"};
+    static const char * pc_hr_arr[] = {"p50", "p90", "p99", "p99.9"};
+
+    jo2p = sgj_named_subobject_r(jsp, jop, "latency_usecs");
+    sgj_pr_hr(jsp, "  latency (usecs): min=%" PRIu64 ", mean=%" PRIu64,
+              lhp->min / 1000,
+              (lhp->count ? (lhp->sum / lhp->count) / 1000 : 0));
+    sgj_js_nv_i(jsp, jo2p, "min", (int64_t)(lhp->min / 1000));
+    sgj_js_nv_i(jsp, jo2p, "mean",
+                (int64_t)(lhp->count ? (lhp->sum / lhp->count) / 1000 : 0));
+    for (k = 0; k < (int)SG_ARRAY_SIZE(pc_arr); ++k) {
+        v = sg_par_lat_percentile(lhp, pc_arr[k]) / 1000;
+        sgj_pr_hr(jsp, ", %s=%" PRIu64, pc_hr_arr[k], v);
+        sgj_js_nv_i(jsp, jo2p, pc_nm_arr[k], (int64_t)v);
+    }
+    sgj_pr_hr(jsp, ", max=%" PRIu64 "\n", lhp->max / 1000);
+    sgj_js_nv_i(jsp, jo2p, "max", (int64_t)(lhp->max / 1000));
+}
+
+/* Runs the benchmark and prints (or outputs as JSON) its results. Returns
+ * 0 on success, otherwise the first error reported by a thread. */
+static int
+do_benchmark(struct bench_opts_t * op, sgj_state * jsp)
+{
+    int k, fd, res, ret = 0;
+    int dio_incomplete = 0;
+    int retries = 0;
+    int64_t num_blks = 0;
+    int64_t per_thr, slice;
+    uint64_t rd_cmds, wr_cmds, blks, min_start, max_end, rnd_seed;
+    double secs, iops, mbps;
+    struct bench_thr_t * thr_arr;
+    struct bench_ctx_t ctx;
+    struct sg_par_lat_hist lat_all;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p jap = NULL;
+
+    if (op->pattern != PAT_SAME) {
+        if (op->range <= 0) {
+            fd = open(op->inf, O_RDONLY | O_NONBLOCK);
+            if (fd < 0) {
+                res = errno;
+                pr2serr(ME "could not open %s: %s\n", op->inf,
+                        safe_strerror(res));
+                return sg_convert_errno(res);
+            }
+            res = bench_capacity(fd, op, &num_blks);
+            close(fd);
+            if (res) {
+                pr2serr(ME "unable to find capacity of %s, try 'range='\n",
+                        op->inf);
+                return res;
+            }
+            op->range = num_blks - op->skip;
+        }
+        if (op->range < ((op->bpt > 0) ? op->bpt : 1)) {
+            pr2serr(ME "range (after skip) smaller than one transfer\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (((op->skip + op->range) > 0xffffffffLL) && (op->cdbsz < 16)) {
+            if (verbose)
+                pr2serr("Range exceeds 32 bits so use 16 byte cdbs\n");
+            op->cdbsz = 16;
+        }
+    }
+    thr_arr = (struct bench_thr_t *)calloc(op->num_threads,
+                                           sizeof(*thr_arr));
+    if (NULL == thr_arr) {
+        pr2serr(ME "out of memory\n");
+        return sg_convert_errno(ENOMEM);
+    }
+    rnd_seed = sg_par_mono_ns() ^ ((uint64_t)getpid() << 32);
+    slice = op->range / op->num_threads;
+    if (op->bpt > 0)
+        slice -= slice % op->bpt;
+    per_thr = (op->total_cmds < 0) ? -1 : op->total_cmds / op->num_threads;
+    for (k = 0; k < op->num_threads; ++k) {
+        struct bench_thr_t * tp = thr_arr + k;
+
+        tp->rnd_state = rnd_seed + ((uint64_t)(k + 1) * 0x9e3779b97f4a7c15ULL);
+        if (0 == tp->rnd_state)
+            tp->rnd_state = 1;
+        if (slice >= op->bpt) {
+            tp->seq_start = op->skip + (k * slice);
+            tp->seq_end = tp->seq_start + slice;
+        } else {        /* range too small, all threads share it */
+            tp->seq_start = op->skip;
+            tp->seq_end = op->skip + op->range;
+        }
+        tp->seq_lba = tp->seq_start;
+        tp->cmds_left = per_thr;
+        if ((per_thr >= 0) && (k < (op->total_cmds % op->num_threads)))
+            ++tp->cmds_left;
+    }
+    if (verbose)
+        pr2serr("Starting %d thread%s, queue depth %d, pattern=%s, "
+                "rwmix=%d%%\n", op->num_threads,
+                (op->num_threads > 1 ? "s" : ""), op->qd,
+                pattern_arr[op->pattern], op->rwmix);
+    install_handler(SIGINT, bench_interrupt_handler);
+    install_handler(SIGQUIT, bench_interrupt_handler);
+    install_handler(SIGPIPE, bench_interrupt_handler);
+    ctx.op = op;
+    ctx.thr_arr = thr_arr;
+    res = sg_par_run(op->num_threads, op->num_threads, bench_work, NULL,
+                     &ctx);
+    if (res) {
+        pr2serr(ME "unable to start threads: %s\n", safe_strerror(res));
+        free(thr_arr);
+        return sg_convert_errno(res);
+    }
+
+    sg_par_lat_init(&lat_all);
+    rd_cmds = 0;
+    wr_cmds = 0;
+    blks = 0;
+    min_start = 0;
+    max_end = 0;
+    for (k = 0; k < op->num_threads; ++k) {
+        const struct bench_thr_t * tp = thr_arr + k;
+
+        if (tp->res && (0 == ret))
+            ret = tp->res;
+        if (0 == tp->start_ns)
+            continue;   /* did not get as far as starting */
+        if ((0 == min_start) || (tp->start_ns < min_start))
+            min_start = tp->start_ns;
+        if (tp->end_ns > max_end)
+            max_end = tp->end_ns;
+        rd_cmds += tp->rd_cmds;
+        wr_cmds += tp->wr_cmds;
+        blks += tp->blks;
+        retries += tp->retries;
+        dio_incomplete += tp->dio_incomplete;
+        sg_par_lat_merge(&lat_all, &tp->lat);
+    }
+    secs = (max_end > min_start) ? (max_end - min_start) / 1000000000.0 : 0.0;
+    iops = (secs > 0.0) ? (rd_cmds + wr_cmds) / secs : 0.0;
+    mbps = (secs > 0.0) ? ((double)blks * op->bs) / (secs * 1000000.0) : 0.0;
+
+    if (jsp->pr_as_json) {
+        jop = sgj_named_subobject_r(jsp, NULL, "benchmark");
+        sgj_js_nv_s(jsp, jop, "device", op->inf);
+        sgj_js_nv_s(jsp, jop, "pattern", pattern_arr[op->pattern]);
+        sgj_js_nv_i(jsp, jop, "threads", op->num_threads);
+        sgj_js_nv_i(jsp, jop, "queue_depth", op->qd);
+        sgj_js_nv_i(jsp, jop, "block_size", op->bs);
+        sgj_js_nv_i(jsp, jop, "blocks_per_transfer", op->bpt);
+        sgj_js_nv_i(jsp, jop, "write_percent", op->rwmix);
+        sgj_js_nv_i(jsp, jop, "skip", op->skip);
+        sgj_js_nv_i(jsp, jop, "range", op->range);
+        sgj_js_nv_b(jsp, jop, "interrupted", !! bench_stop);
+    }
+    sgj_pr_hr(jsp, "Benchmark on %s: pattern=%s, threads=%d, qd=%d, bs=%d, "
+              "bpt=%d, rwmix=%d%%\n", op->inf, pattern_arr[op->pattern],
+              op->num_threads, op->qd, op->bs, op->bpt, op->rwmix);
+    sgj_pr_hr(jsp, "  elapsed: %.3f secs, commands: %" PRIu64 " (reads: %"
+              PRIu64 ", writes: %" PRIu64 "), retries: %d\n", secs,
+              rd_cmds + wr_cmds, rd_cmds, wr_cmds, retries);
+    sgj_pr_hr(jsp, "  IOPS: %.1f, bandwidth: %.2f MB/sec\n", iops, mbps);
+    sgj_js_nv_i(jsp, jop, "elapsed_usecs",
+                (int64_t)((max_end > min_start) ?
+                          (max_end - min_start) / 1000 : 0));
+    sgj_js_nv_i(jsp, jop, "read_commands", (int64_t)rd_cmds);
+    sgj_js_nv_i(jsp, jop, "write_commands", (int64_t)wr_cmds);
+    sgj_js_nv_i(jsp, jop, "retries", retries);
+    sgj_js_nv_i(jsp, jop, "bytes_transferred", (int64_t)(blks * op->bs));
+    sgj_js_nv_i(jsp, jop, "iops", (int64_t)(iops + 0.5));
+    sgj_js_nv_i(jsp, jop, "bandwidth_bytes_per_sec",
+                (int64_t)(mbps * 1000000.0));
+    bench_prt_lat(jsp, jop, &lat_all);
+    if (jsp->pr_as_json)
+        jap = sgj_named_subarray_r(jsp, jop, "thread_list");
+    for (k = 0; k < op->num_threads; ++k) {
+        const struct bench_thr_t * tp = thr_arr + k;
+        sgj_opaque_p jo2p;
+
+        if (verbose)
+            sgj_pr_hr(jsp, "  thread %d: reads=%" PRIu64 ", writes=%" PRIu64
+                      ", p99=%" PRIu64 " usecs, result=%d\n", k, tp->rd_cmds,
+                      tp->wr_cmds,
+                      sg_par_lat_percentile(&tp->lat, 99.0) / 1000,
+                      tp->res);
+        if (NULL == jap)
+            continue;
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo2p, "thread_index", k);
+        sgj_js_nv_i(jsp, jo2p, "read_commands", (int64_t)tp->rd_cmds);
+        sgj_js_nv_i(jsp, jo2p, "write_commands", (int64_t)tp->wr_cmds);
+        sgj_js_nv_i(jsp, jo2p, "p99_usecs",
+                    (int64_t)(sg_par_lat_percentile(&tp->lat, 99.0) / 1000));
+        sgj_js_nv_i(jsp, jo2p, "result", tp->res);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    if (dio_incomplete)
+        pr2serr(">> Direct IO requested but incomplete %d times\n",
+                dio_incomplete);
+    free(thr_arr);
+    return ret;
+}
+
+/* Checks benchmark options, runs it then outputs JSON if requested */
+static int
+bench_main(struct bench_opts_t * op, bool blk_sgio, bool quick, bool do_json,
+           const char * json_arg, const char * js_file, int argc,
+           char * argv[])
+{
+    int ret;
+    sgj_state json_st SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &json_st;
+
+    if (! op->inf[0]) {
+        pr2serr("must provide 'if=<filename>'\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (0 == strcmp("-", op->inf)) {
+        pr2serr("'-' (stdin) invalid as <filename>\n");
+        usage();
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    op->in_type = dd_filetype(op->inf);
+    if (FT_ERROR == op->in_type) {
+        pr2serr("Unable to access: %s\n", op->inf);
+        return SG_LIB_FILE_ERROR;
+    } else if ((FT_BLOCK & op->in_type) && blk_sgio)
+        op->in_type |= FT_SG;
+    if (op->dio && op->do_mmap) {
+        pr2serr("cannot select both dio and mmap\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->no_dxfer && (op->dio || op->do_mmap)) {
+        pr2serr("cannot select no_dxfer with dio or mmap\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if ((op->qd > 1) && ((FT_BLOCK & op->in_type) ||
+                         (! (FT_SG & op->in_type)))) {
+        pr2serr("qd greater than 1 needs a sg device, use threads "
+                "instead\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->do_mmap && ((op->qd > 1) || (FT_BLOCK & op->in_type) ||
+                        (! (FT_SG & op->in_type)))) {
+        pr2serr("mmap-ed IO needs a sg device and qd=1 (one reserved "
+                "buffer)\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if ((0 == op->bpt) && (! (FT_SG & op->in_type))) {
+        pr2serr(ME "zero block transfers only supported with SCSI "
+                "commands\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((0 == op->bpt) && (6 == op->cdbsz)) {
+        pr2serr(ME "SCSI READ (6) can't do zero block reads\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if (do_json) {
+        if (! sgj_init_state(jsp, json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char) {
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            }
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+    }
+    if ((op->rwmix > 0) && (! quick))
+        sg_warn_and_wait("WRITE", op->inf, false);
+
+    ret = do_benchmark(op, jsp);
+
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp->pr_as_json) {
+        FILE * fp = stdout;
+
+        if (js_file) {
+            if ((1 != strlen(js_file)) || ('-' != js_file[0])) {
+                fp = fopen(js_file, "w");   /* truncate if exists */
+                if (NULL == fp) {
+                    int e = errno;
+
+                    pr2serr("unable to open file: %s [%s]\n", js_file,
+                            safe_strerror(e));
+                    ret = sg_convert_errno(e);
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        if (fp)
+            sgj_js2file(jsp, NULL, ret, fp);
+        if (js_file && fp && (stdout != fp))
+            fclose(fp);
+        sgj_finish(jsp);
+    }
+    if (ret && (0 == verbose)) {
+        if (! sg_if_can2stderr("sg_read benchmark failed: ", ret))
+            pr2serr("Some error occurred, try again with '-v' or '-vv' for "
+                    "more information\n");
+    }
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
 {
+    bool bench = false;
     bool count_given = false;
     bool dio_tmp;
     bool do_blk_sgio = false;
@@ -417,6 +1282,8 @@ main(int argc, char * argv[])
     bool dpo = false;
     bool fua = false;
     bool no_dxfer = false;
+    bool do_json = false;
+    bool do_quick = false;
     bool verbose_given = false;
     bool version_given = false;
     int bs = 0;
@@ -428,7 +1295,13 @@ main(int argc, char * argv[])
     int scsi_cdbsz = DEF_SCSI_CDBSZ;
     int res, k, t, buf_sz, iters, infd, blocks, flags, blocks_per, err;
     int n, keylen;
+    int num_threads = 1;
+    int qd = 1;
+    int pattern = PAT_SAME;
+    int rwmix = 0;
+    int runtime = 0;
     size_t psz;
+    int64_t range = 0;
     int64_t skip = 0;
     char * key;
     char * buf;
@@ -439,6 +1312,8 @@ main(int argc, char * argv[])
     char str[STR_SZ];
     char ebuff[EBUFF_SZ];
     const char * read_str;
+    const char * json_arg = NULL;
+    const char * js_file = NULL;
     struct timeval start_tm, end_tm;
 
 #if defined(HAVE_SYSCONF) && defined(_SC_PAGESIZE)
@@ -511,7 +1386,56 @@ main(int argc, char * argv[])
             no_dxfer = !! sg_get_num(buf);
         else if (0 == strcmp(key,"odir"))
             do_odir = !! sg_get_num(buf);
-        else if (strcmp(key,"of") == 0) {
+        else if (0 == strcmp(key,"pattern")) {
+            bench = true;
+            for (n = 0; n < (int)SG_ARRAY_SIZE(pattern_arr); ++n) {
+                if (0 == strcmp(buf, pattern_arr[n]))
+                    break;
+            }
+            if (n >= (int)SG_ARRAY_SIZE(pattern_arr)) {
+                pr2serr( ME "bad argument to 'pattern', expect same, seq "
+                        "or rand\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            pattern = n;
+        } else if (0 == strcmp(key,"qd")) {
+            bench = true;
+            qd = sg_get_num(buf);
+            if ((qd < 1) || (qd > MAX_BENCH_QD)) {
+                pr2serr( ME "bad argument to 'qd', expect 1 to %d\n",
+                        MAX_BENCH_QD);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key,"range")) {
+            bench = true;
+            range = sg_get_llnum(buf);
+            if ((range < 1) || (range > MAX_COUNT_SKIP_SEEK)) {
+                pr2serr( ME "bad argument to 'range'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key,"runtime")) {
+            bench = true;
+            runtime = sg_get_num(buf);
+            if (runtime < 1) {
+                pr2serr( ME "bad argument to 'runtime'\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key,"rwmix")) {
+            bench = true;
+            rwmix = sg_get_num(buf);
+            if ((rwmix < 0) || (rwmix > 100)) {
+                pr2serr( ME "bad argument to 'rwmix', expect 0 to 100\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (0 == strcmp(key,"threads")) {
+            bench = true;
+            num_threads = sg_get_num(buf);
+            if ((num_threads < 1) || (num_threads > SG_PAR_MAX_WORKERS)) {
+                pr2serr( ME "bad argument to 'threads', expect 1 to %d\n",
+                        SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+        } else if (strcmp(key,"of") == 0) {
             memcpy(outf, buf, INF_SZ - 1);
             outf[INF_SZ - 1] = '\0';
         } else if (0 == strcmp(key,"skip")) {
@@ -528,7 +1452,19 @@ main(int argc, char * argv[])
         } else if (0 == strncmp(key, "--help", 6)) {
             usage();
             return 0;
-        } else if (0 == strncmp(key, "--verb", 6)) {
+        } else if ((0 == strcmp(key, "--js-file")) ||
+                   (0 == strcmp(key, "--js_file"))) {
+            bench = true;
+            do_json = true;
+            js_file = argv[k] + (buf - str);    /* may not fit in str */
+        } else if (0 == strcmp(key, "--json")) {
+            bench = true;
+            do_json = true;
+            if (*buf)
+                json_arg = argv[k] + (buf - str);
+        } else if (0 == strcmp(key, "--quick"))
+            do_quick = true;
+        else if (0 == strncmp(key, "--verb", 6)) {
             verbose_given = true;
             ++verbose;
         } else if (0 == strncmp(key, "--vers", 6))
@@ -540,6 +1476,16 @@ main(int argc, char * argv[])
                 usage();
                 return 0;
             }
+            n = num_chs_in_str(key + 1, keylen - 1, 'j');
+            if (n > 0) {
+                bench = true;
+                do_json = true;
+            }
+            res += n;
+            n = num_chs_in_str(key + 1, keylen - 1, 'q');
+            if (n > 0)
+                do_quick = true;
+            res += n;
             n = num_chs_in_str(key + 1, keylen - 1, 'v');
             if (n > 0)
                 verbose_given = true;
@@ -587,6 +1533,42 @@ main(int argc, char * argv[])
         if ((dd_count > 0) && (bpt > 0))
             pr2serr( "Assume default 'bs' (block size) of %d bytes\n", bs);
     }
+    if (bench) {
+        struct bench_opts_t bench_op;
+
+        if ((! count_given) && (0 == runtime)) {
+            pr2serr("benchmark needs 'count' and/or 'runtime'\n");
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        memset(&bench_op, 0, sizeof(bench_op));
+        bench_op.inf = inf;
+        bench_op.bs = bs;
+        bench_op.bpt = bpt;
+        bench_op.cdbsz = scsi_cdbsz;
+        bench_op.skip = skip;
+        bench_op.range = range;
+        bench_op.num_threads = num_threads;
+        bench_op.qd = qd;
+        bench_op.pattern = pattern;
+        bench_op.rwmix = rwmix;
+        bench_op.runtime_ns = (uint64_t)runtime * 1000000000;
+        bench_op.dio = do_dio;
+        bench_op.do_mmap = do_mmap;
+        bench_op.no_dxfer = no_dxfer;
+        bench_op.odir = do_odir;
+        bench_op.fua = fua;
+        bench_op.dpo = dpo;
+        if (! count_given)
+            bench_op.total_cmds = -1;
+        else if ((dd_count < 0) || (0 == bpt)) {
+            bench_op.bpt = 0;   /* zero block SCSI READs */
+            bench_op.total_cmds = (dd_count < 0) ? -dd_count : dd_count;
+        } else
+            bench_op.total_cmds = (dd_count + bpt - 1) / bpt;
+        return bench_main(&bench_op, do_blk_sgio, do_quick, do_json,
+                          json_arg, js_file, argc, argv);
+    }
     if (! count_given) {
         pr2serr("'count' must be given\n");
         usage();
@@ -33,13 +33,14 @@
 #include "sg_pt.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
 /*
  * This utility issues the SCSI READ BUFFER(10 or 16) command to the given
  * device.
  */
 
-static const char * version_str = "1.36 20230622";      /* spc6r06 */
+static const char * version_str = "1.37 20231031";      /* spc6r06 */
 
 #ifndef SG_READ_BUFFER_10_CMD
 #define SG_READ_BUFFER_10_CMD 0x3c
@@ -64,10 +65,14 @@ static const char * version_str = "1.36 20230622";      /* spc6r06 */
 #define SENSE_BUFF_LEN  64      /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT  60      /* 60 seconds */
 #define DEF_RESPONSE_LEN 4      /* increased to 64 for MODE_ERR_HISTORY */
+#define DEF_STREAM_CHUNK (512 * 1024)   /* bytes per READ BUFFER when
+                                         * streaming with --out=OF */
+#define EH_DIR_MAX_LEN (32 + (256 * 8)) /* error history directory */
 
 
 static const struct option long_options[] = {
     {"16", no_argument, 0, 'L'},
+    {"chunk", required_argument, 0, 'c'},
     {"eh_code", required_argument, 0, 'e'},
     {"eh-code", required_argument, 0, 'e'},
     {"help", no_argument, 0, 'h'},
@@ -75,11 +80,14 @@ static const struct option long_options[] = {
     {"id", required_argument, 0, 'i'},
     {"inhex", required_argument, 0, 'I'},
     {"length", required_argument, 0, 'l'},
+    {"list", required_argument, 0, 'f'},
     {"long", no_argument, 0, 'L'},
     {"mode", required_argument, 0, 'm'},
     {"no_output", no_argument, 0, 'N'},
     {"no-output", no_argument, 0, 'N'},
     {"offset", required_argument, 0, 'o'},
+    {"out", required_argument, 0, 'O'},
+    {"parallel", required_argument, 0, 'P'},
     {"raw", no_argument, 0, 'r'},
     {"readonly", no_argument, 0, 'R'},
     {"specific", required_argument, 0, 'S'},
@@ -100,6 +108,7 @@ struct opts_t {
     bool verbose_given;
     bool version_given;
     int sg_fd;
+    int chunk;          /* --chunk=CS */
     int do_help;
     int do_hex;
     int eh_code;
@@ -107,26 +116,36 @@ struct opts_t {
     int rb_len;
     int rb_mode;
     int rb_mode_sp;
+    int num_workers;    /* --parallel=P */
     int verbose;
+    int64_t rb_total;   /* --length=LEN when streaming */
     uint64_t rb_offset;
     const char * device_name;
     const char * inhex_name;
+    const char * list_fn;
+    const char * out_name;      /* --out=OF, streaming capture */
+    struct sg_par_dev_list dev_list;
 };
 
 
 static void
 usage()
 {
-    pr2serr("Usage: sg_read_buffer [--16] [--eh_code=EHC] [--help] [--hex] "
-            "[--id=ID]\n"
-            "                      [--inhex=FN] [--length=LEN] [--long] "
-            "[--mode=MO]\n"
-            "                      [--no_output] [--offset=OFF] [--raw] "
+    pr2serr("Usage: sg_read_buffer [--16] [--chunk=CS] [--eh_code=EHC] "
+            "[--help] [--hex]\n"
+            "                      [--id=ID] [--inhex=FN] [--length=LEN] "
+            "[--list=LF]\n"
+            "                      [--long] [--mode=MO] [--no_output] "
+            "[--offset=OFF]\n"
+            "                      [--out=OF] [--parallel=P] [--raw] "
             "[--readonly]\n"
             "                      [--specific=MS] [--verbose] [--version] "
             "DEVICE\n"
+            "                      [DEVICE...]\n"
             "  where:\n"
             "    --16|-L             issue READ BUFFER(16) (def: 10)\n"
+            "    --chunk=CS|-c CS    with --out=OF, bytes per READ BUFFER "
+            "(def: %d)\n"
             "    --eh_code=EHC|-e EHC    same as '-m eh -i EHC' where "
             "EHC is the\n"
             "                            error history code\n"
@@ -139,11 +158,23 @@ usage()
             "then binary\n"
             "    --length=LEN|-l LEN    length in bytes to read (def: 4, "
             "64 for eh)\n"
+            "                           with --out=OF, total length (def: "
+            "as reported)\n"
+            "    --list=LF|-f LF     read device names (or globs) from LF, "
+            "one per\n"
+            "                        line ('-' for stdin)\n"
             "    --long|-L           issue READ BUFFER(16) (def: 10)\n"
             "    --mode=MO|-m MO     read buffer mode, MO is number or "
             "acronym (def: 0)\n"
             "    --no_output|-N      perform the command then exit\n"
             "    --offset=OFF|-o OFF    buffer offset (unit: bytes, def: 0)\n"
+            "    --out=OF|-O OF      stream the buffer to file OF in chunks "
+            "('-' for\n"
+            "                        stdout); a directory when several "
+            "DEVICEs\n"
+            "    --parallel=P|-P P    with several DEVICEs, number captured "
+            "at the\n"
+            "                         same time (def: %d)\n"
             "    --raw|-r            output response in binary to stdout\n"
             "    --readonly|-R       open DEVICE read-only (def: read-write)\n"
             "    --specific=MS|-S MS    mode specific value; 3 bit field (0 "
@@ -152,7 +183,7 @@ usage()
             "    --version|-V        print version string and exit\n\n"
             "Performs a SCSI READ BUFFER (10 or 16) command. Use '-m xxx' to "
             "list\navailable modes. Some responses are decoded, others are "
-            "output in hex.\n"
+            "output in hex.\n", DEF_STREAM_CHUNK, SG_PAR_DEF_WORKERS
            );
 }
 
@@ -494,6 +525,305 @@ dStrRaw(const uint8_t * str, int len)
         printf("%c", str[k]);
 }
 
+/* Per device state for streaming capture */
+struct rb_dev_t {
+    int res;
+    int num_cmds;
+    int64_t bytes;
+    uint64_t elapsed_ns;
+    const char * name;
+    char * out_name;
+};
+
+struct rb_stream_t {
+    const struct opts_t * op;
+    struct rb_dev_t * dev_arr;
+};
+
+/* Returns the number of bytes in the buffer being captured, or -1 if the
+ * device doesn't say. For error history buffers that comes from the error
+ * history directory, otherwise it is the buffer capacity from descriptor
+ * mode, in which case the offset boundary is placed in *boundp. 'bp' must
+ * have room for EH_DIR_MAX_LEN bytes. */
+static int64_t
+stream_buffer_len(const struct opts_t * op, uint8_t * bp, int * boundp)
+{
+    int k, num, resid, res;
+    const uint8_t * up;
+    struct opts_t dop = *op;
+
+    *boundp = -1;
+    dop.rb_offset = 0;
+    dop.rb_mode_sp = 0;
+    resid = 0;
+    if (MODE_ERR_HISTORY == op->rb_mode) {
+        if ((op->rb_id < 0x10) || (op->rb_id > 0xef))
+            return -1;
+        dop.rb_id = 0;          /* directory */
+        dop.rb_len = EH_DIR_MAX_LEN;
+        res = sg_ll_read_buffer_10(bp, &resid, false, &dop);
+        if (res || ((dop.rb_len - resid) < 32))
+            return -1;
+        num = (dop.rb_len - resid - 32) / 8;
+        for (k = 0, up = bp + 32; k < num; ++k, up += 8) {
+            if (op->rb_id == up[0])
+                return sg_get_unaligned_be32(up + 4);
+        }
+        return -1;
+    }
+    dop.rb_mode = MODE_DESCRIPTOR;
+    dop.rb_len = 4;
+    res = sg_ll_read_buffer_10(bp, &resid, false, &dop);
+    if (res || resid)
+        return -1;
+    *boundp = bp[0];
+    return sg_get_unaligned_be24(bp + 1);
+}
+
+/* Captures one buffer from DEVICE dp->name into file dp->out_name ("-" for
+ * stdout) with a sequence of READ BUFFER commands, each at most op->chunk
+ * bytes long. One chunk sized buffer is reused so memory use doesn't
+ * depend on the size of the captured buffer. Capture stops at the length
+ * given by --length=LEN or reported by the device, at the first short
+ * transfer, or (if the length is unknown) at the first ILLEGAL REQUEST. */
+static int
+stream_one(const struct opts_t * op, struct rb_dev_t * dp)
+{
+    bool to_stdout = (0 == strcmp(dp->out_name, "-"));
+    int n, res, resid, bound, chunk;
+    int ret = 0;
+    int out_fd = -1;
+    int64_t total, off;
+    ssize_t w;
+    uint8_t * bp = NULL;
+    uint8_t * free_bp = NULL;
+    struct opts_t lop = *op;    /* per device copy, holds sg_fd */
+
+    lop.verbose = (op->verbose > 1) ? op->verbose - 1 : 0;
+    lop.sg_fd = sg_cmds_open_device(dp->name, op->o_readonly, lop.verbose);
+    if (lop.sg_fd < 0)
+        return sg_convert_errno(-lop.sg_fd);
+    chunk = op->chunk;
+    /* enough to find the buffer length, resized once chunk is known */
+    bp = (uint8_t *)sg_memalign(EH_DIR_MAX_LEN, 0, &free_bp, false);
+    if (NULL == bp) {
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    if (op->rb_total > 0) {
+        total = op->rb_total + (int64_t)op->rb_offset;
+        bound = -1;
+    } else
+        total = stream_buffer_len(&lop, bp, &bound);
+    if (0xff == bound)          /* only a buffer offset of 0 allowed */
+        chunk = (total > 0) ? (int)total : chunk;
+    else if ((bound >= 0) && (bound < 24)) {
+        chunk &= ~((1 << bound) - 1);
+        if (0 == chunk)
+            chunk = 1 << bound;
+    }
+    if (chunk > 0xffffff)
+        chunk = 0xffffff;       /* READ BUFFER(10) allocation length */
+    if (chunk > EH_DIR_MAX_LEN) {
+        free(free_bp);
+        free_bp = NULL;
+        bp = (uint8_t *)sg_memalign(chunk, 0, &free_bp, false);
+        if (NULL == bp) {
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+    }
+    if (op->verbose) {
+        sg_par_lock();
+        pr2serr("%s: buffer length %" PRId64 ", chunk %d bytes\n", dp->name,
+                total, chunk);
+        sg_par_unlock();
+    }
+    if (to_stdout)
+        out_fd = STDOUT_FILENO;
+    else {
+        out_fd = open(dp->out_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0) {
+            ret = sg_convert_errno(errno);
+            goto fini;
+        }
+    }
+    if (sg_set_binary_mode(out_fd) < 0)
+        perror("sg_set_binary_mode");
+    for (off = (int64_t)op->rb_offset; (total < 0) || (off < total);
+         off += n) {
+        n = chunk;
+        if ((total > 0) && ((total - off) < n))
+            n = (int)(total - off);
+        if ((! op->do_long) && ((off + n - 1) > 0xffffff)) {
+            sg_par_lock();
+            pr2serr("%s: offset 0x%" PRIx64 " too large for READ BUFFER(10), "
+                    "try --16\n", dp->name, off);
+            sg_par_unlock();
+            ret = SG_LIB_SYNTAX_ERROR;
+            break;
+        }
+        lop.rb_offset = off;
+        lop.rb_len = n;
+        resid = 0;
+        if (op->do_long)
+            res = sg_ll_read_buffer_16(bp, &resid, (lop.verbose > 0), &lop);
+        else
+            res = sg_ll_read_buffer_10(bp, &resid, (lop.verbose > 0), &lop);
+        ++dp->num_cmds;
+        if (res) {
+            /* with no length, running off the end of the buffer is EOF */
+            if (! ((total < 0) && (SG_LIB_CAT_ILLEGAL_REQ == res) &&
+                   (dp->bytes > 0)))
+                ret = (res > 0) ? res : SG_LIB_CAT_OTHER;
+            break;
+        }
+        if ((resid < 0) || (resid > n))
+            resid = 0;
+        n -= resid;
+        w = (n > 0) ? write(out_fd, bp, n) : 0;
+        if (w < n) {
+            ret = (w < 0) ? sg_convert_errno(errno) : SG_LIB_FILE_ERROR;
+            break;
+        }
+        dp->bytes += n;
+        if ((resid > 0) || (0 == n))
+            break;              /* short transfer: end of buffer */
+    }
+fini:
+    if ((out_fd >= 0) && (! to_stdout))
+        close(out_fd);
+    if (free_bp)
+        free(free_bp);
+    sg_cmds_close_device(lop.sg_fd);
+    return ret;
+}
+
+/* Worker for sg_par_run(), captures from dev_arr[idx] */
+static int
+stream_work(void * ctxp, int idx)
+{
+    struct rb_stream_t * sp = (struct rb_stream_t *)ctxp;
+    struct rb_dev_t * dp = sp->dev_arr + idx;
+    uint64_t start_ns = sg_par_mono_ns();
+
+    dp->res = stream_one(sp->op, dp);
+    dp->elapsed_ns = sg_par_mono_ns() - start_ns;
+    return dp->res;
+}
+
+/* Called (serialized) as each device's capture completes */
+static void
+stream_done(void * ctxp, int idx, int res)
+{
+    struct rb_stream_t * sp = (struct rb_stream_t *)ctxp;
+    const struct rb_dev_t * dp = sp->dev_arr + idx;
+    char b[80];
+
+    if (res)
+        sg_get_category_sense_str(res, sizeof(b), b, 0);
+    else
+        snprintf(b, sizeof(b), "%s", dp->out_name);
+    printf("  %-22s %12" PRId64 " %6d %8" PRIu64 ".%03u  %s\n", dp->name,
+           dp->bytes, dp->num_cmds, dp->elapsed_ns / 1000000000,
+           (unsigned int)((dp->elapsed_ns / 1000000) % 1000), b);
+    fflush(stdout);
+}
+
+/* Streaming capture entry point, returns exit status. With one DEVICE the
+ * output goes to op->out_name; with more then op->out_name is a directory
+ * and each DEVICE's capture is written to <dir>/<basename(DEVICE)>.bin . */
+static int
+stream_capture(const struct opts_t * op)
+{
+    bool one = ((1 == op->dev_list.num) && (NULL == op->list_fn));
+    int k, n, res;
+    int ret = 0;
+    int num = op->dev_list.num;
+    int num_err = 0;
+    int64_t tot = 0;
+    uint64_t el;
+    uint64_t start_ns = sg_par_mono_ns();
+    const char * cp;
+    struct stat a_stat;
+    struct rb_dev_t * dp;
+    struct rb_stream_t strm;
+
+    if (num < 1) {
+        pr2serr("no devices to capture from\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    if ((! one) && ((0 != stat(op->out_name, &a_stat)) ||
+                    (! S_ISDIR(a_stat.st_mode)))) {
+        pr2serr("with more than one DEVICE, --out=%s must be an existing "
+                "directory\n", op->out_name);
+        return SG_LIB_FILE_ERROR;
+    }
+    memset(&strm, 0, sizeof(strm));
+    strm.op = op;
+    strm.dev_arr = (struct rb_dev_t *)calloc(num, sizeof(struct rb_dev_t));
+    if (NULL == strm.dev_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0; k < num; ++k) {
+        dp = strm.dev_arr + k;
+        dp->name = op->dev_list.names[k];
+        if (one)
+            dp->out_name = strdup(op->out_name);
+        else {
+            cp = strrchr(dp->name, '/');
+            cp = cp ? cp + 1 : dp->name;
+            n = strlen(op->out_name) + strlen(cp) + 8;
+            dp->out_name = (char *)malloc(n);
+            if (dp->out_name)
+                snprintf(dp->out_name, n, "%s/%s.bin", op->out_name, cp);
+        }
+        if (NULL == dp->out_name) {
+            pr2serr("%s: out of memory\n", __func__);
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+    }
+    if (one) {
+        dp = strm.dev_arr;
+        ret = stream_one(op, dp);
+        if (op->verbose)
+            pr2serr("%s: captured %" PRId64 " bytes with %d commands\n",
+                    dp->name, dp->bytes, dp->num_cmds);
+        goto fini;
+    }
+    printf("Capturing READ BUFFER mode=0x%x id=0x%x from %d devices, %d at "
+           "a time\n", op->rb_mode, op->rb_id, num, op->num_workers);
+    printf("  %-22s %12s %6s %12s  %s\n", "Device", "Bytes", "Cmds",
+           "Elapsed(s)", "Output");
+    res = sg_par_run(num, op->num_workers, stream_work, stream_done, &strm);
+    if (res) {
+        pr2serr("unable to start worker threads: %s\n", safe_strerror(res));
+        ret = sg_convert_errno(res);
+        goto fini;
+    }
+    for (k = 0; k < num; ++k) {
+        dp = strm.dev_arr + k;
+        tot += dp->bytes;
+        if (dp->res) {
+            ++num_err;
+            if (0 == ret)       /* first failure in list order */
+                ret = dp->res;
+        }
+    }
+    el = sg_par_mono_ns() - start_ns;
+    printf("%d devices: %d ok, %d error%s, %" PRId64 " bytes in %" PRIu64
+           ".%03u seconds\n", num, num - num_err, num_err,
+           ((1 == num_err) ? "" : "s"), tot, el / 1000000000,
+           (unsigned int)((el / 1000000) % 1000));
+fini:
+    for (k = 0; k < num; ++k)
+        free(strm.dev_arr[k].out_name);
+    free(strm.dev_arr);
+    return ret;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -515,12 +845,19 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "e:hHi:I:l:Lm:No:rRS:vV", long_options,
-                        &option_index);
+        c = getopt_long(argc, argv, "c:e:f:hHi:I:l:Lm:No:O:P:rRS:vV",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'c':
+            op->chunk = sg_get_num(optarg);
+            if ((op->chunk < 1) || (op->chunk > 0xffffff)) {
+                pr2serr("argument to '--chunk=' should be 1 to 0xffffff\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'e':
             if (op->rb_mode_given && (MODE_ERR_HISTORY != op->rb_mode)) {
                 pr2serr("mode incompatible with --eh_code= option\n");
@@ -535,6 +872,9 @@ main(int argc, char * argv[])
             op->rb_mode = MODE_ERR_HISTORY;
             op->eh_code_given = true;
             break;
+        case 'f':
+            op->list_fn = optarg;
+            break;
         case 'h':
         case '?':
             ++op->do_help;
@@ -560,15 +900,14 @@ main(int argc, char * argv[])
                 op->inhex_name = optarg;
             break;
         case 'l':
-            op->rb_len = sg_get_num(optarg);
-            if (op->rb_len < 0) {
+            ll = sg_get_llnum(optarg);
+            if (ll < 0) {
                 pr2serr("bad argument to '--length'\n");
                 return SG_LIB_SYNTAX_ERROR;
              }
-             if (op->rb_len > 0xffffff) {
-                pr2serr("argument to '--length' must be <= 0xffffff\n");
-                return SG_LIB_SYNTAX_ERROR;
-             }
+             /* only --out=OF accepts more, checked after all options */
+             op->rb_total = ll;
+             op->rb_len = (ll > 0xffffff) ? 0xffffff : (int)ll;
              op->rb_len_given = true;
              break;
         case 'L':
@@ -622,6 +961,18 @@ main(int argc, char * argv[])
         case 'N':
             op->no_output = true;
             break;
+        case 'O':
+            op->out_name = optarg;
+            break;
+        case 'P':
+            k = sg_get_num(optarg);
+            if ((k < 1) || (k > SG_PAR_MAX_WORKERS)) {
+                pr2serr("bad argument to '--parallel=', expect 1 to %d\n",
+                        SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_workers = k;
+            break;
         case 'o':
            ll = sg_get_llnum(optarg);
            if (ll < 0) {
@@ -666,15 +1017,14 @@ main(int argc, char * argv[])
         return 0;
     }
     if (optind < argc) {
-        if (NULL == op->device_name) {
+        if (NULL == op->device_name)
             op->device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
+        /* more than one DEVICE (or a glob) needs --out=OF */
+        for (; optind < argc; ++optind) {
+            ret = sg_par_dev_list_add(&op->dev_list, argv[optind],
+                                      op->verbose);
+            if (ret)
+                goto fini;
         }
     }
 
@@ -696,7 +1046,13 @@ main(int argc, char * argv[])
 #endif
     if (op->version_given) {
         pr2serr("version: %s\n", version_str);
-        return 0;
+        goto fini;
+    }
+    if (op->list_fn) {
+        ret = sg_par_dev_list_from_file(&op->dev_list, op->list_fn,
+                                        op->verbose);
+        if (ret)
+            goto fini;
     }
     if ((MODE_ERR_HISTORY == op->rb_mode) && (NULL == op->inhex_name)) {
         if (! op->rb_len_given)
@@ -710,6 +1066,32 @@ main(int argc, char * argv[])
         op->rb_id = op->eh_code;
     }
 
+    if (op->out_name) {
+        if (op->inhex_name) {
+            pr2serr("--out= and --inhex= options contradict\n");
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+        if (0 == op->chunk)
+            op->chunk = DEF_STREAM_CHUNK;
+        if (0 == op->num_workers)
+            op->num_workers = SG_PAR_DEF_WORKERS;
+        ret = stream_capture(op);
+        goto fini;
+    }
+    if ((op->dev_list.num > 1) || op->list_fn ||
+        (op->device_name && strpbrk(op->device_name, "*?["))) {
+        pr2serr("more than one DEVICE needs the --out=OF option\n");
+        ret = SG_LIB_SYNTAX_ERROR;
+        goto fini;
+    }
+    if (op->rb_total > 0xffffff) {
+        pr2serr("argument to '--length' must be <= 0xffffff, unless "
+                "--out=OF is given\n");
+        ret = SG_LIB_SYNTAX_ERROR;
+        goto fini;
+    }
+
     if (op->device_name && op->inhex_name) {
         pr2serr("Confused: both DEVICE (%s) and --inhex= option given. One "
                 "only please\n", op->device_name);
@@ -825,6 +1207,7 @@ decode_result:
     }
 
 fini:
+    sg_par_dev_list_free(&op->dev_list);
     if (free_resp)
         free(free_resp);
     if (op->sg_fd >= 0) {
@@ -41,7 +41,7 @@
  * Based on zbc2r12.pdf
  */
 
-static const char * version_str = "1.51 20230622";
+static const char * version_str = "1.52 20231029";
 
 #define MY_NAME "sg_rep_zones"
 
@@ -508,7 +508,8 @@ decode_rep_zones(const uint8_t * rzBuff, int act_len, uint32_t decod_len,
         return 0;
     }
     if (as_json)
-        jap = sgj_named_subarray_r(jsp, NULL, "zone_descriptors_list");
+        jap = sgj_named_subarray_stream_r(jsp, NULL,
+                                          "zone_descriptors_list");
     for (k = 0, bp = rzBuff + 64; k < num_zd;
          ++k, bp += REPORT_ZONES_DESC_LEN) {
         sgj_opaque_p jo2p;
@@ -603,7 +604,7 @@ decode_rep_realms(const uint8_t * rzBuff, int act_len, struct opts_t * op,
     if (op->do_num > 0)
             realms_count = (realms_count > (uint32_t)op->do_num) ?
                                 (uint32_t)op->do_num : realms_count;
-    jap = sgj_named_subarray_r(jsp, jop, "realm_descriptors_list");
+    jap = sgj_named_subarray_stream_r(jsp, jop, "realm_descriptors_list");
 
     for (k = 0, bp = rzBuff + 64; k < realms_count; ++k, bp += r_desc_len) {
         uint32_t j;
@@ -685,7 +686,8 @@ decode_rep_zdomains(const uint8_t * rzBuff, int act_len, struct opts_t * op,
     if (op->vb > 1)
         pr2serr("Derived zdomains=%u\n", der_zdoms);
     num = ((der_zdoms < zdoms_rep) ? der_zdoms : zdoms_rep) * 96;
-    jap = sgj_named_subarray_r(jsp, jop, "zone_domain_descriptors_list");
+    jap = sgj_named_subarray_stream_r(jsp, jop,
+                                      "zone_domain_descriptors_list");
 
     for (k = 0, bp = rzBuff + 64; k < num; k += 96, bp += 96) {
         uint64_t lba;
@@ -1230,6 +1232,7 @@ main(int argc, char * argv[])
     uint8_t * rzBuff = NULL;
     uint8_t * free_rzbp = NULL;
     const char * cmd_name = "Report zones";
+    FILE * js_fp = NULL;
     sgj_state * jsp;
     sgj_opaque_p jop = NULL;
     char b[80];
@@ -1447,6 +1450,26 @@ main(int argc, char * argv[])
         jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
     }
     as_json = jsp->pr_as_json;
+    if (as_json) {
+        js_fp = stdout;
+        if (op->js_file) {
+            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
+                js_fp = fopen(op->js_file, "w");   /* truncate if exists */
+                if (NULL == js_fp) {
+                    int e = errno;
+
+                    pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                            safe_strerror(e));
+                    ret = sg_convert_errno(e);
+                    goto the_end;
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        /* there may be many thousands of zone descriptors so write them
+         * out as they are decoded rather than holding them all in memory */
+        sgj_stream_start(jsp, js_fp);
+    }
 
     if (op->do_zdomains && op->do_realms) {
         pr2serr("Can't have both --domain and --realm\n");
@@ -1630,25 +1653,10 @@ the_end:
     }
     ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
     if (as_json) {
-        FILE * fp = stdout;
-
-        if (op->js_file) {
-            if ((1 != strlen(op->js_file)) || ('-' != op->js_file[0])) {
-                fp = fopen(op->js_file, "w");   /* truncate if exists */
-                if (NULL == fp) {
-                    int e = errno;
-
-                    pr2serr("unable to open file: %s [%s]\n", op->js_file,
-                            safe_strerror(e));
-                    ret = sg_convert_errno(e);
-                }
-            }
-            /* '--js-file=-' will send JSON output to stdout */
-        }
-        if (fp)
-            sgj_js2file(jsp, NULL, ret, fp);
-        if (op->js_file && fp && (stdout != fp))
-            fclose(fp);
+        if (js_fp)
+            sgj_js2file(jsp, NULL, ret, js_fp);
+        if (js_fp && (stdout != js_fp))
+            fclose(js_fp);
         sgj_finish(jsp);
     }
     return ret;
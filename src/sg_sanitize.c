@@ -30,12 +30,15 @@
 #include "sg_pt.h"
 #include "sg_cmds_basic.h"
 #include "sg_cmds_extra.h"
+#include "sg_monitor.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
 
-static const char * version_str = "1.22 20230622";
+static const char * version_str = "1.24 20231031";
 
-#define ME "sg_sanitize: "
+#define ME_NAME "sg_sanitize"
+#define ME ME_NAME ": "
 
 #define SANITIZE_OP 0x48
 #define SANITIZE_OP_LEN 10
@@ -52,6 +55,8 @@ static const char * version_str = "1.22 20230622";
 #define LONG_TIMEOUT (15 * 3600)       /* 15 hours ! */
                 /* Seagate ST32000444SS 2TB disk takes 9.5 hours to format */
 #define POLL_DURATION_SECS 60
+#define POLL_MIN_MS 10000               /* adaptive poll interval bounds */
+#define POLL_MAX_MS (10 * 60 * 1000)
 
 
 static const struct option long_options[] = {
@@ -67,6 +72,9 @@ static const struct option long_options[] = {
     {"help", no_argument, 0, 'h'},
     {"invert", no_argument, 0, 'I'},
     {"ipl", required_argument, 0, 'i'},
+    {"js-file", required_argument, 0, 'J'},
+    {"js_file", required_argument, 0, 'J'},
+    {"json", optional_argument, 0, '^'},    /* short option is '-j' */
     {"overwrite", no_argument, 0, 'O'},
     {"pattern", required_argument, 0, 'p'},
     {"quick", no_argument, 0, 'Q'},
@@ -85,6 +93,7 @@ struct opts_t {
     bool block;
     bool crypto;
     bool desc;
+    bool do_json;
     bool dry_run;
     bool early;
     bool fail;
@@ -102,6 +111,9 @@ struct opts_t {
     int verbose;
     int zero;
     const char * pattern_fn;
+    const char * json_arg;
+    const char * js_file;
+    sgj_state json_st;
 };
 
 
@@ -112,8 +124,9 @@ usage()
           "[--dry-run]\n"
           "                   [--early] [--fail] [--help] [--invert] "
           "[--ipl=LEN]\n"
-          "                   [--overwrite] [--pattern=PF] [--quick] "
-          "[--test=TE]\n"
+          "                   [--js-file=JFN] [--json[=JO]] [--overwrite] "
+          "[--pattern=PF]\n"
+          "                   [--quick] [--test=TE]\n"
           "                   [--timeout=SECS] [--verbose] [--version] "
           "[--wait]\n"
           "                   [--zero] [--znr] DEVICE\n"
@@ -138,6 +151,15 @@ usage()
           "list\n"
           "    --ipl=LEN|-i LEN     initialization pattern length (in "
           "bytes)\n"
+          "    --js-file=JFN|-J JFN    JFN is a filename to which JSON "
+          "output is\n"
+          "                            written (def: stdout); truncates "
+          "then writes\n"
+          "    --json[=JO]|-j[=JO]    output in JSON instead of plain "
+          "text, each\n"
+          "                           progress poll is an event in "
+          "\"monitor_event_list\"\n"
+          "                           Use --json=? for JSON help\n"
           "    --overwrite|-O       do OVERWRITE sanitize\n"
           "    --pattern=PF|-p PF    PF is file containing initialization "
           "pattern\n"
@@ -344,7 +366,8 @@ get_lu_name(const uint8_t * bp, int u_len, char * b, int b_len)
 #define VPD_DEVICE_ID 0x83
 
 static int
-print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose)
+print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose,
+             sgj_state * jsp)
 {
     int res, k, n, verb, pdt, has_sn, has_di;
     uint8_t b[256];
@@ -363,14 +386,15 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose)
     memcpy(sinq_resp, b, (n < max_rlen) ? n : max_rlen);
     if (n == SAFE_STD_INQ_RESP_LEN) {
         pdt = b[0] & PDT_MASK;
-        printf("    %.8s  %.16s  %.4s   peripheral_type: %s [0x%x]\n",
+        sgj_pr_hr(jsp, "    %.8s  %.16s  %.4s   peripheral_type: %s "
+                  "[0x%x]\n",
                (const char *)(b + 8), (const char *)(b + 16),
                (const char *)(b + 32),
                sg_get_pdt_str(pdt, sizeof(pdt_name), pdt_name), pdt);
         if (verbose)
-            printf("      PROTECT=%d\n", !!(b[5] & 1));
+            sgj_pr_hr(jsp, "      PROTECT=%d\n", !!(b[5] & 1));
         if (b[5] & 1)
-            printf("      << supports protection information>>\n");
+            sgj_pr_hr(jsp, "      << supports protection information>>\n");
     } else {
         pr2serr("Short INQUIRY response: %d bytes, expect at least 36\n", n);
         return SG_LIB_CAT_OTHER;
@@ -414,7 +438,8 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose)
         n = sg_get_unaligned_be16(b + 2);
         if (n > (int)(sizeof(b) - 4))
             n = (sizeof(b) - 4);
-        printf("      Unit serial number: %.*s\n", n, (const char *)(b + 4));
+        sgj_pr_hr(jsp, "      Unit serial number: %.*s\n", n,
+                  (const char *)(b + 4));
     }
     if (has_di) {
         res = sg_ll_inquiry(fd, false, true /* evpd */, VPD_DEVICE_ID, b,
@@ -434,7 +459,110 @@ print_dev_id(int fd, uint8_t * sinq_resp, int max_rlen, int verbose)
             n = (sizeof(b) - 4);
         n = strlen(get_lu_name(b, n + 4, a, sizeof(a)));
         if (n > 0)
-            printf("      LU name: %.*s\n", n, a);
+            sgj_pr_hr(jsp, "      LU name: %.*s\n", n, a);
+    }
+    return 0;
+}
+
+/* Progress monitor callback, 'ctxp' points to the options. In JSON mode
+ * the monitor has already added the event to "monitor_event_list". */
+static void
+sanitize_event(void * ctxp, const struct sg_mon_event * evp)
+{
+    struct opts_t * op = (struct opts_t *)ctxp;
+    int vb = op->verbose;
+    uint32_t e;
+    sgj_state * jsp = &op->json_st;
+    char b[160];
+    char c[48];
+
+    switch (evp->type) {
+    case SG_MON_EV_START:
+    case SG_MON_EV_PROGRESS:
+        if (evp->progress < 0)
+            break;
+        c[0] = '\0';
+        if (evp->eta_ms > 0) {
+            e = (evp->eta_ms + 999) / 1000;
+            snprintf(c, sizeof(c), ", about %u:%02u:%02u remaining",
+                     e / 3600, (e / 60) % 60, e % 60);
+        }
+        sgj_pr_hr(jsp, "Progress indication: %d%% done%s\n",
+                  (evp->progress * 100) / 65536, c);
+        break;
+    case SG_MON_EV_DONE:
+        if ((1 == evp->num_polls) && vb)
+            pr2serr("Sanitize seems to be successful and finished "
+                    "quickly\n");
+        else if (vb)
+            pr2serr("%s\n", sg_mon_event_str(evp, sizeof(b), b));
+        break;
+    default:
+        pr2serr("%s\n", sg_mon_event_str(evp, sizeof(b), b));
+        if ((0 == vb) && (SG_MON_EV_ERROR == evp->type))
+            pr2serr("    try the '-v' option for more information\n");
+        break;
+    }
+}
+
+/* Processes short options that may be combined with '-j' (e.g. '-jv').
+ * Returns 0 if okay, else SG_LIB_SYNTAX_ERROR. */
+static int
+chk_short_opts(const char sopt_ch, struct opts_t * op)
+{
+    /* only need to process short, non-argument options */
+    switch (sopt_ch) {
+    case 'A':
+        op->ause = true;
+        break;
+    case 'B':
+        op->block = true;
+        break;
+    case 'C':
+        op->crypto = true;
+        break;
+    case 'd':
+        op->desc = true;
+        break;
+    case 'D':
+        op->dry_run = true;
+        break;
+    case 'e':
+        op->early = true;
+        break;
+    case 'F':
+        op->fail = true;
+        break;
+    case 'I':
+        op->invert = true;
+        break;
+    case 'j':
+        break;  /* simply ignore second 'j' (e.g. '-jxj') */
+    case 'O':
+        op->overwrite = true;
+        break;
+    case 'Q':
+        op->quick = true;
+        break;
+    case 'v':
+        op->verbose_given = true;
+        ++op->verbose;
+        break;
+    case 'V':
+        op->version_given = true;
+        break;
+    case 'w':
+        op->wait = true;
+        break;
+    case 'z':
+        ++op->zero;
+        break;
+    case 'Z':
+        op->znr = true;
+        break;
+    default:
+        pr2serr("unrecognised option code %c [0x%x] ??\n", sopt_ch, sopt_ch);
+        return SG_LIB_SYNTAX_ERROR;
     }
     return 0;
 }
@@ -444,19 +572,21 @@ int
 main(int argc, char * argv[])
 {
     bool got_stdin = false;
-    int k, res, c, infd, progress, vb, n, resp_len, err;
+    int res, c, infd, vb, n, err;
     int sg_fd = -1;
     int param_lst_len = 0;
     int ret = -1;
     const char * device_name = NULL;
     char ebuff[EBUFF_SZ];
     char b[80];
-    uint8_t rsBuff[DEF_REQS_RESP_LEN];
     uint8_t * wBuff = NULL;
     uint8_t * free_wBuff = NULL;
     struct opts_t opts;
     struct opts_t * op;
     struct stat a_stat;
+    FILE * js_fp = stdout;
+    sgj_state * jsp = NULL;
+    sgj_opaque_p jop = NULL;
     uint8_t inq_resp[SAFE_STD_INQ_RESP_LEN];
 
     op = &opts;
@@ -465,7 +595,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "ABc:CdDeFhi:IOp:Qt:T:vVwzZ",
+        c = getopt_long(argc, argv, "ABc:CdDeFhi:Ij::J:Op:Qt:T:vVwzZ",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -513,6 +643,32 @@ main(int argc, char * argv[])
         case 'I':
             op->invert = true;
             break;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            op->do_json = true;
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                int k;
+
+                if ('^' == c) {
+                    op->json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    op->json_arg = optarg + 1;
+                    break;
+                }
+                n = strlen(optarg);
+                for (k = 0; k < n; ++k) {
+                    if (chk_short_opts(*(optarg + k), op))
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+            } else
+                op->json_arg = NULL;
+            break;
+        case 'J':
+            op->do_json = true;
+            op->js_file = optarg;
+            break;
         case 'O':
             op->overwrite = true;
             break;
@@ -644,6 +800,38 @@ main(int argc, char * argv[])
         }
     }
 
+    jsp = &op->json_st;
+    if (op->do_json) {
+        if (! sgj_init_state(jsp, op->json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char)
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto err_out;
+        }
+        if (op->js_file &&
+            ((1 != strlen(op->js_file)) || ('-' != op->js_file[0]))) {
+            js_fp = fopen(op->js_file, "w");   /* truncate if exists */
+            if (NULL == js_fp) {
+                err = errno;
+                pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                        safe_strerror(err));
+                ret = sg_convert_errno(err);
+                goto err_out;
+            }
+        }
+        jop = sgj_start_r(ME_NAME, version_str, argc, argv, jsp);
+        /* progress events are written out as they occur */
+        sgj_stream_start(jsp, js_fp);
+        jop = sgj_named_subobject_r(jsp, jop, "sanitize");
+        sgj_js_nv_s(jsp, jop, "device_name", device_name);
+    }
+
     sg_fd = sg_cmds_open_device(device_name, false /* rw */, vb);
     if (sg_fd < 0) {
         if (op->verbose)
@@ -653,7 +841,7 @@ main(int argc, char * argv[])
         goto err_out;
     }
 
-    ret = print_dev_id(sg_fd, inq_resp, sizeof(inq_resp), op->verbose);
+    ret = print_dev_id(sg_fd, inq_resp, sizeof(inq_resp), op->verbose, jsp);
     if (ret)
         goto err_out;
 
@@ -724,58 +912,21 @@ main(int argc, char * argv[])
     }
 
     if ((0 == ret) && (! op->early) && (! op->wait)) {
-        for (k = 0; ;++k) {     /* unbounded, exits via break */
-            if (op->dry_run && (k > 0)) {
-                pr2serr("Due to --dry-run option, leave poll loop\n");
-                break;
-            }
-            sg_sleep_secs(POLL_DURATION_SECS);
-            memset(rsBuff, 0x0, sizeof(rsBuff));
-            res = sg_ll_request_sense(sg_fd, op->desc, rsBuff, sizeof(rsBuff),
-                                      1, vb);
-            if (res) {
-                ret = res;
-                if (SG_LIB_CAT_INVALID_OP == res)
-                    pr2serr("Request Sense command not supported\n");
-                else if (SG_LIB_CAT_ILLEGAL_REQ == res) {
-                    pr2serr("bad field in Request Sense cdb\n");
-                    if (op->desc) {
-                        pr2serr("Descriptor type sense may not be supported, "
-                                "try again with fixed type\n");
-                        op->desc = false;
-                        continue;
-                    }
-                } else {
-                    sg_get_category_sense_str(res, sizeof(b), b, vb);
-                    pr2serr("Request Sense: %s\n", b);
-                    if (0 == vb)
-                        pr2serr("    try the '-v' option for more "
-                                "information\n");
-                }
-                break;
-            }
-            /* "Additional sense length" same in descriptor and fixed */
-            resp_len = rsBuff[7] + 8;
-            if (vb > 2) {
-                pr2serr("Parameter data in hex\n");
-                hex2stderr(rsBuff, resp_len, -1);
-            }
-            progress = -1;
-            sg_get_sense_progress_fld(rsBuff, resp_len, &progress);
-            if (progress < 0) {
-                ret = res;
-                if (vb > 1)
-                     pr2serr("No progress indication found, iteration %d\n",
-                             k + 1);
-                if ((0 == k) && vb)
-                     pr2serr("Sanitize seems to be successful and finished "
-                             "quickly\n");
-                /* N.B. exits first time there isn't a progress indication */
-                break;
-            } else
-                printf("Progress indication: %d%% done\n",
-                       (progress * 100) / 65536);
+        struct sg_monitor * mp;
+
+        if (op->dry_run) {
+            pr2serr("Due to --dry-run option, skip poll loop\n");
+            goto err_out;
         }
+        mp = sg_mon_create(POLL_MIN_MS, POLL_MAX_MS, jsp, jop, vb);
+        if ((NULL == mp) ||
+            (sg_mon_add(mp, sg_fd, device_name, "Sanitize", SG_MON_POLL_RS,
+                        op->desc, POLL_DURATION_SECS * 1000) < 0)) {
+            pr2serr("unable to start progress monitor\n");
+            ret = sg_convert_errno(ENOMEM);
+        } else
+            ret = sg_mon_run(mp, 0 /* no timeout */, sanitize_event, op);
+        sg_mon_destroy(mp);
     }
 
 err_out:
@@ -789,10 +940,17 @@ err_out:
                 ret = sg_convert_errno(-res);
         }
     }
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp && jsp->pr_as_json) {
+        sgj_js2file(jsp, NULL, ret, js_fp);
+        sgj_finish(jsp);
+    }
+    if (js_fp && (stdout != js_fp))
+        fclose(js_fp);
     if (0 == op->verbose) {
         if (! sg_if_can2stderr("sg_sanitize failed: ", ret))
             pr2serr("Some error occurred, try again with '-v' "
                     "or '-vv' for more information\n");
     }
-    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    return ret;
 }
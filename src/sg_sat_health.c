@@ -0,0 +1,1080 @@
+/*
+ * Copyright (c) 2023 Douglas Gilbert.
+ * All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the BSD_LICENSE file.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sg_lib.h"
+#include "sg_cmds_basic.h"
+#include "sg_cmds_extra.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
+
+#include "sg_par_common.h"
+
+/* A utility program originally written for the Linux OS SCSI subsystem.
+ *
+ * This program collects health information from ATA (SATA) disks that are
+ * reached through a SCSI to ATA Translation (SAT) layer, for example SATA
+ * disks behind a SAS HBA. Each disk is first sent an ATA CHECK POWER MODE
+ * command, which does not spin up a disk in standby. Disks that are not
+ * spinning, or that return no power mode, are skipped (unless --wake is
+ * given). Each awake disk is then sent IDENTIFY DEVICE, SMART RETURN
+ * STATUS, SMART READ DATA and READ LOG EXT commands for the GPL directory,
+ * the Device Statistics log (all of its pages in one command) and any
+ * other logs requested. All commands are tunnelled with the ATA
+ * PASS-THROUGH(16) SCSI command. Disks are visited concurrently by a pool
+ * of workers and the result is output as one JSON document (or a table,
+ * one line per disk).
+ */
+
+static const char * version_str = "1.00 20231031";
+
+#define MY_NAME "sg_sat_health"
+
+#define SAT_ATA_PASS_THROUGH16 0x85
+#define SAT_ATA_PASS_THROUGH16_LEN 16
+#define ASCQ_ATA_PT_INFO_AVAILABLE 0x1d
+
+#define ATA_CHECK_POWER_MODE 0xe5
+#define ATA_IDENTIFY_DEVICE 0xec
+#define ATA_READ_LOG_EXT 0x2f
+#define ATA_SMART 0xb0
+#define ATA_SMART_READ_DATA 0xd0
+#define ATA_SMART_RETURN_STATUS 0xda
+
+#define ATA_PROT_NON_DATA 3
+#define ATA_PROT_PIO_DATA_IN 4
+
+#define GPL_DIRECTORY_LA 0x0
+#define DEV_STATS_LA 0x4
+
+#define SH_BLK_LEN 512
+#define SH_MAX_LOG_PAGES 16     /* of each log, read in one command */
+#define SH_MAX_XLOGS 8          /* number of --log= log addresses */
+#define SH_LOG_BUFF_LEN (SH_MAX_LOG_PAGES * SH_BLK_LEN)
+/* buffer layout: IDENTIFY, SMART data, GPL directory, Device Statistics,
+ * then each --log= log */
+#define SH_IDENT_OFF 0
+#define SH_SMART_OFF SH_BLK_LEN
+#define SH_GPL_DIR_OFF (2 * SH_BLK_LEN)
+#define SH_DEV_STATS_OFF (3 * SH_BLK_LEN)
+#define SH_XLOG_OFF (SH_DEV_STATS_OFF + SH_LOG_BUFF_LEN)
+#define SH_BUFF_LEN (SH_XLOG_OFF + (SH_MAX_XLOGS * SH_LOG_BUFF_LEN))
+
+#define SMART_NUM_ATTRS 30
+#define SMART_ATTR_LEN 12
+
+#define DEF_TIMEOUT 20          /* seconds, same as other sg_sat_* */
+
+enum sh_state_e {
+    SH_COLLECTED = 0,
+    SH_SKIPPED,         /* not (known to be) spinning, no --wake */
+    SH_ERROR,
+};
+
+struct sh_ata_regs_t {
+    bool valid;
+    uint8_t error;
+    uint8_t status;
+    uint8_t count;      /* count (7:0) */
+    uint8_t lba_mid;    /* LBA (15:8) */
+    uint8_t lba_high;   /* LBA (23:16) */
+};
+
+struct sh_dev_t {
+    bool smart_ok;      /* SMART READ DATA response is valid */
+    int state;          /* enum sh_state_e */
+    int res;            /* 0 or first SG_LIB_* error of device */
+    int num_cmds;       /* number of ATA commands sent */
+    int power_mode;     /* CHECK POWER MODE count field, -1 if unknown */
+    int smart_status;   /* -1: unknown, 0: good, 1: threshold exceeded */
+    int ds_pages;       /* Device Statistics pages read, 0 if none */
+    int xlog_pages[SH_MAX_XLOGS];       /* -1 if not attempted */
+    uint64_t elapsed_ns;
+    const char * dev_name;
+    const char * fail_cmd_s;    /* ATA command that got res */
+    uint8_t * bp;       /* SH_BUFF_LEN bytes, see layout above */
+    uint8_t * free_bp;
+};
+
+struct sh_ctx_t {
+    bool rdonly;
+    bool wake;
+    int tmo;
+    int verbose;
+    int num_devs;
+    int num_xlogs;
+    int num_collected;
+    int num_skipped;
+    int num_failed;
+    int xlog_arr[SH_MAX_XLOGS];
+    sgj_state * jsp;
+    sgj_opaque_p jap;   /* streamed "device_list" array */
+    struct sh_dev_t * devp;
+};
+
+/* Device Statistics (log address 4) statistics that are named */
+struct sh_ds_name_t {
+    uint8_t page;
+    uint8_t offset;
+    const char * name;
+};
+
+static const struct sh_ds_name_t sh_ds_name_arr[] = {
+    {1, 0x8, "lifetime_power_on_resets"},
+    {1, 0x10, "power_on_hours"},
+    {1, 0x18, "logical_sectors_written"},
+    {1, 0x20, "number_of_write_commands"},
+    {1, 0x28, "logical_sectors_read"},
+    {1, 0x30, "number_of_read_commands"},
+    {3, 0x8, "spindle_motor_power_on_hours"},
+    {3, 0x10, "head_flying_hours"},
+    {3, 0x18, "head_load_events"},
+    {3, 0x20, "number_of_reallocated_logical_sectors"},
+    {3, 0x28, "read_recovery_attempts"},
+    {3, 0x30, "number_of_mechanical_start_failures"},
+    {3, 0x38, "number_of_reallocation_candidate_logical_sectors"},
+    {4, 0x8, "number_of_reported_uncorrectable_errors"},
+    {4, 0x10, "number_of_resets_between_command_acceptance_and_completion"},
+    {5, 0x8, "current_temperature"},
+    {5, 0x10, "average_short_term_temperature"},
+    {5, 0x18, "average_long_term_temperature"},
+    {5, 0x20, "highest_temperature"},
+    {5, 0x28, "lowest_temperature"},
+    {6, 0x8, "number_of_hardware_resets"},
+    {6, 0x10, "number_of_asr_events"},
+    {6, 0x18, "number_of_interface_crc_errors"},
+    {7, 0x8, "percentage_used_endurance_indicator"},
+    {0, 0, NULL},
+};
+
+#define DS_TEMPERATURE_PG 5
+
+
+static const struct option long_options[] = {
+    {"help", no_argument, 0, 'h'},
+    {"js-file", required_argument, 0, 'J'},
+    {"js_file", required_argument, 0, 'J'},
+    {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+    {"list", required_argument, 0, 'L'},
+    {"log", required_argument, 0, 'l'},
+    {"parallel", required_argument, 0, 'p'},
+    {"readonly", no_argument, 0, 'r'},
+    {"timeout", required_argument, 0, 't'},
+    {"verbose", no_argument, 0, 'v'},
+    {"version", no_argument, 0, 'V'},
+    {"wake", no_argument, 0, 'w'},
+    {0, 0, 0, 0},
+};
+
+
+static void
+usage()
+{
+    pr2serr("Usage: "
+            "sg_sat_health  [--help] [--js-file=JFN] [--json[=JO]] "
+            "[--list=DLF]\n"
+            "                      [--log=LA[,LA...]] [--parallel=PN] "
+            "[--readonly]\n"
+            "                      [--timeout=SECS] [--verbose] "
+            "[--version] [--wake]\n"
+            "                      [DEVICE...]\n");
+    pr2serr("  where:\n"
+            "    --help|-h          print out usage message\n"
+            "    --js-file=JFN|-J JFN    JFN is a filename to which JSON "
+            "output is\n"
+            "                            written (def: stdout); truncates "
+            "then writes\n"
+            "    --json[=JO]|-j[=JO]    output in JSON instead of a table; "
+            "JO are JSON\n"
+            "                           control characters. Use --json=? "
+            "for JSON help\n"
+            "    --list=DLF|-L DLF    DLF is a file of device names (or "
+            "globs), one\n"
+            "                         per line. If DLF is '-' then read "
+            "stdin\n"
+            "    --log=LA[,LA...]|-l LA[,LA...]    also read GPL log "
+            "address(es) LA\n"
+            "                                      from awake disks "
+            "(output in hex)\n"
+            "    --parallel=PN|-p PN    visit up to PN disks at the same "
+            "time\n"
+            "                           (def: %d)\n"
+            "    --readonly|-r      open DEVICE read-only (def: open it "
+            "read-write)\n"
+            "    --timeout=SECS|-t SECS    command timeout in seconds "
+            "(def: %d)\n"
+            "    --verbose|-v       increase verbosity\n"
+            "    --version|-V       print version string and exit\n"
+            "    --wake|-w          collect from disks in standby as well "
+            "(spins\n"
+            "                       them up). Default: skip them\n\n"
+            "Collects IDENTIFY DEVICE, SMART status, SMART data and GPL "
+            "logs (e.g.\nDevice Statistics) from ATA disks behind a SAT "
+            "layer, after checking\nwith CHECK POWER MODE that each disk "
+            "is spinning.\n", SG_PAR_DEF_WORKERS, DEF_TIMEOUT);
+}
+
+static const char *
+sh_power_mode_str(int pm)
+{
+    switch (pm) {
+    case 0x0:
+        return "standby";
+    case 0x1:
+        return "standby_y";
+    case 0x40:
+        return "nv_spun_down";
+    case 0x41:
+        return "nv_spun_up";
+    case 0x80:
+        return "idle";
+    case 0x81:
+        return "idle_a";
+    case 0x82:
+        return "idle_b";
+    case 0x83:
+        return "idle_c";
+    case 0xff:
+        return "active";
+    default:
+        return "unknown";
+    }
+}
+
+/* Returns true if power mode 'pm' says the disk is not spinning, or may
+ * not be since CHECK POWER MODE returned no registers (pm is -1) */
+static bool
+sh_power_mode_asleep(int pm)
+{
+    return (pm < 0) || (0x0 == pm) || (0x1 == pm) || (0x40 == pm);
+}
+
+/* Sends ATA command 'ata_cmd' tunnelled in an ATA PASS-THROUGH(16) cdb.
+ * For non-data commands (dinp is NULL) CK_COND is set so the ATA
+ * registers are returned in *arp. For PIO data-in commands 'count' 512
+ * byte blocks are read into dinp; 'lba' is the 48 bit LBA field. Returns
+ * 0 on success, else an SG_LIB_CAT_* value (SG_LIB_CAT_ABORTED_COMMAND if
+ * the disk reported an ATA error). */
+static int
+sh_ata_pt16(struct sh_dev_t * dp, int sg_fd, const struct sh_ctx_t * scp,
+            int ata_cmd, int feature, uint64_t lba, int count, bool extend,
+            uint8_t * dinp, struct sh_ata_regs_t * arp)
+{
+    int res, resid;
+    int vb = (scp->verbose > 1) ? scp->verbose - 1 : 0;
+    int protocol = dinp ? ATA_PROT_PIO_DATA_IN : ATA_PROT_NON_DATA;
+    struct sg_scsi_sense_hdr ssh;
+    uint8_t sense_b[64] SG_C_CPP_ZERO_INIT;
+    uint8_t ard[SG_ATA_RETURN_DESC_LEN];
+    uint8_t cdb[SAT_ATA_PASS_THROUGH16_LEN] =
+                {SAT_ATA_PASS_THROUGH16, 0, 0, 0, 0, 0, 0, 0,
+                 0, 0, 0, 0, 0, 0, 0, 0};
+
+    memset(arp, 0, sizeof(*arp));
+    cdb[1] = (protocol << 1) | (extend ? 0x1 : 0x0);
+    if (dinp)   /* T_DIR=1 (from device), BYT_BLOK=1, T_LENGTH=2 (count) */
+        cdb[2] = 0x8 | 0x4 | 0x2;
+    else        /* CK_COND=1 to read back the ATA registers */
+        cdb[2] = 0x20;
+    cdb[3] = (feature >> 8) & 0xff;
+    cdb[4] = feature & 0xff;
+    sg_put_unaligned_be16((uint16_t)count, cdb + 5);
+    cdb[7] = (lba >> 24) & 0xff;        /* LBA (31:24) */
+    cdb[8] = lba & 0xff;                /* LBA (7:0) */
+    cdb[9] = (lba >> 32) & 0xff;        /* LBA (39:32) */
+    cdb[10] = (lba >> 8) & 0xff;        /* LBA (15:8) */
+    cdb[11] = (lba >> 40) & 0xff;       /* LBA (47:40) */
+    cdb[12] = (lba >> 16) & 0xff;       /* LBA (23:16) */
+    cdb[14] = ata_cmd;
+    ++dp->num_cmds;
+    res = sg_ll_ata_pt(sg_fd, cdb, sizeof(cdb), scp->tmo, dinp, NULL,
+                       (dinp ? (count * SH_BLK_LEN) : 0), sense_b,
+                       sizeof(sense_b), NULL, 0, &resid, vb);
+    if (res < 0)
+        return SG_LIB_CAT_OTHER;
+    else if (SAM_STAT_RESERVATION_CONFLICT == res)
+        return SG_LIB_CAT_RES_CONFLICT;
+    else if (SAM_STAT_CHECK_CONDITION == res) {
+        if (! sg_scsi_normalize_sense(sense_b, sizeof(sense_b), &ssh))
+            return SG_LIB_CAT_SENSE;
+        if (((SPC_SK_NO_SENSE != ssh.sense_key) &&
+             (SPC_SK_RECOVERED_ERROR != ssh.sense_key)) || (0 != ssh.asc) ||
+            (ASCQ_ATA_PT_INFO_AVAILABLE != ssh.ascq))
+            return sg_err_category_sense(sense_b, sizeof(sense_b));
+        /* ATA registers are in the sense data, fixed or descriptor */
+        if (sg_get_sense_ata_return_desc(sense_b, sizeof(sense_b), ard)) {
+            arp->valid = true;
+            arp->error = ard[3];
+            arp->count = ard[5];
+            arp->lba_mid = ard[9];
+            arp->lba_high = ard[11];
+            arp->status = ard[13];
+        }
+    } else if (0 != res)
+        return SG_LIB_CAT_OTHER;
+    if (arp->valid && (arp->status & 0x1))      /* ERR bit in status */
+        return SG_LIB_CAT_ABORTED_COMMAND;
+    return 0;
+}
+
+/* Reads 'num' pages (from page 0) of GPL log address 'la' into dinp */
+static int
+sh_read_log_ext(struct sh_dev_t * dp, int sg_fd, const struct sh_ctx_t * scp,
+                int la, int num, uint8_t * dinp)
+{
+    struct sh_ata_regs_t regs;
+
+    /* log address in LBA (7:0), page number in LBA (15:8) and (39:32) */
+    return sh_ata_pt16(dp, sg_fd, scp, ATA_READ_LOG_EXT, 0, la, num, true,
+                       dinp, &regs);
+}
+
+/* Number of pages that GPL directory says log address 'la' has */
+static int
+sh_gpl_dir_pages(const struct sh_dev_t * dp, int la)
+{
+    return sg_get_unaligned_le16(dp->bp + SH_GPL_DIR_OFF + (2 * la));
+}
+
+static uint16_t
+sh_ident_word(const struct sh_dev_t * dp, int w)
+{
+    return sg_get_unaligned_le16(dp->bp + SH_IDENT_OFF + (2 * w));
+}
+
+/* Places IDENTIFY DEVICE string of 'num_words' words, starting at word
+ * 'start_word', into 'b' with trailing spaces removed */
+static void
+sh_ident_str(const struct sh_dev_t * dp, int start_word, int num_words,
+             char * b)
+{
+    int n;
+
+    n = sg_ata_get_chars((const uint16_t *)(dp->bp + SH_IDENT_OFF),
+                         start_word, num_words, sg_is_big_endian(), b);
+    while ((n > 0) && (' ' == b[n - 1]))
+        --n;
+    b[n] = '\0';
+}
+
+static void
+sh_fail(struct sh_dev_t * dp, int res, const char * cmd_s)
+{
+    if (0 == dp->res) {
+        dp->res = res;
+        dp->fail_cmd_s = cmd_s;
+    }
+}
+
+/* Worker for sg_par_run(), collects the health data of one disk */
+static int
+sh_work(void * ctxp, int idx)
+{
+    int k, n, res, sg_fd;
+    struct sh_ctx_t * scp = (struct sh_ctx_t *)ctxp;
+    struct sh_dev_t * dp = scp->devp + idx;
+    int vb = (scp->verbose > 1) ? scp->verbose - 1 : 0;
+    uint8_t * bp;
+    uint64_t start_ns = sg_par_mono_ns();
+    struct sh_ata_regs_t regs;
+
+    dp->power_mode = -1;
+    dp->smart_status = -1;
+    for (k = 0; k < SH_MAX_XLOGS; ++k)
+        dp->xlog_pages[k] = -1;
+    sg_fd = sg_cmds_open_device(dp->dev_name, scp->rdonly, vb);
+    if (sg_fd < 0) {
+        sh_fail(dp, sg_convert_errno(-sg_fd), "open");
+        dp->state = SH_ERROR;
+        goto fini;
+    }
+    /* CHECK POWER MODE does not change the disk's power condition */
+    res = sh_ata_pt16(dp, sg_fd, scp, ATA_CHECK_POWER_MODE, 0, 0, 0, false,
+                      NULL, &regs);
+    if (res) {
+        sh_fail(dp, res, "CHECK POWER MODE");
+        dp->state = SH_ERROR;
+        goto close_fini;
+    }
+    if (regs.valid)
+        dp->power_mode = regs.count;
+    if (sh_power_mode_asleep(dp->power_mode) && (! scp->wake)) {
+        dp->state = SH_SKIPPED;
+        goto close_fini;
+    }
+    dp->bp = sg_memalign(SH_BUFF_LEN, 0 /* page aligned */, &dp->free_bp,
+                         false);
+    if (NULL == dp->bp) {
+        sh_fail(dp, sg_convert_errno(ENOMEM), "malloc");
+        dp->state = SH_ERROR;
+        goto close_fini;
+    }
+    bp = dp->bp;
+    res = sh_ata_pt16(dp, sg_fd, scp, ATA_IDENTIFY_DEVICE, 0, 0, 1, false,
+                      bp + SH_IDENT_OFF, &regs);
+    if (res) {
+        sh_fail(dp, res, "IDENTIFY DEVICE");
+        dp->state = SH_ERROR;
+        goto close_fini;
+    }
+    /* word 82 bit 0: SMART supported; word 85 bit 0: SMART enabled */
+    if ((sh_ident_word(dp, 82) & 0x1) && (sh_ident_word(dp, 85) & 0x1)) {
+        res = sh_ata_pt16(dp, sg_fd, scp, ATA_SMART, ATA_SMART_RETURN_STATUS,
+                          0xc24f00, 0, false, NULL, &regs);
+        if (res)
+            sh_fail(dp, res, "SMART RETURN STATUS");
+        else if (regs.valid) {
+            if ((0x4f == regs.lba_mid) && (0xc2 == regs.lba_high))
+                dp->smart_status = 0;
+            else if ((0xf4 == regs.lba_mid) && (0x2c == regs.lba_high))
+                dp->smart_status = 1;
+        }
+        res = sh_ata_pt16(dp, sg_fd, scp, ATA_SMART, ATA_SMART_READ_DATA,
+                          0xc24f00, 1, false, bp + SH_SMART_OFF, &regs);
+        if (res)
+            sh_fail(dp, res, "SMART READ DATA");
+        else
+            dp->smart_ok = true;
+    }
+    /* word 84 bit 5: General Purpose Logging feature set supported */
+    if (0 == (sh_ident_word(dp, 84) & 0x20))
+        goto close_fini;
+    res = sh_read_log_ext(dp, sg_fd, scp, GPL_DIRECTORY_LA, 1,
+                          bp + SH_GPL_DIR_OFF);
+    if (res) {
+        sh_fail(dp, res, "READ LOG EXT");
+        goto close_fini;
+    }
+    /* all Device Statistics pages with a single READ LOG EXT */
+    n = sh_gpl_dir_pages(dp, DEV_STATS_LA);
+    if (n > SH_MAX_LOG_PAGES)
+        n = SH_MAX_LOG_PAGES;
+    if (n > 0) {
+        res = sh_read_log_ext(dp, sg_fd, scp, DEV_STATS_LA, n,
+                              bp + SH_DEV_STATS_OFF);
+        if (res)
+            sh_fail(dp, res, "READ LOG EXT");
+        else
+            dp->ds_pages = n;
+    }
+    for (k = 0; k < scp->num_xlogs; ++k) {
+        n = sh_gpl_dir_pages(dp, scp->xlog_arr[k]);
+        if (n > SH_MAX_LOG_PAGES)
+            n = SH_MAX_LOG_PAGES;
+        dp->xlog_pages[k] = 0;
+        if (n < 1)
+            continue;   /* log not supported */
+        res = sh_read_log_ext(dp, sg_fd, scp, scp->xlog_arr[k], n,
+                              bp + SH_XLOG_OFF + (k * SH_LOG_BUFF_LEN));
+        if (res)
+            sh_fail(dp, res, "READ LOG EXT");
+        else
+            dp->xlog_pages[k] = n;
+    }
+close_fini:
+    sg_cmds_close_device(sg_fd);
+fini:
+    dp->elapsed_ns = sg_par_mono_ns() - start_ns;
+    return dp->res;
+}
+
+/* Looks up a Device Statistics statistic. Returns true and places its
+ * value in *valp if it is supported and valid. */
+static bool
+sh_dev_stat(const struct sh_dev_t * dp, int pg, int off, int64_t * valp)
+{
+    uint64_t qw;
+    const uint8_t * pp;
+
+    if ((pg >= dp->ds_pages) || (off < 8) || (off >= SH_BLK_LEN))
+        return false;
+    pp = dp->bp + SH_DEV_STATS_OFF + (pg * SH_BLK_LEN);
+    if (pg != pp[2])    /* header qword holds the page number */
+        return false;
+    qw = sg_get_unaligned_le64(pp + off);
+    /* bit 63: supported, bit 62: valid */
+    if ((qw & 0xc000000000000000ULL) != 0xc000000000000000ULL)
+        return false;
+    if (DS_TEMPERATURE_PG == pg)
+        *valp = (int8_t)(qw & 0xff);
+    else
+        *valp = (int64_t)(qw & 0xffffffffffffULL);
+    return true;
+}
+
+/* Looks up raw value of SMART attribute 'id'. Returns true if found. */
+static bool
+sh_smart_raw(const struct sh_dev_t * dp, int id, uint64_t * rawp)
+{
+    int k;
+    const uint8_t * ap;
+
+    if (! dp->smart_ok)
+        return false;
+    for (k = 0; k < SMART_NUM_ATTRS; ++k) {
+        ap = dp->bp + SH_SMART_OFF + 2 + (k * SMART_ATTR_LEN);
+        if (id == ap[0]) {
+            *rawp = sg_get_unaligned_le32(ap + 5) |
+                    ((uint64_t)sg_get_unaligned_le16(ap + 9) << 32);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Current temperature (Celsius) and power on hours, from Device Statistics
+ * or, failing that, SMART attributes 194 and 9 */
+static void
+sh_temp_poh(const struct sh_dev_t * dp, int64_t * tempp, int64_t * pohp)
+{
+    uint64_t raw;
+
+    *tempp = -1000;
+    *pohp = -1;
+    if ((! sh_dev_stat(dp, DS_TEMPERATURE_PG, 0x8, tempp)) &&
+        sh_smart_raw(dp, 194, &raw))
+        *tempp = (int8_t)(raw & 0xff);
+    if ((! sh_dev_stat(dp, 1, 0x10, pohp)) && sh_smart_raw(dp, 9, &raw))
+        *pohp = (int64_t)(raw & 0xffffffff);
+}
+
+static const char *
+sh_ds_name(int pg, int off)
+{
+    const struct sh_ds_name_t * np;
+
+    for (np = sh_ds_name_arr; np->name; ++np) {
+        if ((pg == np->page) && (off == np->offset))
+            return np->name;
+    }
+    return NULL;
+}
+
+static void
+sh_js_ident(const struct sh_dev_t * dp, sgj_state * jsp, sgj_opaque_p jop)
+{
+    uint64_t num_lbs;
+    uint32_t lb_sz = SH_BLK_LEN;
+    sgj_opaque_p jo2p;
+    char b[48];
+
+    jo2p = sgj_named_subobject_r(jsp, jop, "identify");
+    sh_ident_str(dp, 27, 20, b);
+    sgj_js_nv_s(jsp, jo2p, "model", b);
+    sh_ident_str(dp, 10, 10, b);
+    sgj_js_nv_s(jsp, jo2p, "serial_number", b);
+    sh_ident_str(dp, 23, 4, b);
+    sgj_js_nv_s(jsp, jo2p, "firmware_revision", b);
+    if (sh_ident_word(dp, 83) & 0x400)      /* 48 bit address feature set */
+        num_lbs = sg_get_unaligned_le64(dp->bp + SH_IDENT_OFF + 200);
+    else
+        num_lbs = sg_get_unaligned_le32(dp->bp + SH_IDENT_OFF + 120);
+    sgj_js_nv_i(jsp, jo2p, "user_addressable_sectors", (int64_t)num_lbs);
+    /* word 106: bit 14 set, bit 15 clear: valid; bit 12: long sectors */
+    if ((0x5000 == (sh_ident_word(dp, 106) & 0xd000)))
+        lb_sz = 2 * sg_get_unaligned_le32(dp->bp + SH_IDENT_OFF + 234);
+    sgj_js_nv_i(jsp, jo2p, "logical_sector_size", lb_sz);
+    sgj_js_nv_i(jsp, jo2p, "nominal_media_rotation_rate",
+                sh_ident_word(dp, 217));
+    sgj_js_nv_b(jsp, jo2p, "smart_supported", sh_ident_word(dp, 82) & 0x1);
+    sgj_js_nv_b(jsp, jo2p, "smart_enabled", sh_ident_word(dp, 85) & 0x1);
+    sgj_js_nv_b(jsp, jo2p, "gpl_supported", sh_ident_word(dp, 84) & 0x20);
+}
+
+static void
+sh_js_smart(const struct sh_dev_t * dp, sgj_state * jsp, sgj_opaque_p jop)
+{
+    int k;
+    const uint8_t * ap;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jap;
+
+    if (dp->smart_status >= 0) {
+        jo2p = sgj_named_subobject_r(jsp, jop, "smart_status");
+        sgj_js_nv_b(jsp, jo2p, "threshold_exceeded", dp->smart_status > 0);
+    }
+    if (! dp->smart_ok)
+        return;
+    ap = dp->bp + SH_SMART_OFF;
+    sgj_js_nv_ihex(jsp, jop, "offline_data_collection_status", ap[362]);
+    sgj_js_nv_ihex(jsp, jop, "self_test_execution_status", ap[363] >> 4);
+    jap = sgj_named_subarray_r(jsp, jop, "smart_attribute_list");
+    for (k = 0, ap += 2; k < SMART_NUM_ATTRS; ++k, ap += SMART_ATTR_LEN) {
+        if (0 == ap[0])
+            continue;
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_i(jsp, jo2p, "id", ap[0]);
+        sgj_js_nv_ihex(jsp, jo2p, "flags", sg_get_unaligned_le16(ap + 1));
+        sgj_js_nv_i(jsp, jo2p, "current", ap[3]);
+        sgj_js_nv_i(jsp, jo2p, "worst", ap[4]);
+        sgj_js_nv_i(jsp, jo2p, "raw", (int64_t)
+                    (sg_get_unaligned_le32(ap + 5) |
+                     ((uint64_t)sg_get_unaligned_le16(ap + 9) << 32)));
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+}
+
+static void
+sh_js_dev_stats(const struct sh_dev_t * dp, sgj_state * jsp,
+                sgj_opaque_p jop)
+{
+    int k, pg, off, num;
+    int64_t val;
+    const uint8_t * p0p = dp->bp + SH_DEV_STATS_OFF;
+    const char * cp;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jap;
+
+    if (dp->ds_pages < 1)
+        return;
+    /* page 0 is the list of supported pages: count at 8, list from 9 */
+    num = p0p[8];
+    jap = sgj_named_subarray_r(jsp, jop, "device_statistics_list");
+    for (k = 0; (k < num) && ((9 + k) < SH_BLK_LEN); ++k) {
+        pg = p0p[9 + k];
+        if ((0 == pg) || (pg >= dp->ds_pages))
+            continue;
+        for (off = 8; off < SH_BLK_LEN; off += 8) {
+            if (! sh_dev_stat(dp, pg, off, &val))
+                continue;
+            jo2p = sgj_new_unattached_object_r(jsp);
+            sgj_js_nv_i(jsp, jo2p, "page", pg);
+            sgj_js_nv_ihex(jsp, jo2p, "offset", off);
+            cp = sh_ds_name(pg, off);
+            if (cp)
+                sgj_js_nv_s(jsp, jo2p, "name", cp);
+            sgj_js_nv_i(jsp, jo2p, "value", val);
+            sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+        }
+    }
+}
+
+static void
+sh_js_xlogs(const struct sh_ctx_t * scp, const struct sh_dev_t * dp,
+            sgj_state * jsp, sgj_opaque_p jop)
+{
+    int k;
+    sgj_opaque_p jo2p;
+    sgj_opaque_p jap;
+
+    if (scp->num_xlogs < 1)
+        return;
+    jap = sgj_named_subarray_r(jsp, jop, "gpl_log_list");
+    for (k = 0; k < scp->num_xlogs; ++k) {
+        if (dp->xlog_pages[k] < 0)
+            continue;
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_ihex(jsp, jo2p, "log_address", scp->xlog_arr[k]);
+        sgj_js_nv_i(jsp, jo2p, "pages", dp->xlog_pages[k]);
+        if (dp->xlog_pages[k] > 0)
+            sgj_js_nv_hex_bytes(jsp, jo2p, "data",
+                                dp->bp + SH_XLOG_OFF + (k * SH_LOG_BUFF_LEN),
+                                dp->xlog_pages[k] * SH_BLK_LEN);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+}
+
+/* Called (serialized) as each disk completes. Adds its JSON object to
+ * the streamed device list (or prints its row) then frees its buffer. */
+static void
+sh_done(void * ctxp, int idx, int res)
+{
+    int64_t temp, poh;
+    struct sh_ctx_t * scp = (struct sh_ctx_t *)ctxp;
+    struct sh_dev_t * dp = scp->devp + idx;
+    sgj_state * jsp = scp->jsp;
+    const char * cp;
+    sgj_opaque_p jop;
+    char b[80];
+    char tb[16];
+    char pb[24];
+    char mb[128];
+
+    if (SH_SKIPPED == dp->state)
+        ++scp->num_skipped;
+    else if (SH_ERROR == dp->state)
+        ++scp->num_failed;
+    else {
+        ++scp->num_collected;
+        if (res)
+            ++scp->num_failed;  /* partial collection */
+    }
+    if (res)
+        sg_get_category_sense_str(res, sizeof(b), b, scp->verbose);
+    else
+        snprintf(b, sizeof(b), "ok");
+    if (jsp->pr_as_json) {
+        jop = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_s(jsp, jop, "device_name", dp->dev_name);
+        sgj_js_nv_istr(jsp, jop, "result", res, NULL, b);
+        if (dp->fail_cmd_s)
+            sgj_js_nv_s(jsp, jop, "failed_command", dp->fail_cmd_s);
+        sgj_js_nv_i(jsp, jop, "elapsed_usecs",
+                    (int64_t)(dp->elapsed_ns / 1000));
+        sgj_js_nv_i(jsp, jop, "ata_commands", dp->num_cmds);
+        if (dp->power_mode >= 0)
+            sgj_js_nv_ihexstr(jsp, jop, "power_mode", dp->power_mode, NULL,
+                              sh_power_mode_str(dp->power_mode));
+        else if (SH_ERROR != dp->state)
+            sgj_js_nv_s(jsp, jop, "power_mode", "unknown");
+        sgj_js_nv_b(jsp, jop, "skipped", SH_SKIPPED == dp->state);
+        if (dp->bp && (SH_COLLECTED == dp->state)) {
+            sh_js_ident(dp, jsp, jop);
+            sh_js_smart(dp, jsp, jop);
+            sh_js_dev_stats(dp, jsp, jop);
+            sh_js_xlogs(scp, dp, jsp, jop);
+        }
+        sgj_js_nv_o(jsp, scp->jap, NULL /* name */, jop);
+    } else {
+        tb[0] = '-';
+        tb[1] = '\0';
+        snprintf(pb, sizeof(pb), "-");
+        if ((SH_SKIPPED == dp->state) && (dp->power_mode < 0))
+            snprintf(mb, sizeof(mb), "skipped (power mode unknown)");
+        else if (SH_SKIPPED == dp->state)
+            snprintf(mb, sizeof(mb), "skipped (not spinning)");
+        else if (SH_ERROR == dp->state)
+            snprintf(mb, sizeof(mb), "%s: %s", dp->fail_cmd_s, b);
+        else {
+            sh_temp_poh(dp, &temp, &poh);
+            if (temp > -1000)
+                snprintf(tb, sizeof(tb), "%" PRId64, temp);
+            if (poh >= 0)
+                snprintf(pb, sizeof(pb), "%" PRId64, poh);
+            sh_ident_str(dp, 27, 20, mb);
+        }
+        if (dp->smart_status < 0)
+            cp = "-";
+        else
+            cp = dp->smart_status ? "FAILED" : "PASSED";
+        printf("  %-20s %-12s %-6s %5s %8s  %s\n", dp->dev_name,
+               sh_power_mode_str(dp->power_mode), cp, tb, pb, mb);
+        if (res && (SH_COLLECTED == dp->state))
+            printf("      %s: %s\n", dp->fail_cmd_s, b);
+        fflush(stdout);
+    }
+    if (scp->verbose)
+        pr2serr("%s: %d ATA commands in %" PRIu64 " ms, %s\n",
+                dp->dev_name, dp->num_cmds, dp->elapsed_ns / 1000000, b);
+    if (dp->free_bp) {
+        free(dp->free_bp);
+        dp->free_bp = NULL;
+        dp->bp = NULL;
+    }
+}
+
+/* Decodes comma separated list of GPL log addresses */
+static int
+sh_decode_logs(struct sh_ctx_t * scp, const char * arg)
+{
+    int n;
+    const char * cp;
+
+    for (cp = arg; cp && *cp; cp = strchr(cp, ',')) {
+        if (',' == *cp)
+            ++cp;
+        n = sg_get_num_nomult(cp);
+        if ((n < 1) || (n > 0xff)) {
+            pr2serr("--log= expects log addresses between 1 and 255\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (scp->num_xlogs >= SH_MAX_XLOGS) {
+            pr2serr("--log= accepts at most %d log addresses\n",
+                    SH_MAX_XLOGS);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        scp->xlog_arr[scp->num_xlogs++] = n;
+    }
+    return 0;
+}
+
+/* Processes the options that can be in the same argument as '-j' such
+ * as '-jv'. Returns 0 if okay, else SG_LIB_SYNTAX_ERROR. */
+static int
+chk_short_opts(const char sopt_ch, struct sh_ctx_t * scp,
+               bool * verbose_givenp, bool * version_givenp)
+{
+    /* only need to process short, non-argument options used with -j */
+    switch (sopt_ch) {
+    case 'j':
+        break;  /* simply ignore second 'j' (e.g. '-jxj') */
+    case 'r':
+        scp->rdonly = true;
+        break;
+    case 'v':
+        *verbose_givenp = true;
+        ++scp->verbose;
+        break;
+    case 'V':
+        *version_givenp = true;
+        break;
+    case 'w':
+        scp->wake = true;
+        break;
+    default:
+        pr2serr("unrecognised option code %c [0x%x] ??\n", sopt_ch,
+                sopt_ch);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    bool do_json = false;
+    bool verbose_given = false;
+    bool version_given = false;
+    int k, c, n, err;
+    int num_workers = SG_PAR_DEF_WORKERS;
+    int ret = 0;
+    uint64_t el_ns;
+    const char * dl_fn = NULL;
+    const char * json_arg = NULL;
+    const char * js_file = NULL;
+    FILE * js_fp = stdout;
+    struct sh_ctx_t ctx;
+    struct sh_ctx_t * scp = &ctx;
+    struct sg_par_dev_list dlist;
+    sgj_state json_st SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &json_st;
+    sgj_opaque_p jop = NULL;
+    char b[32];
+
+    memset(scp, 0, sizeof(*scp));
+    memset(&dlist, 0, sizeof(dlist));
+    scp->tmo = DEF_TIMEOUT;
+    scp->jsp = jsp;
+    if (getenv("SG3_UTILS_INVOCATION"))
+        sg_rep_invocation(MY_NAME, version_str, argc, argv, stderr);
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "hj::J:l:L:p:rt:vVw", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            do_json = true;
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                if ('^' == c) {
+                    json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    json_arg = optarg + 1;
+                    break;
+                }
+                n = strlen(optarg);
+                for (k = 0; k < n; ++k) {
+                    if (chk_short_opts(*(optarg + k), scp, &verbose_given,
+                                       &version_given))
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+            } else
+                json_arg = NULL;
+            break;
+        case 'J':
+            do_json = true;
+            js_file = optarg;
+            break;
+        case 'l':
+            if (sh_decode_logs(scp, optarg))
+                return SG_LIB_SYNTAX_ERROR;
+            break;
+        case 'L':
+            dl_fn = optarg;
+            break;
+        case 'p':
+            num_workers = sg_get_num(optarg);
+            if ((num_workers < 1) || (num_workers > SG_PAR_MAX_WORKERS)) {
+                pr2serr("--parallel= expects an argument between 1 and %d "
+                        "inclusive\n", SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'r':
+            scp->rdonly = true;
+            break;
+        case 't':
+            scp->tmo = sg_get_num(optarg);
+            if (scp->tmo < 0) {
+                pr2serr("bad argument to '--timeout='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'v':
+            verbose_given = true;
+            ++scp->verbose;
+            break;
+        case 'V':
+            version_given = true;
+            break;
+        case 'w':
+            scp->wake = true;
+            break;
+        default:
+            pr2serr("unrecognised option code 0x%x ??\n", c);
+            usage();
+            return SG_LIB_SYNTAX_ERROR;
+        }
+    }
+    for (; optind < argc; ++optind) {
+        ret = sg_par_dev_list_add(&dlist, argv[optind], scp->verbose);
+        if (ret)
+            goto fini;
+    }
+
+#ifdef DEBUG
+    pr2serr("In DEBUG mode, ");
+    if (verbose_given && version_given) {
+        pr2serr("but override: '-vV' given, zero verbose and continue\n");
+        verbose_given = false;
+        version_given = false;
+        scp->verbose = 0;
+    } else if (! verbose_given) {
+        pr2serr("set '-vv'\n");
+        scp->verbose = 2;
+    } else
+        pr2serr("keep verbose=%d\n", scp->verbose);
+#else
+    if (verbose_given && version_given)
+        pr2serr("Not in DEBUG mode, so '-vV' has no special action\n");
+#endif
+    if (version_given) {
+        pr2serr("version: %s\n", version_str);
+        goto fini;
+    }
+    if (dl_fn) {
+        ret = sg_par_dev_list_from_file(&dlist, dl_fn, scp->verbose);
+        if (ret)
+            goto fini;
+    }
+    if (0 == dlist.num) {
+        pr2serr("missing device name!\n");
+        usage();
+        ret = SG_LIB_SYNTAX_ERROR;
+        goto fini;
+    }
+    if (0 == scp->tmo)
+        scp->tmo = DEF_TIMEOUT;
+    if (do_json) {
+        if (! sgj_init_state(jsp, json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char)
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto fini;
+        }
+        if (js_file && ((1 != strlen(js_file)) || ('-' != js_file[0]))) {
+            js_fp = fopen(js_file, "w");   /* truncate if exists */
+            if (NULL == js_fp) {
+                err = errno;
+                pr2serr("unable to open file: %s [%s]\n", js_file,
+                        safe_strerror(err));
+                ret = sg_convert_errno(err);
+                goto fini;
+            }
+        }
+        /* '--js-file=-' will send JSON output to stdout */
+        sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+        /* each disk's object is written out as it completes */
+        sgj_stream_start(jsp, js_fp);
+        jop = sgj_named_subobject_r(jsp, NULL, "sat_health");
+        sgj_js_nv_i(jsp, jop, "parallel", num_workers);
+        sgj_js_nv_i(jsp, jop, "timeout_secs", scp->tmo);
+        sgj_js_nv_b(jsp, jop, "wake", scp->wake);
+        scp->jap = sgj_named_subarray_stream_r(jsp, jop, "device_list");
+    }
+
+    scp->devp = (struct sh_dev_t *)calloc(dlist.num, sizeof(*scp->devp));
+    if (NULL == scp->devp) {
+        pr2serr("out of memory\n");
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < dlist.num; ++k)
+        scp->devp[k].dev_name = dlist.names[k];
+    scp->num_devs = dlist.num;
+    sgj_pr_hr(jsp, "  %-20s %-12s %-6s %5s %8s  %s\n", "Device", "Power",
+              "SMART", "Temp", "POH", "Model");
+    el_ns = sg_par_mono_ns();
+    err = sg_par_run(scp->num_devs, num_workers, sh_work, sh_done, scp);
+    el_ns = sg_par_mono_ns() - el_ns;
+    if (err) {
+        pr2serr("unable to start workers: %s\n", safe_strerror(err));
+        ret = sg_convert_errno(err);
+        goto fini;
+    }
+    /* report the first failure, in the order devices were given */
+    for (k = 0; k < scp->num_devs; ++k) {
+        if (scp->devp[k].res) {
+            ret = scp->devp[k].res;
+            break;
+        }
+    }
+    snprintf(b, sizeof(b), "%" PRIu64 ".%03u", el_ns / 1000000000,
+             (unsigned int)((el_ns / 1000000) % 1000));
+    sgj_pr_hr(jsp, "%d disk%s: %d collected, %d skipped, %d with errors "
+              "in %s seconds\n", scp->num_devs,
+              (1 == scp->num_devs) ? "" : "s", scp->num_collected,
+              scp->num_skipped, scp->num_failed, b);
+    sgj_js_nv_i(jsp, jop, "devices", scp->num_devs);
+    sgj_js_nv_i(jsp, jop, "collected", scp->num_collected);
+    sgj_js_nv_i(jsp, jop, "skipped", scp->num_skipped);
+    sgj_js_nv_i(jsp, jop, "errors", scp->num_failed);
+    sgj_js_nv_i(jsp, jop, "elapsed_usecs", (int64_t)(el_ns / 1000));
+fini:
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (jsp->pr_as_json) {
+        sgj_js2file(jsp, NULL, ret, js_fp);
+        sgj_finish(jsp);
+    }
+    if (js_fp && (stdout != js_fp))
+        fclose(js_fp);
+    if (scp->devp)
+        free(scp->devp);
+    sg_par_dev_list_free(&dlist);
+    if (ret && (0 == scp->verbose)) {
+        if (! sg_if_can2stderr("sg_sat_health failed: ", ret))
+            pr2serr("Some error occurred, try again with '-v' or '-vv' for "
+                    "more information\n");
+    }
+    return ret;
+}
@@ -13,6 +13,9 @@
  * Options: -a   alpha scan: scan /dev/sga,b,c, ....
  *          -i   do SCSI inquiry on device (implies -w)
  *          -n   numeric scan: scan /dev/sg0,1,2, ....
+ *          -p=PN  maximum parallel INQUIRYs with -s (def: 8)
+ *          -s   sysfs first scan: list from sysfs, no I/O unless -i
+ *          -T=SECS  INQUIRY timeout with -s (def: 20)
  *          -V   output version string and exit
  *          -w   open writable (new driver opens readable unless -i)
  *          -x   extra information output
@@ -41,6 +44,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
 #include <dirent.h>
 #include <libgen.h>
 #include <sys/ioctl.h>
@@ -51,9 +56,10 @@
 #include "sg_lib.h"
 #include "sg_io_linux.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
 
-static const char * version_str = "4.19 20230623";
+static const char * version_str = "4.20 20231024";
 
 #define ME "sg_scan: "
 
@@ -98,12 +104,21 @@ static uint8_t inq_cdb[INQ_CMD_LEN] =
 
 void usage()
 {
-    printf("Usage: sg_scan [-a] [-i] [-n] [-v] [-V] [-w] [-x] "
-           "[DEVICE]*\n");
+    printf("Usage: sg_scan [-a] [-i] [-n] [-p=PN] [-s] [-T=SECS] [-v] [-V] "
+           "[-w] [-x]\n"
+           "               [DEVICE]*\n");
     printf("  where:\n");
     printf("    -a    do alpha scan (ie sga, sgb, sgc)\n");
     printf("    -i    do SCSI INQUIRY, output results\n");
     printf("    -n    do numeric scan (ie sg0, sg1...) [default]\n");
+    printf("    -p=PN    maximum number of INQUIRYs outstanding with -s "
+           "(def: %d)\n", SG_PAR_DEF_WORKERS);
+    printf("    -s    sysfs first: list sg devices and their vendor, "
+           "model and rev\n"
+           "          from sysfs without opening them; with -i send "
+           "INQUIRYs in\n"
+           "          parallel, output as they complete\n");
+    printf("    -T=SECS    timeout for each INQUIRY with -s (def: 20)\n");
     printf("    -v    increase verbosity\n");
     printf("    -V    output version string then exit\n");
     printf("    -w    force open with read/write flag\n");
@@ -169,6 +184,200 @@ void make_dev_name(char * fname, int k, bool do_numeric)
     }
 }
 
+/* Sysfs first scan (-s option). Each sg device bound to a SCSI device is
+ * listed from the attributes that the SCSI mid-level exports in sysfs, so
+ * no device is opened. If an INQUIRY is also requested (-i) then those are
+ * sent by a bounded pool of worker threads, each with its own timeout, and
+ * results are output in the order they arrive. */
+
+struct ss_dev_t {
+    int sg_num;
+    int pdt;            /* -1 if unknown */
+    int res;            /* result of INQUIRY, 0 is good */
+    unsigned int dur_ms;
+    char hctl[64];
+    char vendor[16];
+    char model[24];
+    char rev[8];
+    char q_depth[16];
+    uint8_t inq_b[INQ_REPLY_LEN];
+};
+
+struct ss_opts_t {
+    bool do_extra;
+    bool do_inquiry;
+    bool writeable;
+    int num_workers;
+    int tmo_secs;
+    int verbose;
+    struct ss_dev_t * devs;
+};
+
+/* Reads sysfs attribute of sg device 'sg_num' into b, without trailing
+ * whitespace. Returns false if not available. */
+static bool
+ss_get_attr(int sg_num, const char * attr, char * b, int blen)
+{
+    int k;
+    FILE * fp;
+    char name[128];
+
+    snprintf(name, sizeof(name), "%s/sg%d/device/%s", sysfs_sg_dir, sg_num,
+             attr);
+    b[0] = '\0';
+    fp = fopen(name, "r");
+    if (NULL == fp)
+        return false;
+    if (NULL == fgets(b, blen, fp))
+        b[0] = '\0';
+    fclose(fp);
+    for (k = (int)strlen(b) - 1; (k >= 0) && isspace((uint8_t)b[k]); --k)
+        b[k] = '\0';
+    return true;
+}
+
+static void
+ss_prt_dev(const struct ss_opts_t * sop, const struct ss_dev_t * dp)
+{
+    int h, c, t;
+    uint64_t l;
+    const uint8_t * p = dp->inq_b;
+
+    if (4 == sscanf(dp->hctl, "%d:%d:%d:%" SCNu64, &h, &c, &t, &l))
+        printf("/dev/sg%d: scsi%d channel=%d id=%d lun=%" PRIu64,
+               dp->sg_num, h, c, t, l);
+    else
+        printf("/dev/sg%d: [%s]", dp->sg_num, dp->hctl);
+    if (sop->do_extra && dp->q_depth[0])
+        printf("  queue_depth=%s\n", dp->q_depth);
+    else
+        printf("\n");
+    if (! sop->do_inquiry) {
+        printf("    %-8s  %-16s  %-4s [pdev=0x%x]\n", dp->vendor, dp->model,
+               dp->rev, (dp->pdt >= 0) ? dp->pdt : PDT_UNKNOWN);
+        return;
+    }
+    if (dp->res) {
+        char b[80];
+
+        sg_get_category_sense_str(dp->res, sizeof(b), b, sop->verbose);
+        printf("    INQUIRY failed: %s\n", b);
+        return;
+    }
+    printf("    %.8s  %.16s  %.4s ", p + 8, p + 16, p + 32);
+    printf("[rmb=%d cmdq=%d pqual=%d pdev=0x%x] ", !!(p[1] & 0x80),
+           !!(p[7] & 2), (p[0] & 0xe0) >> 5, (p[0] & PDT_MASK));
+    if (sop->do_extra)
+        printf("dur=%ums\n", dp->dur_ms);
+    else
+        printf("\n");
+}
+
+/* sg_par_run() worker: INQUIRY on one device */
+static int
+ss_inq_work(void * ctxp, int idx)
+{
+    int fd, res;
+    const struct ss_opts_t * sop = (const struct ss_opts_t *)ctxp;
+    struct ss_dev_t * dp = sop->devs + idx;
+    uint8_t sense_b[32] SG_C_CPP_ZERO_INIT;
+    struct sg_io_hdr io_hdr SG_C_CPP_ZERO_INIT;
+    char name[32];
+
+    snprintf(name, sizeof(name), "/dev/sg%d", dp->sg_num);
+    fd = open(name, O_NONBLOCK | (sop->writeable ? O_RDWR : O_RDONLY));
+    if (fd < 0) {
+        dp->res = sg_convert_errno(errno);
+        return dp->res;
+    }
+    memset(dp->inq_b, 0, INQ_REPLY_LEN);
+    io_hdr.interface_id = 'S';
+    io_hdr.cmd_len = sizeof(inq_cdb);
+    io_hdr.mx_sb_len = sizeof(sense_b);
+    io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    io_hdr.dxfer_len = INQ_REPLY_LEN;
+    io_hdr.dxferp = dp->inq_b;
+    io_hdr.cmdp = inq_cdb;
+    io_hdr.sbp = sense_b;
+    io_hdr.timeout = sop->tmo_secs * 1000;
+    if (ioctl(fd, SG_IO, &io_hdr) < 0)
+        res = sg_convert_errno(errno);
+    else {
+        res = sg_err_category3(&io_hdr);
+        if (SG_LIB_CAT_RECOVERED == res)
+            res = 0;
+        dp->dur_ms = io_hdr.duration;
+    }
+    close(fd);
+    dp->res = res;
+    return res;
+}
+
+static void
+ss_inq_done(void * ctxp, int idx, int res)
+{
+    const struct ss_opts_t * sop = (const struct ss_opts_t *)ctxp;
+
+    if (res && (sop->verbose > 1))
+        pr2serr("/dev/sg%d: INQUIRY res=%d\n", sop->devs[idx].sg_num, res);
+    ss_prt_dev(sop, sop->devs + idx);
+    fflush(stdout);
+}
+
+/* Uses gen_index_arr[] as filled by sysfs_sg_scan() */
+static int
+ss_scan(struct ss_opts_t * sop)
+{
+    int k, n, num, res;
+    ssize_t len;
+    struct ss_dev_t * dp;
+    char b[32];
+    char name[128];
+    char lnk[256];
+
+    for (num = 0, k = 0; k < PRESENT_ARRAY_SIZE; ++k)
+        num += !! gen_index_arr[k];
+    if (0 == num)
+        return 0;
+    sop->devs = (struct ss_dev_t *)calloc(num, sizeof(struct ss_dev_t));
+    if (NULL == sop->devs) {
+        pr2serr(ME "Out of memory\n");
+        return sg_convert_errno(ENOMEM);
+    }
+    for (n = 0, k = 0; (k < PRESENT_ARRAY_SIZE) && (n < num); ++k) {
+        if (0 == gen_index_arr[k])
+            continue;
+        dp = sop->devs + n++;
+        dp->sg_num = k;
+        snprintf(name, sizeof(name), "%s/sg%d/device", sysfs_sg_dir, k);
+        len = readlink(name, lnk, sizeof(lnk) - 1);
+        if (len > 0) {
+            lnk[len] = '\0';
+            snprintf(dp->hctl, sizeof(dp->hctl), "%s", basename(lnk));
+        }
+        ss_get_attr(k, "vendor", dp->vendor, sizeof(dp->vendor));
+        ss_get_attr(k, "model", dp->model, sizeof(dp->model));
+        ss_get_attr(k, "rev", dp->rev, sizeof(dp->rev));
+        dp->pdt = ss_get_attr(k, "type", b, sizeof(b)) ? atoi(b) : -1;
+        if (sop->do_extra)
+            ss_get_attr(k, "queue_depth", dp->q_depth, sizeof(dp->q_depth));
+        if (! sop->do_inquiry)
+            ss_prt_dev(sop, dp);        /* no I/O so output now */
+    }
+    if (! sop->do_inquiry)
+        return 0;
+    if (sop->verbose)
+        pr2serr("INQUIRY on %d devices, up to %d at a time\n", num,
+                sop->num_workers);
+    res = sg_par_run(num, sop->num_workers, ss_inq_work, ss_inq_done, sop);
+    if (res) {
+        pr2serr(ME "unable to start worker threads: %s\n",
+                safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    return 0;
+}
+
 
 int main(int argc, char * argv[])
 {
@@ -178,6 +387,7 @@ int main(int argc, char * argv[])
     bool eacces_err = false;
     bool has_file_args = false;
     bool has_sysfs_sg = false;
+    bool do_sysfs = false;
     bool jmp_out;
     bool sg_ver3 = false;
     bool sg_ver3_set = false;
@@ -189,6 +399,8 @@ int main(int argc, char * argv[])
     const int max_file_args = PRESENT_ARRAY_SIZE;
     int num_errors = 0;
     int num_silent = 0;
+    int num_workers = SG_PAR_DEF_WORKERS;
+    int tmo_secs = 20;
     int verbose = 0;
     char * file_namep;
     const char * cp;
@@ -228,6 +440,9 @@ int main(int argc, char * argv[])
                 case 'n':
                     do_numeric = true;
                     break;
+                case 's':
+                    do_sysfs = true;
+                    break;
                 case 'v':
                     ++verbose;
                     break;
@@ -249,7 +464,20 @@ int main(int argc, char * argv[])
             }
             if (plen <= 0)
                 continue;
-            if (jmp_out) {
+            if (0 == strncmp("p=", cp, 2)) {
+                num_workers = sg_get_num(cp + 2);
+                if ((num_workers < 1) || (num_workers > SG_PAR_MAX_WORKERS)) {
+                    pr2serr("Couldn't decode number after 'p=' option, "
+                            "expect 1 to %d\n", SG_PAR_MAX_WORKERS);
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            } else if (0 == strncmp("T=", cp, 2)) {
+                tmo_secs = sg_get_num(cp + 2);
+                if (tmo_secs < 1) {
+                    pr2serr("Couldn't decode number after 'T=' option\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+            } else if (jmp_out) {
                 pr2serr("Unrecognized option: %s\n", cp);
                 usage();
                 return SG_LIB_SYNTAX_ERROR;
@@ -265,6 +493,32 @@ int main(int argc, char * argv[])
         }
     }
 
+    if (do_sysfs) {
+        struct ss_opts_t ss_opts;
+
+        if (has_file_args) {
+            pr2serr("The -s option scans sysfs, so does not take DEVICE "
+                    "names\n");
+            return SG_LIB_CONTRADICT;
+        }
+        res = sysfs_sg_scan(sysfs_sg_dir);
+        if (res < 0) {
+            pr2serr(ME "unable to scan %s: %s\n", sysfs_sg_dir,
+                    safe_strerror(-res));
+            return sg_convert_errno(-res);
+        }
+        memset(&ss_opts, 0, sizeof(ss_opts));
+        ss_opts.do_extra = do_extra;
+        ss_opts.do_inquiry = do_inquiry;
+        ss_opts.writeable = writeable;
+        ss_opts.num_workers = num_workers;
+        ss_opts.tmo_secs = tmo_secs;
+        ss_opts.verbose = verbose;
+        res = ss_scan(&ss_opts);
+        free(ss_opts.devs);
+        free(gen_index_arr);
+        return res;
+    }
     if ((! has_file_args) && (stat(sysfs_sg_dir, &a_stat) >= 0) &&
         (S_ISDIR(a_stat.st_mode)))
         has_sysfs_sg = !! sysfs_sg_scan(sysfs_sg_dir);
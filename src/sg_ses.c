@@ -17,6 +17,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <time.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <getopt.h>
@@ -35,13 +36,14 @@
 #include "sg_pt.h"
 #include "sg_pr2serr.h"
 #include "sg_json_sg_lib.h"
+#include "sg_par_common.h"
 
 /*
  * This program issues SCSI SEND DIAGNOSTIC and RECEIVE DIAGNOSTIC RESULTS
  * commands tailored for SES (enclosure) devices.
  */
 
-static const char * version_str = "2.86 20230623";    /* ses4r04 */
+static const char * version_str = "2.87 20231028";    /* ses4r04 */
 
 #define MY_NAME "sg_ses"
 
@@ -189,6 +191,9 @@ struct opts_t {
     int seid;
     int page_code;      /* recognised abbreviations converted to dpage num */
     int verbose;
+    int watch_secs;     /* --watch=SECS[,CNT] */
+    int watch_count;    /* 0 -> until interrupted */
+    int dev_argc;       /* number of DEVICE arguments */
     int num_cgs;        /* number of --clear-, --get= and --set= options */
     int mx_arr_len;     /* allocated size of data_arr */
     int arr_len;        /* valid bytes in data_arr */
@@ -196,6 +201,7 @@ struct opts_t {
     uint8_t * free_data_arr;
     const char * desc_name;
     const char * dev_name;
+    char ** dev_argv;   /* first DEVICE argument */
     const struct element_type_t * ind_etp;
     const char * index_str;
     const char * nickname_str;
@@ -483,6 +489,7 @@ static const struct option long_options[] = {
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {"warn", no_argument, 0, 'w'},
+    {"watch", required_argument, 0, 'W'},
     {0, 0, 0, 0},
 };
 
@@ -995,10 +1002,15 @@ static void other_usage(bool long_opt)
     if (long_opt)
         pr2serr(
             "    sg_ses  [--enumerate | --list] [--help] [--version]\n"
+            "    sg_ses  --watch=SECS[,CNT] [--json] [--maxlen=LEN] "
+            "[--readonly]\n"
+            "            [--verbose] DEVICE [DEVICE...]\n"
             );
     else
         pr2serr(
             "    sg_ses  [-e | -l] [-h] [-V]\n"
+            "    sg_ses  -W SECS[,CNT] [-J] [-m LEN] [-R] [-v] DEVICE "
+            "[DEVICE...]\n"
             );
 }
 
@@ -1160,7 +1172,13 @@ usage(int help_num)
             "read-write)\n"
             "    --verbose|-v        increase verbosity\n"
             "    --version|-V        print version string and exit\n"
-            "    --warn|-w           warn about join (and other) issues\n\n"
+            "    --warn|-w           warn about join (and other) issues\n"
+            "    --watch=SECS[,CNT]|-W SECS[,CNT]    poll each DEVICE every "
+            "SECS\n"
+            "                        seconds (CNT times, def: forever) and "
+            "output\n"
+            "                        element status changes; --json for "
+            "JSON lines\n\n"
             "SES dpage contents may be fetched from a file named FN by "
             "either\n'--data=@FN' or '--inhex=FN' and it can be parsed and "
             "DEVICE, if given,\nwill be ignored. However when '--control' is "
@@ -1476,7 +1494,7 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
         int option_index = 0;
 
         c = getopt_long(argc, argv, "^aA:b:cC:d:D:eE:fFG:hHiI:jJ::ln:N:m:Mp:"
-                        "qQ:rRsS:vVwx:X:yz", long_options, &option_index);
+                        "qQ:rRsS:vVwW:x:X:yz", long_options, &option_index);
         if (c == -1)
             break;
 
@@ -1720,6 +1738,24 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
         case 'w':
             op->do_warn = true;
             break;
+        case 'W':
+            n = sg_get_num_nomult(optarg);
+            if (n < 1) {
+                pr2serr("bad argument to '--watch=', expect SECS of 1 or "
+                        "more\n");
+                goto err_fini;
+            }
+            op->watch_secs = n;
+            cp = strchr(optarg, ',');
+            if (cp) {
+                n = sg_get_num_nomult(cp + 1);
+                if (n < 0) {
+                    pr2serr("bad CNT in '--watch=SECS,CNT'\n");
+                    goto err_fini;
+                }
+                op->watch_count = n;
+            }
+            break;
         case 'x':
             op->dev_slot_num = sg_get_num_nomult(optarg);
             if ((op->dev_slot_num < 0) || (op->dev_slot_num > 255)) {
@@ -1750,14 +1786,31 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[])
     if (optind < argc) {
         if (NULL == op->dev_name) {
             op->dev_name = argv[optind];
+            op->dev_argv = argv + optind;
+            op->dev_argc = argc - optind;
             ++optind;
         }
-        if (optind < argc) {
+        if ((optind < argc) && (0 == op->watch_secs)) {
             for (; optind < argc; ++optind)
                 pr2serr("Unexpected extra argument: %s\n", argv[optind]);
             goto err_help;
         }
     }
+    if (op->watch_secs > 0) {
+        if (op->do_control || op->data_or_inhex || op->num_cgs ||
+            op->nickname_str) {
+            pr2serr("--watch= conflicts with --control, --data=, --inhex=, "
+                    "--clear=, --get=,\n--set= and --nickname=\n");
+            res = SG_LIB_CONTRADICT;
+            goto err_fini;
+        }
+        if (NULL == op->dev_name) {
+            pr2serr("missing DEVICE name!\n\n");
+            res = SG_LIB_FILE_ERROR;
+            goto err_help;
+        }
+        return 0;       /* other options are ignored by --watch= */
+    }
     if (op->no_config && (op->do_join > 0)) {
          pr2serr("Need configuration dpage to do the join operation\n\n");
          goto err_help;
@@ -7693,6 +7746,541 @@ enumerate_work(const struct opts_t * op)
 }
 
 
+/* The --watch=SECS option. The Configuration dpage (and Element Descriptor
+ * dpage, for names) of each enclosure is fetched once and kept until the
+ * generation code in the Enclosure Status dpage changes. Each SECS seconds
+ * only the Enclosure Status dpage is fetched and compared with the
+ * previous one; each element whose status changed is output. Enclosures
+ * are polled concurrently and hold no state in the globals used by the
+ * other modes. With --json each event is a JSON object built on the heap
+ * by the worker (the JSON state has no arena and is only read by workers)
+ * and written, one per line, by watch_done() which is serialized. */
+
+/* Status bits compared for each element type, indexed by element type
+ * code (other element types compare all bits). Measured values (fan speed,
+ * temperature, voltage and current) are masked out as they change without
+ * the element's state changing. */
+static const uint8_t watch_es_mask_arr[][4] = {
+    {0x7f, 0xff, 0xff, 0xff},   /* [0] UNSPECIFIED */
+    {0x7f, 0xff, 0xff, 0xff},   /* DEVICE */
+    {0x7f, 0xff, 0xff, 0xff},   /* POWER_SUPPLY */
+    {0x7f, 0xc0, 0x00, 0xf8},   /* COOLING: actual fan speed ignored */
+    {0x7f, 0xc0, 0x00, 0x0f},   /* TEMPERATURE: temperature ignored */
+    {0x7f, 0xff, 0xff, 0xff},   /* DOOR */
+    {0x7f, 0xff, 0xff, 0xff},   /* AUD_ALARM */
+    {0x7f, 0xff, 0xff, 0xff},   /* ENC_SCELECTR */
+    {0x7f, 0xff, 0xff, 0xff},   /* SCC_CELECTR */
+    {0x7f, 0xff, 0xff, 0xff},   /* NV_CACHE */
+    {0x7f, 0xff, 0xff, 0xff},   /* [10] INV_OP_REASON */
+    {0x7f, 0xff, 0xff, 0xff},   /* UI_POWER_SUPPLY */
+    {0x7f, 0xff, 0xff, 0xff},   /* DISPLAY */
+    {0x7f, 0xff, 0xff, 0xff},   /* KEY_PAD */
+    {0x7f, 0xff, 0xff, 0xff},   /* ENCLOSURE */
+    {0x7f, 0xff, 0xff, 0xff},   /* SCSI_PORT_TRAN */
+    {0x7f, 0xff, 0xff, 0xff},   /* LANGUAGE */
+    {0x7f, 0xff, 0xff, 0xff},   /* COMM_PORT */
+    {0x7f, 0xff, 0x00, 0x00},   /* VOLT_SENSOR: voltage ignored */
+    {0x7f, 0xff, 0x00, 0x00},   /* CURR_SENSOR: current ignored */
+};
+
+#define WATCH_MX_OUT_LINE 512
+
+struct watch_el_t {
+    uint8_t etype;
+    uint8_t se_id;
+    int th_i;           /* type header index */
+    int indiv_i;        /* -1 for overall element */
+    int ed_off;         /* offset of name in ed_rsp, 0 if none */
+    int ed_len;
+};
+
+struct watch_dev_t {
+    bool dead;          /* open failed, no further polls */
+    bool have_cfg;
+    int sg_fd;
+    int res;
+    int num_el;
+    int out_len;
+    int out_max;
+    int num_jo;
+    int max_jo;
+    uint32_t gen_code;
+    const char * name;
+    struct sg_pt_base * ptvp;
+    uint8_t * es_rsp;
+    uint8_t * free_es_rsp;
+    uint8_t * prev_es;  /* previous Enclosure Status dpage */
+    uint8_t * ed_rsp;   /* Element Descriptor dpage, for element names */
+    uint8_t * free_ed_rsp;
+    struct watch_el_t * el_arr;
+    char * out;         /* lines to be written by watch_done() */
+    sgj_opaque_p * jo_arr;      /* JSON objects for watch_done() */
+};
+
+struct watch_t {
+    struct opts_t * op;
+    bool as_json;
+    int poll;
+    sgj_state * jsp;
+    FILE * fp;          /* for JSON lines */
+    struct watch_dev_t * dev_arr;
+};
+
+static void
+watch_outf(struct watch_dev_t * dp, const char * fmt, ...) __printf(2, 3);
+
+/* Appends to the output lines of the given enclosure */
+static void
+watch_outf(struct watch_dev_t * dp, const char * fmt, ...)
+{
+    int n;
+    char * cp;
+    va_list args;
+
+    while (true) {
+        va_start(args, fmt);
+        n = vsnprintf(dp->out ? (dp->out + dp->out_len) : NULL,
+                      dp->out_max - dp->out_len, fmt, args);
+        va_end(args);
+        if (n < 0)
+            return;
+        if ((dp->out_len + n) < dp->out_max) {
+            dp->out_len += n;
+            return;
+        }
+        cp = (char *)realloc(dp->out, dp->out_max + n + 1024);
+        if (NULL == cp)
+            return;
+        dp->out = cp;
+        dp->out_max += n + 1024;
+    }
+}
+
+/* Starts an event: in plain text an output line with the time and the
+ * enclosure's name. With --json a new JSON object, holding the same and
+ * the event name, that watch_done() will write out is returned (NULL if
+ * out of memory). Returns NULL in plain text. */
+static sgj_opaque_p
+watch_line_start(const struct watch_t * wp, struct watch_dev_t * dp,
+                 const char * event)
+{
+    time_t t;
+    struct timeval tv;
+    struct tm tm_s;
+    sgj_state * jsp = wp->jsp;
+    sgj_opaque_p jop;
+    sgj_opaque_p * jopp;
+    char b[WATCH_MX_OUT_LINE];
+
+    gettimeofday(&tv, NULL);
+    if (wp->as_json) {
+        if (dp->num_jo >= dp->max_jo) {
+            jopp = (sgj_opaque_p *)realloc(dp->jo_arr,
+                                           (dp->max_jo + 8) * sizeof(*jopp));
+            if (NULL == jopp)
+                return NULL;
+            dp->jo_arr = jopp;
+            dp->max_jo += 8;
+        }
+        jop = sgj_new_unattached_object_r(jsp);
+        if (NULL == jop)
+            return NULL;
+        dp->jo_arr[dp->num_jo++] = jop;
+        sgj_js_nv_i(jsp, jop, "time_ms", (int64_t)tv.tv_sec * 1000 +
+                                         tv.tv_usec / 1000);
+        sgj_js_nv_s(jsp, jop, "device", dp->name);
+        sgj_js_nv_i(jsp, jop, "poll", wp->poll);
+        sgj_js_nv_s(jsp, jop, "event", event);
+        return jop;
+    }
+    t = tv.tv_sec;
+    if (NULL == localtime_r(&t, &tm_s))
+        memset(&tm_s, 0, sizeof(tm_s));
+    strftime(b, sizeof(b), "%Y-%m-%d %H:%M:%S", &tm_s);
+    watch_outf(dp, "%s %s: ", b, dp->name);
+    return NULL;
+}
+
+static void
+watch_error(const struct watch_t * wp, struct watch_dev_t * dp,
+            const char * leadin, int res)
+{
+    sgj_opaque_p jop;
+    char b[80];
+    char d[128];
+
+    if (res < 0)        /* do_rec_diag() wrong page or enclosure busy */
+        snprintf(b, sizeof(b), "unexpected response");
+    else
+        sg_get_category_sense_str(res, sizeof(b), b, 0);
+    jop = watch_line_start(wp, dp, "error");
+    if (wp->as_json) {
+        if (jop) {
+            snprintf(d, sizeof(d), "%s: %s", leadin, b);
+            sgj_js_nv_s(wp->jsp, jop, "error", d);
+            sgj_js_nv_i(wp->jsp, jop, "exit_status", res);
+        }
+    } else
+        watch_outf(dp, "%s: %s\n", leadin, b);
+}
+
+/* Builds the element list of an enclosure from its Configuration dpage,
+ * taking element names from the Element Descriptor dpage if available.
+ * Returns 0 on success. */
+static int
+watch_get_config(const struct watch_t * wp, struct watch_dev_t * dp)
+{
+    int k, j, n, el, num_subs, num_ths, resp_len, ed_len, off, res;
+    int num_el = 0;
+    uint8_t * cfg;
+    uint8_t * free_cfg = NULL;
+    const uint8_t * bp;
+    const uint8_t * thp;
+    struct opts_t * op = wp->op;
+    struct watch_el_t * ep;
+
+    dp->have_cfg = false;
+    cfg = sg_memalign(op->maxlen, 0, &free_cfg, false);
+    if (NULL == cfg)
+        return sg_convert_errno(ENOMEM);
+    res = do_rec_diag(dp->ptvp, CONFIGURATION_DPC, cfg, op->maxlen, op,
+                      &resp_len);
+    if (res)
+        goto fini;
+    res = SG_LIB_CAT_MALFORMED;
+    if (resp_len < 8)
+        goto fini;
+    dp->gen_code = sg_get_unaligned_be32(cfg + 4);
+    num_subs = cfg[1] + 1;
+    for (k = 0, num_ths = 0, bp = cfg + 8; k < num_subs; ++k, bp += el) {
+        if ((bp + 4) > (cfg + resp_len))
+            goto fini;
+        el = bp[3] + 4;
+        num_ths += bp[2];
+    }
+    thp = bp;
+    if ((thp + (4 * num_ths)) > (cfg + resp_len))
+        goto fini;
+    for (k = 0, bp = thp; k < num_ths; ++k, bp += 4)
+        num_el += bp[1] + 1;    /* plus one for overall element */
+    free(dp->el_arr);
+    dp->el_arr = (struct watch_el_t *)calloc(num_el + 1, sizeof(*ep));
+    if (NULL == dp->el_arr) {
+        res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    if (do_rec_diag(dp->ptvp, ELEM_DESC_DPC, dp->ed_rsp, op->maxlen, op,
+                    &ed_len) || (ed_len < 8) ||
+        (sg_get_unaligned_be32(dp->ed_rsp + 4) != dp->gen_code))
+        ed_len = 0;     /* element names are optional */
+    off = 8;
+    for (k = 0, ep = dp->el_arr, bp = thp; k < num_ths; ++k, bp += 4) {
+        for (j = -1; j < bp[1]; ++j, ++ep) {
+            ep->etype = bp[0];
+            ep->se_id = bp[2];
+            ep->th_i = k;
+            ep->indiv_i = j;
+            if ((off + 4) <= ed_len) {
+                n = sg_get_unaligned_be16(dp->ed_rsp + off + 2);
+                if ((off + 4 + n) <= ed_len) {
+                    ep->ed_off = off + 4;
+                    ep->ed_len = n;
+                }
+                off += n + 4;
+            }
+        }
+    }
+    dp->num_el = num_el;
+    dp->have_cfg = true;
+    res = 0;
+fini:
+    free(free_cfg);
+    return res;
+}
+
+/* Outputs one event for an element whose status has changed */
+static void
+watch_el_changed(const struct watch_t * wp, struct watch_dev_t * dp,
+                 const struct watch_el_t * ep, const uint8_t * oldp,
+                 const uint8_t * newp)
+{
+    const char * osp = elem_status_code_desc[oldp[0] & 0xf];
+    const char * nsp = elem_status_code_desc[newp[0] & 0xf];
+    const char * np = ep->ed_len ? (const char *)dp->ed_rsp + ep->ed_off :
+                                   NULL;
+    sgj_state * jsp = wp->jsp;
+    sgj_opaque_p jop;
+    char b[64];
+    char d[WATCH_MX_OUT_LINE];
+
+    etype_str(ep->etype, b, sizeof(b));
+    jop = watch_line_start(wp, dp, "element_changed");
+    if (wp->as_json) {
+        if (NULL == jop)
+            return;
+        sgj_js_nv_i(jsp, jop, "element_type", ep->etype);
+        sgj_js_nv_s(jsp, jop, "element_type_name", b);
+        sgj_js_nv_i(jsp, jop, "type_header_index", ep->th_i);
+        sgj_js_nv_i(jsp, jop, "element_index", ep->indiv_i);
+        sgj_js_nv_i(jsp, jop, "subenclosure_identifier", ep->se_id);
+        if (np)
+            sgj_js_nv_s_len_chk(jsp, jop, "descriptor",
+                                (const uint8_t *)np, ep->ed_len);
+        sgj_js_nv_s(jsp, jop, "old_status", osp);
+        sgj_js_nv_s(jsp, jop, "new_status", nsp);
+        snprintf(d, sizeof(d), "%02x%02x%02x%02x", oldp[0], oldp[1],
+                 oldp[2], oldp[3]);
+        sgj_js_nv_s(jsp, jop, "old_hex", d);
+        snprintf(d, sizeof(d), "%02x%02x%02x%02x", newp[0], newp[1],
+                 newp[2], newp[3]);
+        sgj_js_nv_s(jsp, jop, "new_hex", d);
+        return;
+    }
+    if (ep->indiv_i < 0)
+        snprintf(d, sizeof(d), "overall");
+    else
+        snprintf(d, sizeof(d), "%d", ep->indiv_i);
+    watch_outf(dp, "%s [ti=%d,ii=%s]", b, ep->th_i, d);
+    if (np)
+        watch_outf(dp, " '%.*s'", ep->ed_len, np);
+    watch_outf(dp, ": %s -> %s  [%02x %02x %02x %02x -> %02x %02x %02x "
+               "%02x]\n", osp, nsp, oldp[0], oldp[1], oldp[2], oldp[3],
+               newp[0], newp[1], newp[2], newp[3]);
+}
+
+/* Worker for sg_par_run(), polls one enclosure */
+static int
+watch_work(void * ctxp, int idx)
+{
+    int k, j, res, es_len, num;
+    uint8_t * tp;
+    struct watch_t * wp = (struct watch_t *)ctxp;
+    struct opts_t * op = wp->op;
+    struct watch_dev_t * dp = wp->dev_arr + idx;
+    const struct watch_el_t * ep;
+    const uint8_t * mp;
+    sgj_opaque_p jop;
+    static const uint8_t all_mask[4] = {0x7f, 0xff, 0xff, 0xff};
+
+    dp->out_len = 0;
+    if (dp->dead)
+        return dp->res;
+    if (dp->sg_fd < 0) {
+        dp->sg_fd = sg_cmds_open_device(dp->name, op->o_readonly,
+                                        op->verbose);
+        if (dp->sg_fd < 0) {
+            dp->res = sg_convert_errno(-dp->sg_fd);
+            dp->dead = true;
+            watch_error(wp, dp, "open", dp->res);
+            return dp->res;
+        }
+        dp->ptvp = construct_scsi_pt_obj_with_fd(dp->sg_fd, op->verbose);
+        if (NULL == dp->ptvp) {
+            dp->res = sg_convert_errno(ENOMEM);
+            dp->dead = true;
+            return dp->res;
+        }
+    }
+    res = do_rec_diag(dp->ptvp, ENC_STATUS_DPC, dp->es_rsp, op->maxlen, op,
+                      &es_len);
+    if (res) {
+        watch_error(wp, dp, "enclosure status", res);
+        return (dp->res = res);
+    }
+    if ((es_len < 8) || (! dp->have_cfg) ||
+        (sg_get_unaligned_be32(dp->es_rsp + 4) != dp->gen_code)) {
+        /* first poll or configuration changed: (re-)read Configuration
+         * dpage and take this Enclosure Status dpage as the baseline */
+        res = watch_get_config(wp, dp);
+        if (res) {
+            watch_error(wp, dp, "configuration", res);
+            return (dp->res = res);
+        }
+        if ((es_len < 8) ||
+            (sg_get_unaligned_be32(dp->es_rsp + 4) != dp->gen_code)) {
+            res = do_rec_diag(dp->ptvp, ENC_STATUS_DPC, dp->es_rsp,
+                              op->maxlen, op, &es_len);
+            if (res) {
+                watch_error(wp, dp, "enclosure status", res);
+                return (dp->res = res);
+            }
+        }
+        jop = watch_line_start(wp, dp, "configuration");
+        if (wp->as_json) {
+            if (jop) {
+                sgj_js_nv_i(wp->jsp, jop, "generation_code", dp->gen_code);
+                sgj_js_nv_i(wp->jsp, jop, "elements", dp->num_el);
+            }
+        } else
+            watch_outf(dp, "configuration %s, %s: %u, %d elements\n",
+                       (wp->poll > 0) ? "changed" : "read", gc_s,
+                       (unsigned int)dp->gen_code, dp->num_el);
+    } else {
+        num = (es_len - 8) / 4;
+        if (num > dp->num_el)
+            num = dp->num_el;
+        for (k = 0, ep = dp->el_arr; k < num; ++k, ++ep) {
+            const uint8_t * op4 = dp->prev_es + 8 + (4 * k);
+            const uint8_t * np4 = dp->es_rsp + 8 + (4 * k);
+
+            mp = (ep->etype < SG_ARRAY_SIZE(watch_es_mask_arr)) ?
+                 watch_es_mask_arr[ep->etype] : all_mask;
+            for (j = 0; j < 4; ++j) {
+                if ((op4[j] ^ np4[j]) & mp[j])
+                    break;
+            }
+            if (j < 4)
+                watch_el_changed(wp, dp, ep, op4, np4);
+        }
+    }
+    tp = dp->prev_es;           /* swap current and previous */
+    dp->prev_es = dp->es_rsp;
+    dp->es_rsp = tp;
+    dp->res = 0;
+    return 0;
+}
+
+/* Called (serialized) when an enclosure has been polled */
+static void
+watch_done(void * ctxp, int idx, int res)
+{
+    struct watch_t * wp = (struct watch_t *)ctxp;
+    struct watch_dev_t * dp = wp->dev_arr + idx;
+
+    int k;
+
+    if (res) { ; }
+    if (dp->out_len > 0) {
+        fwrite(dp->out, 1, dp->out_len, stdout);
+        fflush(stdout);
+    }
+    for (k = 0; k < dp->num_jo; ++k) {
+        sgj_js2file(wp->jsp, dp->jo_arr[k], 0, wp->fp);
+        sgj_free_unattached(dp->jo_arr[k]);
+    }
+    if (dp->num_jo > 0)
+        fflush(wp->fp);
+    dp->num_jo = 0;
+}
+
+static void
+watch_sleep_ns(uint64_t ns)
+{
+    struct timespec ts, rem;
+
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    while ((nanosleep(&ts, &rem) < 0) && (EINTR == errno))
+        ts = rem;
+}
+
+/* Handles --watch=SECS[,CNT]. Returns 0 if the last poll of every
+ * enclosure was successful, else the first error of the last poll. */
+static int
+ses_watch(struct opts_t * op)
+{
+    int k, j, n, res;
+    int ret = 0;
+    uint64_t start_ns, next_ns, now_ns;
+    struct sg_par_dev_list dev_list;
+    struct watch_t w;
+    struct watch_dev_t * dp;
+
+    memset(&dev_list, 0, sizeof(dev_list));
+    memset(&w, 0, sizeof(w));
+    for (k = 0; k < op->dev_argc; ++k) {
+        res = sg_par_dev_list_add(&dev_list, op->dev_argv[k], op->verbose);
+        if (res) {
+            sg_par_dev_list_free(&dev_list);
+            return res;
+        }
+    }
+    w.op = op;
+    w.as_json = op->do_json;
+    w.jsp = &op->json_st;
+    w.fp = stdout;
+    if (w.as_json) {
+        /* one event per line so not "pretty", no arena or streaming since
+         * events are built by the workers */
+        w.jsp->pr_pretty = false;
+        if (op->js_file &&
+            ((1 != strlen(op->js_file)) || ('-' != op->js_file[0]))) {
+            w.fp = fopen(op->js_file, "w");     /* truncate if exists */
+            if (NULL == w.fp) {
+                res = errno;
+                pr2serr("unable to open file: %s [%s]\n", op->js_file,
+                        safe_strerror(res));
+                sg_par_dev_list_free(&dev_list);
+                return sg_convert_errno(res);
+            }
+        }
+    }
+    w.dev_arr = (struct watch_dev_t *)calloc(dev_list.num, sizeof(*dp));
+    if (NULL == w.dev_arr) {
+        sg_par_dev_list_free(&dev_list);
+        return sg_convert_errno(ENOMEM);
+    }
+    for (k = 0, dp = w.dev_arr; k < dev_list.num; ++k, ++dp) {
+        dp->name = dev_list.names[k];
+        dp->sg_fd = -1;
+        dp->es_rsp = sg_memalign(2 * op->maxlen, 0, &dp->free_es_rsp,
+                                 false);
+        dp->ed_rsp = sg_memalign(op->maxlen, 0, &dp->free_ed_rsp, false);
+        if ((NULL == dp->es_rsp) || (NULL == dp->ed_rsp)) {
+            pr2serr("%s\n", oohm);
+            ret = sg_convert_errno(ENOMEM);
+            goto fini;
+        }
+        dp->prev_es = dp->es_rsp + op->maxlen;
+    }
+    n = (dev_list.num < SG_PAR_DEF_WORKERS) ? dev_list.num :
+                                              SG_PAR_DEF_WORKERS;
+    start_ns = sg_par_mono_ns();
+    for (w.poll = 0; (0 == op->watch_count) || (w.poll < op->watch_count);
+         ++w.poll) {
+        res = sg_par_run(dev_list.num, n, watch_work, watch_done, &w);
+        if (res) {
+            pr2serr("%s: unable to start workers: %s\n", __func__,
+                    safe_strerror(res));
+            ret = sg_convert_errno(res);
+            break;
+        }
+        for (k = 0, ret = 0; k < dev_list.num; ++k) {
+            if (w.dev_arr[k].res) {
+                ret = w.dev_arr[k].res;
+                break;
+            }
+        }
+        if ((op->watch_count > 0) && ((w.poll + 1) >= op->watch_count))
+            break;
+        /* keep to a fixed schedule so the interval does not drift */
+        next_ns = start_ns + ((uint64_t)(w.poll + 1) * op->watch_secs *
+                              1000000000);
+        now_ns = sg_par_mono_ns();
+        if (next_ns > now_ns)
+            watch_sleep_ns(next_ns - now_ns);
+    }
+fini:
+    for (k = 0, dp = w.dev_arr; k < dev_list.num; ++k, ++dp) {
+        if (dp->ptvp)
+            destruct_scsi_pt_obj(dp->ptvp);
+        if (dp->sg_fd >= 0)
+            sg_cmds_close_device(dp->sg_fd);
+        free(dp->free_es_rsp);
+        free(dp->free_ed_rsp);
+        free(dp->el_arr);
+        free(dp->out);
+        for (j = 0; j < dp->num_jo; ++j)
+            sgj_free_unattached(dp->jo_arr[j]);
+        free(dp->jo_arr);
+    }
+    free(w.dev_arr);
+    if (stdout != w.fp)
+        fclose(w.fp);
+    sg_par_dev_list_free(&dev_list);
+    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -7801,9 +8389,14 @@ main(int argc, char * argv[])
             ret = SG_LIB_SYNTAX_ERROR;
             goto early_out;
         }
-        jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+        if (0 == op->watch_secs)
+            jop = sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
     }
     as_json = jsp->pr_as_json;
+    if (op->watch_secs > 0) {
+        ret = ses_watch(op);
+        goto early_out;
+    }
 
     enc_stat_rsp = sg_memalign(op->maxlen, 0, &free_enc_stat_rsp, false);
     if (NULL == enc_stat_rsp) {
@@ -33,6 +33,7 @@
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
 #ifdef SG_LIB_WIN32
 #ifdef SG_LIB_WIN32_DIRECT
@@ -45,12 +46,13 @@
  * RESULTS commands in order to send microcode to the given SES device.
  */
 
-static const char * version_str = "1.21 20230623";    /* ses4r02 */
+static const char * version_str = "1.22 20231031";    /* ses4r02 */
 
 #define ME "sg_ses_microcode: "
 #define MAX_XFER_LEN (128 * 1024 * 1024)
 #define DEF_XFER_LEN (8 * 1024 * 1024)
 #define DEF_DIN_LEN (8 * 1024)
+#define FLEET_DEF_BPW 4096      /* small enough for most expanders */
 #define EBUFF_SZ 256
 
 #define DPC_DOWNLOAD_MICROCODE 0xe
@@ -69,7 +71,10 @@ struct opts_t {
     int mc_skip;        /* on FILE */
     int mc_subenc;
     int mc_tlen;        /* --tlength=TLEN */
+    int num_workers;    /* fleet mode: --parallel=P */
     int verbose;
+    const char * list_fn;
+    struct sg_par_dev_list dev_list;    /* fleet mode devices */
 };
 
 static const struct option long_options[] = {
@@ -81,9 +86,11 @@ static const struct option long_options[] = {
     {"id", required_argument, 0, 'i'},
     {"in", required_argument, 0, 'I'},
     {"length", required_argument, 0, 'l'},
+    {"list", required_argument, 0, 'L'},
     {"mode", required_argument, 0, 'm'},
     {"non", no_argument, 0, 'N'},
     {"offset", required_argument, 0, 'o'},
+    {"parallel", required_argument, 0, 'P'},
     {"skip", required_argument, 0, 's'},
     {"subenc", required_argument, 0, 'S'},
     {"tlength", required_argument, 0, 't'},
@@ -167,13 +174,13 @@ usage()
     pr2serr("Usage: "
             "sg_ses_microcode [--bpw=CS] [--dry-run] [--ealsd] [--help] "
             "[--id=ID]\n"
-            "                        [--in=FILE] [--length=LEN] [--mode=MO] "
-            "[--non]\n"
-            "                        [--offset=OFF] [--skip=SKIP] "
-            "[--subenc=SEID]\n"
-            "                        [--tlength=TLEN] [--verbose] "
-            "[--version]\n"
-            "                        DEVICE\n"
+            "                        [--in=FILE] [--length=LEN] [--list=FN] "
+            "[--mode=MO]\n"
+            "                        [--non] [--offset=OFF] [--parallel=P] "
+            "[--skip=SKIP]\n"
+            "                        [--subenc=SEID] [--tlength=TLEN] "
+            "[--verbose]\n"
+            "                        [--version] DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --bpw=CS|-b CS         CS is chunk size: bytes per send "
             "diagnostic\n"
@@ -193,6 +200,10 @@ usage()
             "    --length=LEN|-l LEN    length in bytes to send (def: "
             "deduced from\n"
             "                           FILE taking SKIP into account)\n"
+            "    --list=FN|-L FN        read device names (or globs) from "
+            "FN, one\n"
+            "                           per line ('-' for stdin); implies "
+            "fleet mode\n"
             "    --mode=MO|-m MO        download microcode mode, MO is "
             "number or\n"
             "                           acronym (def: 0 -> 'dmc_status')\n"
@@ -203,6 +214,9 @@ usage()
             "    --offset=OFF|-o OFF    buffer offset (unit: bytes, def: "
             "0);\n"
             "                           ignored if --bpw=CS given\n"
+            "    --parallel=P|-P P      in fleet mode, number of devices "
+            "sent to at\n"
+            "                           the same time (def: %d)\n"
             "    --skip=SKIP|-s SKIP    bytes in file FILE to skip before "
             "reading\n"
             "    --subenc=SEID|-S SEID     subenclosure identifier (def: 0 "
@@ -216,8 +230,10 @@ usage()
             "Does one or more SCSI SEND DIAGNOSTIC followed by RECEIVE "
             "DIAGNOSTIC\nRESULTS command sequences in order to download "
             "microcode. Use '-m xxx'\nto list available modes. With only "
-            "DEVICE given, the Download Microcode\nStatus dpage is output.\n"
-          );
+            "DEVICE given, the Download Microcode\nStatus dpage is output. "
+            "If more than one DEVICE (or a glob) or --list=FN\nis given "
+            "then fleet mode sends FILE to those devices in parallel.\n",
+            SG_PAR_DEF_WORKERS);
 }
 
 static void
@@ -475,6 +491,310 @@ send_then_receive(int sg_fd, uint32_t gen_code, int off_off,
     return ret;
 }
 
+enum mc_dev_state_e {
+    MD_PENDING = 0,
+    MD_DOWNLOADED,      /* deferred microcode waiting for activation */
+    MD_ACTIVATED,
+    MD_ERROR,
+};
+
+static const char * mc_state_arr[] = {"pending", "downloaded", "activated",
+                                      "error"};
+
+/* Per device state in fleet mode */
+struct mc_dev_t {
+    int sg_fd;
+    int state;
+    int res;
+    int num_cmds;
+    uint32_t gen_code;
+    uint64_t elapsed_ns;
+    const char * name;
+    uint8_t * dip;
+    uint8_t * free_dip;
+    struct dout_buff_t dout;
+};
+
+struct mc_fleet_t {
+    const struct opts_t * op;
+    struct opts_t act_opts;     /* copy of *op with mc_mode=activate_mc */
+    int bpw;
+    const uint8_t * image;      /* shared by all workers, read-only */
+    struct mc_dev_t * dev_arr;
+    int * batch_arr;    /* indexes into dev_arr for the activation wave */
+};
+
+static void
+fleet_prt_row(const struct mc_fleet_t * fp, const struct mc_dev_t * dp)
+{
+    char b[80];
+
+    if (dp->res)
+        sg_get_category_sense_str(dp->res, sizeof(b), b, 0);
+    else
+        b[0] = '\0';
+    printf("  %-22s %-10s %8d %5d %8" PRIu64 ".%03u  %s\n", dp->name,
+           mc_state_arr[dp->state], fp->bpw, dp->num_cmds,
+           dp->elapsed_ns / 1000000000,
+           (unsigned int)((dp->elapsed_ns / 1000000) % 1000), b);
+    fflush(stdout);
+}
+
+/* Opens the device, then fetches the Download microcode status dpage to
+ * get the generation code and to check that the image is no larger than
+ * the maximum size the subenclosure will accept. Returns 0 on success. */
+static int
+fleet_mc_prepare(const struct mc_fleet_t * fp, struct mc_dev_t * dp, int vb)
+{
+    int k, n, res, resid, rsp_len;
+    uint32_t max_sz;
+    const struct opts_t * op = fp->op;
+    const uint8_t * bp;
+
+    dp->sg_fd = sg_cmds_open_device(dp->name, false /* rw */, vb);
+    if (dp->sg_fd < 0)
+        return sg_convert_errno(-dp->sg_fd);
+    dp->dip = sg_memalign(DEF_DIN_LEN, 0, &dp->free_dip, false);
+    if (NULL == dp->dip)
+        return sg_convert_errno(ENOMEM);
+    if (op->dry_run) {
+        n = sizeof(dummy_rd_resp);
+        n = (n < DEF_DIN_LEN) ? n : DEF_DIN_LEN;
+        memcpy(dp->dip, dummy_rd_resp, n);
+        resid = DEF_DIN_LEN - n;
+        res = 0;
+    } else
+        res = sg_ll_receive_diag_v2(dp->sg_fd, true /* pcv */,
+                                    DPC_DOWNLOAD_MICROCODE, dp->dip,
+                                    DEF_DIN_LEN, 0 /* default timeout */,
+                                    &resid, (vb > 0), vb);
+    if (res)
+        return res;
+    rsp_len = sg_get_unaligned_be16(dp->dip + 2) + 4;
+    if (rsp_len > (DEF_DIN_LEN - resid))
+        rsp_len = DEF_DIN_LEN - resid;
+    if (rsp_len < 8)
+        return SG_LIB_CAT_MALFORMED;
+    dp->gen_code = sg_get_unaligned_be32(dp->dip + 4);
+    if (NULL == fp->image)
+        return 0;       /* activate_mc only */
+    n = (rsp_len - 8) / 16;
+    for (k = 0, bp = dp->dip + 8; k < n; ++k, bp += 16) {
+        if ((unsigned int)op->mc_subenc != (unsigned int)bp[1])
+            continue;
+        max_sz = sg_get_unaligned_be32(bp + 4);
+        if ((max_sz > 0) && ((uint32_t)op->mc_tlen > max_sz)) {
+            sg_par_lock();
+            pr2serr("%s: image (%d bytes) exceeds subenclosure %d maximum "
+                    "of %" PRIu32 " bytes\n", dp->name, op->mc_tlen,
+                    op->mc_subenc, max_sz);
+            sg_par_unlock();
+            return SG_LIB_CAT_OTHER;
+        }
+        return 0;
+    }
+    sg_par_lock();
+    pr2serr("%s: no status descriptor for subenclosure %d\n", dp->name,
+            op->mc_subenc);
+    sg_par_unlock();
+    return SG_LIB_CAT_OTHER;
+}
+
+/* Worker for sg_par_run(), downloads the image to dev_arr[idx] */
+static int
+fleet_dnld_work(void * ctxp, int idx)
+{
+    bool last;
+    int k, n, res;
+    struct mc_fleet_t * fp = (struct mc_fleet_t *)ctxp;
+    const struct opts_t * op = fp->op;
+    struct mc_dev_t * dp = fp->dev_arr + idx;
+    int vb = (op->verbose > 1) ? op->verbose - 1 : 0;
+    uint64_t start_ns = sg_par_mono_ns();
+
+    res = fleet_mc_prepare(fp, dp, vb);
+    for (k = 0, last = false; (0 == res) && (k < op->mc_len); k += n) {
+        n = op->mc_len - k;
+        if (n > fp->bpw)
+            n = fp->bpw;
+        else
+            last = true;
+        res = send_then_receive(dp->sg_fd, dp->gen_code, k, fp->image + k,
+                                n, &dp->dout, dp->dip, DEF_DIN_LEN, last,
+                                op);
+        ++dp->num_cmds;
+    }
+    dp->res = res;
+    dp->elapsed_ns = sg_par_mono_ns() - start_ns;
+    return res;
+}
+
+/* Called (serialized) as each device's download completes */
+static void
+fleet_dnld_done(void * ctxp, int idx, int res)
+{
+    struct mc_fleet_t * fp = (struct mc_fleet_t *)ctxp;
+    struct mc_dev_t * dp = fp->dev_arr + idx;
+
+    if (res)
+        dp->state = MD_ERROR;
+    else if (MODE_DNLD_MC_OFFS_DEFER == fp->op->mc_mode)
+        dp->state = MD_DOWNLOADED;
+    else
+        dp->state = MD_ACTIVATED;
+    fleet_prt_row(fp, dp);
+}
+
+/* Worker for sg_par_run(), activates deferred microcode on the device at
+ * batch_arr[idx] */
+static int
+fleet_act_work(void * ctxp, int idx)
+{
+    int res = 0;
+    struct mc_fleet_t * fp = (struct mc_fleet_t *)ctxp;
+    struct mc_dev_t * dp = fp->dev_arr + fp->batch_arr[idx];
+    int vb = (fp->op->verbose > 1) ? fp->op->verbose - 1 : 0;
+    uint64_t start_ns = sg_par_mono_ns();
+
+    if (dp->sg_fd < 0)          /* --mode=activate_mc only */
+        res = fleet_mc_prepare(fp, dp, vb);
+    if (0 == res) {
+        res = send_then_receive(dp->sg_fd, dp->gen_code, 0, NULL, 0,
+                                &dp->dout, dp->dip, DEF_DIN_LEN, true,
+                                &fp->act_opts);
+        ++dp->num_cmds;
+    }
+    dp->res = res;
+    dp->elapsed_ns = sg_par_mono_ns() - start_ns;
+    return res;
+}
+
+static void
+fleet_act_done(void * ctxp, int idx, int res)
+{
+    struct mc_fleet_t * fp = (struct mc_fleet_t *)ctxp;
+    struct mc_dev_t * dp = fp->dev_arr + fp->batch_arr[idx];
+
+    dp->state = res ? MD_ERROR : MD_ACTIVATED;
+    fleet_prt_row(fp, dp);
+}
+
+/* Fleet mode: downloads the (shared) image to every device in op->dev_list
+ * with at most op->num_workers devices in progress at once. With
+ * dmc_offs_defer and '--bpw=CS,act', once every download has succeeded, a
+ * wave of activate_mc requests is sent. Returns exit status (the first
+ * failure in list order). */
+static int
+fleet_ses_microcode(struct mc_fleet_t * fp)
+{
+    bool activate;
+    int k, n, res;
+    int ret = 0;
+    const struct opts_t * op = fp->op;
+    int num = op->dev_list.num;
+    int num_workers = op->num_workers;
+    int num_err = 0;
+    uint64_t el;
+    uint64_t start_ns = sg_par_mono_ns();
+    struct mc_dev_t * dp;
+
+    activate = op->bpw_then_activate;
+    fp->act_opts = *op;
+    fp->act_opts.mc_mode = MODE_ACTIVATE_MC;
+    if (op->dry_run)
+        num_workers = 1;        /* dummy_rd_resp[] is shared */
+    fp->dev_arr = (struct mc_dev_t *)calloc(num, sizeof(struct mc_dev_t));
+    fp->batch_arr = (int *)calloc(num, sizeof(int));
+    if ((NULL == fp->dev_arr) || (NULL == fp->batch_arr)) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < num; ++k) {
+        dp = fp->dev_arr + k;
+        dp->name = op->dev_list.names[k];
+        dp->sg_fd = -1;
+        dp->state = MD_PENDING;
+    }
+    if (MODE_ACTIVATE_MC != op->mc_mode) {
+        printf("Downloading %d bytes to %d device%s, mode=0x%x, %d at a "
+               "time%s\n", op->mc_len, num, ((num > 1) ? "s" : ""),
+               op->mc_mode, num_workers, (op->dry_run ? " [dry run]" : ""));
+        printf("  %-22s %-10s %8s %5s %12s  %s\n", "Device", "State",
+               "Chunk", "Cmds", "Elapsed(s)", "Reason");
+        res = sg_par_run(num, num_workers, fleet_dnld_work, fleet_dnld_done,
+                         fp);
+        if (res) {
+            pr2serr("unable to start worker threads: %s\n",
+                    safe_strerror(res));
+            ret = sg_convert_errno(res);
+            goto fini;
+        }
+    } else {
+        activate = true;
+        fp->bpw = 0;
+        for (k = 0; k < num; ++k)
+            fp->dev_arr[k].state = MD_DOWNLOADED;
+    }
+    for (n = 0, k = 0; k < num; ++k) {
+        dp = fp->dev_arr + k;
+        if (MD_ERROR == dp->state)
+            ++num_err;
+        else if (MD_DOWNLOADED == dp->state)
+            fp->batch_arr[n++] = k;
+    }
+    if (activate && (n > 0)) {
+        if (num_err > 0)
+            printf("%d download%s failed so no activation wave; later use "
+                   "'--mode=activate_mc'\n", num_err,
+                   ((num_err > 1) ? "s" : ""));
+        else {
+            printf("Activating deferred microcode on %d device%s\n", n,
+                   ((n > 1) ? "s" : ""));
+            printf("  %-22s %-10s %8s %5s %12s  %s\n", "Device", "State",
+                   "Chunk", "Cmds", "Elapsed(s)", "Reason");
+            res = sg_par_run(n, num_workers, fleet_act_work, fleet_act_done,
+                             fp);
+            if (res) {
+                pr2serr("unable to start worker threads: %s\n",
+                        safe_strerror(res));
+                ret = sg_convert_errno(res);
+                goto fini;
+            }
+            for (k = 0; k < n; ++k) {
+                if (MD_ERROR == fp->dev_arr[fp->batch_arr[k]].state)
+                    ++num_err;
+            }
+        }
+    }
+    for (k = 0; k < num; ++k) {
+        dp = fp->dev_arr + k;
+        if ((MD_ERROR == dp->state) && (0 == ret))
+            ret = dp->res ? dp->res : SG_LIB_CAT_OTHER;
+    }
+    el = sg_par_mono_ns() - start_ns;
+    printf("%d device%s: %d ok, %d error%s in %" PRIu64 ".%03u seconds\n",
+           num, ((num > 1) ? "s" : ""), num - num_err, num_err,
+           ((1 == num_err) ? "" : "s"), el / 1000000000,
+           (unsigned int)((el / 1000000) % 1000));
+fini:
+    if (fp->dev_arr) {
+        for (k = 0; k < num; ++k) {
+            dp = fp->dev_arr + k;
+            if (dp->sg_fd >= 0)
+                sg_cmds_close_device(dp->sg_fd);
+            if (dp->free_dip)
+                free(dp->free_dip);
+            if (dp->dout.free_doutp)
+                free(dp->dout.free_doutp);
+        }
+        free(fp->dev_arr);
+    }
+    if (fp->batch_arr)
+        free(fp->batch_arr);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -501,16 +821,19 @@ main(int argc, char * argv[])
     struct opts_t opts;
     struct opts_t * op;
     const struct mode_s * mp;
+    struct sg_par_file_map fmap;
+    struct mc_fleet_t fleet;
 
     op = &opts;
     memset(op, 0, sizeof(opts));
     memset(&dout, 0, sizeof(dout));
+    memset(&fmap, 0, sizeof(fmap));
     din_len = DEF_DIN_LEN;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:dehi:I:l:m:No:s:S:t:vV", long_options,
-                        &option_index);
+        c = getopt_long(argc, argv, "b:dehi:I:l:L:m:No:P:s:S:t:vV",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
@@ -556,6 +879,9 @@ main(int argc, char * argv[])
              }
              op->mc_len_given = true;
              break;
+        case 'L':
+            op->list_fn = optarg;
+            break;
         case 'm':
             if (isdigit((uint8_t)*optarg)) {
                 op->mc_mode = sg_get_num_nomult(optarg);
@@ -592,6 +918,15 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'P':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > SG_PAR_MAX_WORKERS)) {
+                pr2serr("bad argument to '--parallel=', expect 1 to %d\n",
+                        SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_workers = n;
+            break;
         case 's':
            op->mc_skip = sg_get_num(optarg);
            if (op->mc_skip < 0) {
@@ -636,15 +971,14 @@ main(int argc, char * argv[])
         return 0;
     }
     if (optind < argc) {
-        if (NULL == device_name) {
+        if (NULL == device_name)
             device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
+        /* more than one DEVICE (or a glob) is for fleet mode */
+        for (; optind < argc; ++optind) {
+            ret = sg_par_dev_list_add(&op->dev_list, argv[optind],
+                                      op->verbose);
+            if (ret)
+                goto fini;
         }
     }
 
@@ -666,7 +1000,67 @@ main(int argc, char * argv[])
 #endif
     if (version_given) {
         pr2serr(ME "version: %s\n", version_str);
-        return 0;
+        goto fini;
+    }
+    if (op->list_fn) {
+        ret = sg_par_dev_list_from_file(&op->dev_list, op->list_fn,
+                                        op->verbose);
+        if (ret)
+            goto fini;
+    }
+    if ((op->dev_list.num > 1) || op->list_fn ||
+        (device_name && strpbrk(device_name, "*?["))) {
+        memset(&fleet, 0, sizeof(fleet));
+        switch (op->mc_mode) {
+        case MODE_DNLD_MC_OFFS:
+        case MODE_DNLD_MC_OFFS_SAVE:
+        case MODE_DNLD_MC_OFFS_DEFER:
+            if ((NULL == file_name) || (0 == strcmp(file_name, "-"))) {
+                pr2serr("fleet mode needs --in=FILE naming a regular "
+                        "file\n");
+                ret = SG_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            ret = sg_par_file_map(&fmap, file_name, op->mc_skip,
+                                  op->mc_len, op->verbose);
+            if (ret)
+                goto fini;
+            if ((op->mc_len_given && (fmap.len < op->mc_len)) ||
+                (fmap.len > MAX_XFER_LEN)) {
+                pr2serr("%s holds %" PRId64 " bytes after skip, need 1 to "
+                        "%d\n", file_name, fmap.len,
+                        op->mc_len_given ? op->mc_len : MAX_XFER_LEN);
+                ret = SG_LIB_FILE_ERROR;
+                goto fini;
+            }
+            fleet.image = fmap.p;
+            op->mc_len = (int)fmap.len;
+            break;
+        case MODE_ACTIVATE_MC:
+            break;
+        default:
+            pr2serr("fleet mode needs --mode= of dmc_offs, dmc_offs_save, "
+                    "dmc_offs_defer or\nactivate_mc\n");
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto fini;
+        }
+        if (op->dev_list.num < 1) {
+            pr2serr("no devices to download to\n");
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto fini;
+        }
+        if (op->mc_tlen < op->mc_len)
+            op->mc_tlen = op->mc_len;
+        /* offsets in the dpage must be multiples of 4 */
+        fleet.bpw = (op->bpw > 0) ? (op->bpw & ~3) : FLEET_DEF_BPW;
+        if (0 == fleet.bpw)
+            fleet.bpw = 4;
+        op->mc_offset = 0;
+        if (0 == op->num_workers)
+            op->num_workers = SG_PAR_DEF_WORKERS;
+        fleet.op = op;
+        ret = fleet_ses_microcode(&fleet);
+        goto fini;
     }
 
     if (NULL == device_name) {
@@ -916,6 +1310,8 @@ main(int argc, char * argv[])
         ret = res;
 
 fini:
+    sg_par_file_unmap(&fmap);
+    sg_par_dev_list_free(&op->dev_list);
     if ((infd >= 0) && (! got_stdin))
         close(infd);
     if (dmp)
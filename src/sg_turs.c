@@ -25,6 +25,7 @@
 #include <time.h>
 #include <errno.h>
 #include <getopt.h>
+#include <ctype.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 
@@ -43,9 +44,13 @@
 #include "sg_cmds_basic.h"
 #include "sg_pt.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
+#ifdef SG_LIB_LINUX
+#include <dirent.h>
+#endif
 
-static const char * version_str = "3.56 20230623";
+static const char * version_str = "3.57 20231022";
 
 static const char * my_name = "sg_turs: ";
 
@@ -58,18 +63,22 @@ static const struct option long_options[] = {
     {"ascq", required_argument, 0, 'a'},
     {"delay", required_argument, 0, 'd'},
     {"help", no_argument, 0, 'h'},
+    {"list", required_argument, 0, 'L'},
     {"low", no_argument, 0, 'l'},   /* use sg_pt, minimize open()s */
     {"new", no_argument, 0, 'N'},
     {"number", required_argument, 0, 'n'},
     {"num", required_argument, 0, 'n'}, /* added in v3.32 (sg3_utils
                             * v1.43) for sg_requests compatibility */
     {"old", no_argument, 0, 'O'},
+    {"parallel", required_argument, 0, 'P'},
     {"progress", no_argument, 0, 'p'},
+    {"sysfs", required_argument, 0, 's'},
     {"time", no_argument, 0, 't'},
     {"timeout", required_argument, 0, 'T'},
     {"tmo", required_argument, 0, 'T'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
+    {"wait", required_argument, 0, 'w'},
     {0, 0, 0, 0},
 };
 
@@ -86,9 +95,14 @@ struct opts_t {
     int delay;
     int do_help;
     int do_number;
+    int num_workers;
     int tmo;
     int verbose;
+    int wait_secs;      /* fleet mode: time allowed to become ready */
     const char * device_name;
+    const char * list_fn;
+    const char * sysfs_filt;
+    struct sg_par_dev_list dev_list;    /* fleet mode devices */
 };
 
 struct loop_res_t {
@@ -102,28 +116,43 @@ static void
 usage()
 {
     printf("Usage: sg_turs [--ascq=ASC[,ASQ]] [--delay=MS] [--help] "
-           "[--low]\n"
-           "               [--number=NUM] [--num=NUM] [--progress] "
-           "[--time]\n"
-           "               [--timeout=SE] [--verbose] [--version] "
-           "DEVICE\n"
+           "[--list=DLF]\n"
+           "               [--low] [--number=NUM] [--num=NUM] "
+           "[--parallel=PN]\n"
+           "               [--progress] [--sysfs=FILT] [--time] "
+           "[--timeout=SE]\n"
+           "               [--verbose] [--version] [--wait=SECS] "
+           "DEVICE [DEVICE...]\n"
            "  where:\n"
            "    --ascq=ASC[,ASQ] |    check sense from TUR for match on "
            "ASC[,ASQ]\n"
            "        -a ASC[,ASQ]      exit status 36 if sense code match\n"
            "    --delay=MS|-d MS    delay MS miiliseconds before sending "
            "each tur\n"
+           "                        (in fleet mode: poll interval, def: "
+           "1000)\n"
            "    --help|-h        print usage message then exit\n"
+           "    --list=DLF|-L DLF    read device names from file DLF, one "
+           "per line\n"
+           "                         ('-' for stdin); implies fleet mode\n"
            "    --low|-l         use low level (sg_pt) interface for "
            "speed\n"
            "    --number=NUM|-n NUM    number of test_unit_ready commands "
            "(def: 1)\n"
            "    --num=NUM|-n NUM       same action as '--number=NUM'\n"
            "    --old|-O         use old interface (use as first option)\n"
+           "    --parallel=PN|-P PN    maximum number of devices polled at "
+           "the same\n"
+           "                           time in fleet mode (def: %d)\n"
            "    --progress|-p    outputs progress indication (percentage) "
            "if available\n"
            "                     waits 30 seconds before TUR unless "
            "--delay=MS given\n"
+           "    --sysfs=FILT|-s FILT    poll sg devices found in sysfs "
+           "that match\n"
+           "                            FILT: KEY=VAL[,KEY=VAL...] or 'all'; "
+           "KEY is one\n"
+           "                            of: hctl, model, type or vendor\n"
            "    --time|-t        outputs total duration and commands per "
            "second\n"
            "    --timeout SE |-T SE    command timeout on each "
@@ -131,9 +160,18 @@ usage()
            "                           (def: 0 which is mapped to 60 "
            "seconds)\n"
            "    --verbose|-v     increase verbosity\n"
-           "    --version|-V     print version string then exit\n\n"
+           "    --version|-V     print version string then exit\n"
+           "    --wait=SECS|-w SECS    in fleet mode, poll each device "
+           "until it is\n"
+           "                           ready or SECS seconds have "
+           "elapsed\n\n"
            "Performs a SCSI TEST UNIT READY command (or many of them).\n"
-           "This SCSI command is often known by its abbreviation: TUR .\n");
+           "This SCSI command is often known by its abbreviation: TUR .\n"
+           "If more than one DEVICE is given (or DEVICE is a glob), or "
+           "--list=,\n"
+           "--sysfs= or --wait= is given, then fleet mode polls all those "
+           "devices\nconcurrently and prints a table of their readiness.\n",
+           SG_PAR_DEF_WORKERS);
 }
 
 static void
@@ -174,7 +212,7 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "a:d:hln:NOptT:vV", long_options,
+        c = getopt_long(argc, argv, "a:d:hlL:n:NOpP:s:tT:vVw:", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -219,6 +257,9 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'l':
             op->do_low = true;
             break;
+        case 'L':
+            op->list_fn = optarg;
+            break;
         case 'n':
             n = sg_get_num(optarg);
             if (n < 0) {
@@ -236,6 +277,18 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'p':
             op->do_progress = true;
             break;
+        case 'P':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > SG_PAR_MAX_WORKERS)) {
+                pr2serr("bad argument to '--parallel=', expect 1 to %d\n",
+                        SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->num_workers = n;
+            break;
+        case 's':
+            op->sysfs_filt = optarg;
+            break;
         case 't':
             op->do_time = true;
             break;
@@ -255,6 +308,14 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         case 'V':
             op->version_given = true;
             break;
+        case 'w':
+            n = sg_get_num(optarg);
+            if (n < 0) {
+                pr2serr("bad argument to '--wait='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->wait_secs = n;
+            break;
         default:
             pr2serr("unrecognised option code %c [0x%x]\n", c, c);
             if (op->do_help)
@@ -264,15 +325,14 @@ new_parse_cmd_line(struct opts_t * op, int argc, char * argv[])
         }
     }
     if (optind < argc) {
-        if (NULL == op->device_name) {
+        if (NULL == op->device_name)
             op->device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
+        /* more than one DEVICE (or a glob) is for fleet mode */
+        for (; optind < argc; ++optind) {
+            n = sg_par_dev_list_add(&op->dev_list, argv[optind],
+                                    op->verbose);
+            if (n)
+                return n;
         }
     }
     return 0;
@@ -626,6 +686,465 @@ loop_turs(struct sg_pt_base * ptvp, struct loop_res_t * resp,
     }
 }
 
+/* Fleet mode: TEST UNIT READY is sent to many devices by a bounded pool of
+ * long lived workers. Each worker runs its own event loop: it claims the
+ * pending device whose next poll is due soonest, sleeping until then if
+ * need be, sends it one TUR and processes (and prints a row of the
+ * readiness table for) the result. So a device that is slow to respond
+ * only holds up the worker polling it. Devices that are not ready are
+ * polled again after the delay until they become ready or the --wait
+ * deadline passes; that deadline is checked against the monotonic clock
+ * each time a worker looks for work and each TUR's timeout is trimmed so
+ * it does not run past the deadline. */
+
+enum tur_state_e {
+    TD_PENDING = 0,
+    TD_READY,
+    TD_NOT_READY,       /* final, --wait deadline passed (or not given) */
+    TD_ERROR,
+};
+
+static const char * tur_state_arr[] = {"pending", "ready", "not ready",
+                                       "error"};
+
+struct tur_dev_t {
+    int state;          /* enum tur_state_e */
+    int res;            /* result of last TUR: 0 or SG_LIB_CAT_* */
+    int progress;       /* -1 or 0 to 65535 */
+    int last_pr_progress;
+    int num_turs;
+    int sg_fd;
+    int asc;
+    int ascq;
+    bool in_flight;     /* claimed by a worker, TUR outstanding */
+    uint64_t due_ns;    /* time of next poll */
+    uint64_t done_ns;
+    struct sg_pt_base * ptvp;
+    const char * name;
+    uint8_t sense_b[64];
+};
+
+struct tur_fleet_t {
+    const struct opts_t * op;
+    int num_devs;
+    struct tur_dev_t * dev_arr;
+    uint64_t start_ns;
+    uint64_t deadline_ns;       /* 0 -> one TUR per device */
+    uint64_t delay_ns;
+};
+
+static void
+fleet_prt_row(const struct tur_fleet_t * fp, const struct tur_dev_t * dp)
+{
+    uint64_t el = dp->done_ns - fp->start_ns;
+    char pb[16];
+    char b[80];
+
+    if (dp->progress >= 0)
+        snprintf(pb, sizeof(pb), "%d.%02d%%", (dp->progress * 100) / 65536,
+                 ((dp->progress * 100) % 65536) / 656);
+    else
+        snprintf(pb, sizeof(pb), "%s", "-");
+    if (TD_READY == dp->state)
+        b[0] = '\0';
+    else if (dp->asc >= 0)
+        sg_get_asc_ascq_str(dp->asc, dp->ascq, sizeof(b), b);
+    else
+        sg_get_category_sense_str(dp->res, sizeof(b), b, 0);
+    printf("  %-22s %-10s %5d %8" PRIu64 ".%03u %8s  %s\n", dp->name,
+           tur_state_arr[dp->state], dp->num_turs, el / 1000000000,
+           (unsigned int)((el / 1000000) % 1000), pb, b);
+    fflush(stdout);
+}
+
+/* Sends one TUR to the device at dp, called without the pool's mutex */
+static int
+fleet_tur(struct tur_fleet_t * fp, struct tur_dev_t * dp)
+{
+    int err;
+    int tmo;
+    const struct opts_t * op = fp->op;
+    int vb = (op->verbose > 1) ? op->verbose - 1 : 0;
+    uint64_t now;
+    static const uint8_t tur_cdb[6] = {0, 0, 0, 0, 0, 0};
+    struct sg_scsi_sense_hdr ssh;
+
+    dp->progress = -1;
+    dp->asc = -1;
+    dp->ascq = -1;
+    if (NULL == dp->ptvp) {     /* first poll of this device */
+        dp->sg_fd = sg_cmds_open_device(dp->name, true /* ro */, vb);
+        if (dp->sg_fd < 0) {
+            dp->res = sg_convert_errno(-dp->sg_fd);
+            return dp->res;
+        }
+        dp->ptvp = construct_scsi_pt_obj_with_fd(dp->sg_fd, vb);
+        if ((NULL == dp->ptvp) || ((err = get_scsi_pt_os_err(dp->ptvp)))) {
+            dp->res = sg_convert_errno(dp->ptvp ? err : ENOMEM);
+            return dp->res;
+        }
+    } else
+        partial_clear_scsi_pt_obj(dp->ptvp);
+    /* do not let this TUR run (much) past the --wait deadline */
+    tmo = op->tmo;
+    now = sg_par_mono_ns();
+    if (fp->deadline_ns && (now < fp->deadline_ns)) {
+        err = (int)((fp->deadline_ns - now + 999999999) / 1000000000);
+        if (err < tmo)
+            tmo = err;
+    }
+    set_scsi_pt_cdb(dp->ptvp, tur_cdb, sizeof(tur_cdb));
+    set_scsi_pt_sense(dp->ptvp, dp->sense_b, sizeof(dp->sense_b));
+    dp->res = ll_test_unit_ready(dp->ptvp, dp->num_turs, tmo,
+                                 &dp->progress, false, vb);
+    if (dp->res && sg_scsi_normalize_sense(dp->sense_b,
+                                           get_scsi_pt_sense_len(dp->ptvp),
+                                           &ssh)) {
+        dp->asc = ssh.asc;
+        dp->ascq = ssh.ascq;
+    }
+    return dp->res;
+}
+
+/* Called, holding the pool's mutex, as each TUR completes */
+static void
+fleet_done(struct tur_fleet_t * fp, struct tur_dev_t * dp, int res)
+{
+    const struct opts_t * op = fp->op;
+
+    ++dp->num_turs;
+    dp->done_ns = sg_par_mono_ns();
+    switch (res) {
+    case 0:
+        dp->state = TD_READY;
+        break;
+    case SG_LIB_CAT_NOT_READY:
+    case SG_LIB_CAT_UNIT_ATTENTION:
+    case SG_LIB_CAT_STANDBY:
+    case SG_LIB_CAT_UNAVAILABLE:
+    case SG_LIB_CAT_ABORTED_COMMAND:
+    case SG_LIB_CAT_TIMEOUT:
+        if ((op->asc > 0) && (op->asc == dp->asc) &&
+            ((op->ascq < 0) || (op->ascq == dp->ascq))) {
+            dp->res = SG_LIB_OK_FALSE;  /* --ascq= match, stop polling */
+            dp->state = TD_NOT_READY;
+        } else if (fp->deadline_ns &&
+                   ((dp->done_ns + fp->delay_ns) < fp->deadline_ns)) {
+            dp->due_ns = dp->done_ns + fp->delay_ns;
+            if ((dp->progress >= 0) &&
+                (dp->progress != dp->last_pr_progress)) {
+                dp->last_pr_progress = dp->progress;
+                fleet_prt_row(fp, dp);  /* progress row, still pending */
+            }
+            return;
+        } else
+            dp->state = TD_NOT_READY;
+        break;
+    default:
+        dp->state = TD_ERROR;
+        break;
+    }
+    fleet_prt_row(fp, dp);
+}
+
+/* Each worker (sg_par_run() item) loops here until no pending device is
+ * left unclaimed. The set of pending devices only shrinks, and each one
+ * that is claimed stays with its worker until its TUR completes, so no
+ * device is left behind when a worker returns. */
+static int
+fleet_worker(void * ctxp, int idx)
+{
+    int k, res;
+    uint64_t now;
+    struct tur_fleet_t * fp = (struct tur_fleet_t *)ctxp;
+    struct tur_dev_t * dp;
+    struct tur_dev_t * best_dp;
+
+    if (idx) { ; }      /* unused, suppress warning */
+    while (true) {
+        sg_par_lock();
+        now = sg_par_mono_ns();
+        best_dp = NULL;
+        for (k = 0; k < fp->num_devs; ++k) {
+            dp = fp->dev_arr + k;
+            if ((TD_PENDING != dp->state) || dp->in_flight)
+                continue;
+            /* every device gets at least one TUR */
+            if (fp->deadline_ns && (now >= fp->deadline_ns) &&
+                (dp->num_turs > 0)) {
+                dp->state = TD_NOT_READY;
+                dp->done_ns = now;
+                fleet_prt_row(fp, dp);
+                continue;
+            }
+            if ((NULL == best_dp) || (dp->due_ns < best_dp->due_ns))
+                best_dp = dp;
+        }
+        if (NULL == best_dp) {
+            sg_par_unlock();
+            break;
+        }
+        if (best_dp->due_ns > now) {
+            sg_par_unlock();
+            wait_millisecs((int)((best_dp->due_ns - now + 999999) /
+                                 1000000));
+            continue;   /* another worker may have claimed it */
+        }
+        best_dp->in_flight = true;
+        sg_par_unlock();
+        res = fleet_tur(fp, best_dp);
+        sg_par_lock();
+        best_dp->in_flight = false;
+        fleet_done(fp, best_dp, res);
+        sg_par_unlock();
+    }
+    return 0;
+}
+
+#ifdef SG_LIB_LINUX
+
+static const char * sysfs_sg_dir = "/sys/class/scsi_generic";
+
+/* Reads first line of sysfs attribute into b with trailing whitespace
+ * removed. Returns false if unable to read. */
+static bool
+sysfs_get_str(const char * dir, const char * sub, const char * attr,
+              char * b, int blen)
+{
+    int k;
+    FILE * f;
+    char p[512];
+
+    snprintf(p, sizeof(p), "%s/%s/%s", dir, sub, attr);
+    b[0] = '\0';
+    f = fopen(p, "r");
+    if (NULL == f)
+        return false;
+    if (NULL == fgets(b, blen, f))
+        b[0] = '\0';
+    fclose(f);
+    for (k = (int)strlen(b) - 1; (k >= 0) && isspace((uint8_t)b[k]); --k)
+        b[k] = '\0';
+    return true;
+}
+
+/* Checks that filter is a comma separated list of KEY=VALUE where KEY is
+ * one of: hctl, model, type or vendor. Or the filter can be "all". If
+ * 'vals' is non-NULL then each value is checked against it (in the order
+ * hctl, vendor, model, type) and true is returned if all match. */
+static bool
+sysfs_filter_match(const char * filt, const char * const * vals, bool * okp)
+{
+    static const char * key_arr[] = {"hctl", "vendor", "model", "type"};
+    bool match = true;
+    int k, klen, vlen;
+    const char * cp;
+    const char * ep;
+    const char * vp;
+
+    *okp = true;
+    if (0 == strcmp(filt, "all"))
+        return true;
+    for (cp = filt; *cp; cp = (*ep ? ep + 1 : ep)) {
+        ep = strchr(cp, ',');
+        if (NULL == ep)
+            ep = cp + strlen(cp);
+        vp = (const char *)memchr(cp, '=', ep - cp);
+        if (NULL == vp) {
+            *okp = false;
+            return false;
+        }
+        klen = vp - cp;
+        ++vp;
+        vlen = ep - vp;
+        for (k = 0; k < (int)SG_ARRAY_SIZE(key_arr); ++k) {
+            if ((klen == (int)strlen(key_arr[k])) &&
+                (0 == memcmp(cp, key_arr[k], klen)))
+                break;
+        }
+        if (k >= (int)SG_ARRAY_SIZE(key_arr)) {
+            *okp = false;
+            return false;
+        }
+        if (NULL == vals)
+            continue;
+        if (3 == k)     /* type: peripheral device type, exact match */
+            match = match && (atoi(vals[3]) == atoi(vp));
+        else    /* others: prefix match, vendor and model ignore case */
+            match = match && ((int)strlen(vals[k]) >= vlen) &&
+                    ((0 == k) ? (0 == strncmp(vals[k], vp, vlen)) :
+                                (0 == strncasecmp(vals[k], vp, vlen)));
+    }
+    return match;
+}
+
+static int
+sg_name_cmp(const void * ap, const void * bp)
+{
+    const char * a = *(const char * const *)ap;
+    const char * b = *(const char * const *)bp;
+    int alen = strlen(a);
+    int blen = strlen(b);
+
+    /* so /dev/sg2 sorts before /dev/sg10 */
+    return (alen != blen) ? (alen - blen) : strcmp(a, b);
+}
+
+/* Adds each sg device in sysfs that matches filter 'filt' to the list */
+static int
+sysfs_add_devs(struct sg_par_dev_list * dlp, const char * filt, int vb)
+{
+    bool ok;
+    int k, res, first = dlp->num;
+    ssize_t n;
+    const char * cp;
+    struct dirent * dep;
+    DIR * dirp;
+    const char * vals[4];
+    char hctl[512];
+    char vendor[64];
+    char model[64];
+    char type[16];
+    char b[512];
+    char lnk[512];
+
+    sysfs_filter_match(filt, NULL, &ok);
+    if (! ok) {
+        pr2serr("bad --sysfs= filter: %s, expect KEY=VAL[,KEY=VAL...] "
+                "where KEY is\nhctl, model, type or vendor; or 'all'\n",
+                filt);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    dirp = opendir(sysfs_sg_dir);
+    if (NULL == dirp) {
+        res = errno;
+        pr2serr("unable to open %s: %s\n", sysfs_sg_dir, safe_strerror(res));
+        return sg_convert_errno(res);
+    }
+    while ((dep = readdir(dirp))) {
+        if ('.' == dep->d_name[0])
+            continue;
+        snprintf(b, sizeof(b), "%s/%s/device", sysfs_sg_dir, dep->d_name);
+        n = readlink(b, lnk, sizeof(lnk) - 1);
+        if (n < 0)
+            continue;
+        lnk[n] = '\0';
+        cp = strrchr(lnk, '/');
+        snprintf(hctl, sizeof(hctl), "%s", (cp ? cp + 1 : lnk));
+        sysfs_get_str(sysfs_sg_dir, dep->d_name, "device/vendor", vendor,
+                      sizeof(vendor));
+        sysfs_get_str(sysfs_sg_dir, dep->d_name, "device/model", model,
+                      sizeof(model));
+        sysfs_get_str(sysfs_sg_dir, dep->d_name, "device/type", type,
+                      sizeof(type));
+        vals[0] = hctl;
+        vals[1] = vendor;
+        vals[2] = model;
+        vals[3] = type;
+        if (! sysfs_filter_match(filt, vals, &ok))
+            continue;
+        if (vb > 1)
+            pr2serr("%s: [%s] %s %s matches\n", dep->d_name, hctl, vendor,
+                    model);
+        snprintf(b, sizeof(b), "/dev/%s", dep->d_name);
+        res = sg_par_dev_list_add(dlp, b, vb);
+        if (res) {
+            closedir(dirp);
+            return res;
+        }
+    }
+    closedir(dirp);
+    qsort(dlp->names + first, dlp->num - first, sizeof(char *), sg_name_cmp);
+    if (vb)
+        pr2serr("--sysfs=%s matched %d devices\n", filt, dlp->num - first);
+    for (k = first; (vb > 2) && (k < dlp->num); ++k)
+        pr2serr("    %s\n", dlp->names[k]);
+    return 0;
+}
+
+#endif          /* SG_LIB_LINUX */
+
+/* Fleet mode entry point, returns exit status */
+static int
+fleet_turs(struct opts_t * op)
+{
+    int k, res, num, num_workers;
+    int ret = 0;
+    int num_ready = 0;
+    int num_not_ready = 0;
+    int num_err = 0;
+    uint64_t now;
+    struct tur_fleet_t fleet;
+    struct tur_fleet_t * fp = &fleet;
+    struct tur_dev_t * dp;
+
+    num = op->dev_list.num;
+    if (num < 1) {
+        pr2serr("no devices to poll\n");
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    memset(fp, 0, sizeof(*fp));
+    fp->op = op;
+    fp->num_devs = num;
+    fp->dev_arr = (struct tur_dev_t *)calloc(num, sizeof(struct tur_dev_t));
+    if (NULL == fp->dev_arr) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    fp->start_ns = sg_par_mono_ns();
+    if (op->wait_secs > 0)
+        fp->deadline_ns = fp->start_ns +
+                          ((uint64_t)op->wait_secs * 1000000000);
+    fp->delay_ns = (uint64_t)(op->delay_given ? op->delay : 1000) * 1000000;
+    for (k = 0; k < num; ++k) {
+        dp = fp->dev_arr + k;
+        dp->name = op->dev_list.names[k];
+        dp->sg_fd = -1;
+        dp->last_pr_progress = -1;
+        dp->due_ns = fp->start_ns;
+    }
+    printf("Polling %d device%s with TEST UNIT READY", num,
+           ((num > 1) ? "s" : ""));
+    if (fp->deadline_ns)
+        printf(", waiting up to %d seconds", op->wait_secs);
+    printf("\n  %-22s %-10s %5s %12s %8s  %s\n", "Device", "State", "TURs",
+           "Elapsed(s)", "Progress", "Reason");
+
+    num_workers = (op->num_workers < num) ? op->num_workers : num;
+    res = sg_par_run(num_workers, num_workers, fleet_worker, NULL, fp);
+    if (res) {
+        pr2serr("unable to start worker threads: %s\n", safe_strerror(res));
+        ret = sg_convert_errno(res);
+    }
+
+    for (k = 0; k < num; ++k) {
+        dp = fp->dev_arr + k;
+        if (TD_READY == dp->state)
+            ++num_ready;
+        else {
+            if (TD_ERROR == dp->state)
+                ++num_err;
+            else
+                ++num_not_ready;
+            if (0 == ret)       /* first failure in list order */
+                ret = dp->res ? dp->res : SG_LIB_CAT_OTHER;
+        }
+        if (dp->ptvp)
+            destruct_scsi_pt_obj(dp->ptvp);
+        if (dp->sg_fd >= 0)
+            sg_cmds_close_device(dp->sg_fd);
+    }
+    now = sg_par_mono_ns() - fp->start_ns;
+    printf("%d device%s: %d ready, %d not ready, %d error%s in %" PRIu64
+           ".%03u seconds\n", num, ((num > 1) ? "s" : ""), num_ready,
+           num_not_ready, num_err, ((1 == num_err) ? "" : "s"),
+           now / 1000000000, (unsigned int)((now / 1000000) % 1000));
+fini:
+    free(fp->dev_arr);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -682,6 +1201,37 @@ main(int argc, char * argv[])
         pr2serr("Version string: %s\n", version_str);
         return 0;
     }
+    if (op->list_fn) {
+        res = sg_par_dev_list_from_file(&op->dev_list, op->list_fn,
+                                        op->verbose);
+        if (res) {
+            ret = res;
+            goto fini;
+        }
+    }
+    if (op->sysfs_filt) {
+#ifdef SG_LIB_LINUX
+        res = sysfs_add_devs(&op->dev_list, op->sysfs_filt, op->verbose);
+        if (res) {
+            ret = res;
+            goto fini;
+        }
+#else
+        pr2serr("--sysfs= option only supported on Linux\n");
+        ret = SG_LIB_SYNTAX_ERROR;
+        goto fini;
+#endif
+    }
+    if ((op->dev_list.num > 1) || op->list_fn || op->sysfs_filt ||
+        (op->wait_secs > 0) ||
+        (op->device_name && strpbrk(op->device_name, "*?["))) {
+        if (0 == op->tmo)
+            op->tmo = DEF_PT_TIMEOUT;
+        if (0 == op->num_workers)
+            op->num_workers = SG_PAR_DEF_WORKERS;
+        ret = fleet_turs(op);
+        goto fini;
+    }
     if (op->do_progress && (! op->delay_given))
         op->delay = 30 * 1000;  /* progress has 30 second default delay */
 
@@ -798,5 +1348,6 @@ fini:
         destruct_scsi_pt_obj(ptvp);
     if (sg_fd >= 0)
         sg_cmds_close_device(sg_fd);
+    sg_par_dev_list_free(&op->dev_list);
     return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
 }
@@ -29,6 +29,7 @@
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
 #ifdef SG_LIB_WIN32
 #ifdef SG_LIB_WIN32_DIRECT
@@ -40,7 +41,7 @@
  * This utility issues the SCSI WRITE BUFFER command to the given device.
  */
 
-static const char * version_str = "1.33 20230623";    /* spc6r07 */
+static const char * version_str = "1.34 20231031";    /* spc6r07 */
 
 static const char * my_name = "sg_write_buffer: ";    /* spc6r07 */
 
@@ -52,6 +53,11 @@ static const char * my_name = "sg_write_buffer: ";    /* spc6r07 */
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT 300      /* 300 seconds, 5 minutes */
 
+#define FLEET_DEF_BPW (64 * 1024)       /* if READ BUFFER descriptor fails */
+#define FLEET_MAX_BPW (1024 * 1024)     /* stay under HBA transfer limits */
+#define RB_MODE_DESC 3
+#define RB_DESC_LEN 4
+
 static const struct option long_options[] = {
     {"bpw", required_argument, 0, 'b'},
     {"dry-run", no_argument, 0, 'd'},
@@ -60,8 +66,10 @@ static const struct option long_options[] = {
     {"id", required_argument, 0, 'i'},
     {"in", required_argument, 0, 'I'},
     {"length", required_argument, 0, 'l'},
+    {"list", required_argument, 0, 'L'},
     {"mode", required_argument, 0, 'm'},
     {"offset", required_argument, 0, 'o'},
+    {"parallel", required_argument, 0, 'P'},
     {"read-stdin", no_argument, 0, 'r'},
     {"read_stdin", no_argument, 0, 'r'},
     {"raw", no_argument, 0, 'r'},
@@ -80,12 +88,13 @@ usage()
     pr2serr("Usage: "
             "sg_write_buffer [--bpw=CS] [--dry-run] [--help] [--id=ID] "
             "[--in=FILE]\n"
-            "                       [--length=LEN] [--mode=MO] "
+            "                       [--length=LEN] [--list=FN] [--mode=MO] "
             "[--offset=OFF]\n"
-            "                       [--read-stdin] [--skip=SKIP] "
-            "[--specific=MS]\n"
-            "                       [--timeout=TO] [--verbose] [--version] "
-            "DEVICE\n"
+            "                       [--parallel=P] [--read-stdin] "
+            "[--skip=SKIP]\n"
+            "                       [--specific=MS] [--timeout=TO] "
+            "[--verbose]\n"
+            "                       [--version] DEVICE [DEVICE...]\n"
             "  where:\n"
             "    --bpw=CS|-b CS         CS is chunk size: bytes per write "
             "buffer\n"
@@ -101,11 +110,18 @@ usage()
             "    --length=LEN|-l LEN    length in bytes to write; may be "
             "deduced from\n"
             "                           FILE\n"
+            "    --list=FN|-L FN        read device names (or globs) from "
+            "FN, one\n"
+            "                           per line ('-' for stdin); implies "
+            "fleet mode\n"
             "    --mode=MO|-m MO        write buffer mode, MO is number or "
             "acronym\n"
             "                           (def: 0 -> 'combined header and "
             "data' (obs))\n"
             "    --offset=OFF|-o OFF    buffer offset (unit: bytes, def: 0)\n"
+            "    --parallel=P|-P P      in fleet mode, number of devices "
+            "written to\n"
+            "                           at the same time (def: %d)\n"
             "    --read-stdin|-r        read from stdin (same as '-I -')\n"
             "    --skip=SKIP|-s SKIP    bytes in file FILE to skip before "
             "reading\n"
@@ -119,6 +135,10 @@ usage()
             "to list\navailable modes. A chunk size of 4 KB ('--bpw=4k') "
             "seems to work well.\nExample: sg_write_buffer -b 4k -I xxx.lod "
             "-m 7 /dev/sg3\n"
+            "If more than one DEVICE (or a glob) or --list=FN is given then "
+            "fleet mode\ndownloads FILE to those devices in parallel, "
+            "followed by a wave of\nactivate_mc commands if '--bpw=CS,act' "
+            "is given with a deferred mode.\n", SG_PAR_DEF_WORKERS
           );
 
 }
@@ -189,6 +209,312 @@ print_modes(void)
             "dmc_offs_ev_defer mode downloads.\n");
 }
 
+enum wb_dev_state_e {
+    WD_PENDING = 0,
+    WD_DOWNLOADED,      /* deferred microcode waiting for activation */
+    WD_ACTIVATED,
+    WD_ERROR,
+};
+
+static const char * wb_state_arr[] = {"pending", "downloaded", "activated",
+                                      "error"};
+
+/* Per device state in fleet mode */
+struct wb_dev_t {
+    int sg_fd;
+    int state;
+    int res;
+    int bpw;            /* bytes per WRITE BUFFER chosen for this device */
+    int num_cmds;
+    uint64_t elapsed_ns;
+    const char * name;
+};
+
+struct wb_fleet_t {
+    bool dry_run;
+    int mode;
+    int mspec;
+    int id;
+    int offset;
+    int bpw;            /* from --bpw=CS, 0 -> choose per device */
+    int len;            /* bytes of image to send */
+    int tmo;
+    int verbose;
+    const uint8_t * image;      /* shared by all workers, read-only */
+    struct wb_dev_t * dev_arr;
+    int * batch_arr;    /* indexes into dev_arr for the activation wave */
+};
+
+static void
+fleet_prt_row(const struct wb_dev_t * dp)
+{
+    char b[80];
+
+    if (dp->res)
+        sg_get_category_sense_str(dp->res, sizeof(b), b, 0);
+    else
+        b[0] = '\0';
+    printf("  %-22s %-10s %8d %5d %8" PRIu64 ".%03u  %s\n", dp->name,
+           wb_state_arr[dp->state], dp->bpw, dp->num_cmds,
+           dp->elapsed_ns / 1000000000,
+           (unsigned int)((dp->elapsed_ns / 1000000) % 1000), b);
+    fflush(stdout);
+}
+
+/* Chooses the number of bytes per WRITE BUFFER command for one device from
+ * the offset boundary and buffer capacity that READ BUFFER (descriptor
+ * mode) reports. A chunk size given with --bpw=CS is rounded down to the
+ * offset boundary and trimmed to the buffer capacity. Returns the chunk
+ * size, or -1 if the image can't be sent to this device. */
+static int
+fleet_choose_bpw(const struct wb_fleet_t * fp, const struct wb_dev_t * dp,
+                 int vb)
+{
+    int res, bound, cap, n;
+    uint8_t d[RB_DESC_LEN];
+
+    n = fp->bpw;
+    res = sg_ll_read_buffer(dp->sg_fd, RB_MODE_DESC, fp->id, 0, d,
+                            sizeof(d), (vb > 0), vb);
+    if (res) {
+        if (0 == n)
+            n = FLEET_DEF_BPW;
+        if (fp->verbose) {
+            sg_par_lock();
+            pr2serr("%s: READ BUFFER descriptor failed, chunk size %d\n",
+                    dp->name, n);
+            sg_par_unlock();
+        }
+    } else {
+        bound = d[0];
+        cap = sg_get_unaligned_be24(d + 1);
+        if (fp->verbose > 1) {
+            sg_par_lock();
+            pr2serr("%s: offset boundary=0x%x, buffer capacity=%d\n",
+                    dp->name, bound, cap);
+            sg_par_unlock();
+        }
+        if (0xff == bound) {    /* only a buffer offset of 0 allowed */
+            if ((cap > 0) && (cap < fp->len))
+                return -1;
+            return fp->len;
+        }
+        if (0 == n)
+            n = FLEET_MAX_BPW;
+        if ((cap > 0) && (n > cap))
+            n = cap;
+        if (bound < 24) {
+            n &= ~((1 << bound) - 1);
+            if (0 == n)
+                n = 1 << bound;
+        }
+    }
+    return (n < fp->len) ? n : fp->len;
+}
+
+/* Worker for sg_par_run(), downloads the image to dev_arr[idx] */
+static int
+fleet_dnld_work(void * ctxp, int idx)
+{
+    int k, n;
+    int res = 0;
+    struct wb_fleet_t * fp = (struct wb_fleet_t *)ctxp;
+    struct wb_dev_t * dp = fp->dev_arr + idx;
+    int vb = (fp->verbose > 1) ? fp->verbose - 1 : 0;
+    uint64_t start_ns = sg_par_mono_ns();
+
+    dp->sg_fd = sg_cmds_open_device(dp->name, false /* rw */, vb);
+    if (dp->sg_fd < 0) {
+        res = sg_convert_errno(-dp->sg_fd);
+        goto fini;
+    }
+    dp->bpw = fleet_choose_bpw(fp, dp, vb);
+    if (dp->bpw <= 0) {
+        sg_par_lock();
+        pr2serr("%s: image (%d bytes) exceeds buffer capacity\n", dp->name,
+                fp->len);
+        sg_par_unlock();
+        res = SG_LIB_CAT_OTHER;
+        goto fini;
+    }
+    for (k = 0; k < fp->len; k += n) {
+        n = fp->len - k;
+        if (n > dp->bpw)
+            n = dp->bpw;
+        if (! fp->dry_run)
+            res = sg_ll_write_buffer_v2(dp->sg_fd, fp->mode, fp->mspec,
+                                        fp->id, fp->offset + k,
+                                        (uint8_t *)(fp->image + k), n,
+                                        fp->tmo, (vb > 0), vb);
+        ++dp->num_cmds;
+        if (res)
+            break;
+    }
+fini:
+    dp->res = res;
+    dp->elapsed_ns = sg_par_mono_ns() - start_ns;
+    return res;
+}
+
+/* Called (serialized) as each device's download completes */
+static void
+fleet_dnld_done(void * ctxp, int idx, int res)
+{
+    struct wb_fleet_t * fp = (struct wb_fleet_t *)ctxp;
+    struct wb_dev_t * dp = fp->dev_arr + idx;
+
+    if (res)
+        dp->state = WD_ERROR;
+    else if ((MODE_DNLD_MC_OFFS_DEFER == fp->mode) ||
+             (MODE_DNLD_MC_EV_OFFS_DEFER == fp->mode))
+        dp->state = WD_DOWNLOADED;
+    else
+        dp->state = WD_ACTIVATED;
+    fleet_prt_row(dp);
+}
+
+/* Worker for sg_par_run(), activates deferred microcode on the device at
+ * batch_arr[idx] */
+static int
+fleet_act_work(void * ctxp, int idx)
+{
+    int res = 0;
+    struct wb_fleet_t * fp = (struct wb_fleet_t *)ctxp;
+    struct wb_dev_t * dp = fp->dev_arr + fp->batch_arr[idx];
+    int vb = (fp->verbose > 1) ? fp->verbose - 1 : 0;
+    uint64_t start_ns = sg_par_mono_ns();
+
+    if (dp->sg_fd < 0) {        /* --mode=activate_mc only */
+        dp->sg_fd = sg_cmds_open_device(dp->name, false /* rw */, vb);
+        if (dp->sg_fd < 0) {
+            res = sg_convert_errno(-dp->sg_fd);
+            goto fini;
+        }
+    }
+    if (! fp->dry_run)
+        res = sg_ll_write_buffer_v2(dp->sg_fd, MODE_ACTIVATE_MC, 0, 0, 0,
+                                    NULL, 0, fp->tmo, (vb > 0), vb);
+    ++dp->num_cmds;
+fini:
+    dp->res = res;
+    dp->elapsed_ns = sg_par_mono_ns() - start_ns;
+    return res;
+}
+
+static void
+fleet_act_done(void * ctxp, int idx, int res)
+{
+    struct wb_fleet_t * fp = (struct wb_fleet_t *)ctxp;
+    struct wb_dev_t * dp = fp->dev_arr + fp->batch_arr[idx];
+
+    dp->state = res ? WD_ERROR : WD_ACTIVATED;
+    fleet_prt_row(dp);
+}
+
+/* Fleet mode: downloads the (shared) image to every device in 'dlp' with
+ * at most 'num_workers' devices in progress at once. If 'activate' is
+ * true and the mode defers activation then, once every download has
+ * succeeded, a wave of activate_mc commands is sent. Returns exit status
+ * (the first failure in list order). */
+static int
+fleet_write_buffer(struct wb_fleet_t * fp, const struct sg_par_dev_list * dlp,
+                   int num_workers, bool activate)
+{
+    int k, n, res;
+    int ret = 0;
+    int num = dlp->num;
+    int num_err = 0;
+    uint64_t el;
+    uint64_t start_ns = sg_par_mono_ns();
+    struct wb_dev_t * dp;
+
+    fp->dev_arr = (struct wb_dev_t *)calloc(num, sizeof(struct wb_dev_t));
+    fp->batch_arr = (int *)calloc(num, sizeof(int));
+    if ((NULL == fp->dev_arr) || (NULL == fp->batch_arr)) {
+        pr2serr("%s: out of memory\n", __func__);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    for (k = 0; k < num; ++k) {
+        dp = fp->dev_arr + k;
+        dp->name = dlp->names[k];
+        dp->sg_fd = -1;
+        dp->state = WD_PENDING;
+    }
+    if (MODE_ACTIVATE_MC != fp->mode) {
+        printf("Downloading %d bytes to %d device%s, mode=0x%x, %d at a "
+               "time%s\n", fp->len, num, ((num > 1) ? "s" : ""), fp->mode,
+               num_workers, (fp->dry_run ? " [dry run]" : ""));
+        printf("  %-22s %-10s %8s %5s %12s  %s\n", "Device", "State",
+               "Chunk", "Cmds", "Elapsed(s)", "Reason");
+        res = sg_par_run(num, num_workers, fleet_dnld_work, fleet_dnld_done,
+                         fp);
+        if (res) {
+            pr2serr("unable to start worker threads: %s\n",
+                    safe_strerror(res));
+            ret = sg_convert_errno(res);
+            goto fini;
+        }
+    } else {
+        activate = true;
+        for (k = 0; k < num; ++k)
+            fp->dev_arr[k].state = WD_DOWNLOADED;
+    }
+    for (n = 0, k = 0; k < num; ++k) {
+        dp = fp->dev_arr + k;
+        if (WD_ERROR == dp->state)
+            ++num_err;
+        else if (WD_DOWNLOADED == dp->state)
+            fp->batch_arr[n++] = k;
+    }
+    if (activate && (n > 0)) {
+        if (num_err > 0)
+            printf("%d download%s failed so no activation wave; later use "
+                   "'--mode=activate_mc'\n", num_err,
+                   ((num_err > 1) ? "s" : ""));
+        else {
+            printf("Activating deferred microcode on %d device%s\n", n,
+                   ((n > 1) ? "s" : ""));
+            printf("  %-22s %-10s %8s %5s %12s  %s\n", "Device", "State",
+                   "Chunk", "Cmds", "Elapsed(s)", "Reason");
+            res = sg_par_run(n, num_workers, fleet_act_work, fleet_act_done,
+                             fp);
+            if (res) {
+                pr2serr("unable to start worker threads: %s\n",
+                        safe_strerror(res));
+                ret = sg_convert_errno(res);
+                goto fini;
+            }
+            for (k = 0; k < n; ++k) {
+                if (WD_ERROR == fp->dev_arr[fp->batch_arr[k]].state)
+                    ++num_err;
+            }
+        }
+    }
+    for (k = 0; k < num; ++k) {
+        dp = fp->dev_arr + k;
+        if ((WD_ERROR == dp->state) && (0 == ret))
+            ret = dp->res ? dp->res : SG_LIB_CAT_OTHER;
+    }
+    el = sg_par_mono_ns() - start_ns;
+    printf("%d device%s: %d ok, %d error%s in %" PRIu64 ".%03u seconds\n",
+           num, ((num > 1) ? "s" : ""), num - num_err, num_err,
+           ((1 == num_err) ? "" : "s"), el / 1000000000,
+           (unsigned int)((el / 1000000) % 1000));
+fini:
+    if (fp->dev_arr) {
+        for (k = 0; k < num; ++k) {
+            if (fp->dev_arr[k].sg_fd >= 0)
+                sg_cmds_close_device(fp->dev_arr[k].sg_fd);
+        }
+        free(fp->dev_arr);
+    }
+    if (fp->batch_arr)
+        free(fp->batch_arr);
+    return ret;
+}
+
+
 
 int
 main(int argc, char * argv[])
@@ -199,10 +525,12 @@ main(int argc, char * argv[])
     bool verbose_given = false;
     bool version_given = false;
     bool wb_len_given = false;
+    bool wb_mode_given = false;
     int infd, res, c, len, k, n;
     int sg_fd = -1;
     int bpw = 0;
     int do_help = 0;
+    int num_workers = 0;
     int ret = 0;
     int verbose = 0;
     int wb_id = 0;
@@ -214,19 +542,25 @@ main(int argc, char * argv[])
     int wb_mspec = 0;
     const char * device_name = NULL;
     const char * file_name = NULL;
+    const char * list_fn = NULL;
     uint8_t * dop = NULL;
     uint8_t * read_buf = NULL;
     uint8_t * free_dop = NULL;
     char * cp;
     const struct mode_s * mp;
     char ebuff[EBUFF_SZ];
+    struct sg_par_dev_list dev_list;
+    struct sg_par_file_map fmap;
+    struct wb_fleet_t fleet;
 
+    memset(&dev_list, 0, sizeof(dev_list));
+    memset(&fmap, 0, sizeof(fmap));
     if (getenv("SG3_UTILS_INVOCATION"))
         sg_rep_invocation(my_name, version_str, argc, argv, stderr);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:dhi:I:l:m:o:rs:S:t:vV", long_options,
+        c = getopt_long(argc, argv, "b:dhi:I:l:L:m:o:P:rs:S:t:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -270,6 +604,9 @@ main(int argc, char * argv[])
              }
              wb_len_given = true;
              break;
+        case 'L':
+            list_fn = optarg;
+            break;
         case 'm':
             if (isdigit((uint8_t)*optarg)) {
                 wb_mode = sg_get_num(optarg);
@@ -291,6 +628,7 @@ main(int argc, char * argv[])
                     return SG_LIB_SYNTAX_ERROR;
                 }
             }
+            wb_mode_given = true;
             break;
         case 'o':
            wb_offset = sg_get_num(optarg);
@@ -299,6 +637,15 @@ main(int argc, char * argv[])
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'P':
+            n = sg_get_num(optarg);
+            if ((n < 1) || (n > SG_PAR_MAX_WORKERS)) {
+                pr2serr("bad argument to '--parallel=', expect 1 to %d\n",
+                        SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            num_workers = n;
+            break;
         case 'r':       /* --read-stdin and --raw (previous name) */
             file_name = "-";
             break;
@@ -346,15 +693,13 @@ main(int argc, char * argv[])
         return 0;
     }
     if (optind < argc) {
-        if (NULL == device_name) {
+        if (NULL == device_name)
             device_name = argv[optind];
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SG_LIB_SYNTAX_ERROR;
+        /* more than one DEVICE (or a glob) is for fleet mode */
+        for (; optind < argc; ++optind) {
+            ret = sg_par_dev_list_add(&dev_list, argv[optind], verbose);
+            if (ret)
+                goto err_out;
         }
     }
 
@@ -376,7 +721,73 @@ main(int argc, char * argv[])
 #endif
     if (version_given) {
         pr2serr("version: %s\n", version_str);
-        return 0;
+        goto err_out;
+    }
+    if (list_fn) {
+        ret = sg_par_dev_list_from_file(&dev_list, list_fn, verbose);
+        if (ret)
+            goto err_out;
+    }
+    if ((dev_list.num > 1) || list_fn ||
+        (device_name && strpbrk(device_name, "*?["))) {
+        switch (wb_mode_given ? wb_mode : -1) {
+        case MODE_DNLD_MC_OFFS:
+        case MODE_DNLD_MC_OFFS_SAVE:
+        case MODE_DNLD_MC_EV_OFFS_DEFER:
+        case MODE_DNLD_MC_OFFS_DEFER:
+            if ((NULL == file_name) || (0 == strcmp(file_name, "-"))) {
+                pr2serr("fleet mode needs --in=FILE naming a regular "
+                        "file\n");
+                ret = SG_LIB_SYNTAX_ERROR;
+                goto err_out;
+            }
+            break;
+        case MODE_ACTIVATE_MC:
+            break;
+        default:
+            pr2serr("fleet mode needs --mode= of dmc_offs, dmc_offs_save, "
+                    "dmc_offs_ev_defer,\ndmc_offs_defer or activate_mc\n");
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto err_out;
+        }
+        if (dev_list.num < 1) {
+            pr2serr("no devices to download to\n");
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto err_out;
+        }
+        memset(&fleet, 0, sizeof(fleet));
+        if (MODE_ACTIVATE_MC != wb_mode) {
+            ret = sg_par_file_map(&fmap, file_name, wb_skip, wb_len,
+                                  verbose);
+            if (ret)
+                goto err_out;
+            if (wb_len_given && (fmap.len < wb_len)) {
+                pr2serr("--length=%d but %s only has %" PRId64 " bytes "
+                        "after skip\n", wb_len, file_name, fmap.len);
+                ret = SG_LIB_FILE_ERROR;
+                goto err_out;
+            }
+            if (fmap.len > INT32_MAX) {
+                pr2serr("%s is too large\n", file_name);
+                ret = SG_LIB_FILE_ERROR;
+                goto err_out;
+            }
+            fleet.image = fmap.p;
+            fleet.len = (int)fmap.len;
+        }
+        fleet.dry_run = dry_run;
+        fleet.mode = wb_mode;
+        fleet.mspec = wb_mspec;
+        fleet.id = wb_id;
+        fleet.offset = wb_offset;
+        fleet.bpw = bpw;
+        fleet.tmo = wb_timeout;
+        fleet.verbose = verbose;
+        if (0 == num_workers)
+            num_workers = SG_PAR_DEF_WORKERS;
+        ret = fleet_write_buffer(&fleet, &dev_list, num_workers,
+                                 bpw_then_activate);
+        goto err_out;
     }
 
     if (NULL == device_name) {
@@ -581,6 +992,8 @@ main(int argc, char * argv[])
     }
 
 err_out:
+    sg_par_file_unmap(&fmap);
+    sg_par_dev_list_free(&dev_list);
     if (free_dop)
         free(free_dop);
     if (read_buf)
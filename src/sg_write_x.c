@@ -10,6 +10,12 @@
  * WRITE(16 or 32), WRITE ATOMIC(16 or 32), ORWRITE(16 or 32),
  * WRITE SAME(16 or 32), WRITE SCATTERED (16 or 32) or WRITE
  * STREAM(16 or 32).
+ *
+ * There is also a workload mode (--workload=) that keeps several WRITE
+ * SCATTERED, (normal) WRITE or WRITE ATOMIC commands outstanding and
+ * reports IOPS and latency percentiles. Its scatter lists are generated
+ * or streamed from a file and WRITE SCATTERED commands are made as large
+ * as the device's Block Limits (Extension) VPD pages allow.
  */
 
 #include <unistd.h>
@@ -22,6 +28,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <ctype.h>
+#include <signal.h>
 #include <sys/types.h>  /* needed for lseek() */
 #include <sys/stat.h>
 #include <getopt.h>
@@ -37,8 +44,9 @@
 #include "sg_cmds_extra.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_par_common.h"
 
-static const char * version_str = "1.34 20230623";
+static const char * version_str = "1.35 20231031";
 
 static const char * my_name = "sg_write_x: ";
 
@@ -81,6 +89,13 @@ static const char * my_name = "sg_write_x: ";
 
 #define MAX_NUM_ADDR 128
 
+#define VPD_BLOCK_LIMITS 0xb0
+#define VPD_BLOCK_LIMITS_EXT 0xb7
+#define VPD_BL_RESP_LEN 64
+#define WL_DEF_MAX_LBARD MAX_NUM_ADDR   /* when device reports no limit */
+#define WL_DEF_MAX_XFER (1024 * 1024)   /* bytes, when no limit reported */
+#define WL_MAX_XFER (32 * 1024 * 1024)  /* bytes, cap on data-out buffer */
+
 #ifndef UINT32_MAX
 #define UINT32_MAX ((uint32_t)-1)
 #endif
@@ -111,7 +126,9 @@ static const struct option long_options[] = {
     {"num", required_argument, 0, 'n'},
     {"offset", required_argument, 0, 'o'},
     {"or", no_argument, 0, 'O'},
+    {"parallel", required_argument, 0, 'P'},
     {"quiet", no_argument, 0, 'Q'},
+    {"range", required_argument, 0, 'K'},
     {"ref-tag", required_argument, 0, 'r'},
     {"ref_tag", required_argument, 0, 'r'},
     {"same", required_argument, 0, 'M'},
@@ -129,6 +146,7 @@ static const struct option long_options[] = {
     {"unmap", required_argument, 0, 'u'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
+    {"workload", required_argument, 0, 'W'},
     {"wrprotect", required_argument, 0, 'w'},
     {0, 0, 0, 0},
 };
@@ -150,6 +168,7 @@ struct opts_t {
     bool do_stream;             /* -T  WRITE STREAM(16 or 32) */
                                 /*  --stream=ID  ID --> .str_id */
     bool do_unmap;              /* from --unmap=U_A , bit 0; WRITE SAME */
+    bool do_workload;           /* -W  --workload=CNT[,SECS] */
     bool do_write_normal;       /* -N  WRITE (16 or 32) */
     bool expect_pi_do;          /* expect protection information (PI) which
                                  * is 8 bytes long following each logical
@@ -165,6 +184,7 @@ struct opts_t {
     int dry_run;        /* temporary write when used more than once */
     int grpnum;         /* "Group Number", 0 to 0x3f (GRPNUM_MASK) */
     int help;
+    int num_workers;    /* from --parallel=P, commands outstanding */
     int pi_type;        /* -1: unknown: 0: type 0 (none): 1: type 1 */
     int strict;         /* > 0, report then exit on questionable meta data */
     int timeout;        /* timeout (in seconds) to abort SCSI commands */
@@ -190,9 +210,12 @@ struct opts_t {
     uint32_t orw_eog;   /* from --generation=EOG,NOG (first argument) */
     uint32_t orw_nog;   /* from --generation=EOG,NOG (for ORWRITE) */
     uint32_t ref_tag;   /* part of protection information (def: 0xffffffff) */
+    uint32_t wl_secs;   /* from --workload=CNT,SECS ; 0 -> no time limit */
     uint64_t lba;       /* "Logical Block Address", for non-scattered use */
     uint64_t if_offset; /* byte offset in .if_name to start reading */
     uint64_t tot_lbs;   /* from READ CAPACITY */
+    uint64_t wl_cnt;    /* from --workload=CNT ; 0 -> no command limit */
+    uint64_t wl_range;  /* from --range=RNG ; 0 -> to end of DEVICE */
     ssize_t xfer_bytes;     /* derived value: bs_pi_do * numblocks */
                             /* for WRITE SCATTERED .xfer_bytes < do_len */
     const char * device_name;
@@ -219,13 +242,15 @@ usage(int do_help)
             "           [--fua] [--generation=EOG,NOG] [--grpnum=GN] "
             "[--help] --in=IF\n"
             "           [--lba=LBA,LBA...] [--normal] [--num=NUM,NUM...]\n"
-            "           [--offset=OFF[,DLEN]] [--or] [--quiet] "
-            "[--ref-tag=RT]\n"
-            "           [--same=NDOB] [--scat-file=SF] [--scat-raw] "
-            "[--scattered=RD]\n"
-            "           [--stream=ID] [--strict] [--tag-mask=TM] "
-            "[--timeout=TO]\n"
-            "           [--unmap=U_A] [--verbose] [--version] "
+            "           [--offset=OFF[,DLEN]] [--or] [--parallel=P] "
+            "[--quiet]\n"
+            "           [--range=RNG] [--ref-tag=RT] [--same=NDOB] "
+            "[--scat-file=SF]\n"
+            "           [--scat-raw] [--scattered=RD] [--stream=ID] "
+            "[--strict]\n"
+            "           [--tag-mask=TM] [--timeout=TO] [--unmap=U_A] "
+            "[--verbose]\n"
+            "           [--version] [--workload=CNT[,SECS]] "
             "[--wrprotect=WRP]\n"
             "           DEVICE\n");
         if (1 != do_help) {
@@ -234,11 +259,12 @@ usage(int do_help)
                 "[-c DOF] [-D DLD]\n"
                 "           [-d] [-x] [-f] [-G EOG,NOG] [-g GN] [-h] -i IF "
                 "[-l LBA,LBA...]\n"
-                "           [-N] [-n NUM,NUM...] [-o OFF[,DLEN]] [-O] [-Q] "
-                "[-r RT] [-M NDOB]\n"
-                "           [-q SF] [-R] [-S RD] [-T ID] [-s] [-t TM] [-I TO] "
-                "[-u U_A] [-v]\n"
-                "           [-V] [-w WPR] DEVICE\n"
+                "           [-N] [-n NUM,NUM...] [-o OFF[,DLEN]] [-O] "
+                "[-P P] [-Q] [-K RNG]\n"
+                "           [-r RT] [-M NDOB] [-q SF] [-R] [-S RD] [-T ID] "
+                "[-s] [-t TM]\n"
+                "           [-I TO] [-u U_A] [-v] [-V] [-W CNT[,SECS]] "
+                "[-w WPR] DEVICE\n"
                    );
             pr2serr("\nUse '-h' or '--help' for more help\n");
             return;
@@ -306,7 +332,14 @@ usage(int do_help)
             "        |-o OFF[,DLEN]     (def: 0), then read DLEN bytes(def: "
             "rest of IF)\n"
             "    --or|-O            send ORWRITE command\n"
+            "    --parallel=P|-P P    in workload mode keep P commands "
+            "outstanding\n"
+            "                         (def: 8)\n"
             "    --quiet|-Q         suppress some informational messages\n"
+            "    --range=RNG|-K RNG    in workload mode generated LBA "
+            "ranges lie in\n"
+            "                          RNG blocks starting at LBA (def: "
+            "to end of DEVICE)\n"
             "    --ref-tag=RT|-r RT     expected reference tag field (def: "
             "0xffffffff)\n"
             "    --same=NDOB|-M NDOB    send WRITE SAME command. NDOB (no "
@@ -337,6 +370,11 @@ usage(int do_help)
             "both\n"
             "    --verbose|-v       increase verbosity\n"
             "    --version|-V       print version string then exit\n"
+            "    --workload=CNT[,SECS]    send CNT commands (0: no limit) "
+            "for at most\n"
+            "        |-W CNT[,SECS]       SECS seconds (def: 0, no limit), "
+            "then report\n"
+            "                             IOPS and latency\n"
             "    --wrprotect=WPR|-w WPR    WPR is the WRPROTECT field "
             "value (def: 0)\n\n"
             "Performs a SCSI WRITE (normal), ORWRITE, WRITE ATOMIC, WRITE "
@@ -424,6 +462,16 @@ usage(int do_help)
             "[--wrprotect=WRP]\n"
             "             DEVICE\n"
             "\n"
+            "WRITE SCATTERED, WRITE or WRITE ATOMIC workload applicable "
+            "options:\n"
+            "  sg_write_x --workload=CNT[,SECS] --in=IF [--scattered=RD] "
+            "[--16] [--32]\n"
+            "             [--bs=BS] [--dpo] [--fua] [--grpnum=GN] "
+            "[--lba=LBA] [--num=NUM]\n"
+            "             [--parallel=P] [--range=RNG] [--scat-file=SF] "
+            "[--timeout=TO]\n"
+            "             [--wrprotect=WRP] DEVICE\n"
+            "\n"
             "WRITE STREAM (32) applicable options:\n"
             "  sg_write_x --stream=ID --in=IF --32 [--app-tag=AT] "
             "[--bs=BS] [--dpo]\n"
@@ -484,6 +532,18 @@ usage(int do_help)
             "'--num=NUM,NUM...' should\n"
             "   also be used. Also they should have the same number of "
             "elements.\n"
+            " - --workload=CNT[,SECS] applies to WRITE SCATTERED, WRITE "
+            "and WRITE\n"
+            "   ATOMIC. Each command writes random, non-overlapping ranges "
+            "of NUM blocks\n"
+            "   (from --num=NUM) within RNG blocks starting at LBA. With "
+            "--scat-file=SF\n"
+            "   the ranges (one LBA,NUM per line) are streamed from SF "
+            "instead; SF may\n"
+            "   be '-' for stdin. WRITE SCATTERED packs as many ranges "
+            "into each command\n"
+            "   as the Block Limits Extension VPD page allows, or RD "
+            "if smaller.\n"
               );
     }
 }
@@ -1509,7 +1569,7 @@ do_read_capacity(int sg_fd, struct opts_t *op)
 
 #define WANT_ZERO_EXIT 9999
 static const char * const opt_long_ctl_str =
-    "36a:A:b:B:c:dD:Efg:G:hi:I:l:M:n:No:Oq:Qr:RsS:t:T:u:vVw:x";
+    "36a:A:b:B:c:dD:Efg:G:hi:I:K:l:M:n:No:OP:q:Qr:RsS:t:T:u:vVw:W:x";
 
 /* command line processing, options and arguments. Returns 0 if ok,
  * returns WANT_ZERO_EXIT so upper level yields an exist status of zero.
@@ -1680,6 +1740,14 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[],
                 return SG_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'K':
+            ll = sg_get_llnum(optarg);
+            if (ll < 1) {
+                pr2serr("bad argument to '--range=', expect 1 or more\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->wl_range = (uint64_t)ll;
+            break;
         case 'l':
             if (*lba_opp) {
                 pr2serr("only expect '--lba=' option once\n");
@@ -1733,6 +1801,15 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[],
             op->do_or = true;
             op->cmd_name = "Orwrite";
             break;
+        case 'P':
+            op->num_workers = sg_get_num(optarg);
+            if ((op->num_workers < 1) ||
+                (op->num_workers > SG_PAR_MAX_WORKERS)) {
+                pr2serr("bad argument to '--parallel=', expect 1 to %d\n",
+                        SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'q':
             op->scat_filename = optarg;
             break;
@@ -1801,6 +1878,23 @@ parse_cmd_line(struct opts_t *op, int argc, char *argv[],
         case 'V':
             op->version_given = true;
             break;
+        case 'W':       /* --workload=CNT[,SECS] */
+            ll = sg_get_llnum(optarg);
+            if (ll < 0) {
+                pr2serr("bad first argument to '--workload='\n");
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            op->wl_cnt = (uint64_t)ll;
+            if ((cp = strchr(optarg, ','))) {
+                j = sg_get_num(cp + 1);
+                if (j < 0) {
+                    pr2serr("bad second argument to '--workload='\n");
+                    return SG_LIB_SYNTAX_ERROR;
+                }
+                op->wl_secs = (uint32_t)j;
+            }
+            op->do_workload = true;
+            break;
         case 'w':       /* WRPROTECT field (or ORPROTECT for ORWRITE) */
             op->wrprotect = sg_get_num(optarg);
             if ((op->wrprotect < 0) || (op->wrprotect > 7))  {
@@ -2168,6 +2262,659 @@ finii:
     return ret;
 }
 
+/* Workload mode. Each worker has its own file descriptor, data-out buffer
+ * and copy of the options, and has one command outstanding at a time. So
+ * --parallel=P is the number of commands kept outstanding on DEVICE. */
+
+static volatile sig_atomic_t wl_stop = 0;
+
+struct wl_thr_t {
+    int res;            /* 0 or first SG_LIB_* error */
+    uint64_t rnd_state;
+    uint64_t cmds;
+    uint64_t ranges;    /* number of LBA ranges written */
+    uint64_t blks;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    struct sg_par_lat_hist lat;
+};
+
+struct wl_ctx_t {
+    bool sf_eof;
+    bool have_pend;
+    int sf_lineno;
+    int64_t cmds_left;          /* -1 for no limit */
+    uint32_t max_lbard;         /* LBA range descriptors per command */
+    uint32_t max_blks;          /* blocks per command */
+    uint32_t max_rd_blks;       /* blocks per descriptor, 0 -> no limit */
+    uint32_t lbdof;             /* LB data offset, only WRITE SCATTERED */
+    uint32_t atomic_align;      /* WRITE ATOMIC LBA multiple, 0 -> any */
+    uint32_t atomic_gran;       /* WRITE ATOMIC NUM multiple, 0 -> any */
+    uint64_t slot_blks;         /* distance between generated ranges */
+    uint64_t deadline;          /* 0 -> no time limit */
+    uint64_t lba;               /* start of generated ranges */
+    uint64_t num_slots;         /* number of NUM sized slots in RNG */
+    const struct opts_t * op;
+    const uint8_t * pattern;    /* max_blks worth of data to write */
+    FILE * sf_fp;               /* streams LBA,NUM[,RT,AT,TM] lines */
+    uint8_t pend[32];           /* descriptor read but not yet sent */
+    struct wl_thr_t * thr_arr;
+};
+
+
+static void
+wl_interrupt_handler(int sig)
+{
+    struct sigaction sigact;
+
+    /* a second signal of the same type terminates */
+    sigact.sa_handler = SIG_DFL;
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigaction(sig, &sigact, NULL);
+    wl_stop = 1;
+}
+
+static void
+wl_install_handler(int sig_num, void (*sig_handler)(int sig))
+{
+    struct sigaction sigact;
+
+    sigaction(sig_num, NULL, &sigact);
+    if (sigact.sa_handler != SIG_IGN) {
+        sigact.sa_handler = sig_handler;
+        sigemptyset(&sigact.sa_mask);
+        sigact.sa_flags = 0;
+        sigaction(sig_num, &sigact, NULL);
+    }
+}
+
+/* xorshift64* generator, each worker has its own state */
+static uint64_t
+wl_rand(uint64_t * statep)
+{
+    uint64_t x = *statep;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *statep = x;
+    return x * UINT64_C(2685821657736338717);
+}
+
+/* Generates the LBA range descriptors of one command starting at 'dp'.
+ * The NUM sized slots in RNG are split into max_lbard equal parts and a
+ * random slot is taken from each, so the ranges never overlap (which WRITE
+ * SCATTERED does not allow). Returns the number of descriptors. */
+static uint32_t
+wl_gen(const struct wl_ctx_t * cp, struct wl_thr_t * tp, uint8_t * dp)
+{
+    uint32_t k;
+    uint32_t nd = cp->max_lbard;
+    uint64_t part, slot;
+    const struct opts_t * op = cp->op;
+
+    part = cp->num_slots / nd;
+    for (k = 0; k < nd; ++k, dp += lbard_sz) {
+        if (k == (nd - 1))      /* last part takes the remainder */
+            slot = (k * part) + (wl_rand(&tp->rnd_state) %
+                                 (cp->num_slots - (k * part)));
+        else
+            slot = (k * part) + (wl_rand(&tp->rnd_state) % part);
+        memset(dp, 0, lbard_sz);
+        sg_put_unaligned_be64(cp->lba + (slot * cp->slot_blks), dp + 0);
+        sg_put_unaligned_be32(op->numblocks, dp + 8);
+        if (op->do_32) {
+            sg_put_unaligned_be32(op->ref_tag, dp + 12);
+            sg_put_unaligned_be16(op->app_tag, dp + 16);
+            sg_put_unaligned_be16(op->tag_mask, dp + 18);
+        }
+    }
+    return nd;
+}
+
+/* Returns true if the range at 'lba' of 'num' blocks starts on a WRITE
+ * ATOMIC alignment boundary and its length is a multiple of the atomic
+ * transfer length granularity, or if --atomic= is not given */
+static bool
+wl_atomic_ok(const struct wl_ctx_t * cp, uint64_t lba, uint32_t num)
+{
+    if (! cp->op->do_atomic)
+        return true;
+    if ((cp->atomic_align > 1) && (lba % cp->atomic_align))
+        return false;
+    if ((cp->atomic_gran > 1) && (num % cp->atomic_gran))
+        return false;
+    return true;
+}
+
+/* Reads LBA range descriptors for one command from the scatter file into
+ * 'dp', stopping at max_lbard descriptors or when the next one would take
+ * the command over max_blks blocks. Caller must hold sg_par_lock(). Returns
+ * the number of descriptors (0 at end of file) and their summed NUMs in
+ * *blksp, or -1 on a syntax error. */
+static int
+wl_stream(struct wl_ctx_t * cp, uint8_t * dp, uint32_t * blksp)
+{
+    int n, res;
+    uint32_t num;
+    uint32_t blks = 0;
+    uint64_t lba;
+    const struct opts_t * op = cp->op;
+    char line[1024];
+
+    for (n = 0; n < (int)cp->max_lbard; ) {
+        if (! cp->have_pend) {
+            if (cp->sf_eof)
+                break;
+            if (NULL == fgets(line, sizeof(line), cp->sf_fp)) {
+                cp->sf_eof = true;
+                break;
+            }
+            ++cp->sf_lineno;
+            line[strcspn(line, "\r\n")] = '\0';
+            res = parse_scat_pi_line(line, cp->pend, NULL);
+            if (999 == res)
+                continue;       /* blank or comment line */
+            if (res) {
+                pr2serr("line %d of %s\n", cp->sf_lineno, op->scat_filename);
+                return -1;
+            }
+            if (op->do_16)      /* those fields are reserved */
+                memset(cp->pend + 12, 0, 8);
+            lba = sg_get_unaligned_be64(cp->pend + 0);
+            num = sg_get_unaligned_be32(cp->pend + 8);
+            if (! wl_atomic_ok(cp, lba, num)) {
+                pr2serr("LBA (0x%" PRIx64 ") or NUM (%u) on line %d of %s "
+                        "breaks WRITE ATOMIC alignment (%u) or granularity "
+                        "(%u)\n", lba, num, cp->sf_lineno, op->scat_filename,
+                        cp->atomic_align, cp->atomic_gran);
+                return -1;
+            }
+            if ((num > cp->max_blks) ||
+                (cp->max_rd_blks && (num > cp->max_rd_blks))) {
+                pr2serr("NUM (%u) on line %d of %s exceeds the maximum "
+                        "transfer length\n", num, cp->sf_lineno,
+                        op->scat_filename);
+                return -1;
+            }
+            cp->have_pend = true;
+        }
+        num = sg_get_unaligned_be32(cp->pend + 8);
+        if ((blks + num) > cp->max_blks)
+            break;      /* keep it for the next command */
+        memcpy(dp + (n * lbard_sz), cp->pend, lbard_sz);
+        cp->have_pend = false;
+        blks += num;
+        ++n;
+    }
+    *blksp = blks;
+    return n;
+}
+
+/* Worker for sg_par_run(), one call per outstanding command */
+static int
+wl_work(void * ctxp, int idx)
+{
+    int n, fd;
+    uint32_t blks, hdr_len, dout_len;
+    uint64_t t;
+    struct wl_ctx_t * cp = (struct wl_ctx_t *)ctxp;
+    const struct opts_t * op = cp->op;
+    struct wl_thr_t * tp = cp->thr_arr + idx;
+    uint8_t * up;
+    uint8_t * dp;
+    uint8_t * free_up = NULL;
+    struct opts_t lopts;
+    uint8_t rd[32];     /* single descriptor for WRITE and WRITE ATOMIC */
+
+    lopts = *op;
+    lopts.scat_lbdof = cp->lbdof;
+    hdr_len = cp->lbdof * op->bs_pi_do;
+    fd = sg_cmds_open_device(op->device_name, false /* rw */, op->verbose);
+    if (fd < 0) {
+        sg_par_lock();
+        pr2serr("worker %d: open error: %s: %s\n", idx, op->device_name,
+                safe_strerror(-fd));
+        sg_par_unlock();
+        tp->res = sg_convert_errno(-fd);
+        return tp->res;
+    }
+    up = sg_memalign(hdr_len + (cp->max_blks * op->bs_pi_do), 0, &free_up,
+                     false);
+    if (NULL == up) {
+        tp->res = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    memcpy(up + hdr_len, cp->pattern, cp->max_blks * op->bs_pi_do);
+    dp = op->do_scattered ? (up + lbard_sz) : rd;
+    tp->start_ns = sg_par_mono_ns();
+    while (! wl_stop) {
+        if (cp->deadline && (sg_par_mono_ns() >= cp->deadline))
+            break;
+        blks = 0;
+        sg_par_lock();
+        if (0 == cp->cmds_left)
+            n = 0;
+        else if (cp->sf_fp)
+            n = wl_stream(cp, dp, &blks);
+        else
+            n = 1;      /* generated outside the lock */
+        if ((n > 0) && (cp->cmds_left > 0))
+            --cp->cmds_left;
+        sg_par_unlock();
+        if (n < 0) {
+            tp->res = SG_LIB_SYNTAX_ERROR;
+            wl_stop = 1;
+            break;
+        } else if (0 == n)
+            break;
+        if (NULL == cp->sf_fp) {
+            n = wl_gen(cp, tp, dp);
+            blks = n * op->numblocks;
+        }
+        if (op->do_scattered) {
+            lopts.scat_num_lbard = n;
+            lopts.numblocks = blks;
+            dout_len = hdr_len + (blks * op->bs_pi_do);
+        } else {
+            lopts.lba = sg_get_unaligned_be64(rd + 0);
+            lopts.numblocks = sg_get_unaligned_be32(rd + 8);
+            if (op->do_32) {
+                lopts.ref_tag = sg_get_unaligned_be32(rd + 12);
+                lopts.app_tag = sg_get_unaligned_be16(rd + 16);
+                lopts.tag_mask = sg_get_unaligned_be16(rd + 18);
+            }
+            dout_len = blks * op->bs_pi_do;
+        }
+        t = sg_par_mono_ns();
+        tp->res = do_write_x(fd, up, dout_len, &lopts);
+        if (tp->res) {
+            wl_stop = 1;
+            break;
+        }
+        sg_par_lat_add(&tp->lat, sg_par_mono_ns() - t);
+        ++tp->cmds;
+        tp->ranges += n;
+        tp->blks += blks;
+    }
+    tp->end_ns = sg_par_mono_ns();
+fini:
+    if (free_up)
+        free(free_up);
+    sg_cmds_close_device(fd);
+    return tp->res;
+}
+
+/* Fetches the Block Limits and (for WRITE SCATTERED) the Block Limits
+ * Extension VPD pages and sets the per command limits in 'cp'. For WRITE
+ * ATOMIC the atomic alignment and granularity are also kept and the blocks
+ * per command are capped by the maximum atomic transfer length and by the
+ * 16 bit TRANSFER LENGTH field. Limits that DEVICE does not report fall
+ * back to defaults. Returns 0 or an SG_LIB_* error. */
+static int
+wl_limits(int sg_fd, struct wl_ctx_t * cp, const struct opts_t * op)
+{
+    int len;
+    int vb = op->verbose;
+    uint32_t max_xfer = 0;
+    uint32_t max_atomic = 0;
+    uint32_t max_lbard = 0;
+    uint32_t max_blks;
+    uint8_t b[VPD_BL_RESP_LEN];
+
+    memset(b, 0, sizeof(b));
+    if (0 == sg_ll_inquiry(sg_fd, false, true /* evpd */, VPD_BLOCK_LIMITS,
+                           b, sizeof(b), false, (vb > 1 ? vb - 1 : 0))) {
+        len = sg_get_unaligned_be16(b + 2) + 4;
+        if (len >= 16)
+            max_xfer = sg_get_unaligned_be32(b + 8);
+        if (len >= 48)
+            max_atomic = sg_get_unaligned_be32(b + 44);
+        if (len >= 56) {
+            cp->atomic_align = sg_get_unaligned_be32(b + 48);
+            cp->atomic_gran = sg_get_unaligned_be32(b + 52);
+        }
+    } else if (vb)
+        pr2serr("Block Limits VPD page not available, use defaults\n");
+    max_blks = WL_MAX_XFER / op->bs_pi_do;
+    if (max_xfer > 0) {
+        if (max_xfer < max_blks)
+            max_blks = max_xfer;
+    } else if (! op->do_scattered)
+        max_blks = WL_DEF_MAX_XFER / op->bs_pi_do;
+    if (op->do_atomic) {
+        if ((max_atomic > 0) && (max_atomic < max_blks))
+            max_blks = max_atomic;
+        if (max_blks > UINT16_MAX)
+            max_blks = UINT16_MAX;
+        if ((cp->atomic_gran > 1) && (max_blks >= cp->atomic_gran))
+            max_blks -= max_blks % cp->atomic_gran;
+    }
+
+    if (op->do_scattered) {
+        uint32_t max_scat = 0;
+
+        memset(b, 0, sizeof(b));
+        if (0 == sg_ll_inquiry(sg_fd, false, true, VPD_BLOCK_LIMITS_EXT, b,
+                               sizeof(b), false, (vb > 1 ? vb - 1 : 0))) {
+            len = sg_get_unaligned_be16(b + 2) + 4;
+            if (len >= 28) {
+                cp->max_rd_blks = sg_get_unaligned_be32(b + 16);
+                max_lbard = sg_get_unaligned_be16(b + 22);
+                max_scat = sg_get_unaligned_be32(b + 24);
+            }
+        } else if (vb)
+            pr2serr("Block Limits Extension VPD page not available, use "
+                    "defaults\n");
+        if (max_scat > 0) {
+            if (max_scat < max_blks)
+                max_blks = max_scat;
+        } else if (0 == max_xfer) {
+            if ((WL_DEF_MAX_XFER / op->bs_pi_do) < max_blks)
+                max_blks = WL_DEF_MAX_XFER / op->bs_pi_do;
+        }
+        if (0 == max_lbard)
+            max_lbard = WL_DEF_MAX_LBARD;
+        if ((op->scat_num_lbard > 0) && (op->scat_num_lbard < max_lbard))
+            max_lbard = op->scat_num_lbard;
+    } else
+        max_lbard = 1;
+    if (0 == max_blks)
+        max_blks = 1;
+    cp->max_lbard = max_lbard;
+    cp->max_blks = max_blks;
+    if (vb) {
+        pr2serr("Workload limits: %u %s%s and %u blocks per command",
+                max_lbard, lbard_str, (max_lbard > 1 ? "s" : ""), max_blks);
+        if (cp->max_rd_blks > 0)
+            pr2serr(", %u blocks per range\n", cp->max_rd_blks);
+        else
+            pr2serr("\n");
+        if (op->do_atomic && ((cp->atomic_align > 1) ||
+                              (cp->atomic_gran > 1)))
+            pr2serr("Atomic alignment: %u, atomic transfer length "
+                    "granularity: %u\n", cp->atomic_align, cp->atomic_gran);
+    }
+    return 0;
+}
+
+static void
+wl_prt_lat(const struct sg_par_lat_hist * lhp)
+{
+    int k;
+    static const double pc_arr[] = {50.0, 90.0, 99.0, 99.9};
+    static const char * pc_nm_arr[] = {"p50", "p90", "p99", "p99.9"};
+
+    printf("  latency (usecs): min=%" PRIu64 ", mean=%" PRIu64,
+           lhp->min / 1000,
+           (lhp->count ? (lhp->sum / lhp->count) / 1000 : 0));
+    for (k = 0; k < (int)SG_ARRAY_SIZE(pc_arr); ++k)
+        printf(", %s=%" PRIu64, pc_nm_arr[k],
+               sg_par_lat_percentile(lhp, pc_arr[k]) / 1000);
+    printf(", max=%" PRIu64 "\n", lhp->max / 1000);
+}
+
+/* Runs the workload (--workload=CNT[,SECS]) with WRITE SCATTERED, WRITE or
+ * WRITE ATOMIC then reports IOPS and latency. Ranges are generated from
+ * op->numblocks blocks each, starting at 'lba', unless they are streamed
+ * from op->scat_filename . Returns 0 on success, otherwise the first error
+ * reported by a worker. */
+static int
+process_workload(int sg_fd, int infd, uint32_t if_len, uint64_t lba,
+                 struct opts_t * op)
+{
+    bool got_stdin = false;
+    int k, n, res;
+    int ret = 0;
+    int vb = op->verbose;
+    uint32_t pat_len;
+    uint64_t cmds, ranges, blks, min_start, max_end, rnd_seed, range;
+    double secs;
+    uint8_t * pat_up = NULL;
+    uint8_t * free_pat_up = NULL;
+    struct wl_thr_t * thr_arr = NULL;
+    struct sg_par_lat_hist lat_all;
+    struct wl_ctx_t ctx;
+    char b[80];
+
+    if (! (op->do_scattered || op->do_write_normal || op->do_atomic)) {
+        pr2serr("--workload= only applies to WRITE SCATTERED, WRITE and "
+                "WRITE ATOMIC\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if (op->do_combined || op->do_scat_raw || (op->dry_run > 1)) {
+        pr2serr("--workload= does not accept --combined=, --scat-raw or "
+                "--dry-run twice\n");
+        return SG_LIB_CONTRADICT;
+    }
+    if ((0 == op->wl_cnt) && (0 == op->wl_secs) && op->dry_run &&
+        (NULL == op->scat_filename)) {
+        pr2serr("--dry-run needs a command count or run time with "
+                "--workload=\n");
+        return SG_LIB_CONTRADICT;
+    }
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.op = op;
+    ctx.lba = lba;
+    ctx.cmds_left = (op->wl_cnt > 0) ? (int64_t)op->wl_cnt : -1;
+    if (op->num_workers < 1)
+        op->num_workers = SG_PAR_DEF_WORKERS;
+    res = wl_limits(sg_fd, &ctx, op);
+    if (res)
+        return res;
+
+    if (op->scat_filename) {
+        if (op->wl_range > 0)
+            pr2serr("--range=RNG ignored with --scat-file=SF\n");
+        if (0 == strcmp(op->scat_filename, "-")) {
+            if (STDIN_FILENO == infd) {
+                pr2serr("IF and SF can't both be stdin\n");
+                return SG_LIB_CONTRADICT;
+            }
+            got_stdin = true;
+            ctx.sf_fp = stdin;
+        } else if (NULL == (ctx.sf_fp = fopen(op->scat_filename, "r"))) {
+            res = errno;
+            pr2serr("unable to open %s: %s\n", op->scat_filename,
+                    safe_strerror(res));
+            return sg_convert_errno(res);
+        }
+    } else {
+        if (0 == op->numblocks) {
+            pr2serr("--workload= needs --num=NUM greater than 0 or "
+                    "--scat-file=SF\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if (op->do_atomic && (ctx.atomic_gran > 1) &&
+            (op->numblocks % ctx.atomic_gran)) {
+            op->numblocks += ctx.atomic_gran -
+                             (op->numblocks % ctx.atomic_gran);
+            if (vb)
+                pr2serr("NUM rounded up to %u, a multiple of the atomic "
+                        "transfer length granularity\n", op->numblocks);
+        }
+        if (op->numblocks > ctx.max_blks) {
+            pr2serr("NUM (%u) exceeds the maximum transfer length (%u)\n",
+                    op->numblocks, ctx.max_blks);
+            return SG_LIB_CONTRADICT;
+        }
+        if (ctx.max_rd_blks && (op->numblocks > ctx.max_rd_blks)) {
+            pr2serr("NUM (%u) exceeds the maximum scattered LBA range "
+                    "transfer length (%u)\n", op->numblocks,
+                    ctx.max_rd_blks);
+            return SG_LIB_CONTRADICT;
+        }
+        range = op->wl_range;
+        if (op->tot_lbs > 0) {
+            if (lba >= op->tot_lbs) {
+                pr2serr("LBA (0x%" PRIx64 ") is beyond the end of %s\n",
+                        lba, op->device_name);
+                return SG_LIB_LBA_OUT_OF_RANGE;
+            }
+            if (0 == range)
+                range = op->tot_lbs - lba;
+            else if (range > (op->tot_lbs - lba)) {
+                pr2serr("LBA+RNG goes beyond the end of %s\n",
+                        op->device_name);
+                return SG_LIB_LBA_OUT_OF_RANGE;
+            }
+        } else if (0 == range) {
+            pr2serr("capacity of %s unknown, please give --range=RNG\n",
+                    op->device_name);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        ctx.slot_blks = op->numblocks;
+        if (op->do_atomic && (ctx.atomic_align > 1)) {
+            uint64_t d = lba % ctx.atomic_align;
+
+            /* each range must start on an atomic alignment boundary */
+            d = d ? (ctx.atomic_align - d) : 0;
+            range = (range > d) ? (range - d) : 0;
+            ctx.lba = lba + d;
+            if (ctx.slot_blks % ctx.atomic_align)
+                ctx.slot_blks += ctx.atomic_align -
+                                 (ctx.slot_blks % ctx.atomic_align);
+            if (vb && d)
+                pr2serr("LBA rounded up to 0x%" PRIx64 ", a multiple of the "
+                        "atomic alignment\n", ctx.lba);
+        }
+        ctx.num_slots = range / ctx.slot_blks;
+        if (0 == ctx.num_slots) {
+            pr2serr("RNG smaller than NUM, nothing to do\n");
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        if ((ctx.max_lbard * op->numblocks) > ctx.max_blks)
+            ctx.max_lbard = ctx.max_blks / op->numblocks;
+        if (ctx.max_lbard > ctx.num_slots)
+            ctx.max_lbard = (uint32_t)ctx.num_slots;
+    }
+    if (op->do_scattered) {
+        n = lbard_sz * (1 + ctx.max_lbard);
+        ctx.lbdof = (n + op->bs_pi_do - 1) / op->bs_pi_do;
+        if (ctx.lbdof > UINT16_MAX) {
+            pr2serr("%ss don't fit in the LB data offset field\n",
+                    lbard_str);
+            ret = SG_LIB_CONTRADICT;
+            goto fini;
+        }
+    }
+
+    /* data to write: as much of IF as fits in one command, zero padded */
+    pat_len = ctx.max_blks * op->bs_pi_do;
+    pat_up = sg_memalign(pat_len, 0, &free_pat_up, false);
+    if (NULL == pat_up) {
+        pr2serr("unable to allocate %u bytes of memory\n", pat_len);
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    if ((infd >= 0) && (if_len > 0) && (if_len < pat_len))
+        pat_len = if_len;
+    for (k = 0; (infd >= 0) && (k < (int)pat_len); k += res) {
+        res = read(infd, pat_up + k, pat_len - k);
+        if (res < 0) {
+            if (EINTR == errno) {
+                res = 0;
+                continue;
+            }
+            res = errno;
+            pr2serr("Error doing read of IF: %s\n", safe_strerror(res));
+            ret = sg_convert_errno(res);
+            goto fini;
+        } else if (0 == res)
+            break;
+    }
+    ctx.pattern = pat_up;
+
+    thr_arr = (struct wl_thr_t *)calloc(op->num_workers, sizeof(*thr_arr));
+    if (NULL == thr_arr) {
+        pr2serr("out of memory\n");
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    rnd_seed = sg_par_mono_ns() ^ ((uint64_t)getpid() << 32);
+    for (k = 0; k < op->num_workers; ++k) {
+        struct wl_thr_t * tp = thr_arr + k;
+
+        tp->rnd_state = rnd_seed + ((uint64_t)(k + 1) * 0x9e3779b97f4a7c15ULL);
+        if (0 == tp->rnd_state)
+            tp->rnd_state = 1;
+    }
+    ctx.thr_arr = thr_arr;
+    wl_install_handler(SIGINT, wl_interrupt_handler);
+    wl_install_handler(SIGQUIT, wl_interrupt_handler);
+    wl_install_handler(SIGPIPE, wl_interrupt_handler);
+    if (op->wl_secs > 0)
+        ctx.deadline = sg_par_mono_ns() +
+                       ((uint64_t)op->wl_secs * 1000000000ULL);
+    res = sg_par_run(op->num_workers, op->num_workers, wl_work, NULL, &ctx);
+    if (res) {
+        pr2serr("unable to start workers: %s\n", safe_strerror(res));
+        ret = sg_convert_errno(res);
+        goto fini;
+    }
+
+    sg_par_lat_init(&lat_all);
+    cmds = 0;
+    ranges = 0;
+    blks = 0;
+    min_start = 0;
+    max_end = 0;
+    for (k = 0; k < op->num_workers; ++k) {
+        const struct wl_thr_t * tp = thr_arr + k;
+
+        if (tp->res && (0 == ret))
+            ret = tp->res;
+        if (0 == tp->start_ns)
+            continue;   /* did not get as far as starting */
+        if ((0 == min_start) || (tp->start_ns < min_start))
+            min_start = tp->start_ns;
+        if (tp->end_ns > max_end)
+            max_end = tp->end_ns;
+        cmds += tp->cmds;
+        ranges += tp->ranges;
+        blks += tp->blks;
+        sg_par_lat_merge(&lat_all, &tp->lat);
+    }
+    secs = (max_end > min_start) ? (max_end - min_start) / 1000000000.0 : 0.0;
+    printf("%s workload on %s: %d worker%s, up to %u %s%s and %u blocks "
+           "per command\n", op->cdb_name, op->device_name, op->num_workers,
+           (op->num_workers > 1 ? "s" : ""), ctx.max_lbard, lbard_str,
+           (ctx.max_lbard > 1 ? "s" : ""), ctx.max_blks);
+    printf("  elapsed: %.3f secs, commands: %" PRIu64 ", LBA ranges: %"
+           PRIu64 ", blocks: %" PRIu64 "%s\n", secs, cmds, ranges, blks,
+           (wl_stop && (0 == ret) ? " [interrupted]" : ""));
+    printf("  IOPS: %.1f, LBA ranges/sec: %.1f, bandwidth: %.2f MB/sec\n",
+           (secs > 0.0) ? cmds / secs : 0.0,
+           (secs > 0.0) ? ranges / secs : 0.0,
+           (secs > 0.0) ? ((double)blks * op->bs) / (secs * 1000000.0) :
+                          0.0);
+    wl_prt_lat(&lat_all);
+    if (vb) {
+        for (k = 0; k < op->num_workers; ++k) {
+            const struct wl_thr_t * tp = thr_arr + k;
+
+            printf("  worker %d: commands=%" PRIu64 ", p99=%" PRIu64
+                   " usecs, result=%d\n", k, tp->cmds,
+                   sg_par_lat_percentile(&tp->lat, 99.0) / 1000, tp->res);
+        }
+    }
+    if (ret && (! op->do_quiet)) {
+        strcpy(b, "OS error");
+        if (ret > 0)
+            sg_get_category_sense_str(ret, sizeof(b), b, vb);
+        pr2serr("%s: %s\n", op->cdb_name, b);
+    }
+fini:
+    if (thr_arr)
+        free(thr_arr);
+    if (free_pat_up)
+        free(free_pat_up);
+    if (ctx.sf_fp && (! got_stdin))
+        fclose(ctx.sf_fp);
+    return ret;
+}
+
 
 int
 main(int argc, char * argv[])
@@ -2313,8 +3060,15 @@ main(int argc, char * argv[])
                 "--scat-file=SF, or --combined=DOF\n");
         return SG_LIB_CONTRADICT;
     }
+    if ((op->num_workers > 0) || op->wl_range) {
+        if (! op->do_workload) {
+            pr2serr("--parallel=P and --range=RNG only apply to "
+                    "--workload=\n");
+            return SG_LIB_CONTRADICT;
+        }
+    }
     if (op->scat_filename && (1 == strlen(op->scat_filename)) &&
-        ('-' == op->scat_filename[0])) {
+        ('-' == op->scat_filename[0]) && (! op->do_workload)) {
         pr2serr("don't accept '-' (implying stdin) as a filename in "
                 "--scat-file=SF\n");
         return SG_LIB_CONTRADICT;
@@ -2491,6 +3245,16 @@ main(int argc, char * argv[])
         }
         addr_arr_len = 1;  /* allow --num=0 without --lba= since it is safe */
     }
+    if (op->do_workload) {
+        if ((addr_arr_len > 1) || (num_arr_len > 1)) {
+            pr2serr("--workload= takes one LBA and one NUM, they are the "
+                    "start of\nthe region and the size of each range\n");
+            goto syntax_err_out;
+        }
+        op->numblocks = num_arr[0];
+        ret = process_workload(sg_fd, infd, if_len, addr_arr[0], op);
+        goto fini;
+    }
     /* Everything can use a SF, except --same=1 (when op->ndob==true) */
     if (op->scat_filename) {
         if (stat(op->scat_filename, &sf_stat) < 0) {
@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
@@ -29,6 +30,9 @@
 #include "sg_cmds_basic.h"
 #include "sg_unaligned.h"
 #include "sg_pr2serr.h"
+#include "sg_json_sg_lib.h"
+
+#include "sg_par_common.h"
 
 /* A utility program originally written for the Linux OS SCSI subsystem.
  *
@@ -37,21 +41,63 @@
  *   - FINISH ZONE
  *   - OPEN ZONE
  *   - REMOVE ELEMENT AND MODIFY ZONES
+ *   - RESET WRITE POINTER
  *   - SEQUENTIALIZE ZONE
+ *
+ * With the --list=ZLF option, the chosen zone out command is sent to each
+ * zone whose starting LBA is listed in ZLF. Those LBAs are first checked
+ * with REPORT ZONES, then the commands are issued by a pool of workers.
  */
 
-static const char * version_str = "1.21 20230623";
+static const char * version_str = "1.22 20231018";
+
+#define MY_NAME "sg_zone"
 
 #define SG_ZONING_OUT_CMDLEN 16
+#define SG_ZONING_IN_CMDLEN 16
 #define CLOSE_ZONE_SA 0x1
 #define FINISH_ZONE_SA 0x2
 #define OPEN_ZONE_SA 0x3
+#define RESET_WRITE_POINTER_SA 0x4
 #define SEQUENTIALIZE_ZONE_SA 0x10
 #define REM_ELEM_MOD_ZONES_SA 0x1a      /* uses SERVICE ACTION IN(16) */
 
+#define REPORT_ZONES_SA 0x0
+#define REPORT_ZONES_DESC_LEN 64
+#define ZLIST_RZONES_BUFF_LEN (1024 * 1024)
+
 #define SENSE_BUFF_LEN 64       /* Arbitrary, could be larger */
 #define DEF_PT_TIMEOUT  60      /* 60 seconds */
 
+/* Per zone state when the --list=ZLF option is given */
+enum zl_result_e {
+    ZL_PENDING = 0,
+    ZL_GOOD,
+    ZL_FAILED,
+    ZL_NOT_ZONE_START,  /* LBA is not the start of a zone */
+    ZL_NO_WP,           /* conventional or gap zone: has no write pointer */
+    ZL_DUPLICATE,       /* same LBA appears earlier in ZLF */
+};
+
+struct zl_elem_t {
+    uint64_t zs_lba;
+    uint8_t zt;         /* zone type, from REPORT ZONES */
+    uint8_t zcond;      /* zone condition, from REPORT ZONES */
+    enum zl_result_e result;
+    int res;            /* 0 or SG_LIB_CAT_* value from zone out command */
+};
+
+struct zl_ctx_t {
+    bool all;
+    int sg_fd;
+    int sa;
+    int tmo;
+    int vb;
+    uint16_t zc;
+    int num_failed;
+    struct zl_elem_t * zlp;
+};
+
 
 static const struct option long_options[] = {
     {"all", no_argument, 0, 'a'},
@@ -60,11 +106,18 @@ static const struct option long_options[] = {
     {"element", required_argument, 0, 'e'},
     {"finish", no_argument, 0, 'f'},
     {"help", no_argument, 0, 'h'},
+    {"json", optional_argument, 0, '^'},    /* short option is '-j' */
+    {"js-file", required_argument, 0, 'J'},
+    {"js_file", required_argument, 0, 'J'},
+    {"list", required_argument, 0, 'l'},
     {"open", no_argument, 0, 'o'},
+    {"parallel", required_argument, 0, 'p'},
     {"quick", no_argument, 0, 'q'},
     {"remove", no_argument, 0, 'r'},
     {"reset-all", no_argument, 0, 'R'},     /* same as --all */
     {"reset_all", no_argument, 0, 'R'},
+    {"reset-wp", no_argument, 0, 'w'},
+    {"reset_wp", no_argument, 0, 'w'},
     {"sequentialize", no_argument, 0, 'S'},
     {"timeout", required_argument, 0, 't'},
     {"tmo", required_argument, 0, 't'},
@@ -80,7 +133,8 @@ static const char * sa_name_arr[] = {
     "Close zone",
     "Finish zone",
     "Open zone",
-    "-", "-", "-", "-",
+    "Reset write pointer",
+    "-", "-", "-",
     "-",
     "-", "-", "-", "-",
     "-",
@@ -100,11 +154,13 @@ usage()
     pr2serr("Usage: "
             "sg_zone  [--all] [--close] [--count=ZC] [--element=EID] "
             "[--finish]\n"
-            "                [--help] [--open] [--quick] [--remove] "
-            "[--sequentialize]\n"
-            "                [--timeout=SE] [--verbose] [--version] "
-            "[--zone=ID]\n"
-            "                DEVICE\n");
+            "                [--help] [--json[=JO]] [--js-file=JFN] "
+            "[--list=ZLF]\n"
+            "                [--open] [--parallel=PN] [--quick] "
+            "[--remove]\n"
+            "                [--reset-wp] [--sequentialize] [--timeout=SE] "
+            "[--verbose]\n"
+            "                [--version] [--zone=ID] DEVICE\n");
     pr2serr("  where:\n"
             "    --all|-a           sets the ALL flag in the cdb\n"
             "    --close|-c         issue CLOSE ZONE command\n"
@@ -115,11 +171,27 @@ usage()
             "EID\n"
             "    --finish|-f        issue FINISH ZONE command\n"
             "    --help|-h          print out usage message\n"
+            "    --json[=JO]|-j[=JO]    output in JSON instead of plain "
+            "text\n"
+            "                           Use --json=? for JSON help\n"
+            "    --js-file=JFN|-J JFN    JFN is a filename to which JSON "
+            "output is\n"
+            "                            written (def: stdout); truncates "
+            "then writes\n"
+            "    --list=ZLF|-l ZLF    ZLF is a file of zone starting LBAs, "
+            "one command\n"
+            "                         is sent to each listed zone. If ZLF "
+            "is '-' then\n"
+            "                         read stdin\n"
             "    --open|-o          issue OPEN ZONE command\n"
+            "    --parallel=PN|-p PN    with --list=ZLF, have up to PN "
+            "commands\n"
+            "                           outstanding (def: %d)\n"
             "    --quick|-q         bypass 15 second warn and wait "
             "(for --remove)\n"
             "    --remove|-r        issue REMOVE ELEMENT AND MODIFY ZONES "
             "command\n"
+            "    --reset-wp|-w      issue RESET WRITE POINTER command\n"
             "    --sequentialize|-S    issue SEQUENTIALIZE ZONE command\n"
             "    --timeout=SE|-t SE    command timeout in seconds (def: "
             "60 secs)\n"
@@ -128,9 +200,10 @@ usage()
             "    --zone=ID|-z ID    ID is the starting LBA of the zone "
             "(def: 0)\n\n"
             "Performs a SCSI OPEN ZONE, CLOSE ZONE, FINISH ZONE, "
-            "REMOVE ELEMENT AND\nMODIFY ZONES or SEQUENTIALIZE ZONE "
-            "command. Either --close, --finish,\n--open, --remove or "
-            "--sequentialize option needs to be given.\n");
+            "REMOVE ELEMENT AND\nMODIFY ZONES, RESET WRITE POINTER or "
+            "SEQUENTIALIZE ZONE command. Either\n--close, --finish, --open, "
+            "--remove, --reset-wp or --sequentialize\noption needs to be "
+            "given.\n", SG_PAR_DEF_WORKERS);
 }
 
 /* Invokes the zone out command indicated by 'sa' (ZBC).  Return of 0
@@ -196,16 +269,453 @@ sg_ll_zone_out(int sg_fd, int sa, uint64_t zid, uint16_t zc, bool all,
     return ret;
 }
 
+/* Invokes a SCSI REPORT ZONES command (ZBC) with the PARTIAL bit set.
+ * Return of 0 -> success, various SG_LIB_CAT_* positive values or -1 ->
+ * other errors */
+static int
+sg_ll_report_zones(int sg_fd, uint64_t zs_lba, void * resp, int mx_resp_len,
+                   int * residp, bool noisy, int verbose)
+{
+    int ret, res, sense_cat;
+    uint8_t rz_cdb[SG_ZONING_IN_CMDLEN] =
+          {SG_ZONING_IN, REPORT_ZONES_SA, 0, 0,  0, 0, 0, 0, 0, 0, 0, 0,
+           0, 0, 0x80 /* PARTIAL */, 0};
+    uint8_t sense_b[SENSE_BUFF_LEN] SG_C_CPP_ZERO_INIT;
+    struct sg_pt_base * ptvp;
+
+    sg_put_unaligned_be64(zs_lba, rz_cdb + 2);
+    sg_put_unaligned_be32((uint32_t)mx_resp_len, rz_cdb + 10);
+    if (verbose) {
+        char b[128];
+
+        pr2serr("    Report zones cdb: %s\n",
+                sg_get_command_str(rz_cdb, SG_ZONING_IN_CMDLEN, false,
+                                   sizeof(b), b));
+    }
+    ptvp = construct_scsi_pt_obj();
+    if (NULL == ptvp) {
+        pr2serr("%s: out of memory\n", __func__);
+        return -1;
+    }
+    set_scsi_pt_cdb(ptvp, rz_cdb, sizeof(rz_cdb));
+    set_scsi_pt_sense(ptvp, sense_b, sizeof(sense_b));
+    set_scsi_pt_data_in(ptvp, (uint8_t *)resp, mx_resp_len);
+    res = do_scsi_pt(ptvp, sg_fd, DEF_PT_TIMEOUT, verbose);
+    ret = sg_cmds_process_resp(ptvp, "report zones", res, noisy, verbose,
+                               &sense_cat);
+    if (-1 == ret) {
+        if (get_scsi_pt_transport_err(ptvp))
+            ret = SG_LIB_TRANSPORT_ERROR;
+        else
+            ret = sg_convert_errno(get_scsi_pt_os_err(ptvp));
+    } else if (-2 == ret) {
+        switch (sense_cat) {
+        case SG_LIB_CAT_RECOVERED:
+        case SG_LIB_CAT_NO_SENSE:
+            ret = 0;
+            break;
+        default:
+            ret = sense_cat;
+            break;
+        }
+    } else
+        ret = 0;
+    if (residp)
+        *residp = get_scsi_pt_resid(ptvp);
+    destruct_scsi_pt_obj(ptvp);
+    return ret;
+}
+
+static const char *
+zone_condition_str(int zc, char * b, int blen, int vb)
+{
+    const char * cp;
+
+    if (NULL == b)
+        return "zone_condition_str: NULL ptr)";
+    switch (zc) {
+    case 0:
+        cp = "Not write pointer";
+        break;
+    case 1:
+        cp = "Empty";
+        break;
+    case 2:
+        cp = "Implicitly opened";
+        break;
+    case 3:
+        cp = "Explicitly opened";
+        break;
+    case 4:
+        cp = "Closed";
+        break;
+    case 5:
+        cp = "Inactive";
+        break;
+    case 0xd:
+        cp = "Read only";
+        break;
+    case 0xe:
+        cp = "Full";
+        break;
+    case 0xf:
+        cp = "Offline";
+        break;
+    default:
+        cp = NULL;
+        break;
+    }
+    if (cp) {
+        if (vb)
+            snprintf(b, blen, "%s [0x%x]", cp, zc);
+        else
+            snprintf(b, blen, "%s", cp);
+    } else
+        snprintf(b, blen, "Reserved [0x%x]", zc);
+    return b;
+}
+
+static const char *
+zl_result_str(const struct zl_elem_t * zep, char * b, int blen, int vb)
+{
+    switch (zep->result) {
+    case ZL_PENDING:
+        snprintf(b, blen, "not sent");
+        break;
+    case ZL_GOOD:
+        snprintf(b, blen, "good");
+        break;
+    case ZL_FAILED:
+        sg_get_category_sense_str(zep->res, blen, b, vb);
+        break;
+    case ZL_NOT_ZONE_START:
+        snprintf(b, blen, "skipped: not a zone starting LBA");
+        break;
+    case ZL_NO_WP:
+        snprintf(b, blen, "skipped: zone has no write pointer");
+        break;
+    case ZL_DUPLICATE:
+        snprintf(b, blen, "skipped: duplicate");
+        break;
+    }
+    return b;
+}
+
+/* Reads zone starting LBAs from file 'fn' (or stdin if 'fn' is "-") into
+ * a newly allocated array placed in *zlpp with the count in *nump. LBAs
+ * are separated by whitespace or commas and are decimal unless prefixed
+ * by '0x' or suffixed by 'h'. Text after a '#' is ignored. */
+static int
+read_zone_list(const char * fn, struct zl_elem_t ** zlpp, int * nump)
+{
+    bool from_stdin = ((1 == strlen(fn)) && ('-' == fn[0]));
+    int n = 0;
+    int max_n = 0;
+    int ret = 0;
+    int line_num = 0;
+    int64_t ll;
+    char * cp;
+    struct zl_elem_t * zlp = NULL;
+    FILE * fp;
+    char line[1024];
+
+    if (from_stdin)
+        fp = stdin;
+    else {
+        fp = fopen(fn, "r");
+        if (NULL == fp) {
+            int err = errno;
+
+            pr2serr("unable to open %s: %s\n", fn, safe_strerror(err));
+            return sg_convert_errno(err);
+        }
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        ++line_num;
+        cp = strchr(line, '#');
+        if (cp)
+            *cp = '\0';
+        for (cp = strtok(line, " ,\t\r\n"); cp;
+             cp = strtok(NULL, " ,\t\r\n")) {
+            ll = sg_get_llnum(cp);
+            if (-1 == ll) {
+                pr2serr("%s: bad LBA '%s' at line %d\n", fn, cp, line_num);
+                ret = SG_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            if (n >= max_n) {
+                struct zl_elem_t * nzlp;
+
+                max_n = max_n ? (2 * max_n) : 1024;
+                nzlp = (struct zl_elem_t *)realloc(zlp, max_n *
+                                                   sizeof(*zlp));
+                if (NULL == nzlp) {
+                    ret = sg_convert_errno(ENOMEM);
+                    goto fini;
+                }
+                zlp = nzlp;
+            }
+            memset(zlp + n, 0, sizeof(*zlp));
+            zlp[n++].zs_lba = (uint64_t)ll;
+        }
+    }
+fini:
+    if (! from_stdin)
+        fclose(fp);
+    if (ret) {
+        free(zlp);
+        zlp = NULL;
+        n = 0;
+    }
+    *zlpp = zlp;
+    *nump = n;
+    return ret;
+}
+
+static int
+zl_lba_cmp(const void * a, const void * b)
+{
+    const struct zl_elem_t * zap = *(const struct zl_elem_t * const *)a;
+    const struct zl_elem_t * zbp = *(const struct zl_elem_t * const *)b;
+
+    if (zap->zs_lba != zbp->zs_lba)
+        return (zap->zs_lba < zbp->zs_lba) ? -1 : 1;
+    return (zap < zbp) ? -1 : ((zap > zbp) ? 1 : 0);
+}
+
+/* Checks each element of zlp against REPORT ZONES responses. The listed
+ * LBAs are visited in ascending order and each REPORT ZONES command starts
+ * at the lowest LBA not yet checked, so regions of the medium between
+ * listed zones are skipped. Returns 0 or an SG_LIB_CAT_* value. */
+static int
+validate_zone_list(int sg_fd, struct zl_elem_t * zlp, int num, int vb)
+{
+    int k, j, res, resid, rlen, num_zd;
+    int ret = 0;
+    uint64_t zs, zlen;
+    const uint8_t * bp;
+    uint8_t * rzBuff = NULL;
+    uint8_t * free_rzbp = NULL;
+    struct zl_elem_t ** sarr;
+
+    sarr = (struct zl_elem_t **)calloc(num, sizeof(*sarr));
+    if (NULL == sarr)
+        return sg_convert_errno(ENOMEM);
+    for (k = 0; k < num; ++k)
+        sarr[k] = zlp + k;
+    qsort(sarr, num, sizeof(*sarr), zl_lba_cmp);
+    for (k = 1; k < num; ++k) {
+        if (sarr[k]->zs_lba == sarr[k - 1]->zs_lba)
+            sarr[k]->result = ZL_DUPLICATE;
+    }
+    rzBuff = (uint8_t *)sg_memalign(ZLIST_RZONES_BUFF_LEN, 0, &free_rzbp,
+                                    vb > 3);
+    if (NULL == rzBuff) {
+        ret = sg_convert_errno(ENOMEM);
+        goto fini;
+    }
+    k = 0;
+    while (k < num) {
+        int k0 = k;
+
+        if (ZL_DUPLICATE == sarr[k]->result) {
+            ++k;
+            continue;
+        }
+        res = sg_ll_report_zones(sg_fd, sarr[k]->zs_lba, rzBuff,
+                                 ZLIST_RZONES_BUFF_LEN, &resid, vb > 0, vb);
+        if (res) {
+            if (SG_LIB_CAT_ILLEGAL_REQ == res) {
+                /* most likely this LBA is beyond the last zone */
+                sarr[k++]->result = ZL_NOT_ZONE_START;
+                continue;
+            }
+            ret = res;
+            goto fini;
+        }
+        rlen = ZLIST_RZONES_BUFF_LEN - resid;
+        num_zd = (rlen < 64) ? 0 : ((rlen - 64) / REPORT_ZONES_DESC_LEN);
+        if (vb > 1)
+            pr2serr("%s: Report zones from 0x%" PRIx64 " returned %d "
+                    "descriptors\n", __func__, sarr[k]->zs_lba, num_zd);
+        if (0 == num_zd) {
+            sarr[k++]->result = ZL_NOT_ZONE_START;
+            continue;
+        }
+        for (j = 0, bp = rzBuff + 64; (j < num_zd) && (k < num);
+             ++j, bp += REPORT_ZONES_DESC_LEN) {
+            zlen = sg_get_unaligned_be64(bp + 8);
+            zs = sg_get_unaligned_be64(bp + 16);
+            for ( ; k < num; ++k) {
+                struct zl_elem_t * zep = sarr[k];
+
+                if (ZL_DUPLICATE == zep->result)
+                    continue;
+                if (zep->zs_lba > zs) {
+                    if ((zlen > 0) && (zep->zs_lba < (zs + zlen))) {
+                        zep->result = ZL_NOT_ZONE_START;
+                        continue;
+                    }
+                    break;      /* belongs to a later zone */
+                } else if (zep->zs_lba < zs) {
+                    zep->result = ZL_NOT_ZONE_START;
+                    continue;
+                }
+                zep->zt = bp[0] & 0xf;
+                zep->zcond = (bp[1] >> 4) & 0xf;
+                /* conventional and gap zones have no write pointer */
+                if ((1 == zep->zt) || (5 == zep->zt))
+                    zep->result = ZL_NO_WP;
+            }
+        }
+        if (k == k0)    /* guard against a malformed response */
+            sarr[k++]->result = ZL_NOT_ZONE_START;
+    }
+fini:
+    if (free_rzbp)
+        free(free_rzbp);
+    free(sarr);
+    return ret;
+}
+
+static int
+zl_work(void * ctxp, int idx)
+{
+    struct zl_ctx_t * zcp = (struct zl_ctx_t *)ctxp;
+    struct zl_elem_t * zep = zcp->zlp + idx;
+
+    if (ZL_PENDING != zep->result)
+        return 0;
+    return sg_ll_zone_out(zcp->sg_fd, zcp->sa, zep->zs_lba, zcp->zc,
+                          zcp->all, zcp->tmo, zcp->vb > 0, zcp->vb);
+}
+
+static void
+zl_done(void * ctxp, int idx, int res)
+{
+    struct zl_ctx_t * zcp = (struct zl_ctx_t *)ctxp;
+    struct zl_elem_t * zep = zcp->zlp + idx;
+
+    if (ZL_PENDING != zep->result)
+        return;
+    zep->res = res;
+    if (res) {
+        zep->result = ZL_FAILED;
+        ++zcp->num_failed;
+    } else
+        zep->result = ZL_GOOD;
+}
+
+/* Outputs the per zone result table, as plain text or JSON. */
+static void
+prt_zone_list(sgj_state * jsp, const struct zl_elem_t * zlp, int num,
+              const char * sa_name, int vb)
+{
+    int k;
+    int num_good = 0;
+    int num_failed = 0;
+    int num_skipped = 0;
+    const struct zl_elem_t * zep;
+    sgj_opaque_p jop = NULL;
+    sgj_opaque_p jap = NULL;
+    char ztb[32];
+    char zcb[32];
+    char rb[80];
+
+    if (jsp->pr_as_json) {
+        jop = sgj_named_subobject_r(jsp, NULL, "zone_list_results");
+        sgj_js_nv_s(jsp, jop, "scsi_command_name", sa_name);
+        jap = sgj_named_subarray_r(jsp, jop, "zone_list");
+    }
+    sgj_pr_hr(jsp, "%s results:\n", sa_name);
+    sgj_pr_hr(jsp, "  Zone start LBA      Zone type  Condition          "
+              "Result\n");
+    for (k = 0, zep = zlp; k < num; ++k, ++zep) {
+        bool have_desc = ((ZL_NOT_ZONE_START != zep->result) &&
+                          (ZL_DUPLICATE != zep->result));
+        sgj_opaque_p jo2p;
+
+        switch (zep->result) {
+        case ZL_GOOD:
+            ++num_good;
+            break;
+        case ZL_FAILED:
+            ++num_failed;
+            break;
+        default:
+            ++num_skipped;
+            break;
+        }
+        zl_result_str(zep, rb, sizeof(rb), vb);
+        if (have_desc) {
+            sg_get_zone_type_str(zep->zt, sizeof(ztb), ztb);
+            zone_condition_str(zep->zcond, zcb, sizeof(zcb), 0);
+        } else {
+            snprintf(ztb, sizeof(ztb), "-");
+            snprintf(zcb, sizeof(zcb), "-");
+        }
+        sgj_pr_hr(jsp, "  0x%-16" PRIx64 "  %-9.9s  %-17.17s  %s\n",
+                  zep->zs_lba, have_desc ? ztb : "-", zcb, rb);
+        if (NULL == jap)
+            continue;
+        jo2p = sgj_new_unattached_object_r(jsp);
+        sgj_js_nv_ihex(jsp, jo2p, "zone_start_lba", (int64_t)zep->zs_lba);
+        if (have_desc) {
+            sgj_js_nv_istr(jsp, jo2p, "zone_type", zep->zt, NULL, ztb);
+            sgj_js_nv_istr(jsp, jo2p, "zone_condition", zep->zcond, NULL,
+                           zcb);
+        }
+        sgj_js_nv_s(jsp, jo2p, "result", rb);
+        if (ZL_FAILED == zep->result)
+            sgj_js_nv_i(jsp, jo2p, "sense_category", zep->res);
+        sgj_js_nv_o(jsp, jap, NULL /* name */, jo2p);
+    }
+    sgj_pr_hr(jsp, "Zones listed: %d, good: %d, failed: %d, skipped: %d\n",
+              num, num_good, num_failed, num_skipped);
+    sgj_js_nv_i(jsp, jop, "zones_listed", num);
+    sgj_js_nv_i(jsp, jop, "zones_good", num_good);
+    sgj_js_nv_i(jsp, jop, "zones_failed", num_failed);
+    sgj_js_nv_i(jsp, jop, "zones_skipped", num_skipped);
+}
+
+/* Processes the options that can be in the same argument as '-j' such
+ * as '-jv'. Returns 0 if okay, else SG_LIB_SYNTAX_ERROR. */
+static int
+chk_short_opts(const char sopt_ch, bool * verbose_givenp, int * verbosep,
+               bool * version_givenp)
+{
+    /* only need to process short, non-argument options used with -j */
+    switch (sopt_ch) {
+    case 'j':
+        break;  /* simply ignore second 'j' (e.g. '-jxj') */
+    case 'v':
+        *verbose_givenp = true;
+        ++*verbosep;
+        break;
+    case 'V':
+        *version_givenp = true;
+        break;
+    default:
+        pr2serr("unrecognised option code %c [0x%x] ??\n", sopt_ch,
+                sopt_ch);
+        return SG_LIB_SYNTAX_ERROR;
+    }
+    return 0;
+}
+
 
 int
 main(int argc, char * argv[])
 {
     bool all = false;
+    bool as_json = false;
     bool close = false;
+    bool do_json = false;
     bool finish = false;
     bool open = false;
     bool quick = false;
     bool reamz = false;
+    bool reset_wp = false;
     bool element_id_given = false;
     bool sequentialize = false;
     bool verbose_given = false;
@@ -216,17 +726,27 @@ main(int argc, char * argv[])
     int verbose = 0;
     int ret = 0;
     int sa = 0;
+    int num_workers = SG_PAR_DEF_WORKERS;
+    int num_zl = 0;
     uint16_t zc = 0;
     uint64_t zid = 0;
     int64_t ll;
     const char * device_name = NULL;
+    const char * json_arg = NULL;
+    const char * js_file = NULL;
+    const char * zl_fn = NULL;
     const char * sa_name;
+    struct zl_elem_t * zlp = NULL;
+    sgj_state json_st SG_C_CPP_ZERO_INIT;
+    sgj_state * jsp = &json_st;
 
+    if (getenv("SG3_UTILS_INVOCATION"))
+        sg_rep_invocation(MY_NAME, version_str, argc, argv, stderr);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "acC:e:fhoqrRSt:vVz:", long_options,
-                        &option_index);
+        c = getopt_long(argc, argv, "^acC:e:fhj::J:l:op:qrRSt:vVwz:",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
@@ -267,10 +787,48 @@ main(int argc, char * argv[])
         case '?':
             usage();
             return 0;
+        case 'j':       /* for: -j[=JO] */
+        case '^':       /* for: --json[=JO] */
+            do_json = true;
+            /* Now want '=' to precede all JSON optional arguments */
+            if (optarg) {
+                int k;
+
+                if ('^' == c) {
+                    json_arg = optarg;
+                    break;
+                } else if ('=' == *optarg) {
+                    json_arg = optarg + 1;
+                    break;
+                }
+                n = strlen(optarg);
+                for (k = 0; k < n; ++k) {
+                    if (chk_short_opts(*(optarg + k), &verbose_given,
+                                       &verbose, &version_given))
+                        return SG_LIB_SYNTAX_ERROR;
+                }
+            } else
+                json_arg = NULL;
+            break;
+        case 'J':
+            do_json = true;
+            js_file = optarg;
+            break;
+        case 'l':
+            zl_fn = optarg;
+            break;
         case 'o':
             open = true;
             sa = OPEN_ZONE_SA;
             break;
+        case 'p':
+            num_workers = sg_get_num(optarg);
+            if ((num_workers < 1) || (num_workers > SG_PAR_MAX_WORKERS)) {
+                pr2serr("--parallel= expects an argument between 1 and %d "
+                        "inclusive\n", SG_PAR_MAX_WORKERS);
+                return SG_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'q':
             quick = true;
             break;
@@ -296,6 +854,10 @@ main(int argc, char * argv[])
         case 'V':
             version_given = true;
             break;
+        case 'w':
+            reset_wp = true;
+            sa = RESET_WRITE_POINTER_SA;
+            break;
         case 'z':
             ll = sg_get_llnum(optarg);
             if (-1 == ll) {
@@ -346,10 +908,10 @@ main(int argc, char * argv[])
     }
 
     if (1 != ((int)close + (int)finish + (int)open + (int)sequentialize +
-              (int)reamz)) {
+              (int)reamz + (int)reset_wp)) {
         pr2serr("One, and only one, of these options needs to be given:\n"
-                "   --close, --finish, --open, --remove or --sequentialize "
-                "\n\n");
+                "   --close, --finish, --open, --remove, --reset-wp or "
+                "--sequentialize\n\n");
         usage();
         return SG_LIB_CONTRADICT;
     }
@@ -359,6 +921,12 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_CONTRADICT;
     }
+    if (zl_fn && (reamz || all)) {
+        pr2serr("The --list=ZLF option cannot be used with --all or "
+                "--remove\n\n");
+        usage();
+        return SG_LIB_CONTRADICT;
+    }
     sa_name = sa_name_arr[sa];
 
     if (0 == tmo)
@@ -368,6 +936,34 @@ main(int argc, char * argv[])
         usage();
         return SG_LIB_SYNTAX_ERROR;
     }
+    if (do_json) {
+        if (! sgj_init_state(jsp, json_arg)) {
+            int bad_char = jsp->first_bad_char;
+            char e[1500];
+
+            if (bad_char) {
+                pr2serr("bad argument to --json= option, unrecognized "
+                        "character '%c'\n\n", bad_char);
+            }
+            sg_json_usage(0, e, sizeof(e));
+            pr2serr("%s", e);
+            return SG_LIB_SYNTAX_ERROR;
+        }
+        sgj_start_r(MY_NAME, version_str, argc, argv, jsp);
+        as_json = jsp->pr_as_json;
+    }
+    if (zl_fn) {
+        ret = read_zone_list(zl_fn, &zlp, &num_zl);
+        if (ret)
+            goto fini;
+        if (0 == num_zl) {
+            pr2serr("no zone starting LBAs found in %s\n", zl_fn);
+            ret = SG_LIB_SYNTAX_ERROR;
+            goto fini;
+        }
+        if (verbose)
+            pr2serr("read %d zone starting LBAs from %s\n", num_zl, zl_fn);
+    }
 
     sg_fd = sg_cmds_open_device(device_name, false /* rw */, verbose);
     if (sg_fd < 0) {
@@ -382,6 +978,44 @@ main(int argc, char * argv[])
         sg_warn_and_wait(sa_name_arr[REM_ELEM_MOD_ZONES_SA], device_name,
                          false);
 
+    if (zlp) {
+        struct zl_ctx_t zl_ctx;
+
+        ret = validate_zone_list(sg_fd, zlp, num_zl, verbose);
+        if (ret) {
+            char b[80];
+
+            sg_get_category_sense_str(ret, sizeof(b), b, verbose);
+            pr2serr("Report zones command: %s\n", b);
+            goto fini;
+        }
+        memset(&zl_ctx, 0, sizeof(zl_ctx));
+        zl_ctx.all = all;
+        zl_ctx.sg_fd = sg_fd;
+        zl_ctx.sa = sa;
+        zl_ctx.tmo = tmo;
+        zl_ctx.vb = verbose;
+        zl_ctx.zc = zc;
+        zl_ctx.zlp = zlp;
+        res = sg_par_run(num_zl, num_workers, zl_work, zl_done, &zl_ctx);
+        if (res) {
+            pr2serr("unable to start workers: %s\n", safe_strerror(res));
+            ret = sg_convert_errno(res);
+            goto fini;
+        }
+        prt_zone_list(jsp, zlp, num_zl, sa_name, verbose);
+        if (zl_ctx.num_failed > 0) {
+            int k;
+
+            for (k = 0; k < num_zl; ++k) {
+                if (ZL_FAILED == zlp[k].result) {
+                    ret = zlp[k].res;   /* first failure in list order */
+                    break;
+                }
+            }
+        }
+        goto fini;
+    }
     res = sg_ll_zone_out(sg_fd, sa, zid, zc, all, tmo, true, verbose);
     ret = res;
     if (res) {
@@ -404,10 +1038,35 @@ fini:
                 ret = sg_convert_errno(-res);
         }
     }
+    if (zlp)
+        free(zlp);
     if (0 == verbose) {
         if (! sg_if_can2stderr("sg_zone failed: ", ret))
             pr2serr("Some error occurred, try again with '-v' or '-vv' for "
                     "more information\n");
     }
-    return (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    ret = (ret >= 0) ? ret : SG_LIB_CAT_OTHER;
+    if (as_json) {
+        FILE * fp = stdout;
+
+        if (js_file) {
+            if ((1 != strlen(js_file)) || ('-' != js_file[0])) {
+                fp = fopen(js_file, "w");   /* truncate if exists */
+                if (NULL == fp) {
+                    int e = errno;
+
+                    pr2serr("unable to open file: %s [%s]\n", js_file,
+                            safe_strerror(e));
+                    ret = sg_convert_errno(e);
+                }
+            }
+            /* '--js-file=-' will send JSON output to stdout */
+        }
+        if (fp)
+            sgj_js2file(jsp, NULL, ret, fp);
+        if (js_file && fp && (stdout != fp))
+            fclose(fp);
+        sgj_finish(jsp);
+    }
+    return ret;
 }
@@ -26,7 +26,7 @@
 
 #define ME "sg_sense_test: "
 
-static const char * version_str = "2.04 20181207";
+static const char * version_str = "2.05 20231031";
 
 static struct option long_options[] = {
         {"help", no_argument, 0, 'h'},
@@ -58,6 +58,57 @@ usage()
 
 }
 
+/* Checks sg_get_sense_fields() against the sg_get_sense_*() functions for
+ * each length from 1 to sb_len of the sense buffer at sbp. The buffer is
+ * copied into a zeroed array first since those functions may read beyond
+ * the given length. Returns the number of mismatches. */
+static int
+chk_sense_fields(FILE * outfp, const char * name, const uint8_t * sbp,
+                 int sb_len, int verbose)
+{
+    bool ok, fm, eom, ili;
+    int k, n, progress;
+    int bad = 0;
+    uint64_t info, cmd_spec;
+    struct sg_sense_fields sf;
+    uint8_t b[256];
+
+    for (n = 1; n <= sb_len; ++n) {
+        memset(b, 0, sizeof(b));
+        memcpy(b, sbp, n);
+        sg_get_sense_fields(b, n, &sf);
+        fm = false;
+        eom = false;
+        ili = false;
+        progress = 0;
+        k = 0;
+        ok = sg_get_sense_info_fld(b, n, &info);
+        if ((ok != sf.info_valid) || (ok && (info != sf.info)))
+            k |= 1;
+        ok = sg_get_sense_cmd_spec_fld(b, n, &cmd_spec);
+        if ((ok != sf.cmd_spec_present) || (ok && (cmd_spec != sf.cmd_spec)))
+            k |= 2;
+        ok = sg_get_sense_filemark_eom_ili(b, n, &fm, &eom, &ili);
+        if ((ok != sf.fm_eom_ili_present) ||
+            (ok && ((fm != sf.filemark) || (eom != sf.eom) ||
+                    (ili != sf.ili))))
+            k |= 4;
+        ok = sg_get_sense_progress_fld(b, n, &progress);
+        if ((ok != sf.progress_present) ||
+            (ok && (progress != sf.progress)))
+            k |= 8;
+        if (k) {
+            fprintf(outfp, "  %s, sb_len=%d: mismatch in%s%s%s%s\n", name, n,
+                    (k & 1) ? " info" : "", (k & 2) ? " cmd_spec" : "",
+                    (k & 4) ? " fm_eom_ili" : "",
+                    (k & 8) ? " progress" : "");
+            ++bad;
+        } else if (verbose > 1)
+            fprintf(outfp, "  %s, sb_len=%d: ok\n", name, n);
+    }
+    return bad;
+}
+
 int
 main(int argc, char * argv[])
 {
@@ -101,6 +152,34 @@ main(int argc, char * argv[])
     uint8_t err8[] = {0xff, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xa, 0xb, 0xc,
                       0xd, 0xe, 0xf, 0xee, 0xdd, 0xcc, 0xbb, 0xaa, 0x99,
                       0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0};
+                     /* Fixed, Not ready with progress indication and
+                      * command specific information */
+    uint8_t err9[] = {0x70, 0, SPC_SK_NOT_READY, 0, 0, 0, 0, 0xa,
+                      0xde, 0xad, 0xbe, 0xef, 0x4, 0x4, 0, 0x80, 0x40, 0};
+                     /* Descriptor, progress indication then stream
+                      * commands descriptor (ILI) which is cut short after
+                      * its flags byte */
+    uint8_t err10[] = {0x72, SPC_SK_NO_SENSE, 0, 0x16, 0, 0, 0, 14,
+                       0xa, 0x6, 0x2, 0x4, 0x0, 0x0, 0x80, 0x0,
+                       0x4, 0x4, 0, 0x20};
+                     /* Fixed, SAT ATA PASS THROUGH INFORMATION AVAILABLE
+                      * with the registers after SMART RETURN STATUS */
+    uint8_t err11[] = {0x70, 0, SPC_SK_RECOVERED_ERROR, 0, 0x50, 0x40, 0x1,
+                       0xa, 0, 0x12, 0x4f, 0xc2, 0, 0x1d, 0, 0, 0, 0};
+    struct sense_chk_t {
+        const char * name;
+        const uint8_t * sbp;
+        int sb_len;
+    } chk_arr[] = {
+        {"err1", err1, sizeof(err1)}, {"err2", err2, sizeof(err2)},
+        {"err3", err3, sizeof(err3)}, {"err4", err4, sizeof(err4)},
+        {"err5", err5, sizeof(err5)}, {"err6", err6, sizeof(err6)},
+        {"err7", err7, sizeof(err7)}, {"err9", err9, sizeof(err9)},
+        {"err10", err10, sizeof(err10)},
+    };
+    int bad = 0;
+    struct sg_sense_fields sf;
+    uint8_t ard[SG_ATA_RETURN_DESC_LEN];
     char b[2048];
 
     while (1) {
@@ -173,6 +252,52 @@ main(int argc, char * argv[])
     sg_print_sense(leadin, err8, sizeof(err8), verbose);
     fprintf(outfp, "\n");
 
+    fprintf(outfp, "sg_get_sense_fields() versus sg_get_sense_*() on short "
+            "and truncated\nsense buffers, then SAT ATA registers:\n");
+    for (k = 0; k < (int)(sizeof(chk_arr) / sizeof(chk_arr[0])); ++k)
+        bad += chk_sense_fields(outfp, chk_arr[k].name, chk_arr[k].sbp,
+                                chk_arr[k].sb_len, verbose);
+    /* short fixed format still yields command specific information */
+    sg_get_sense_fields(err9, 12, &sf);
+    if ((! sf.cmd_spec_present) || (0xdeadbeef != sf.cmd_spec)) {
+        fprintf(outfp, "  err9, sb_len=12: bad cmd_spec\n");
+        ++bad;
+    }
+    /* truncated stream commands descriptor still yields ILI */
+    sg_get_sense_fields(err10, sizeof(err10), &sf);
+    if ((! sf.fm_eom_ili_present) || (! sf.ili) ||
+        (! sf.progress_present) || (0x8000 != sf.progress)) {
+        fprintf(outfp, "  err10: bad stream or progress fields\n");
+        ++bad;
+    }
+    /* truncated progress indication descriptor (last byte missing) */
+    sg_get_sense_fields(err10, 15, &sf);
+    if ((! sf.progress_present) || (0x8000 != sf.progress)) {
+        fprintf(outfp, "  err10, sb_len=15: bad progress field\n");
+        ++bad;
+    }
+    /* SAT fixed format (current then deferred): LBA (7:0), (15:8) and
+     * (23:16) are in bytes 9, 10 and 11 */
+    for (k = 0; k < 2; ++k) {
+        err11[0] = k ? 0x71 : 0x70;
+        if ((! sg_get_sense_ata_return_desc(err11, sizeof(err11), ard)) ||
+            (0x12 != ard[7]) || (0x4f != ard[9]) || (0xc2 != ard[11]) ||
+            (0x1 != ard[5]) || (0x40 != ard[12]) || (0x50 != ard[13])) {
+            fprintf(outfp, "  err11 (0x%x): bad ATA registers\n", err11[0]);
+            ++bad;
+        }
+    }
+    if ((! sg_get_sense_ata_return_desc(err6, sizeof(err6), ard)) ||
+        (0x44 != ard[9]) || (0x55 != ard[11]) || (0x2 != ard[13])) {
+        fprintf(outfp, "  err6: bad ATA registers\n");
+        ++bad;
+    }
+    if (sg_get_sense_ata_return_desc(err8, sizeof(err8), ard)) {
+        fprintf(outfp, "  err8: vendor specific yielded ATA registers\n");
+        ++bad;
+    }
+    fprintf(outfp, "%s\n\n", bad ? "FAILED" : "passed");
+
     if (verbose > 1) {
         fprintf(outfp, "\n\nTry different output string sizes with "
                "sg_get_sense_str(err2):\n");
@@ -200,5 +325,5 @@ main(int argc, char * argv[])
                 prev_len = strlen(b);
         }
     }
-    return 0;
+    return bad ? 1 : 0;
 }
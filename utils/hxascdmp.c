@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2004-2019 Douglas Gilbert.
+ * Copyright (c) 2004-2023 Douglas Gilbert.
  * All rights reserved.
  * Use of this source code is governed by a BSD-style
  * license that can be found in the BSD_LICENSE file.
@@ -24,12 +24,14 @@
 
 static int bytes_per_line = DEF_BYTES_PER_LINE;
 
-static const char * version_str = "1.11 20190527";
+static const char * version_str = "1.12 20231030";
 
 #define CHARS_PER_HEX_BYTE 3
 #define BINARY_START_COL 6
 #define MAX_LINE_LENGTH 257
 
+static const char hex_lc[] = "0123456789abcdef";  /* as "%x" outputs */
+
 
 #ifdef SG_LIB_MINGW
 /* Non Unix OSes distinguish between text and binary files.
@@ -253,7 +255,8 @@ dStrHex(const char* str, int len, long start, int noAddr)
         bpos += (nl && noAddr) ?  0 : CHARS_PER_HEX_BYTE;
         if ((bytes_per_line > 4) && ((j % bytes_per_line) == midline_space))
             bpos++;
-        sprintf(&buff[bpos], "%.2x", (int)(unsigned char)c);
+        buff[bpos] = hex_lc[c >> 4];
+        buff[bpos + 1] = hex_lc[c & 0xf];
         buff[bpos + 2] = ' ';
         if ((c < ' ') || (c >= 0x7f))
             c='.';
@@ -308,7 +311,8 @@ dStrHexOnly(const char* str, int len, long start, int noAddr)
         bpos += (nl && noAddr) ? 0 : CHARS_PER_HEX_BYTE;
         if ((bytes_per_line > 4) && ((j % bytes_per_line) == midline_space))
             bpos++;
-        sprintf(&buff[bpos], "%.2x", (int)(unsigned char)c);
+        buff[bpos] = hex_lc[c >> 4];
+        buff[bpos + 1] = hex_lc[c & 0xf];
         buff[bpos + 2] = ' ';
     }
     if (bpos > bpstart)